@@ -17,6 +17,10 @@ SEXP call_DLL(SEXP y, SEXP dY, SEXP time, SEXP func, SEXP initfunc, SEXP parms,
   C_res_func_type *res;
 
   int nprot = 0;
+  deSolve_context solver_ctx, *ctx = &solver_ctx;
+
+  init_context(ctx);
+  enter_context(ctx);
 
   ny   = LENGTH(y);
   type = INTEGER(Type)[0];
@@ -29,13 +33,13 @@ SEXP call_DLL(SEXP y, SEXP dY, SEXP time, SEXP func, SEXP initfunc, SEXP parms,
   }
 
 /* initialise output, parameters, forcings ... */
-  initOutR(isDll,  &nout, &ntot, ny, nOut, Rpar, Ipar);
+  initOutR(ctx, isDll,  &nout, &ntot, ny, nOut, Rpar, Ipar);
 
   //initParms(initfunc, parms);
   if (initfunc != NA_STRING) {
     if (inherits(initfunc, "NativeSymbol")) {
       init_func_type *initializer;
-      PROTECT(de_gparms = parms); nprot++;
+      PROTECT(ctx->de_gparms = parms); nprot++;
       initializer = (init_func_type *) R_ExternalPtrAddrFn_(initfunc);
       initializer(Initdeparms);
     }
@@ -43,7 +47,7 @@ SEXP call_DLL(SEXP y, SEXP dY, SEXP time, SEXP func, SEXP initfunc, SEXP parms,
   // end inline initParms
 
 
-  isForcing = initForcings(flist);
+  isForcing = initForcings(ctx, flist);
 
   PROTECT(yout = allocVector(REALSXP,ntot)); nprot++;
 
@@ -55,12 +59,12 @@ SEXP call_DLL(SEXP y, SEXP dY, SEXP time, SEXP func, SEXP initfunc, SEXP parms,
   dy   = (double *) R_alloc(ny, sizeof(double));
     for (j = 0; j < ny; j++) dy[j] = REAL(dY)[j];
 
-  if(isForcing == 1)  updatedeforc(&tin);
+  if(isForcing == 1)  updatedeforc(ctx, &tin);
 
   if (type == 1)   {
     derivs = (C_deriv_func_type *) R_ExternalPtrAddrFn_(func);
 
-    derivs (&ny, &tin, ytmp, dy, out, ipar) ;
+    derivs (&ny, &tin, ytmp, dy, ctx->out, ctx->ipar) ;
     for (j = 0; j < ny; j++)  REAL(yout)[j] = dy[j];
 
   } else {
@@ -69,7 +73,7 @@ SEXP call_DLL(SEXP y, SEXP dY, SEXP time, SEXP func, SEXP initfunc, SEXP parms,
     delta = (double *) R_alloc(ny, sizeof(double));
     for (j = 0; j < ny; j++) delta[j] = 0.;
 
-    res    (&tin, ytmp, dy, &cj, delta, &ires, out, ipar) ;
+    res    (&tin, ytmp, dy, &cj, delta, &ires, ctx->out, ctx->ipar) ;
     for (j = 0; j < ny; j++)  REAL(yout)[j] = delta[j];
 
   }
@@ -77,9 +81,10 @@ SEXP call_DLL(SEXP y, SEXP dY, SEXP time, SEXP func, SEXP initfunc, SEXP parms,
   if (nout > 0)   {
 
 	   for (j = 0; j < nout; j++)
-	       REAL(yout)[j + ny] = out[j];
+	       REAL(yout)[j + ny] = ctx->out[j];
   }
 
+  leave_context(ctx);
   UNPROTECT(nprot);
   return(yout);
 }
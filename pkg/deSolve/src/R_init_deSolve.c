@@ -22,7 +22,7 @@
 */
 
 /* .C calls */
-extern void unlock_solver(void);
+extern void unlock_solver(int *);
 
 /* Examples (manually added) */
 extern void initccl4(void (* odeparms)(int *, double *));
@@ -46,22 +46,27 @@ extern void aquaphyforc (int *neq, double *t, double *y, double *ydot, double *o
 /* .Call calls */
 extern SEXP call_daspk(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 extern SEXP call_DLL(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP call_ensemble(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 extern SEXP call_euler(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 extern SEXP call_iteration(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
-extern SEXP call_lsoda(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP call_jacgroups(SEXP, SEXP);
+extern SEXP call_lsoda(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 extern SEXP call_radau(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 extern SEXP call_rk4(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
-extern SEXP call_rkAuto(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
-extern SEXP call_rkFixed(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
-extern SEXP call_rkImplicit(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP call_rkAuto(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP call_rkFixed(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP call_rkImplicit(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP call_rkRosenbrock(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP call_sparsity(SEXP, SEXP);
 extern SEXP call_zvode(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 extern SEXP getLagDeriv(SEXP, SEXP);
 extern SEXP getLagValue(SEXP, SEXP);
 extern SEXP getTimestep(void);
+extern SEXP solver_level(void);
 
 
 static const R_CMethodDef CEntries[] = {
-    {"unlock_solver", (DL_FUNC) &unlock_solver, 0},
+    {"unlock_solver", (DL_FUNC) &unlock_solver, 1},
     {"initccl4",     (DL_FUNC) &initccl4,    1},
     {"initparms",    (DL_FUNC) &initparms,   1},
     {"initforcs",    (DL_FUNC) &initforcs,   1},
@@ -81,18 +86,23 @@ static const R_CMethodDef CEntries[] = {
 static const R_CallMethodDef CallEntries[] = {
     {"call_daspk",      (DL_FUNC) &call_daspk,      28},
     {"call_DLL",        (DL_FUNC) &call_DLL,        11},
+    {"call_ensemble",   (DL_FUNC) &call_ensemble,   22},
     {"call_euler",      (DL_FUNC) &call_euler,      11},
     {"call_iteration",  (DL_FUNC) &call_iteration,  12},
-    {"call_lsoda",      (DL_FUNC) &call_lsoda,      28},
+    {"call_jacgroups",  (DL_FUNC) &call_jacgroups,   2},
+    {"call_lsoda",      (DL_FUNC) &call_lsoda,      29},
     {"call_radau",      (DL_FUNC) &call_radau,      26},
     {"call_rk4",        (DL_FUNC) &call_rk4,        11},
-    {"call_rkAuto",     (DL_FUNC) &call_rkAuto,     21},
-    {"call_rkFixed",    (DL_FUNC) &call_rkFixed,    17},
-    {"call_rkImplicit", (DL_FUNC) &call_rkImplicit, 17},
+    {"call_rkAuto",     (DL_FUNC) &call_rkAuto,     28},
+    {"call_rkFixed",    (DL_FUNC) &call_rkFixed,    19},
+    {"call_rkImplicit", (DL_FUNC) &call_rkImplicit, 22},
+    {"call_rkRosenbrock", (DL_FUNC) &call_rkRosenbrock, 24},
+    {"call_sparsity",   (DL_FUNC) &call_sparsity,    2},
     {"call_zvode",      (DL_FUNC) &call_zvode,      21},
     {"getLagDeriv",     (DL_FUNC) &getLagDeriv,      2},
     {"getLagValue",     (DL_FUNC) &getLagValue,      2},
     {"getTimestep",     (DL_FUNC) &getTimestep,      0},
+    {"solver_level",    (DL_FUNC) &solver_level,     0},
     {NULL, NULL, 0}
 };
 
@@ -105,8 +115,6 @@ void lagvalue(double T, int* nr, int N, double* ytau);
 
 void lagderiv(double T, int* nr, int N, double* ytau);
 
-double glob_timesteps[] = {0, 0};
-
 /* Initialization ---------------------------------------------------------- */
 void R_init_deSolve(DllInfo *dll) {
 
@@ -127,7 +135,4 @@ void R_init_deSolve(DllInfo *dll) {
   RREGDEF(get_deSolve_gparms);
   RREGDEF(lagvalue);
   RREGDEF(lagderiv);
-
-  /* initialize global variables */
-  timesteps = glob_timesteps;
 }
@@ -21,13 +21,15 @@
    karline: version 1.7: added time lags -> delay differential equations
      improving names
    karline: version 2.0: func in compiled code (was only res)
-
-   to do: implement psolfunc
+   Krylov method: psolfunc and jacres in R or compiled code, or the
+     built-in preconditioners of precond.c
   +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
-/* globals for when mass matrix is used with func in a DLL with mass matrix   */
-int isMass;
-double * mass, *dytmp;
+/* data for when mass matrix is used with func in a DLL, in ctx->solver     */
+typedef struct daspk_data {
+  int isMass;
+  double * mass, *dytmp;
+} daspk_data;
 
 
 /* define data types for function pointers */
@@ -41,7 +43,7 @@ typedef void C_daejac_func_type(double *, double *, double *, double *, double *
 typedef void C_psol_func_type(int *, double *, double *, double *, double *,
                               double *, double *, double *, double *, int*, double *,
                               double *, int*, double *, int*);
-typedef void C_kryljac_func_type(double *, int *, int *, double *, double *,
+typedef void C_kryljac_func_type(C_res_func_type *, int *, int *, double *, double *,
                                  double *, double *, double *,
                                  double *, double *, double *, double *, int*, int*, double *, int*);
 
@@ -70,15 +72,17 @@ void F77_NAME(ddaspk)(void (*)(double *, double *, double *, double*,
 static void DLL_res_ode (double *t, double *y, double *yprime, double *cj,
                          double *delta, int *ires, double *yout, int *iout)
 {
+  deSolve_context *ctx = desolve_ctx;
+  daspk_data *dae = (daspk_data *) ctx->solver;
   int i;
-  DLL_deriv_func (&n_eq, t, y, delta, yout, iout);
+  ctx->DLL_deriv_func (&ctx->n_eq, t, y, delta, yout, iout);
 
-  if (isMass) {
-    matvecmult(n_eq, n_eq, mass, yprime, dytmp);
-    for ( i = 0; i < n_eq; i++)
-      delta[i] = dytmp[i] - delta[i];
+  if (dae->isMass) {
+    matvecmult(ctx->n_eq, ctx->n_eq, dae->mass, yprime, dae->dytmp);
+    for ( i = 0; i < ctx->n_eq; i++)
+      delta[i] = dae->dytmp[i] - delta[i];
   } else {
-    for ( i = 0; i < n_eq; i++)
+    for ( i = 0; i < ctx->n_eq; i++)
       delta[i] = yprime[i] - delta[i];
   }
 }
@@ -87,25 +91,66 @@ static void DLL_res_ode (double *t, double *y, double *yprime, double *cj,
 static void DLL_forc_dae (double *t, double *y, double *yprime, double *cj,
                           double *delta, int *ires, double *yout, int *iout)
 {
-  updatedeforc(t);
-  DLL_res_func(t, y, yprime, cj, delta, ires, yout, iout);
+  deSolve_context *ctx = desolve_ctx;
+  updatedeforc(ctx, t);
+  ctx->DLL_res_func(t, y, yprime, cj, delta, ires, yout, iout);
 }
 
 /* func is in a DLL, with forcing function                                   */
 static void DLL_forc_dae2 (double *t, double *y, double *yprime, double *cj,
                            double *delta, int *ires, double *yout, int *iout)
 {
-  updatedeforc(t);
+  deSolve_context *ctx = desolve_ctx;
+  updatedeforc(ctx, t);
   DLL_res_ode(t, y, yprime, cj, delta, ires, yout, iout);
 }
 
 
-/* not yet implemented                                                       */
+/* Krylov method: the call of R function psolfunc; its last argument holds
+   the result of the last call of jacres (the preconditioner), or NULL     */
+static SEXP psol_call (deSolve_context *ctx)
+{
+  return ctx_lang(ctx, CALL_PSOL, ctx->R_psol_func, "dddds", 2, ctx->n_eq,
+                  ctx->n_eq, ctx->n_eq, R_NilValue);
+}
+
+/* interface between FORTRAN call to psol and R function                    */
 static void C_psol_func (int *neq, double *t, double *y, double *yprime,
                          double *savr, double *wk, double *cj, double* wght,
                          double *wp, int *iwp, double *b, double *eplin,
                          int *ierr, double *RPAR, int *IPAR)
 {
+  deSolve_context *ctx = desolve_ctx;
+  int i;
+  SEXP R_fcall, ans, Rin, Y, YPRIME, B;
+
+  R_fcall = psol_call(ctx);
+  Rin = call_arg(R_fcall, 1);
+  REAL(Rin)[0] = *t;
+  REAL(Rin)[1] = *cj;
+  Y = call_arg(R_fcall, 2);
+  YPRIME = call_arg(R_fcall, 3);
+  B = call_arg(R_fcall, 4);
+  for (i = 0; i < ctx->n_eq; i++)
+  {
+    REAL(Y)[i] = y[i];
+    REAL(YPRIME)[i] = yprime[i];
+    REAL(B)[i] = b[i];
+  }
+  PROTECT(ans = ctx_eval(ctx, R_fcall, ctx->R_envir));
+  for (i = 0; i < ctx->n_eq; i++)  b[i] = REAL(ans)[i];
+  *ierr = 0;
+
+  UNPROTECT(1);
+}
+
+/* Krylov method without preconditioner: P = identity                      */
+static void C_psol_none (int *neq, double *t, double *y, double *yprime,
+                         double *savr, double *wk, double *cj, double* wght,
+                         double *wp, int *iwp, double *b, double *eplin,
+                         int *ierr, double *RPAR, int *IPAR)
+{
+  *ierr = 0;
 }
 
 /* interface between FORTRAN function calls and R functions                 */
@@ -113,21 +158,25 @@ static void C_psol_func (int *neq, double *t, double *y, double *yprime,
 static void C_res_func (double *t, double *y, double *yprime, double *cj,
                         double *delta, int *ires, double *yout, int *iout)
 {
+  deSolve_context *ctx = desolve_ctx;
   int i;
-  SEXP R_fcall, Time, ans;
-
-  for (i = 0; i < n_eq; i++)
+  SEXP R_fcall, ans, Y, YPRIME;
+
+  R_fcall = ctx_lang(ctx, CALL_DERIV, ctx->R_res_func, "ddd", 1, ctx->n_eq,
+                     ctx->n_eq);
+  REAL(call_arg(R_fcall, 1))[0] = *t;
+  Y = call_arg(R_fcall, 2);
+  YPRIME = call_arg(R_fcall, 3);
+  for (i = 0; i < ctx->n_eq; i++)
   {
     REAL(Y)[i] = y[i];
     REAL (YPRIME)[i] = yprime[i];
   }
-  PROTECT(Time = ScalarReal(*t));
-  PROTECT(R_fcall = lang4(R_res_func,Time, Y, YPRIME));
-  PROTECT(ans = eval(R_fcall, R_envir));
+  PROTECT(ans = ctx_eval(ctx, R_fcall, ctx->R_envir));
 
-  for (i = 0; i < n_eq; i++)  	delta[i] = REAL(ans)[i];
+  for (i = 0; i < ctx->n_eq; i++)  	delta[i] = REAL(ans)[i];
 
-  UNPROTECT(3);
+  UNPROTECT(1);
 }
 
 /* deriv output function  */
@@ -135,22 +184,26 @@ static void C_res_func (double *t, double *y, double *yprime, double *cj,
 static void C_out (int *nout, double *t, double *y,
                    double *yprime, double *yout)
 {
+  deSolve_context *ctx = desolve_ctx;
   int i;
-  SEXP R_fcall, Time, ans;
-
-  for (i = 0; i < n_eq; i++)
+  SEXP R_fcall, ans, Y, YPRIME;
+
+  R_fcall = ctx_lang(ctx, CALL_DERIV, ctx->R_res_func, "ddd", 1, ctx->n_eq,
+                     ctx->n_eq);
+  REAL(call_arg(R_fcall, 1))[0] = *t;
+  Y = call_arg(R_fcall, 2);
+  YPRIME = call_arg(R_fcall, 3);
+  for (i = 0; i < ctx->n_eq; i++)
   {
     REAL(Y)[i] = y[i];
     REAL (YPRIME)[i] = yprime[i];
   }
 
-  PROTECT(Time = ScalarReal(*t));
-  PROTECT(R_fcall = lang4(R_res_func,Time, Y, YPRIME));
-  PROTECT(ans = eval(R_fcall, R_envir));
+  PROTECT(ans = ctx_eval(ctx, R_fcall, ctx->R_envir));
 
-  for (i = 0; i < *nout; i++) yout[i] = REAL(ans)[i + n_eq];
+  for (i = 0; i < *nout; i++) yout[i] = REAL(ans)[i + ctx->n_eq];
 
-  UNPROTECT(3);
+  UNPROTECT(1);
 }
 
 /* interface between FORTRAN call to jacobian and R function */
@@ -158,22 +211,62 @@ static void C_out (int *nout, double *t, double *y,
 static void C_daejac_func (double *t, double *y, double *yprime,
                            double *pd,  double *cj, double *RPAR, int *IPAR)
 {
+  deSolve_context *ctx = desolve_ctx;
+  int i;
+  SEXP R_fcall, ans, Rin, Y, YPRIME;
+
+  R_fcall = ctx_lang(ctx, CALL_JAC, ctx->R_daejac_func, "ddd", 2, ctx->n_eq,
+                     ctx->n_eq);
+  Rin = call_arg(R_fcall, 1);
+  REAL(Rin)[0] = *t;
+  REAL(Rin)[1] = *cj;
+
+  Y = call_arg(R_fcall, 2);
+  YPRIME = call_arg(R_fcall, 3);
+  for (i = 0; i < ctx->n_eq; i++)
+  {
+    REAL(Y)[i] = y[i];
+    REAL (YPRIME)[i] = yprime[i];
+  }
+  PROTECT(ans = ctx_eval(ctx, R_fcall, ctx->R_envir));
+  for (i = 0; i < ctx->n_eq * ctx->nrowpd; i++)  pd[i] = REAL(ans)[i];
+
+  UNPROTECT(1);
+}
+
+/* Krylov method: R function jacres prepares the preconditioner; the result
+   is passed to psolfunc                                                    */
+
+static void C_kryljac_func (C_res_func_type *res, int *ires, int *neq,
+                            double *t, double *y, double *yprime, double *rewt,
+                            double *savr, double *wk, double *h, double *cj,
+                            double *wp, int *iwp, int *ier, double *RPAR,
+                            int *IPAR)
+{
+  deSolve_context *ctx = desolve_ctx;
   int i;
-  SEXP R_fcall, ans;
+  SEXP R_fcall, ans, Rin, Y, YPRIME;
 
+  R_fcall = ctx_lang(ctx, CALL_JAC, ctx->R_daejac_func, "ddd", 2, ctx->n_eq,
+                     ctx->n_eq);
+  Rin = call_arg(R_fcall, 1);
   REAL(Rin)[0] = *t;
   REAL(Rin)[1] = *cj;
 
-  for (i = 0; i < n_eq; i++)
+  Y = call_arg(R_fcall, 2);
+  YPRIME = call_arg(R_fcall, 3);
+  for (i = 0; i < ctx->n_eq; i++)
   {
     REAL(Y)[i] = y[i];
     REAL (YPRIME)[i] = yprime[i];
   }
-  PROTECT(R_fcall = lang4(R_daejac_func, Rin, Y, YPRIME));
-  PROTECT(ans = eval(R_fcall, R_envir));
-  for (i = 0; i < n_eq * nrowpd; i++)  pd[i] = REAL(ans)[i];
+  PROTECT(ans = ctx_eval(ctx, R_fcall, ctx->R_envir));
+  /* argument 5 of the psolfunc call; kept (protected) by the call object */
+  for (i = 0, R_fcall = psol_call(ctx); i < 5; i++) R_fcall = CDR(R_fcall);
+  SETCAR(R_fcall, ans);
+  *ier = 0;
 
-  UNPROTECT(2);
+  UNPROTECT(1);
 }
 
 
@@ -196,6 +289,8 @@ SEXP call_daspk(SEXP y, SEXP yprime, SEXP times, SEXP resfunc, SEXP parms,
   int    *Info,  ninfo, idid, mflag, ires = 0;
   int    *iwork, it, ntot= 0, nout, funtype;
   double *rwork;
+  deSolve_context solver_ctx, *ctx = &solver_ctx;
+  daspk_data dae_data, *dae = &dae_data;
 
 
   /* pointers to functions passed to FORTRAN */
@@ -208,18 +303,23 @@ SEXP call_daspk(SEXP y, SEXP yprime, SEXP times, SEXP resfunc, SEXP parms,
   /******                         STATEMENTS                               ******/
   /******************************************************************************/
 
-  lock_solver(); /* prevent nested call of solvers that have global variables */
+  init_context(ctx);
+  dae->isMass = 0;
+  dae->mass = NULL;
+  dae->dytmp = NULL;
+  ctx->solver = dae;
+  enter_context(ctx);  /* nested calls of solvers are possible */
 
   /*                      #### initialisation ####                              */
 
   int nprot = 0;
   ny   = LENGTH(y);
-  n_eq = ny;                          /* n_eq is a global variable */
+  ctx->n_eq = ny;
   nt = LENGTH(times);
   mflag = INTEGER(verbose)[0];
 
   ninfo=LENGTH(info);
-  nrowpd = INTEGER(nRowpd)[0];
+  ctx->nrowpd = INTEGER(nRowpd)[0];
   maxit = INTEGER(maxIt)[0];
 
   /* function is a dll ?*/
@@ -229,18 +329,18 @@ SEXP call_daspk(SEXP y, SEXP yprime, SEXP times, SEXP resfunc, SEXP parms,
     isDll = 0;
   }
 
-  initOutC(isDll, &nout, &ntot, n_eq, nOut, Rpar, Ipar);
+  initOutC(ctx, isDll, &nout, &ntot, ctx->n_eq, nOut, Rpar, Ipar);
 
   /* copies of all variables that will be changed in the FORTRAN subroutine */
   Info  = (int *) R_alloc(ninfo,sizeof(int));
   for (j = 0; j < ninfo; j++) Info[j] = INTEGER(info)[j];
   if (mflag == 1) Info[17] = 1;
 
-  xytmp = (double *) R_alloc(n_eq, sizeof(double));
-  for (j = 0; j < n_eq; j++) xytmp[j] = REAL(y)[j];
+  xytmp = (double *) R_alloc(ctx->n_eq, sizeof(double));
+  for (j = 0; j < ctx->n_eq; j++) xytmp[j] = REAL(y)[j];
 
-  xdytmp = (double *) R_alloc(n_eq, sizeof(double));
-  for (j = 0; j < n_eq; j++) xdytmp[j] = REAL(yprime)[j];
+  xdytmp = (double *) R_alloc(ctx->n_eq, sizeof(double));
+  for (j = 0; j < ctx->n_eq; j++) xdytmp[j] = REAL(yprime)[j];
 
   latol = LENGTH(atol);
   Atol  = (double *) R_alloc((int) latol, sizeof(double));
@@ -259,74 +359,85 @@ SEXP call_daspk(SEXP y, SEXP yprime, SEXP times, SEXP resfunc, SEXP parms,
   for (j = 0; j < lrw; j++) rwork[j] = REAL(rWork)[j];
 
   //timesteps = (double *) R_alloc(2, sizeof(double));
-  for (j = 0; j < 2; j++) timesteps[j] = 0.;
+  for (j = 0; j < 2; j++) ctx->timesteps[j] = 0.;
 
   /**************************************************************************/
   /****** Initialization of globals, Parameters and Forcings (DLLs)    ******/
   /**************************************************************************/
   //thpe 2017-07-17: internalize this to make PROTECT/UNPROTECT more transparent
   //initdaeglobals(nt, ntot);
-  PROTECT(Rin  = NEW_NUMERIC(2)); nprot++;
-  PROTECT(Y = allocVector(REALSXP,n_eq));  nprot++;
-  PROTECT(YPRIME = allocVector(REALSXP,n_eq)); nprot++;
-  PROTECT(YOUT = allocMatrix(REALSXP,ntot+1,nt)); nprot++;
+  PROTECT(ctx->Rcalls = allocVector(VECSXP, NRCALLS)); nprot++;
+  PROTECT(ctx->YOUT = allocMatrix(REALSXP,ntot+1,nt)); nprot++;
   // end
 
   //initParms(initfunc, parms);
   if (initfunc != NA_STRING) {
     if (inherits(initfunc, "NativeSymbol")) {
       init_func_type *initializer;
-      PROTECT(de_gparms = parms); nprot++;
+      PROTECT(ctx->de_gparms = parms); nprot++;
       initializer = (init_func_type *) R_ExternalPtrAddrFn_(initfunc);
       initializer(Initdeparms);
     }
   }
   // end inline initParms
 
-  isForcing = initForcings(flist);
-  isEvent = initEvents(elist, eventfunc, 0);  /* zero roots */
-  islag = initLags(elag, 0, 0);
+  isForcing = initForcings(ctx, flist);
+  isEvent = initEvents(ctx, elist, eventfunc, 0);  /* zero roots */
+  islag = initLags(ctx, elag, 0, 0);
 
   /* pointers to functions res_func, psol_func and daejac_func,
    passed to the FORTRAN subroutine */
-  isMass = 0;
   if (isDll == 1)  {       /* DLL address passed to FORTRAN */
   funtype = Info[19];
     if (funtype == 1) {   /* res is in DLL */
   res_func = (C_res_func_type *) R_ExternalPtrAddrFn_(resfunc);
       if(isForcing==1) {
-        DLL_res_func = (C_res_func_type *) R_ExternalPtrAddrFn_(resfunc);
+        ctx->DLL_res_func = (C_res_func_type *) R_ExternalPtrAddrFn_(resfunc);
         res_func = (C_res_func_type *) DLL_forc_dae;
       }
     } else if (funtype <= 3){ /* func is in DLL, +- mass matrix */
   res_func = DLL_res_ode;
-      DLL_deriv_func = (C_deriv_func_type *) R_ExternalPtrAddrFn_(resfunc);
+      ctx->DLL_deriv_func = (C_deriv_func_type *) R_ExternalPtrAddrFn_(resfunc);
       if(isForcing==1) {
         res_func = (C_res_func_type *) DLL_forc_dae2;
       }
       if (funtype == 3) {    /* mass matrix */
-  isMass = 1;
-        mass = (double *)R_alloc(n_eq * n_eq, sizeof(double));
-        for (j = 0; j < n_eq * n_eq; j++) mass[j] = REAL(Mass)[j];
-        dytmp = (double *) R_alloc(n_eq, sizeof(double));
+  dae->isMass = 1;
+        dae->mass = (double *)R_alloc(ctx->n_eq * ctx->n_eq, sizeof(double));
+        for (j = 0; j < ctx->n_eq * ctx->n_eq; j++) dae->mass[j] = REAL(Mass)[j];
+        dae->dytmp = (double *) R_alloc(ctx->n_eq, sizeof(double));
       }
 
     } else
       error("DLL function type not yet implemented");
 
-    delta = (double *) R_alloc(n_eq, sizeof(double));
-    for (j = 0; j < n_eq; j++) delta[j] = 0.;
+    delta = (double *) R_alloc(ctx->n_eq, sizeof(double));
+    for (j = 0; j < ctx->n_eq; j++) delta[j] = 0.;
 
 
   } else {
     /* interface function between FORTRAN and R passed to FORTRAN */
     res_func = (C_res_func_type *) C_res_func;
     /* needed to communicate with R */
-    R_res_func = resfunc;
+    ctx->R_res_func = resfunc;
   }
-  R_envir = rho;           /* karline: this to allow merging compiled and R-code (e.g. events)*/
-
-    if (!isNull(jacfunc))
+  ctx->R_envir = rho;           /* karline: this to allow merging compiled and R-code (e.g. events)*/
+
+    if (inherits(jacfunc, "deSolve.sparsity")) {
+      /* internal Jacobian, grouped columns of a known sparsity pattern */
+      initGroups(ctx, jacfunc, NULL, FALSE);
+      ctx->cpr->res_func = res_func;
+      if (Info[11] == 1 && Info[23] > 0) {
+        /* krylov, block-Jacobi preconditioner estimated with the groups */
+        kryljac_func = (C_kryljac_func_type *) prec_jac;
+        psol_func = (C_psol_func_type *) prec_psol;
+      } else
+        daejac_func = cpr_daejac;
+    } else if (Info[11] == 1 && Info[23] > 0) {
+      /* krylov, built-in preconditioner (banded ILU or block-Jacobi) */
+      kryljac_func = (C_kryljac_func_type *) prec_jac;
+      psol_func = (C_psol_func_type *) prec_psol;
+    } else if (!isNull(jacfunc))
     {
       if (inherits(jacfunc,"NativeSymbol"))
       {
@@ -337,38 +448,44 @@ SEXP call_daspk(SEXP y, SEXP yprime, SEXP times, SEXP resfunc, SEXP parms,
         }
       }
       else  {
-        R_daejac_func = jacfunc;
-        daejac_func = C_daejac_func;
+        ctx->R_daejac_func = jacfunc;
+        if (Info[11] ==0)
+          daejac_func = C_daejac_func;
+        else
+          kryljac_func = C_kryljac_func;
       }
     }
-    if (!isNull(psolfunc))
+    if (Info[11] == 1 && Info[23] > 0)
+      ;                            /* psol_func set above */
+    else if (!isNull(psolfunc))
     {
       if (inherits(psolfunc,"NativeSymbol"))
       {
         psol_func = (C_psol_func_type *) R_ExternalPtrAddrFn_(psolfunc);
       }
       else  {
-        R_psol_func = psolfunc;
+        ctx->R_psol_func = psolfunc;
         psol_func = C_psol_func;
       }
-    }
+    } else if (Info[11] == 1)
+      psol_func = C_psol_none;
 
     /*                      #### initial time step ####                           */
     idid = 1;
-    REAL(YOUT)[0] = REAL(times)[0];
-    for (j = 0; j < n_eq; j++)
-      REAL(YOUT)[j+1] = REAL(y)[j];
+    REAL(ctx->YOUT)[0] = REAL(times)[0];
+    for (j = 0; j < ctx->n_eq; j++)
+      REAL(ctx->YOUT)[j+1] = REAL(y)[j];
 
-    if (islag == 1) updatehistini(REAL(times)[0], xytmp, xdytmp, rwork, iwork);
+    if (islag == 1) updatehistini(ctx, REAL(times)[0], xytmp, xdytmp, rwork, iwork);
 
     if (nout>0)
     {
       tin = REAL(times)[0];
 
-      if (isDll == 1) res_func (&tin, xytmp, xdytmp, &cj, delta, &ires, out, ipar) ;
-      else C_out(&nout,&tin,xytmp,xdytmp,out);
+      if (isDll == 1) res_func (&tin, xytmp, xdytmp, &cj, delta, &ires, ctx->out, ctx->ipar) ;
+      else C_out(&nout,&tin,xytmp,xdytmp,ctx->out);
       for (j = 0; j < nout; j++)
-        REAL(YOUT)[j + n_eq + 1] = out[j];
+        REAL(ctx->YOUT)[j + ctx->n_eq + 1] = ctx->out[j];
     }
 
     /*                     ####   main time loop   ####                           */
@@ -379,7 +496,7 @@ SEXP call_daspk(SEXP y, SEXP yprime, SEXP times, SEXP resfunc, SEXP parms,
       tout = REAL(times)[it+1];
       if (isEvent) {
         istate =  2;
-        updateevent(&tin, xytmp, &istate);
+        updateevent(ctx, &tin, xytmp, &istate);
         if (istate  == 1) Info[0] = 0;
         Info[3] = 1;
         rwork[0] = tout;
@@ -391,18 +508,18 @@ SEXP call_daspk(SEXP y, SEXP yprime, SEXP times, SEXP resfunc, SEXP parms,
         if (Info[11] == 0) {        /* ordinary jac */
           F77_CALL(ddaspk) (res_func, &ny, &tin, xytmp, xdytmp, &tout,
              Info, Rtol, Atol, &idid,
-             rwork, &lrw, iwork, &liw, out, ipar, (funcptr)daejac_func, psol_func);
+             rwork, &lrw, iwork, &liw, ctx->out, ctx->ipar, (funcptr)daejac_func, psol_func);
 
-        } else {                   /* krylov - not yet used */
+        } else {                   /* krylov */
           F77_CALL(ddaspk) (res_func, &ny, &tin, xytmp, xdytmp, &tout,
              Info, Rtol, Atol, &idid,
-             rwork, &lrw, iwork, &liw, out, ipar, (funcptr)kryljac_func, psol_func);
+             rwork, &lrw, iwork, &liw, ctx->out, ctx->ipar, (funcptr)kryljac_func, psol_func);
         }
         /* in case timestep is asked for... */
-        timesteps [0] = rwork[10];
-        timesteps [1] = rwork[11];
+        ctx->timesteps [0] = rwork[10];
+        ctx->timesteps [1] = rwork[11];
 
-        if (islag == 1) updatehist(tin, xytmp, xdytmp, rwork, iwork);
+        if (islag == 1) updatehist(ctx, tin, xytmp, xdytmp, rwork, iwork);
 
         repcount ++;
         if (idid == -1)  {
@@ -452,38 +569,38 @@ SEXP call_daspk(SEXP y, SEXP yprime, SEXP times, SEXP resfunc, SEXP parms,
 
       while (tin < tout && repcount < maxit);
 
-      REAL(YOUT)[(it+1)*(ntot+1)] = tin;
-      for (j = 0; j < n_eq; j++)
-        REAL(YOUT)[(it+1)*(ntot + 1) + j + 1] = xytmp[j];
+      REAL(ctx->YOUT)[(it+1)*(ntot+1)] = tin;
+      for (j = 0; j < ctx->n_eq; j++)
+        REAL(ctx->YOUT)[(it+1)*(ntot + 1) + j + 1] = xytmp[j];
 
       if (nout>0) {
-        if (isDll == 1) res_func (&tin, xytmp, xdytmp, &cj, delta, &ires, out, ipar) ;
-        else C_out(&nout,&tin,xytmp,xdytmp,out);
+        if (isDll == 1) res_func (&tin, xytmp, xdytmp, &cj, delta, &ires, ctx->out, ctx->ipar) ;
+        else C_out(&nout,&tin,xytmp,xdytmp,ctx->out);
         for (j = 0; j < nout; j++)
-          REAL(YOUT)[(it+1)*(ntot + 1) + j + n_eq + 1] = out[j];
+          REAL(ctx->YOUT)[(it+1)*(ntot + 1) + j + ctx->n_eq + 1] = ctx->out[j];
       }
 
       /*                    ####  an error occurred   ####                          */
       if (repcount > maxit || tin < tout || idid <= 0) {
         idid = 0;
-        PROTECT(YOUT2 = allocMatrix(REALSXP,ntot+1,(it+2))); nprot++;
-        returnearly(1, it, ntot);
+        PROTECT(ctx->YOUT2 = allocMatrix(REALSXP,ntot+1,(it+2))); nprot++;
+        returnearly(ctx, 1, it, ntot);
         break;
       }
     }    /* end main time loop */
 
     /*                   ####   returning output   ####                           */
-    PROTECT(ISTATE = allocVector(INTSXP, 23)); nprot++;
-    PROTECT(RWORK = allocVector(REALSXP, 3)); nprot++;
-    terminate(idid, iwork, 23, 0, rwork, 3, 1);
-    REAL(RWORK)[0] = rwork[6];
+    PROTECT(ctx->ISTATE = allocVector(INTSXP, 23)); nprot++;
+    PROTECT(ctx->RWORK = allocVector(REALSXP, 3)); nprot++;
+    terminate(ctx, idid, iwork, 23, 0, rwork, 3, 1);
+    REAL(ctx->RWORK)[0] = rwork[6];
 
-    unlock_solver();
+    leave_context(ctx);
     UNPROTECT(nprot);
 
     if (idid > 0)
-      return(YOUT);
+      return(ctx->YOUT);
     else
-      return(YOUT2);
+      return(ctx->YOUT2);
 }
 
@@ -0,0 +1,560 @@
+#include <string.h>
+#include "rk_util.h"
+#include "externalptr.h"
+
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+   Ensembles of compiled models: one model (func in a DLL) is integrated for
+   many initial states and parameter sets within one call from R.
+
+   The symbols of the DLL are resolved once (R-function checkDLL), the work
+   arrays are allocated once and then reused by all members of the ensemble,
+   so there is no communication with R between the members.
+
+   Available solvers: lsoda (1), lsode (2), vode (5), and the explicit
+   Runge-Kutta methods with variable time step (0, via rk_auto).
+
+   The results are returned as 3-D array with dimensions
+   (time, 1 + states + outputs, member), i.e. the usual output matrix
+   of deSolve for each member of the ensemble.
+
+   Parameters are passed either via initfunc (once per member), or, if the
+   model has no initfunc, in front of rpar: rpar = c(parms[i, ], rpar).
+
+   Parallel ensembles (nthreads > 1, OpenMP) are restricted to the
+   Runge-Kutta solvers and to thread-safe models: no initfunc, no forcings,
+   and no static variables in the compiled model. Each thread has its own
+   context and work arrays (allocated before the parallel region), the
+   threads do not call the R API. The FORTRAN solvers keep their state in
+   COMMON blocks and run always serially.
+
+   thpe, ks: version 1.41
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* the FORTRAN solvers, see call_lsoda.c */
+
+void F77_NAME(dlsoda)(void (*)(int *, double *, double *, double *, double *, int *),
+              int *, double *, double *, double *,
+              int *, double *, double *, int *, int *,
+              int *, double *,int *,int *, int *,
+              void (*)(int *, double *, double *, int *,
+                    int *, double *, int *, double *, int *),
+                    int *, double *, int *);
+
+void F77_NAME(dlsode)(void (*)(int *, double *, double *, double *, double *, int *),
+              int *, double *, double *, double *,
+              int *, double *, double *, int *, int *,
+              int *, double *,int *,int *, int *,
+              void (*)(int *, double *, double *, int *,
+                    int *, double *, int *, double *, int *),
+                    int *, double *, int *);
+
+void F77_NAME(dvode)(void (*)(int *, double *, double *, double *,
+                     double *, int *),
+                     int *, double *, double *, double *,
+                     int *, double *, double *, int *, int *,
+                     int *, double *,int *,int *, int *,
+                     void (*)(int *, double *, double *, int *,
+                           int *, double *, int *, double*, int*),
+                           int *, double *, int *);
+
+typedef void C_jac_func_type  (int *, double *, double *, int *,
+                               int *, double *, int *, double *, int *);
+
+/* Butcher table and settings of the Runge-Kutta method */
+typedef struct {
+  int     fsal, stage, densetype, qerr, nknots, ldknots, interpolate, maxsteps;
+  double  alpha, beta, tcrit, hini, hmax, hmin;
+  double *A, *bb1, *bb2, *cc, *dd;
+} ens_method;
+
+/* workspace of one thread */
+typedef struct {
+  deSolve_context ctx;
+  double *y0, *y1, *y2, *dy1, *dy2, *f, *y, *Fj, *tmp, *FF, *rr, *yknots;
+  double *out;
+  int    *ipar;
+} ens_work;
+
+/* wrapper above the derivative function that first estimates the
+   values of the forcing functions */
+
+static void C_deriv_func_forc (int *neq, double *t, double *y,
+                               double *ydot, double *yout, int *iout)
+{
+  deSolve_context *ctx = desolve_ctx;
+  updatedeforc(ctx, t);
+  ctx->DLL_deriv_func(neq, t, y, ydot, yout, iout);
+}
+
+/* copy the parameters of one member to the DLL */
+
+static void ensemble_parms(init_func_type *initializer, double *Parms,
+                           double *parms, int npar, int m)
+{
+  int j;
+  if (initializer == NULL) return;
+  for (j = 0; j < npar; j++) parms[j] = Parms[j + npar * m];
+  initializer(Initdeparms);
+}
+
+/* out and ipar of one thread; nrpar parameters per member in front of rpar,
+   see initOutC */
+
+static void ensemble_out(double **out, int **ipar, int nout, int nrpar,
+                         SEXP Rpar, SEXP Ipar)
+{
+  int j, lrpar, lipar;
+
+  lrpar = nout + nrpar + LENGTH(Rpar);
+  lipar = 3 + LENGTH(Ipar);
+  *out  = (double*) R_alloc(lrpar, sizeof(double));
+  *ipar = (int*)    R_alloc(lipar, sizeof(int));
+
+  (*ipar)[0] = nout;
+  (*ipar)[1] = lrpar;
+  (*ipar)[2] = lipar;
+  for (j = 0; j < LENGTH(Ipar); j++) (*ipar)[j+3] = INTEGER(Ipar)[j];
+
+  for (j = 0; j < nout + nrpar; j++) (*out)[j] = 0.;
+  for (j = 0; j < LENGTH(Rpar); j++) (*out)[nout + nrpar + j] = REAL(Rpar)[j];
+}
+
+/* one member, integrated with rk_auto; no calls of the R API in here,
+   so that this can run in a thread of its own */
+
+static void ensemble_rk(ens_method *rk, ens_work *w, SEXP Func, int neq,
+                        int nt, int nout, int isForcing, int verbose,
+                        double *tt, double *xs, double *atol, double *rtol,
+                        double *yout, int *ist)
+{
+  int i, j, iknots = 0, it = 1, it_ext = 0, it_tot = 0, it_rej = 0;
+  int nknots = rk->nknots, stage = rk->stage;
+  double t, dt, tmax, hmax, errold = 0.0;
+  deSolve_context *ctx = &w->ctx;
+
+  for (i = 0; i < 22; i++) ist[i] = 0;
+
+  /* initialization of the integration loop */
+  yout[0]      = tt[0];
+  for (i = 0; i < neq; i++) {
+    w->y0[i] = xs[i];
+    yout[(i + 1) * nt] = xs[i];
+  }
+  putknot(w->yknots, nknots, rk->ldknots, iknots++, tt[0], xs, NULL, neq);
+
+  for (i = 0; i < neq; i++)  {
+    w->y1[i] = 0;
+    w->y2[i] = 0;
+    w->Fj[i] = 0;
+    for (j = 0; j < stage; j++) w->FF[i + j * neq] = 0;
+  }
+
+  t    = tt[0];
+  tmax = fmax(tt[nt - 1], rk->tcrit);
+  dt   = fmin(rk->hmax, rk->hini);
+  hmax = fmin(rk->hmax, tmax - t);
+
+  if (rk->interpolate) {
+    rk_auto(ctx,
+      rk->fsal, neq, stage, TRUE, isForcing, verbose, nknots, rk->interpolate,
+      rk->densetype, rk->maxsteps, nt,
+      &iknots, &it, &it_ext, &it_tot, &it_rej,
+      ist, w->ipar,
+      t, tmax, rk->hmin, hmax, rk->alpha, rk->beta,
+      &dt, &errold,
+      tt, w->y0, w->y1, w->y2, w->dy1, w->dy2, w->f, w->y, w->Fj, w->tmp,
+      w->FF, w->rr, rk->A, w->out, rk->bb1, rk->bb2, rk->cc, rk->dd,
+      atol, rtol, w->yknots, yout,
+      Func, R_NilValue, R_NilValue
+    );
+  } else {
+    for (j = 0; j < nt - 1; j++) {
+      t = tt[j];
+      tmax = fmin(tt[j + 1], rk->tcrit);
+      dt = tmax - t;
+      rk_auto(ctx,
+        rk->fsal, neq, stage, TRUE, isForcing, verbose, nknots, rk->interpolate,
+        rk->densetype, rk->maxsteps, nt,
+        &iknots, &it, &it_ext, &it_tot, &it_rej,
+        ist, w->ipar,
+        t, tmax, rk->hmin, hmax, rk->alpha, rk->beta,
+        &dt, &errold,
+        tt, w->y0, w->y1, w->y2, w->dy1, w->dy2, w->f, w->y, w->Fj, w->tmp,
+        w->FF, w->rr, rk->A, w->out, rk->bb1, rk->bb2, rk->cc, rk->dd,
+        atol, rtol, w->yknots, yout,
+        Func, R_NilValue, R_NilValue
+      );
+      if (ist[0] == -1) break;   /* maxsteps exceeded */
+      yout[j + 1] = tmax;
+      for (i = 0; i < neq; i++) yout[j + 1 + nt * (1 + i)] = w->y2[i];
+    }
+  }
+
+  /* global outputs */
+  if (nout > 0) {
+    for (j = 0; j < nt; j++) {
+      t = yout[j];
+      if (ISNAN(t)) break;
+      for (i = 0; i < neq; i++) w->tmp[i] = yout[j + nt * (1 + i)];
+      derivs(ctx, Func, t, w->tmp, R_NilValue, R_NilValue, w->FF, w->out,
+             -1, neq, w->ipar, TRUE, isForcing);
+      for (i = 0; i < nout; i++) yout[j + nt * (1 + neq + i)] = w->out[i];
+    }
+  }
+
+  /* diagnostics, codes are compatible to lsoda */
+  ist[11] = it_tot;
+  ist[12] = it_tot * (stage - rk->fsal) + 1;
+  if (rk->fsal) ist[12] = ist[12] + it_rej + 1;
+  if (rk->densetype == 2) ist[12] = it_tot * stage + 2;
+  ist[13] = it_rej;
+  ist[14] = rk->qerr;
+}
+
+/* MAIN C-FUNCTION, CALLED FROM R-code
+
+   Y     : matrix of initial states, one column per member
+   Parms : matrix of parameters, one column per member
+   rWork : rwork[0] = tcrit, rwork[4] = hini, rwork[5] = hmax, rwork[6] = hmin
+   iWork : iwork[5] = maxsteps
+   (as in lsoda; the Runge-Kutta solver uses the same positions)
+*/
+
+SEXP call_ensemble(SEXP Y, SEXP times, SEXP derivfunc, SEXP Parms, SEXP rtol,
+                   SEXP atol, SEXP jacfunc, SEXP initfunc, SEXP verbose,
+                   SEXP iTask, SEXP rWork, SEXP iWork, SEXP jT, SEXP nOut,
+                   SEXP lRw, SEXP lIw, SEXP Solver, SEXP Rpar, SEXP Ipar,
+                   SEXP Method, SEXP flist, SEXP nThreads)
+{
+  /******************************************************************************/
+  /******                   DECLARATION SECTION                            ******/
+  /******************************************************************************/
+
+  int  i, j, m, it, nt, neq, nm, npar, nrpar = 0, ncol, latol, lrtol, lrw, liw;
+  int  solver, isForcing, mflag, nout, nfail = 0, nthreads;
+  int  itol, itask, istate, iopt, jt, is;
+  double *xytmp, *dy, tin, tout, *Atol, *Rtol, ss, *tt, *yout, *parms = NULL;
+  double *ys, *ps;
+  int    *iwork, *ist;
+  double *rwork;
+  SEXP   PARMS, ISTATE;
+  deSolve_context solver_ctx, *ctx = &solver_ctx;
+
+  init_func_type    *initializer = NULL;
+  C_deriv_func_type *deriv_func;
+  C_jac_func_type   *jac_func = NULL;
+
+  /******************************************************************************/
+  /******                         STATEMENTS                               ******/
+  /******************************************************************************/
+
+  init_context(ctx);
+  enter_context(ctx);  /* nested calls of solvers are possible */
+
+  /*                      #### initialisation ####                              */
+  int nprot = 0;
+
+  solver   = INTEGER(Solver)[0];  /* 0 = rk, 1 = lsoda, 2 = lsode, 5 = vode */
+  mflag    = INTEGER(verbose)[0];
+  jt       = INTEGER(jT)[0];
+  nout     = INTEGER(nOut)[0];
+  nthreads = INTEGER(nThreads)[0];
+
+  neq = ctx->n_eq = INTEGER(getAttrib(Y, R_DimSymbol))[0];
+  nm   = INTEGER(getAttrib(Y, R_DimSymbol))[1];   /* number of members */
+  npar = INTEGER(getAttrib(Parms, R_DimSymbol))[0];
+  nt   = LENGTH(times);
+  tt   = REAL(times);
+  ys   = REAL(Y);
+  ps   = REAL(Parms);
+  ncol = neq + nout + 1;
+
+  latol = LENGTH(atol);
+  Atol = (double *) R_alloc((int) latol, sizeof(double));
+  for (j = 0; j < latol; j++) Atol[j] = REAL(atol)[j];
+
+  lrtol = LENGTH(rtol);
+  Rtol = (double *) R_alloc((int) lrtol, sizeof(double));
+  for (j = 0; j < lrtol; j++) Rtol[j] = REAL(rtol)[j];
+
+  for (j = 0; j < 2; j++) ctx->timesteps[j] = 0.;
+
+  /* output: all members in one array; istate: one column per member */
+  PROTECT(ctx->YOUT = alloc3DArray(REALSXP, nt, ncol, nm)); nprot++;
+  for (R_xlen_t k = 0; k < XLENGTH(ctx->YOUT); k++) REAL(ctx->YOUT)[k] = NA_REAL;
+  PROTECT(ISTATE = allocMatrix(INTSXP, 22, nm)); nprot++;
+  for (i = 0; i < 22 * nm; i++) INTEGER(ISTATE)[i] = 0;
+
+  /* parameters are passed to the DLL once per member, via Initdeparms,
+     or together with rpar */
+  if (initfunc != NA_STRING && inherits(initfunc, "NativeSymbol")) {
+    PROTECT(PARMS = allocVector(REALSXP, npar)); nprot++;
+    parms = REAL(PARMS);
+    ctx->de_gparms = PARMS;
+    initializer = (init_func_type *) R_ExternalPtrAddrFn_(initfunc);
+  } else
+    nrpar = npar;
+
+  isForcing = initForcings(ctx, flist);
+
+  /* the derivative function, resolved once for all members */
+  deriv_func = (C_deriv_func_type *) R_ExternalPtrAddrFn_(derivfunc);
+  ctx->DLL_deriv_func = deriv_func;
+  if (isForcing)
+    deriv_func = (C_deriv_func_type *) C_deriv_func_forc;
+  if (!isNull(jacfunc))
+    jac_func = (C_jac_func_type *) R_ExternalPtrAddrFn_(jacfunc);
+
+#ifdef _OPENMP
+  if (solver > 0 || nthreads < 1) nthreads = 1;
+  if (nthreads > nm) nthreads = nm;
+#else
+  nthreads = 1;
+#endif
+  if (nthreads > 1 && (initializer != NULL || isForcing))
+    error("parallel ensembles need thread-safe models: no initfunc, no forcings");
+
+  if (solver > 0) {
+    /*==========================================================================*/
+    /*  the FORTRAN solvers lsoda, lsode and vode                               */
+    /*==========================================================================*/
+
+    ensemble_out(&ctx->out, &ctx->ipar, nout, nrpar, Rpar, Ipar);
+
+    liw = INTEGER(lIw)[0];
+    lrw = INTEGER(lRw)[0];
+    iwork = (int *)    R_alloc(liw, sizeof(int));
+    rwork = (double *) R_alloc(lrw, sizeof(double));
+
+    xytmp = (double *) R_alloc(neq, sizeof(double));
+    dy    = (double *) R_alloc(neq, sizeof(double));
+    for (j = 0; j < neq; j++) dy[j] = 0.;
+
+    /* tolerance specifications */
+    if (latol == 1 && lrtol == 1 ) itol = 1;
+    if (latol  > 1 && lrtol == 1 ) itol = 2;
+    if (latol == 1 && lrtol  > 1 ) itol = 3;
+    if (latol  > 1 && lrtol  > 1 ) itol = 4;
+
+    itask = INTEGER(iTask)[0];
+
+    iopt = 0;
+    ss = 0.;
+    is = 0 ;
+    for (i = 5; i < 8 ; i++) ss = ss + REAL(rWork)[i];
+    for (i = 5; i < 10; i++) is = is + INTEGER(iWork)[i];
+    if (ss >0 || is > 0) iopt = 1; /* non-standard input */
+
+    for (m = 0; m < nm; m++) {
+      yout = REAL(ctx->YOUT) + (R_xlen_t) m * nt * ncol;
+      ist  = INTEGER(ISTATE) + 22 * m;
+
+      ensemble_parms(initializer, ps, parms, npar, m);
+      for (j = 0; j < nrpar; j++) ctx->out[nout + j] = ps[j + npar * m];
+
+      /* fresh start of the solver: work arrays as passed from R */
+      for (j = 0; j < liw; j++) iwork[j] = 0;
+      for (j = 0; j < lrw; j++) rwork[j] = 0.;
+      for (j = 0; j < LENGTH(iWork); j++) iwork[j] = INTEGER(iWork)[j];
+      for (j = 0; j < LENGTH(rWork); j++) rwork[j] = REAL(rWork)[j];
+      for (j = 0; j < neq; j++) xytmp[j] = ys[j + neq * m];
+      istate = 1;
+
+      /*                      #### initial time step ####                     */
+      tin = tt[0];
+      yout[0] = tin;
+      for (j = 0; j < neq; j++) yout[(j + 1) * nt] = xytmp[j];
+      if (nout > 0) {
+        deriv_func (&neq, &tin, xytmp, dy, ctx->out, ctx->ipar);
+        for (j = 0; j < nout; j++) yout[(j + neq + 1) * nt] = ctx->out[j];
+      }
+
+      /*                     ####   main time loop   ####                     */
+      for (it = 0; it < nt - 1; it++) {
+        tin  = tt[it];
+        tout = tt[it + 1];
+
+        if (solver == 1) {
+          F77_CALL(dlsoda) (deriv_func, &neq, xytmp, &tin, &tout,
+                   &itol, Rtol, Atol, &itask, &istate, &iopt, rwork,
+                   &lrw, iwork, &liw, jac_func, &jt, ctx->out, ctx->ipar);
+        } else if (solver == 2) {
+          F77_CALL(dlsode) (deriv_func, &neq, xytmp, &tin, &tout,
+                   &itol, Rtol, Atol, &itask, &istate, &iopt, rwork,
+                   &lrw, iwork, &liw, jac_func, &jt, ctx->out, ctx->ipar);
+        } else if (solver == 5) {
+          F77_CALL(dvode) (deriv_func, &neq, xytmp, &tin, &tout,
+                   &itol, Rtol, Atol, &itask, &istate, &iopt, rwork,
+                   &lrw, iwork, &liw, jac_func, &jt, ctx->out, ctx->ipar);
+        }
+        /* in case size of timesteps is called for */
+        ctx->timesteps [0] = rwork[10];
+        ctx->timesteps [1] = rwork[11];
+
+        if (istate == -3)
+          error("illegal input detected before taking any integration steps - see written message");
+        if (istate < 0) break;   /* remaining output of this member is NA */
+
+        yout[it + 1] = tin;
+        for (j = 0; j < neq; j++) yout[it + 1 + nt * (j + 1)] = xytmp[j];
+        if (nout > 0) {
+          deriv_func (&neq, &tin, xytmp, dy, ctx->out, ctx->ipar);
+          for (j = 0; j < nout; j++)
+            yout[it + 1 + nt * (j + neq + 1)] = ctx->out[j];
+        }
+      }
+      if (istate < 0) {
+        nfail++;
+        if (mflag) Rprintf("member %d: integration failed at t = %g, istate = %d\n",
+                           m + 1, tin, istate);
+      }
+
+      /* istate, iwork (as in lsoda) */
+      ist[0] = istate;
+      for (j = 0; j < 20; j++) ist[j + 1] = iwork[j];
+    }
+
+  } else {
+    /*==========================================================================*/
+    /*  explicit Runge-Kutta methods with variable time step                    */
+    /*==========================================================================*/
+    ens_method rk;
+    ens_work  *work;
+    SEXP R_FSAL, Alpha, Beta, R_A, R_B1, R_B2, R_C, R_D, R_densetype, R_nknots;
+
+    rk.tcrit    = REAL(rWork)[0];
+    rk.hini     = REAL(rWork)[4];
+    rk.hmax     = REAL(rWork)[5];
+    rk.hmin     = REAL(rWork)[6];
+    rk.maxsteps = INTEGER(iWork)[5];
+
+    rk.stage = (int)REAL(getListElement(Method, "stage"))[0];
+    rk.bb2 = rk.cc = rk.dd = NULL;
+
+    PROTECT(R_A = getListElement(Method, "A")); nprot++;
+    rk.A = REAL(R_A);
+
+    PROTECT(R_B1 = getListElement(Method, "b1")); nprot++;
+    rk.bb1 = REAL(R_B1);
+
+    PROTECT(R_B2 = getListElement(Method, "b2")); nprot++;
+    if (length(R_B2)) rk.bb2 = REAL(R_B2);
+
+    PROTECT(R_C = getListElement(Method, "c")); nprot++;
+    if (length(R_C)) rk.cc = REAL(R_C);
+
+    PROTECT(R_D = getListElement(Method, "d")); nprot++;
+    if (length(R_D)) rk.dd = REAL(R_D);
+
+    rk.densetype = 0;
+    PROTECT(R_densetype = getListElement(Method, "densetype")); nprot++;
+    if (length(R_densetype)) rk.densetype = INTEGER(R_densetype)[0];
+
+    rk.qerr = (int)REAL(getListElement(Method, "Qerr"))[0];
+    rk.beta = 0;      /* 0.4/qerr; */
+
+    PROTECT(Beta = getListElement(Method, "beta")); nprot++;
+    if (length(Beta)) rk.beta = REAL(Beta)[0];
+
+    rk.alpha = 1.0/(double)rk.qerr - 0.75 * rk.beta;
+    PROTECT(Alpha = getListElement(Method, "alpha")); nprot++;
+    if (length(Alpha)) rk.alpha = REAL(Alpha)[0];
+
+    rk.fsal = FALSE;
+    PROTECT(R_FSAL = getListElement(Method, "FSAL")); nprot++;
+    if (length(R_FSAL)) rk.fsal = INTEGER(R_FSAL)[0];
+
+    /* polynomial interpolation */
+    rk.nknots = 6;
+    rk.interpolate = TRUE;
+    PROTECT(R_nknots = getListElement(Method, "nknots")); nprot++;
+    if (length(R_nknots)) rk.nknots = INTEGER(R_nknots)[0] + 1;
+    if (rk.nknots < 2) {rk.nknots = 1; rk.interpolate = FALSE;}
+    if (rk.densetype > 0) rk.interpolate = TRUE;
+    rk.ldknots = neq + 1;
+    if (rk.densetype == 3) {           /* Hermite dense output */
+      rk.nknots  = (rk.qerr + 2) / 2;
+      rk.ldknots = 2 * neq + 1;
+    }
+
+    /* specialized stage kernels of a built-in table, copied to all threads */
+    ctx->solver = rk_findkernel(Method);
+
+    /* workspace and context of each thread, allocated here in advance */
+    work = (ens_work *) R_alloc(nthreads, sizeof(ens_work));
+    for (i = 0; i < nthreads; i++) {
+      ens_work *w = &work[i];
+      memcpy(&w->ctx, ctx, sizeof(deSolve_context));
+      w->ctx.worker = (nthreads > 1);
+      ensemble_out(&w->out, &w->ipar, nout, nrpar, Rpar, Ipar);
+      w->ctx.out  = w->out;
+      w->ctx.ipar = w->ipar;
+      w->y0  = (double*) R_alloc(neq, sizeof(double));
+      w->y1  = (double*) R_alloc(neq, sizeof(double));
+      w->y2  = (double*) R_alloc(neq, sizeof(double));
+      w->dy1 = (double*) R_alloc(neq, sizeof(double));
+      w->dy2 = (double*) R_alloc(neq, sizeof(double));
+      w->f   = (double*) R_alloc(neq, sizeof(double));
+      w->y   = (double*) R_alloc(neq, sizeof(double));
+      w->Fj  = (double*) R_alloc(neq, sizeof(double));
+      w->tmp = (double*) R_alloc(neq, sizeof(double));
+      w->FF  = (double*) R_alloc(neq * rk.stage, sizeof(double));
+      w->rr  = (double*) R_alloc(neq * 5, sizeof(double));
+      w->yknots = (double*) R_alloc(rk.ldknots * (rk.nknots + 1), sizeof(double));
+    }
+
+    if (nthreads == 1) {
+      for (m = 0; m < nm; m++) {
+        ensemble_parms(initializer, ps, parms, npar, m);
+        for (j = 0; j < nrpar; j++) work[0].out[nout + j] = ps[j + npar * m];
+        ensemble_rk(&rk, &work[0], derivfunc, neq, nt, nout, isForcing, mflag,
+                    tt, ys + (R_xlen_t) neq * m, Atol, Rtol,
+                    REAL(ctx->YOUT) + (R_xlen_t) m * nt * ncol,
+                    INTEGER(ISTATE) + 22 * m);
+      }
+    } else {
+      double *yo = REAL(ctx->YOUT);
+      int    *io = INTEGER(ISTATE);
+
+      /* each member writes to its own slice of the output,
+         so the results do not depend on the number of threads */
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nthreads) schedule(dynamic) private(j)
+#endif
+      for (m = 0; m < nm; m++) {
+        int k = 0;
+#ifdef _OPENMP
+        k = omp_get_thread_num();
+#endif
+        for (j = 0; j < nrpar; j++) work[k].out[nout + j] = ps[j + npar * m];
+        ensemble_rk(&rk, &work[k], derivfunc, neq, nt, nout, isForcing, 0,
+                    tt, ys + (R_xlen_t) neq * m, Atol, Rtol,
+                    yo + (R_xlen_t) m * nt * ncol, io + 22 * m);
+      }
+    }
+
+    for (m = 0; m < nm; m++) {
+      if (INTEGER(ISTATE)[22 * m] == -1) {
+        nfail++;
+        if (mflag) Rprintf("member %d: integration failed, istate = %d\n",
+                           m + 1, -1);
+      }
+    }
+  }
+
+  if (nfail > 0)
+    warning("integration failed for %d of %d members of the ensemble", nfail, nm);
+
+  setAttrib(ctx->YOUT, install("istate"), ISTATE);
+
+  /*                       ####   termination   ####                            */
+  ctx->timesteps[0] = 0;
+  ctx->timesteps[1] = 0;
+  leave_context(ctx);
+  UNPROTECT(nprot);
+  return(ctx->YOUT);
+}
@@ -13,6 +13,7 @@ SEXP call_euler(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
 
   /* Initialization */
   int nprot = 0;
+  deSolve_context solver_ctx, *ctx = &solver_ctx;
 
   double *tt = NULL, *xs = NULL;
   double *tmp, *FF, *out;
@@ -41,11 +42,17 @@ SEXP call_euler(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
   int nout  = INTEGER(Nout)[0]; /* n of global outputs if func is in a DLL */
   int verbose = INTEGER(Verbose)[0];
 
+  /*------------------------------------------------------------------------*/
+  /* solver context; timesteps, outputs, forcings and events are kept here  */
+  /*------------------------------------------------------------------------*/
+  init_context(ctx);
+  enter_context(ctx);  /* nested calls of solvers are possible */
+
   /*------------------------------------------------------------------------*/
   /* timesteps (for advection computation in ReacTran)                      */
   /*------------------------------------------------------------------------*/
 
-  for (i = 0; i < 2; i++) timesteps[i] = tt[1] - tt[0];
+  for (i = 0; i < 2; i++) ctx->timesteps[i] = tt[1] - tt[0];
 
   /*------------------------------------------------------------------------*/
   /* DLL, ipar, rpar (for compatibility with lsoda)                         */
@@ -56,13 +63,13 @@ SEXP call_euler(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
 
   if (inherits(Func, "NativeSymbol")) { /* function is a dll */
     isDll = TRUE;
-    if (nout > 0) isOut = TRUE;
+    if (nout > 0) ctx->isOut = TRUE;
     lrpar = nout + LENGTH(Rpar);  /* length of rpar; LENGTH(Rpar) is always >0 */
     lipar = 3    + LENGTH(Ipar);  /* length of ipar */
 
   } else {                        /* function is not a dll */
     isDll = FALSE;
-    isOut = FALSE;
+    ctx->isOut = FALSE;
     lipar = 3;                    /* in lsoda = 1; */
     lrpar = nout;                 /* in lsoda = 1; */
   }
@@ -86,6 +93,7 @@ SEXP call_euler(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
   /*------------------------------------------------------------------------*/
   PROTECT(R_y0 = allocVector(REALSXP, neq)); nprot++;
   PROTECT(R_f  = allocVector(REALSXP, neq)); nprot++;
+  PROTECT(ctx->Rcalls = allocVector(VECSXP, NRCALLS)); nprot++;
   y0 = REAL(R_y0);
   f  = REAL(R_f);
 
@@ -107,13 +115,13 @@ SEXP call_euler(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
   if (Initfunc != NA_STRING) {
     if (inherits(Initfunc, "NativeSymbol")) {
       init_func_type *initializer;
-      PROTECT(de_gparms = Parms); nprot++;
+      PROTECT(ctx->de_gparms = Parms); nprot++;
       initializer = (init_func_type *) R_ExternalPtrAddrFn_(Initfunc);
       initializer(Initdeparms);
     }
   }
 
-  isForcing = initForcings(Flist);
+  isForcing = initForcings(ctx, Flist);
 
   /*------------------------------------------------------------------------*/
   /* Initialization of Integration Loop                                     */
@@ -131,12 +139,12 @@ SEXP call_euler(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
     t = tt[it];
     dt = tt[it + 1] - t;
 
-    timesteps[0] = timesteps[1];
-    timesteps[1] = dt;
+    ctx->timesteps[0] = ctx->timesteps[1];
+    ctx->timesteps[1] = dt;
 
     if (verbose)
       Rprintf("Time steps = %d / %d time = %e\n", it + 1, nt, t);
-    derivs(Func, t, y0, Parms, Rho, f, out, 0, neq, ipar, isDll, isForcing);
+    derivs(ctx, Func, t, y0, Parms, Rho, f, out, 0, neq, ipar, isDll, isForcing);
     for (i = 0; i < neq; i++) {
       y0[i]  = y0[i] + dt * f[i];
     }
@@ -153,7 +161,7 @@ SEXP call_euler(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
     for (int j = 0; j < nt; j++) {
       t = yout[j];
       for (i = 0; i < neq; i++) tmp[i] = yout[j + nt * (1 + i)];
-      derivs(Func, t, tmp, Parms, Rho, FF, out, -1, neq, ipar, isDll, isForcing);
+      derivs(ctx, Func, t, tmp, Parms, Rho, FF, out, -1, neq, ipar, isDll, isForcing);
       for (i = 0; i < nout; i++) {
         yout[j + nt * (1 + neq + i)] = out[i];
       }
@@ -162,8 +170,9 @@ SEXP call_euler(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
   /* attach diagnostic information (codes are compatible to lsoda) */
   setIstate(R_yout, R_istate, istate, it, 1, 0, 1, 0);
 
-  timesteps[0] = 0;
-  timesteps[1] = 0;
+  ctx->timesteps[0] = 0;
+  ctx->timesteps[1] = 0;
+  leave_context(ctx);
   UNPROTECT(nprot);
   return(R_yout);
 }
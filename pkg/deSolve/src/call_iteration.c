@@ -11,11 +11,12 @@ SEXP call_iteration(SEXP Xstart, SEXP Times, SEXP Nsteps, SEXP Func, SEXP Initfu
 
   /* Initialization */
   int nprot = 0;
+  deSolve_context solver_ctx, *ctx = &solver_ctx;
 
   double *tt = NULL, *xs = NULL;
   double *ytmp, *out;
 
-  SEXP R_y0, R_yout, R_t = NULL, R_y = NULL;
+  SEXP R_y0, R_yout, R_y = NULL;
   SEXP Val, R_fcall;
 
   double *y0, *yout, *yy;
@@ -43,10 +44,16 @@ SEXP call_iteration(SEXP Xstart, SEXP Times, SEXP Nsteps, SEXP Func, SEXP Initfu
   int nout  = INTEGER(Nout)[0]; /* n of global outputs if func is in a DLL */
   int verbose = INTEGER(Verbose)[0];
 
+  /*------------------------------------------------------------------------*/
+  /* solver context; timesteps, outputs, forcings and events are kept here  */
+  /*------------------------------------------------------------------------*/
+  init_context(ctx);
+  enter_context(ctx);  /* nested calls of solvers are possible */
+
   /*------------------------------------------------------------------------*/
   /* timesteps (e.g. for advection computation in ReacTran)                 */
   /*------------------------------------------------------------------------*/
-  for (i = 0; i < 2; i++) timesteps[i] = (tt[1] - tt[0])/nsteps;
+  for (i = 0; i < 2; i++) ctx->timesteps[i] = (tt[1] - tt[0])/nsteps;
 
   /*------------------------------------------------------------------------*/
   /* DLL, ipar, rpar (for compatibility with lsoda)                         */
@@ -57,17 +64,17 @@ SEXP call_iteration(SEXP Xstart, SEXP Times, SEXP Nsteps, SEXP Func, SEXP Initfu
 
   if (inherits(Func, "NativeSymbol")) { /* function is a dll */
     isDll = TRUE;
-    if (nout > 0) isOut = TRUE;
+    if (nout > 0) ctx->isOut = TRUE;
     lrpar = nout + LENGTH(Rpar);  /* length of rpar; LENGTH(Rpar) is always >0 */
     lipar = 3    + LENGTH(Ipar);  /* length of ipar */
     cderivs = (C_deriv_func_type *) R_ExternalPtrAddrFn_(Func);
 
   } else {                        /* function is not a dll */
     isDll = FALSE;
-    isOut = FALSE;
+    ctx->isOut = FALSE;
     lipar = 3;
     lrpar = nout;
-    PROTECT(R_y = allocVector(REALSXP, neq)); nprot++;
+    PROTECT(ctx->Rcalls = allocVector(VECSXP, NRCALLS)); nprot++;
   }
   out   = (double *) R_alloc(lrpar, sizeof(double));
   ipar  = (int *) R_alloc(lipar, sizeof(int));
@@ -109,13 +116,13 @@ SEXP call_iteration(SEXP Xstart, SEXP Times, SEXP Nsteps, SEXP Func, SEXP Initfu
   if (Initfunc != NA_STRING) {
     if (inherits(Initfunc, "NativeSymbol")) {
       init_func_type *initializer;
-      PROTECT(de_gparms = Parms); nprot++;
+      PROTECT(ctx->de_gparms = Parms); nprot++;
       initializer = (init_func_type *) R_ExternalPtrAddrFn_(Initfunc);
       initializer(Initdeparms);
     }
   }
   
-  isForcing = initForcings(Flist);
+  isForcing = initForcings(ctx, Flist);
 
   /*------------------------------------------------------------------------*/
   /* Initialization of Loop                                                 */
@@ -137,8 +144,8 @@ SEXP call_iteration(SEXP Xstart, SEXP Times, SEXP Nsteps, SEXP Func, SEXP Initfu
     else
       dt = 0;                       /* dt after final time is undefined*/
 
-    timesteps[0] = timesteps[1];
-    timesteps[1] = dt;
+    ctx->timesteps[0] = ctx->timesteps[1];
+    ctx->timesteps[1] = dt;
     if (verbose)
         Rprintf("Time steps = %d / %d time = %e\n", it + 1, nt, t);
 
@@ -152,21 +159,20 @@ SEXP call_iteration(SEXP Xstart, SEXP Times, SEXP Nsteps, SEXP Func, SEXP Initfu
       }
 
       if (isDll) {
-        if (isForcing) updatedeforc(&t);
+        if (isForcing) updatedeforc(ctx, &t);
         cderivs(&neq, &t, y0, ytmp, out, ipar);
         for (i = 0; i < neq; i++)  y0[i] = ytmp[i];
 
       } else {
-        /* the following PROTECTs are considered local and will quickly be
-           removed thereafter */
-        
+        /* the call is allocated once, only time and state are updated;
+           the PROTECT is considered local and will quickly be removed */
+        R_fcall = ctx_lang(ctx, CALL_DERIV, Func, "dds", 1, neq, Parms);
+        REAL(call_arg(R_fcall, 1))[0] = t;
+        R_y = call_arg(R_fcall, 2);
         yy = REAL(R_y);
-        PROTECT(R_t = ScalarReal(t));                       /* i1 */
-
         for (i = 0; i < neq; i++) yy[i] = y0[i];
 
-        PROTECT(R_fcall = lang4(Func, R_t, R_y, Parms));    /* i2 */
-        PROTECT(Val = eval(R_fcall, Rho));                  /* i3 */
+        PROTECT(Val = ctx_eval(ctx, R_fcall, Rho));                  /* i1 */
 
         for (i = 0; i < neq; i++)  y0[i] = REAL(VECTOR_ELT(Val, 0))[i];
 
@@ -182,7 +188,7 @@ SEXP call_iteration(SEXP Xstart, SEXP Times, SEXP Nsteps, SEXP Func, SEXP Initfu
             ii++;
           }
         }
-        UNPROTECT(3);
+        UNPROTECT(1);
       }  /* isDLL*/
       t = t + dt;
 
@@ -196,9 +202,10 @@ SEXP call_iteration(SEXP Xstart, SEXP Times, SEXP Nsteps, SEXP Func, SEXP Initfu
   setIstate(R_yout, R_istate, istate, it, 1, 0, 1, 0);
 
   /* reset timesteps pointer to saved state, release R resources */
-  timesteps[0] = 0;
-  timesteps[1] = 0;
+  ctx->timesteps[0] = 0;
+  ctx->timesteps[1] = 0;
 
+  leave_context(ctx);
   UNPROTECT(nprot);
   return(R_yout);
 }
@@ -4,7 +4,8 @@
 #include "externalptr.h"
 
 /* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-   Ordinary differential equation solvers lsoda, lsode, lsodes, lsodar, and vode.
+   Ordinary differential equation solvers lsoda, lsode, lsodes, lsodar, vode
+   and lsodpk.
 
    The C-wrappers that provide the interface between FORTRAN codes and R-code
    are: C_deriv_func: interface with R-code "func", passes derivatives
@@ -12,6 +13,10 @@
         C_jac_func  : interface with R-code "jacfunc", passes jacobian (except lsodes)
         C_jac_vec   : interface with R-code "jacvec", passes jacobian (only lsodes)
 
+   lsodpk (Krylov method) has no Jacobian; jacfunc is then a list with the
+   compiled preconditioner routines (jac, psol), or with the sparsity
+   pattern (jac) for the built-in block-diagonal preconditioner (precond.c).
+
    C_deriv_func_forc provides the interface between the function specified in
    a DLL and the integrator, in case there are forcing functions.
 
@@ -98,14 +103,31 @@ void F77_NAME(dvode)(void (*)(int *, double *, double *, double *,
                            int *, double *, int *, double*, int*),
                            int *, double *, int *);
 
+/* Krylov version of dlsode, in file dlsodpk.f; preconditioner setup and solve */
+typedef void C_pjac_func_type (C_deriv_func_type *, int *, double *, double *,
+              double *, double *, double *, double *, double *, double *,
+              int *, int *, double *, int *);
+typedef void C_psol_func_type (int *, double *, double *, double *, double *,
+              double *, double *, int *, double *, int *, int *);
+
+void F77_NAME(dlsodpk)(void (*)(int *, double *, double *, double *, double *, int *),
+              int *, double *, double *, double *,
+              int *, double *, double *, int *, int *,
+              int *, double *,int *,int *, int *,
+              C_pjac_func_type *, C_psol_func_type *, int *, double *, int *);
+
+/* warm restart after an event, in file dwarms.f */
+void F77_NAME(dwarms)(int *, double *, double *, double *, double *, int *);
+
 /* wrapper above the derivate function that first estimates the
  values of the forcing functions */
 
 static void C_deriv_func_forc (int *neq, double *t, double *y,
                                double *ydot, double *yout, int *iout)
 {
-  updatedeforc(t);
-  DLL_deriv_func(neq, t, y, ydot, yout, iout);
+  deSolve_context *ctx = desolve_ctx;
+  updatedeforc(ctx, t);
+  ctx->DLL_deriv_func(neq, t, y, ydot, yout, iout);
 }
 
 /* interface between FORTRAN function call and R function
@@ -116,19 +138,21 @@ static void C_deriv_func_forc (int *neq, double *t, double *y,
 static void C_deriv_func (int *neq, double *t, double *y,
                           double *ydot, double *yout, int *iout)
 {
+  deSolve_context *ctx = desolve_ctx;
   int i;
-  SEXP R_fcall, ans, Time;
-
+  SEXP R_fcall, ans, Y;
 
+  /* the call, time and state vector are allocated only once per solve */
+  R_fcall = ctx_lang(ctx, CALL_DERIV, ctx->R_deriv_func, "dd", 1, *neq);
+  REAL(call_arg(R_fcall, 1))[0] = *t;
+  Y = call_arg(R_fcall, 2);
   for (i = 0; i < *neq; i++)  REAL(Y)[i] = y[i];
 
-  PROTECT(Time = ScalarReal(*t));
-  PROTECT(R_fcall = lang3(R_deriv_func,Time,Y));
-  PROTECT(ans = eval(R_fcall, R_envir));
+  PROTECT(ans = ctx_eval(ctx, R_fcall, ctx->R_envir));
 
   for (i = 0; i < *neq; i++)   ydot[i] = REAL(ans)[i];
 
-  UNPROTECT(3);
+  UNPROTECT(1);
 }
 
 /* deriv output function  */
@@ -136,20 +160,22 @@ static void C_deriv_func (int *neq, double *t, double *y,
 static void C_deriv_out (int *nOut, double *t, double *y,
                          double *ydot, double *yout)
 {
+  deSolve_context *ctx = desolve_ctx;
   int i;
-  SEXP R_fcall, Time, ans;
+  SEXP R_fcall, ans, Y;
 
-  for (i = 0; i < n_eq; i++)
+  R_fcall = ctx_lang(ctx, CALL_DERIV, ctx->R_deriv_func, "dd", 1, ctx->n_eq);
+  REAL(call_arg(R_fcall, 1))[0] = *t;
+  Y = call_arg(R_fcall, 2);
+  for (i = 0; i < ctx->n_eq; i++)
     REAL(Y)[i] = y[i];
 
-  PROTECT(Time = ScalarReal(*t));
-  PROTECT(R_fcall = lang3(R_deriv_func,Time, Y));
-  PROTECT(ans = eval(R_fcall, R_envir));
+  PROTECT(ans = ctx_eval(ctx, R_fcall, ctx->R_envir));
 
-  for (i = 0; i < n_eq; i++)  ydot[i] = REAL (ans)[i] ;
-  for (i = 0; i < *nOut; i++) yout[i] = REAL(ans)[i + n_eq];
+  for (i = 0; i < ctx->n_eq; i++)  ydot[i] = REAL (ans)[i] ;
+  for (i = 0; i < *nOut; i++) yout[i] = REAL(ans)[i + ctx->n_eq];
 
-  UNPROTECT(3);
+  UNPROTECT(1);
 }
 
 /* only if lsodar, lsoder, lsodesr:
@@ -157,17 +183,20 @@ static void C_deriv_out (int *nOut, double *t, double *y,
 
 static void C_root_func (int *neq, double *t, double *y, int *ng, double *gout)
 {
+  deSolve_context *ctx = desolve_ctx;
   int i;
-  SEXP R_fcall, Time, ans;
+  SEXP R_fcall, ans, Y;
+
+  R_fcall = ctx_lang(ctx, CALL_ROOT, ctx->R_root_func, "dd", 1, *neq);
+  REAL(call_arg(R_fcall, 1))[0] = *t;
+  Y = call_arg(R_fcall, 2);
   for (i = 0; i < *neq; i++)  REAL(Y)[i] = y[i];
 
-  PROTECT(Time = ScalarReal(*t));
-  PROTECT(R_fcall = lang3(R_root_func,Time,Y));
-  PROTECT(ans = eval(R_fcall, R_envir));
+  PROTECT(ans = ctx_eval(ctx, R_fcall, ctx->R_envir));
 
   for (i = 0; i < *ng; i++)   gout[i] = REAL(ans)[i];
 
-  UNPROTECT(3);
+  UNPROTECT(1);
 }
 
 /* interface between FORTRAN call to jacobian and R function */
@@ -175,18 +204,20 @@ static void C_root_func (int *neq, double *t, double *y, int *ng, double *gout)
 static void C_jac_func (int *neq, double *t, double *y, int *ml,
                         int *mu, double *pd, int *nrowpd, double *yout, int *iout)
 {
+  deSolve_context *ctx = desolve_ctx;
   int i;
-  SEXP R_fcall, Time, ans;
+  SEXP R_fcall, ans, Y;
 
+  R_fcall = ctx_lang(ctx, CALL_JAC, ctx->R_jac_func, "dd", 1, *neq);
+  REAL(call_arg(R_fcall, 1))[0] = *t;
+  Y = call_arg(R_fcall, 2);
   for (i = 0; i < *neq; i++) REAL(Y)[i] = y[i];
 
-  PROTECT(Time = ScalarReal(*t));
-  PROTECT(R_fcall = lang3(R_jac_func,Time,Y));
-  PROTECT(ans = eval(R_fcall, R_envir));
+  PROTECT(ans = ctx_eval(ctx, R_fcall, ctx->R_envir));
 
   for (i = 0; i < *neq * *nrowpd; i++)  pd[i] = REAL(ans)[i];
 
-  UNPROTECT(3);
+  UNPROTECT(1);
 }
 
 /* only if lsodes:
@@ -195,19 +226,21 @@ static void C_jac_func (int *neq, double *t, double *y, int *ml,
 static void C_jac_vec (int *neq, double *t, double *y, int *j,
                        int *ian, int *jan, double *pdj, double *yout, int *iout)
 {
+  deSolve_context *ctx = desolve_ctx;
   int i;
-  SEXP R_fcall, ans, Time, J;
-  PROTECT(J = NEW_INTEGER(1));
-  INTEGER(J)[0] = *j;
+  SEXP R_fcall, ans, Y;
+
+  R_fcall = ctx_lang(ctx, CALL_JACVEC, ctx->R_jac_vec, "ddi", 1, *neq, 1);
+  REAL(call_arg(R_fcall, 1))[0] = *t;
+  INTEGER(call_arg(R_fcall, 3))[0] = *j;
+  Y = call_arg(R_fcall, 2);
   for (i = 0; i < *neq; i++) REAL(Y)[i] = y[i];
 
-  PROTECT(Time = ScalarReal(*t));
-  PROTECT(R_fcall = lang4(R_jac_vec,Time,Y,J));
-  PROTECT(ans = eval(R_fcall, R_envir));
+  PROTECT(ans = ctx_eval(ctx, R_fcall, ctx->R_envir));
 
   for (i = 0; i < *neq ; i++)  pdj[i] = REAL(ans)[i];
 
-  UNPROTECT(4);
+  UNPROTECT(1);
 }
 
 
@@ -225,7 +258,7 @@ SEXP call_lsoda(SEXP y, SEXP times, SEXP derivfunc, SEXP parms, SEXP rtol,
                 SEXP eventfunc, SEXP verbose, SEXP iTask, SEXP rWork, SEXP iWork, SEXP jT,
                 SEXP nOut, SEXP lRw, SEXP lIw, SEXP Solver, SEXP rootfunc,
                 SEXP nRoot, SEXP Rpar, SEXP Ipar, SEXP Type, SEXP flist, SEXP elist,
-                SEXP elag)
+                SEXP elag, SEXP Keep)
 
 {
   /******************************************************************************/
@@ -237,16 +270,21 @@ SEXP call_lsoda(SEXP y, SEXP times, SEXP derivfunc, SEXP parms, SEXP rtol,
   double *xytmp, tin, tout, *Atol, *Rtol, *dy=NULL, ss, pt;
   int itol, itask, istate, iopt, jt, mflag,  is, iterm;
   int nroot, *jroot=NULL, isDll, type;
+  int warm, iwarm, nwarm, ncold;
 
-  int    *iwork, it, ntot, nout, iroot, *evals =NULL;
+  int    *iwork, it, ntot, nout, nkeep, iroot, *evals =NULL;
   double *rwork;
-  SEXP TROOT, NROOT, VROOT; /* IROOT is in deSolve.h*/
+  SEXP TROOT, NROOT, VROOT; /* IROOT is in the solver context */
+  deSolve_context solver_ctx, *ctx = &solver_ctx;
 
   /* pointers to functions passed to FORTRAN */
   C_deriv_func_type *deriv_func;
   C_jac_func_type   *jac_func=NULL;
   C_jac_vec_type    *jac_vec=NULL;
   C_root_func_type  *root_func=NULL;
+  C_pjac_func_type  *prec_jac_func=NULL;
+  C_psol_func_type  *prec_sol_func=NULL;
+  SEXP precjac, precsol;
   
   /* memory overlay, KS, TP 2019-07-03 */
   union t_work {
@@ -258,13 +296,14 @@ SEXP call_lsoda(SEXP y, SEXP times, SEXP derivfunc, SEXP parms, SEXP rtol,
   /******                         STATEMENTS                               ******/
   /******************************************************************************/
 
-  lock_solver(); /* prevent nested call of solvers that have global variables */
+  init_context(ctx);
+  enter_context(ctx);  /* nested calls of solvers are possible */
 
   /*                      #### initialisation ####                              */
   int nprot = 0;
 
   jt  = INTEGER(jT)[0];         /* method flag */
-  n_eq = LENGTH(y);             /* number of equations */
+  ctx->n_eq = LENGTH(y);             /* number of equations */
   nt  = LENGTH(times);
 
   maxit = 10;                   /* number of iterations */
@@ -272,7 +311,7 @@ SEXP call_lsoda(SEXP y, SEXP times, SEXP derivfunc, SEXP parms, SEXP rtol,
 
   nroot  = INTEGER(nRoot)[0];   /* number of roots (lsodar, lsode, lsodes) */
   solver = INTEGER(Solver)[0];  /* 1=lsoda,2=lsode,3=lsodeS,4=lsodar,5=vode,
-   6=lsoder, 7 = lsodeSr */
+   6=lsoder, 7 = lsodeSr, 8 = lsodpk */
 
   /* is function a dll ?*/
   if (inherits(derivfunc, "NativeSymbol")) {
@@ -282,12 +321,12 @@ SEXP call_lsoda(SEXP y, SEXP times, SEXP derivfunc, SEXP parms, SEXP rtol,
   }
 
   /* initialise output ... */
-  initOutC(isDll, &nout, &ntot, n_eq, nOut, Rpar, Ipar);
+  initOutC(ctx, isDll, &nout, &ntot, ctx->n_eq, nOut, Rpar, Ipar);
 
   /* copies of variables that will be changed in the FORTRAN subroutine */
 
-  xytmp = (double *) R_alloc(n_eq, sizeof(double));
-  for (j = 0; j < n_eq; j++) xytmp[j] = REAL(y)[j];
+  xytmp = (double *) R_alloc(ctx->n_eq, sizeof(double));
+  for (j = 0; j < ctx->n_eq; j++) xytmp[j] = REAL(y)[j];
 
   latol = LENGTH(atol);
   Atol = (double *) R_alloc((int) latol, sizeof(double));
@@ -308,8 +347,7 @@ SEXP call_lsoda(SEXP y, SEXP times, SEXP derivfunc, SEXP parms, SEXP rtol,
   for (j=0; j<length(rWork); j++) u_work.rwk [j] = REAL(rWork)[j];
   rwork = u_work.rwk;
 
-  /* a global variable*/
-  for (j=0; j<2; j++) timesteps[j] = 0.;
+  for (j=0; j<2; j++) ctx->timesteps[j] = 0.;
 
   /* if a 1-D, 2-D or 3-D special-purpose problem (lsodes)
    iwork will contain the sparsity structure */
@@ -318,44 +356,57 @@ SEXP call_lsoda(SEXP y, SEXP times, SEXP derivfunc, SEXP parms, SEXP rtol,
   {
     type   = INTEGER(Type)[0];
     if (type == 2)        /* 1-D problem ; Type contains further information */
-  sparsity1D( Type, iwork, n_eq, liw) ;
+  sparsity1D( Type, iwork, ctx->n_eq, liw) ;
     else if (type == 3)  /* 2-D problem */
-  sparsity2D( Type, iwork, n_eq, liw);
+  sparsity2D( Type, iwork, ctx->n_eq, liw);
     else if (type == 30)  /* 2-D problem with map */
-  sparsity2Dmap( Type, iwork, n_eq, liw);
+  sparsity2Dmap( Type, iwork, ctx->n_eq, liw);
     else if (type == 4)  /* 3-D problem */
-  sparsity3D (Type, iwork, n_eq, liw);
+  sparsity3D (Type, iwork, ctx->n_eq, liw);
     else if (type == 40)  /* 3-D problem with map */
-  sparsity3Dmap( Type, iwork, n_eq, liw);
+  sparsity3Dmap( Type, iwork, ctx->n_eq, liw);
   }
 
   /* initialise global R-variables...  */
   //initglobals (nt, ntot);
-  PROTECT(Y = allocVector(REALSXP, (n_eq))); nprot++;
-  PROTECT(YOUT = allocMatrix(REALSXP, ntot+1, nt)); nprot++;
+  PROTECT(ctx->Rcalls = allocVector(VECSXP, NRCALLS)); nprot++;
+  /* output: time and the kept states and global outputs per column */
+  nkeep = initKeep(ctx, Keep, ntot);
+  PROTECT(ctx->YOUT = allocMatrix(REALSXP, nkeep+1, nt)); nprot++;
 
   /* Initialization of Parameters and Forcings (DLL functions)  */
   //initParms(initfunc, parms);
   if (initfunc != NA_STRING) {
     if (inherits(initfunc, "NativeSymbol")) {
       init_func_type *initializer;
-      PROTECT(de_gparms = parms); nprot++;
+      PROTECT(ctx->de_gparms = parms); nprot++;
       initializer = (init_func_type *) R_ExternalPtrAddrFn_(initfunc);
       initializer(Initdeparms);
     }
   }
   // end inline initParms
 
-  isForcing = initForcings(flist);
-  isEvent = initEvents(elist, eventfunc, nroot); /* added nroot */
-  islag = initLags(elag, solver, nroot);
+  isForcing = initForcings(ctx, flist);
+  isEvent = initEvents(ctx, elist, eventfunc, nroot); /* added nroot */
+  islag = initLags(ctx, elag, solver, nroot);
+
+  /* warm restarts after events: not for vode, which has its own common block,
+     nor for lsodpk, which keeps the Krylov state in common block DLPK01,
+     nor with root functions: the root search (DRCHEK) would continue with
+     the root functions of the state before the event */
+  warm = 0;
+  if (isEvent && !isNull(getListElement(elist, "Restart")))
+    warm = (INTEGER(getListElement(elist, "Restart"))[0] == 1 && solver != 5
+            && solver != 8 && nroot == 0);
+  nwarm = 0;
+  ncold = 0;
 
   /* pointers to functions deriv_func, jac_func, jac_vec, root_func, passed to FORTRAN */
-  if (nout > 0 || islag == 1) {
-    dy = (double *) R_alloc(n_eq, sizeof(double));
-    for (j = 0; j < n_eq; j++) dy[j] = 0.;
+  if (nout > 0 || islag == 1 || warm) {
+    dy = (double *) R_alloc(ctx->n_eq, sizeof(double));
+    for (j = 0; j < ctx->n_eq; j++) dy[j] = 0.;
   }
-  R_envir = rho;
+  ctx->R_envir = rho;
 
   if (isDll) {
     /* DLL address passed to FORTRAN */
@@ -364,29 +415,46 @@ SEXP call_lsoda(SEXP y, SEXP times, SEXP derivfunc, SEXP parms, SEXP rtol,
 
     /* here overruling deriv_func if forcing */
     if (isForcing) {
-      DLL_deriv_func = deriv_func;
+      ctx->DLL_deriv_func = deriv_func;
       deriv_func = (C_deriv_func_type *) C_deriv_func_forc;
     }
   } else {
     /* interface function between FORTRAN and C/R passed to FORTRAN */
     deriv_func = (C_deriv_func_type *) C_deriv_func;
     /* needed to communicate with R */
-    R_deriv_func = derivfunc;
+    ctx->R_deriv_func = derivfunc;
   }
-  R_envir = rho;           /* karline: this to allow merging compiled and R-code (e.g. events)*/
-
-    if (!isNull(jacfunc) && solver != 3 && solver != 7) { /* lsodes uses jac_vec */
+  ctx->R_envir = rho;           /* karline: this to allow merging compiled and R-code (e.g. events)*/
+
+    if (solver == 8) {                  /* lsodpk: preconditioner */
+      precjac = getListElement(jacfunc, "jac");
+      precsol = getListElement(jacfunc, "psol");
+      if (inherits(precjac, "deSolve.sparsity")) {
+        initGroups(ctx, precjac, deriv_func, FALSE);
+        prec_jac_func = prec_blockjac;
+        prec_sol_func = prec_blocksol;
+      } else {
+        if (!isNull(precjac))
+          prec_jac_func = (C_pjac_func_type *) R_ExternalPtrAddrFn_(precjac);
+        if (!isNull(precsol))
+          prec_sol_func = (C_psol_func_type *) R_ExternalPtrAddrFn_(precsol);
+      }
+    } else if (inherits(jacfunc, "deSolve.sparsity") && solver != 3 && solver != 7) {
+      /* internal Jacobian, grouped columns of a known sparsity pattern */
+      initGroups(ctx, jacfunc, deriv_func, abs(jt) % 10 == 4);
+      jac_func = cpr_jac;
+    } else if (!isNull(jacfunc) && solver != 3 && solver != 7) { /* lsodes uses jac_vec */
     if (isDll)
       jac_func = (C_jac_func_type *) R_ExternalPtrAddrFn_(jacfunc);
     else  {
-      R_jac_func = jacfunc;
+      ctx->R_jac_func = jacfunc;
       jac_func = C_jac_func;
     }
     }  else if (!isNull(jacfunc) && (solver == 3 || solver == 7)) {  /*lsodes*/
     if (isDll)
       jac_vec = (C_jac_vec_type *) R_ExternalPtrAddrFn_(jacfunc);
     else  {
-      R_jac_vec = jacfunc;
+      ctx->R_jac_vec = jacfunc;
       jac_vec = C_jac_vec;
     }
     }
@@ -405,7 +473,7 @@ SEXP call_lsoda(SEXP y, SEXP times, SEXP derivfunc, SEXP parms, SEXP rtol,
         root_func = (C_root_func_type *) R_ExternalPtrAddrFn_(rootfunc);
       } else {
         root_func = (C_root_func_type *) C_root_func;
-        R_root_func = rootfunc;
+        ctx->R_root_func = rootfunc;
       }
     }
 
@@ -433,23 +501,21 @@ SEXP call_lsoda(SEXP y, SEXP times, SEXP derivfunc, SEXP parms, SEXP rtol,
 
     /*                      #### initial time step ####                           */
     tin = REAL(times)[0];
-    REAL(YOUT)[0] = tin;
-    for (j = 0; j < n_eq; j++) REAL(YOUT)[j+1] = REAL(y)[j];
     if (islag == 1) {
       if (isDll == 1)   /* function in DLL and output */         // + thpe
-    deriv_func (&n_eq, &tin, xytmp, dy, out, ipar);          // + thpe
+    deriv_func (&ctx->n_eq, &tin, xytmp, dy, ctx->out, ctx->ipar);          // + thpe
       else                                                       // + thpe
-        C_deriv_func (&n_eq, &tin, xytmp, dy, out, ipar);
-      updatehistini(tin, xytmp, dy, rwork, iwork);
+        C_deriv_func (&ctx->n_eq, &tin, xytmp, dy, ctx->out, ctx->ipar);
+      updatehistini(ctx, tin, xytmp, dy, rwork, iwork);
     }
     if (nout>0)   {
       tin = REAL(times)[0];
       if (isDll == 1)   /* function in DLL and output */
-    deriv_func (&n_eq, &tin, xytmp, dy, out, ipar) ;
+    deriv_func (&ctx->n_eq, &tin, xytmp, dy, ctx->out, ctx->ipar) ;
       else
-        C_deriv_out(&nout,&tin,xytmp,dy,out);
-      for (j = 0; j < nout; j++) REAL(YOUT)[j + n_eq + 1] = out[j];
+        C_deriv_out(&nout,&tin,xytmp,dy,ctx->out);
     }
+    keepRow(ctx, REAL(ctx->YOUT), 1, tin, xytmp, ctx->n_eq, ctx->out);
 
     iroot = 0;
 
@@ -458,10 +524,26 @@ SEXP call_lsoda(SEXP y, SEXP times, SEXP derivfunc, SEXP parms, SEXP rtol,
       tin = REAL(times)[it];
       tout = REAL(times)[it+1];
       if (isEvent) {
-        updateevent(&tin, xytmp, &istate);
+        iwarm = istate;
+        updateevent(ctx, &tin, xytmp, &istate);
+        if (istate == 1 && iwarm > 1) {
+          /* event changed the states: keep Jacobian, LU and step size if possible */
+          iwarm = 0;
+          if (warm) {
+            deriv_func (&ctx->n_eq, &tin, xytmp, dy, ctx->out, ctx->ipar);
+            F77_CALL(dwarms) (&ctx->n_eq, &tin, xytmp, dy, rwork, &iwarm);
+          }
+          if (iwarm == 1) {
+            istate = 2;
+            nwarm++;
+          } else
+            ncold++;
+        }
         // check tEvent > tout to account for root events
-        if ((iEvent < nEvent)&&(tEvent > tout)) {
-          rwork[0] = tEvent;
+        // (with warm restarts, the solver also stops at events at tout)
+        if ((ctx->iEvent < ctx->nEvent) &&
+            (ctx->tEvent > tout || (warm && ctx->tEvent == tout))) {
+          rwork[0] = ctx->tEvent;
         } else {
           rwork[0] = REAL(times)[nt-1];
         }
@@ -480,70 +562,76 @@ SEXP call_lsoda(SEXP y, SEXP times, SEXP derivfunc, SEXP parms, SEXP rtol,
         }
 
         if (solver == 1) {
-          F77_CALL(dlsoda) (deriv_func, &n_eq, xytmp, &tin, &tout,
+          F77_CALL(dlsoda) (deriv_func, &ctx->n_eq, xytmp, &tin, &tout,
                    &itol, Rtol, Atol, &itask, &istate, &iopt, rwork,
-                   &lrw, iwork, &liw, jac_func, &jt, out, ipar);
+                   &lrw, iwork, &liw, jac_func, &jt, ctx->out, ctx->ipar);
         } else if (solver == 2) {
-          F77_CALL(dlsode) (deriv_func, &n_eq, xytmp, &tin, &tout,
+          F77_CALL(dlsode) (deriv_func, &ctx->n_eq, xytmp, &tin, &tout,
                    &itol, Rtol, Atol, &itask, &istate, &iopt, rwork,
-                   &lrw, iwork, &liw, jac_func, &jt, out, ipar);
+                   &lrw, iwork, &liw, jac_func, &jt, ctx->out, ctx->ipar);
         } else if (solver == 3) {
-          F77_CALL(dlsodes) (deriv_func, &n_eq, xytmp, &tin, &tout,
+          F77_CALL(dlsodes) (deriv_func, &ctx->n_eq, xytmp, &tin, &tout,
                    &itol, Rtol, Atol, &itask, &istate, &iopt, u_work.rwk,
-                   &lrw, iwork, &liw, u_work.iwk, jac_vec, &jt, out, ipar);  /*rwork: iwk in fortran*/
+                   &lrw, iwork, &liw, u_work.iwk, jac_vec, &jt, ctx->out, ctx->ipar);  /*rwork: iwk in fortran*/
         } else if (solver == 4) {
-          F77_CALL(dlsodar) (deriv_func, &n_eq, xytmp, &tin, &tout,
+          F77_CALL(dlsodar) (deriv_func, &ctx->n_eq, xytmp, &tin, &tout,
                    &itol, Rtol, Atol,  &itask, &istate, &iopt, rwork,
                    &lrw, iwork, &liw, jac_func, &jt, root_func, &nroot, jroot,
-                   out, ipar);
+                   ctx->out, ctx->ipar);
         } else if (solver == 5) {
-          F77_CALL(dvode) (deriv_func, &n_eq, xytmp, &tin, &tout,
+          F77_CALL(dvode) (deriv_func, &ctx->n_eq, xytmp, &tin, &tout,
                    &itol, Rtol, Atol, &itask, &istate, &iopt, rwork,
-                   &lrw, iwork, &liw, jac_func, &jt, out, ipar);
+                   &lrw, iwork, &liw, jac_func, &jt, ctx->out, ctx->ipar);
         } else if (solver == 6) {
-          F77_CALL(dlsoder) (deriv_func, &n_eq, xytmp, &tin, &tout,
+          F77_CALL(dlsoder) (deriv_func, &ctx->n_eq, xytmp, &tin, &tout,
                    &itol, Rtol, Atol, &itask, &istate, &iopt, rwork,
                    &lrw, iwork, &liw, jac_func, &jt, root_func, &nroot, jroot,
-                   out, ipar);
+                   ctx->out, ctx->ipar);
         } else if (solver == 7) {
-          F77_CALL(dlsodesr) (deriv_func, &n_eq, xytmp, &tin, &tout,
+          F77_CALL(dlsodesr) (deriv_func, &ctx->n_eq, xytmp, &tin, &tout,
                    &itol, Rtol, Atol, &itask, &istate, &iopt, u_work.rwk,
                    &lrw, iwork, &liw, u_work.iwk, jac_vec, &jt, root_func, &nroot, jroot, /*rwork: iwk in fortran*/
-        out, ipar);
-          lyh = iwork[21];
+        ctx->out, ctx->ipar);
+          ctx->lyh = iwork[21];
+        } else if (solver == 8) {
+          F77_CALL(dlsodpk) (deriv_func, &ctx->n_eq, xytmp, &tin, &tout,
+                   &itol, Rtol, Atol, &itask, &istate, &iopt, rwork,
+                   &lrw, iwork, &liw, prec_jac_func, prec_sol_func, &jt,
+                   ctx->out, ctx->ipar);
         }
         /* in case size of timesteps is called for */
-        timesteps [0] = rwork[10];
-        timesteps [1] = rwork[11];
+        ctx->timesteps [0] = rwork[10];
+        ctx->timesteps [1] = rwork[11];
 
         if (istate == -1)  {
           warning("an excessive amount of work (> maxsteps ) was done, but integration was not successful - increase maxsteps");
         } else if (istate == 3 && (solver == 4 || solver == 6 || solver == 7)){
 
           /* root found - take into account if an EVENT */
-          if (isEvent && rootevent) {
-            pt = tEvent;
-            tEvent = tin;
+          if (isEvent && ctx->rootevent) {
+            pt = ctx->tEvent;
+            ctx->tEvent = tin;
             /* function evaluations set to 0 again . */
             for (j=0; j<3; j++) evals[j] = evals[j] + iwork[10+j];
 
-            if (iroot < Rootsave) {
-              troot[iroot] = tin;
+            if (iroot < ctx->Rootsave) {
+              ctx->troot[iroot] = tin;
               for (j = 0; j < nroot; j++)
-                if (jroot[j] == 1) nrroot[iroot] = j+1;
-              for (j = 0; j < n_eq; j++)
-                valroot[iroot*n_eq+j] = xytmp[j];
+                if (jroot[j] == 1) ctx->nrroot[iroot] = j+1;
+              for (j = 0; j < ctx->n_eq; j++)
+                ctx->valroot[iroot*ctx->n_eq+j] = xytmp[j];
             }
             iroot ++;
             iterm = 0;      /* check if simulation should be terminated */
 
             for (j = 0; j < nroot; j++)
-              if (jroot[j] == 1 && termroot[j] == 1) iterm = 1;
+              if (jroot[j] == 1 && ctx->termroot[j] == 1) iterm = 1;
 
             if (iterm == 0) {
-              updateevent(&tin, xytmp, &istate);
-              tEvent = pt;
+              updateevent(ctx, &tin, xytmp, &istate);
+              ctx->tEvent = pt;
               istate = 1;
+              ncold++;
               repcount = 0;
               if (mflag ==1) Rprintf("root found at time %g\n",tin);
             } else {
@@ -566,10 +654,10 @@ SEXP call_lsoda(SEXP y, SEXP times, SEXP derivfunc, SEXP parms, SEXP rtol,
         }
         if (islag == 1) {
           if (isDll == 1)   /* function in DLL and output */         // + thpe
-            deriv_func (&n_eq, &tin, xytmp, dy, out, ipar);          // + thpe
+            deriv_func (&ctx->n_eq, &tin, xytmp, dy, ctx->out, ctx->ipar);          // + thpe
           else                                                       // + thpe
-            C_deriv_func (&n_eq, &tin, xytmp, dy, out, ipar);
-          updatehist(tin, xytmp, dy, rwork, iwork);
+            C_deriv_func (&ctx->n_eq, &tin, xytmp, dy, ctx->out, ctx->ipar);
+          updatehist(ctx, tin, xytmp, dy, rwork, iwork);
           repcount = 0;
         }
         repcount ++;
@@ -578,85 +666,91 @@ SEXP call_lsoda(SEXP y, SEXP times, SEXP derivfunc, SEXP parms, SEXP rtol,
       if (istate == -3)  {
         error("illegal input detected before taking any integration steps - see written message");
       }  else {
-        REAL(YOUT)[(it+1)*(ntot+1)] = tin;
-        for (j = 0; j < n_eq; j++)
-          REAL(YOUT)[(it+1)*(ntot + 1) + j + 1] = xytmp[j];
-
         if (nout>0)   {
           if (isDll == 1)   /* function in DLL and output */
-            deriv_func (&n_eq, &tin, xytmp, dy, out, ipar) ;
+            deriv_func (&ctx->n_eq, &tin, xytmp, dy, ctx->out, ctx->ipar) ;
           else
-            C_deriv_out(&nout,&tin,xytmp,dy,out);
-          for (j = 0; j < nout; j++)
-            REAL(YOUT)[(it+1)*(ntot + 1) + j + n_eq + 1] = out[j];
+            C_deriv_out(&nout,&tin,xytmp,dy,ctx->out);
         }
+        keepRow(ctx, REAL(ctx->YOUT) + (it+1)*(nkeep+1), 1, tin, xytmp,
+                ctx->n_eq, ctx->out);
       }
 
 
       /*                    ####  an error occurred   ####                          */
       if (istate < 0 || tin < tout) {
-        PROTECT(YOUT2 = allocMatrix(REALSXP,ntot+1,(it+2))); nprot++;
+        PROTECT(ctx->YOUT2 = allocMatrix(REALSXP,nkeep+1,(it+2))); nprot++;
         if (istate > -20)
-          returnearly (1, it, ntot);
+          returnearly (ctx, 1, it, nkeep);
         else
-          returnearly (0, it, ntot);  /* stop because a root was found */
+          returnearly (ctx, 0, it, nkeep);  /* stop because a root was found */
         break;
       }
     }     /* end main time loop */
 
     /*                   ####   returning output   ####                           */
-    if (isEvent && rootevent && iroot > 0)
+    if (isEvent && ctx->rootevent && iroot > 0)
       for (j=0; j<3; j++) iwork[10+j] = evals[j];
 
-    PROTECT(ISTATE = allocVector(INTSXP, 21)); nprot++;
-    PROTECT(RWORK = allocVector(REALSXP, 5)); nprot++;
-    terminate(istate, iwork, 21, 0, rwork, 5, 10);    /* istate, iwork, rwork */
+    PROTECT(ctx->ISTATE = allocVector(INTSXP, 26)); nprot++;
+    PROTECT(ctx->RWORK = allocVector(REALSXP, 5)); nprot++;
+    terminate(ctx, istate, iwork, 21, 0, rwork, 5, 10);    /* istate, iwork, rwork */
+    /* restarts after events: warm (history kept) and cold (istate = 1) */
+    for (k = 21; k < 23; k++) INTEGER(ctx->ISTATE)[k] = NA_INTEGER;
+    INTEGER(ctx->ISTATE)[23] = nwarm;
+    INTEGER(ctx->ISTATE)[24] = ncold;
+    /* lsodpk: psol calls, nonlinear and linear convergence failures */
+    INTEGER(ctx->ISTATE)[25] = NA_INTEGER;
+    if (solver == 8) {
+      for (k = 21; k < 23; k++) INTEGER(ctx->ISTATE)[k] = iwork[k - 1];
+      INTEGER(ctx->ISTATE)[25] = iwork[22];
+    }
 
-    if (istate <= -20) INTEGER(ISTATE)[0] = 3;
+    if (istate <= -20) INTEGER(ctx->ISTATE)[0] = 3;
 
     if (istate == -20 && nroot > 0)  {
-      PROTECT(IROOT = allocVector(INTSXP, nroot)); nprot++;
-      for (k = 0;k<nroot;k++) INTEGER(IROOT)[k] = jroot[k];
-      setAttrib(YOUT2, install("iroot"), IROOT);
+      PROTECT(ctx->IROOT = allocVector(INTSXP, nroot)); nprot++;
+      for (k = 0;k<nroot;k++) INTEGER(ctx->IROOT)[k] = jroot[k];
+      setAttrib(ctx->YOUT2, install("iroot"), ctx->IROOT);
       PROTECT(TROOT = allocVector(REALSXP, 1)); nprot++;
       REAL(TROOT)[0] = tin;
-      setAttrib(YOUT2, install("troot"), TROOT);
+      setAttrib(ctx->YOUT2, install("troot"), TROOT);
     }
     if (iroot > 0) {                                 /* root + events */
       PROTECT(NROOT = allocVector(INTSXP, 1)); nprot++;
       INTEGER(NROOT)[0] = iroot;
 
-      if (iroot > Rootsave) iroot = Rootsave;
+      if (iroot > ctx->Rootsave) iroot = ctx->Rootsave;
 
       PROTECT(TROOT = allocVector(REALSXP, iroot)); nprot++;
-      for (k = 0; k < iroot; k++) REAL(TROOT)[k] = troot[k];
+      for (k = 0; k < iroot; k++) REAL(TROOT)[k] = ctx->troot[k];
 
-      PROTECT(VROOT = allocVector(REALSXP, iroot*n_eq)); nprot++;
-      for (k = 0; k < iroot*n_eq; k++) REAL(VROOT)[k] = valroot[k];
+      PROTECT(VROOT = allocVector(REALSXP, iroot*ctx->n_eq)); nprot++;
+      for (k = 0; k < iroot*ctx->n_eq; k++) REAL(VROOT)[k] = ctx->valroot[k];
 
-      PROTECT(IROOT = allocVector(INTSXP, iroot)); nprot++;
-      for (k = 0; k < iroot; k++) INTEGER(IROOT)[k] = nrroot[k];
+      PROTECT(ctx->IROOT = allocVector(INTSXP, iroot)); nprot++;
+      for (k = 0; k < iroot; k++) INTEGER(ctx->IROOT)[k] = ctx->nrroot[k];
 
       if (istate > 0 ) {
-        setAttrib(YOUT, install("troot"), TROOT);
-        setAttrib(YOUT, install("nroot"), NROOT);
-        setAttrib(YOUT, install("valroot"), VROOT);
-        setAttrib(YOUT, install("indroot"), IROOT);
+        setAttrib(ctx->YOUT, install("troot"), TROOT);
+        setAttrib(ctx->YOUT, install("nroot"), NROOT);
+        setAttrib(ctx->YOUT, install("valroot"), VROOT);
+        setAttrib(ctx->YOUT, install("indroot"), ctx->IROOT);
       } else  {
-        setAttrib(YOUT2, install("troot"), TROOT);
-        setAttrib(YOUT2, install("nroot"), NROOT);
-        setAttrib(YOUT2, install("valroot"), VROOT);
-        setAttrib(YOUT2, install("indroot"), IROOT);
+        setAttrib(ctx->YOUT2, install("troot"), TROOT);
+        setAttrib(ctx->YOUT2, install("nroot"), NROOT);
+        setAttrib(ctx->YOUT2, install("valroot"), VROOT);
+        setAttrib(ctx->YOUT2, install("indroot"), ctx->IROOT);
       }
     }
     /*                       ####   termination   ####                            */
 
-    unlock_solver();
+    leave_context(ctx);
     UNPROTECT(nprot);
 
     if (istate > 0)
-      return(YOUT);
+      return(ctx->YOUT);
     else
-      return(YOUT2);
+      return(ctx->YOUT2);
 }
 
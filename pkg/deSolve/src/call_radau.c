@@ -22,17 +22,19 @@
    karline soetaert
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
-/* globals for radau */
+/* data of radau shared with the FORTRAN callbacks, in ctx->solver */
 
+typedef void C_root_func_type (int *, double *, double *,int *, double *);
+
+typedef struct radau_data {
   int    maxt, it, nout, isDll, ntot;
   double *xdytmp, *ytmp, *tt, *rwork, *root, *oldroot;
   int    *iwork, *jroot;
   int    iroot, nroot, nr_root, islag, isroot, isEvent, endsim;
   double tin, tprevroot;
-
-  typedef void C_root_func_type (int *, double *, double *,int *, double *);
-  C_root_func_type      *root_func = NULL;
+  C_root_func_type      *root_func;
   C_deriv_func_type     *deriv_func;
+} radau_data;
 
 /* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
  definition of the calls to the FORTRAN subroutines in file radau.f           */
@@ -62,8 +64,9 @@ values of the forcing functions                                               */
 static void C_deriv_func_forc_rad (int *neq, double *t, double *y,
                          double *ydot, double *yout, int *iout)
 {
-  updatedeforc(t);
-  DLL_deriv_func(neq, t, y, ydot, yout, iout);
+  deSolve_context *ctx = desolve_ctx;
+  updatedeforc(ctx, t);
+  ctx->DLL_deriv_func(neq, t, y, ydot, yout, iout);
 }
 
 /* Fortran code calls C_deriv_func_rad(N, t, y, ydot, yout, iout)
@@ -72,18 +75,20 @@ static void C_deriv_func_forc_rad (int *neq, double *t, double *y,
 static void C_deriv_func_rad (int *neq, double *t, double *y,
                           double *ydot, double *yout, int *iout)
 {
+  deSolve_context *ctx = desolve_ctx;
   int i;
-  SEXP R_fcall, Time, ans;
+  SEXP R_fcall, ans, Y;
 
+  R_fcall = ctx_lang(ctx, CALL_DERIV, ctx->R_deriv_func, "dd", 1, *neq);
+  REAL(call_arg(R_fcall, 1))[0] = *t;
+  Y = call_arg(R_fcall, 2);
   for (i = 0; i < *neq; i++)  REAL(Y)[i] = y[i];
 
-  PROTECT(Time = ScalarReal(*t));
-  PROTECT(R_fcall = lang3(R_deriv_func,Time,Y));
-  PROTECT(ans = eval(R_fcall, R_envir));
+  PROTECT(ans = ctx_eval(ctx, R_fcall, ctx->R_envir));
 
   for (i = 0; i < *neq; i++)   ydot[i] = REAL(ans)[i];
 
-  UNPROTECT(3);
+  UNPROTECT(1);
 }
 
 /* mass matrix function                                                       */
@@ -91,20 +96,18 @@ static void C_deriv_func_rad (int *neq, double *t, double *y,
 static void C_mas_func_rad (int *neq, double *am, int *lmas,
                              double *yout, int *iout)
 {
+  deSolve_context *ctx = desolve_ctx;
   int i;
-  SEXP NEQ, LM, R_fcall, ans;
+  SEXP R_fcall, ans;
 
-  PROTECT(NEQ = NEW_INTEGER(1));
-  PROTECT(LM = NEW_INTEGER(1));
-
-  INTEGER(NEQ)[0] = *neq;
-  INTEGER(LM) [0] = *lmas;
-  PROTECT(R_fcall = lang3(R_mas_func,NEQ,LM));
-  PROTECT(ans = eval(R_fcall, R_envir));
+  R_fcall = ctx_lang(ctx, CALL_MAS, ctx->R_mas_func, "ii", 1, 1);
+  INTEGER(call_arg(R_fcall, 1))[0] = *neq;
+  INTEGER(call_arg(R_fcall, 2))[0] = *lmas;
+  PROTECT(ans = ctx_eval(ctx, R_fcall, ctx->R_envir));
 
   for (i = 0; i <*lmas * *neq; i++)   am[i] = REAL(ans)[i];
 
-  UNPROTECT(4);
+  UNPROTECT(1);
 }
 
 /* deriv output function - for ordinary output variables                      */
@@ -112,38 +115,42 @@ static void C_mas_func_rad (int *neq, double *am, int *lmas,
 static void C_deriv_out_rad (int *nOut, double *t, double *y,
                        double *ydot, double *yout)
 {
+  deSolve_context *ctx = desolve_ctx;
   int i;
-  SEXP R_fcall, Time, ans;
+  SEXP R_fcall, ans, Y;
 
-  for (i = 0; i < n_eq; i++)
+  R_fcall = ctx_lang(ctx, CALL_DERIV, ctx->R_deriv_func, "dd", 1, ctx->n_eq);
+  REAL(call_arg(R_fcall, 1))[0] = *t;
+  Y = call_arg(R_fcall, 2);
+  for (i = 0; i < ctx->n_eq; i++)
       REAL(Y)[i] = y[i];
 
-  PROTECT(Time = ScalarReal(*t));
-  PROTECT(R_fcall = lang3(R_deriv_func,Time, Y));
-  PROTECT(ans = eval(R_fcall, R_envir));
+  PROTECT(ans = ctx_eval(ctx, R_fcall, ctx->R_envir));
 
-  for (i = 0; i < *nOut; i++) yout[i] = REAL(ans)[i + n_eq];
+  for (i = 0; i < *nOut; i++) yout[i] = REAL(ans)[i + ctx->n_eq];
 
-  UNPROTECT(3);
+  UNPROTECT(1);
 }
 
 /* save output in R-variables                                                 */
 
 static void saveOut (double t, double *y) {
+  deSolve_context *ctx = desolve_ctx;
+  radau_data *rad = (radau_data *) ctx->solver;
   int j;
 
-    REAL(YOUT)[(it)*(ntot+1)] = t;
-	  for (j = 0; j < n_eq; j++)
-	    REAL(YOUT)[(it)*(ntot + 1) + j + 1] = y[j];
+    REAL(ctx->YOUT)[(rad->it)*(rad->ntot+1)] = t;
+	  for (j = 0; j < ctx->n_eq; j++)
+	    REAL(ctx->YOUT)[(rad->it)*(rad->ntot + 1) + j + 1] = y[j];
 
     /* if ordinary output variables: call function again */
-    if (nout>0)   {
-      if (isDll == 1)   /* output function in DLL */
-        deriv_func (&n_eq, &t, y, xdytmp, out, ipar) ;
+    if (rad->nout>0)   {
+      if (rad->isDll == 1)   /* output function in DLL */
+        rad->deriv_func (&ctx->n_eq, &t, y, rad->xdytmp, ctx->out, ctx->ipar) ;
       else
-        C_deriv_out_rad(&nout, &t, y, xdytmp, out);
-      for (j = 0; j < nout; j++)
-        REAL(YOUT)[(it)*(ntot + 1) + j + n_eq + 1] = out[j];
+        C_deriv_out_rad(&rad->nout, &t, y, rad->xdytmp, ctx->out);
+      for (j = 0; j < rad->nout; j++)
+        REAL(ctx->YOUT)[(rad->it)*(rad->ntot + 1) + j + ctx->n_eq + 1] = ctx->out[j];
     }
 }
 
@@ -151,44 +158,50 @@ static void saveOut (double t, double *y) {
 
 static void C_saveLag(int ini, double *t, double *y, double *con, int *lrc,
                       double *rpar, int *ipar) {
+  deSolve_context *ctx = desolve_ctx;
+  radau_data *rad = (radau_data *) ctx->solver;
    /* estimate dy (xdytmp) */
-   if (isDll == 1)
-      deriv_func (&n_eq, t, y, xdytmp, rpar, ipar) ;
+   if (rad->isDll == 1)
+      rad->deriv_func (&ctx->n_eq, t, y, rad->xdytmp, rpar, ipar) ;
    else
-      C_deriv_func_rad (&n_eq, t, y, xdytmp, rpar, ipar) ;
+      C_deriv_func_rad (&ctx->n_eq, t, y, rad->xdytmp, rpar, ipar) ;
 
    if (ini == 1)
-    updatehistini(*t, y, xdytmp, rpar, ipar);
+    updatehistini(ctx, *t, y, rad->xdytmp, rpar, ipar);
    else
-    updatehist(*t, y, xdytmp, con, lrc);
+    updatehist(ctx, *t, y, rad->xdytmp, con, lrc);
 }
 
 /* root function                                                              */
 
 static void C_root_radau (int *neq, double *t, double *y, int *ng, double *gout)
 {
+  deSolve_context *ctx = desolve_ctx;
   int i;
-  SEXP R_fcall, Time, ans;
+  SEXP R_fcall, ans, Y;
 
+  R_fcall = ctx_lang(ctx, CALL_ROOT, ctx->R_root_func, "dd", 1, *neq);
+  REAL(call_arg(R_fcall, 1))[0] = *t;
+  Y = call_arg(R_fcall, 2);
   for (i = 0; i < *neq; i++)  REAL(Y)[i] = y[i];
 
-  PROTECT(Time = ScalarReal(*t));
-  PROTECT(R_fcall = lang3(R_root_func,Time,Y));
-  PROTECT(ans = eval(R_fcall, R_envir));
+  PROTECT(ans = ctx_eval(ctx, R_fcall, ctx->R_envir));
 
   for (i = 0; i < *ng; i++)   gout[i] = REAL(ans)[i];
 
-  UNPROTECT(3);
+  UNPROTECT(1);
 }
 /* function for brent's root finding algorithm                                */
 
 double f (double t, double *Con, int *Lrc) {
-   F77_CALL(contr5) (&n_eq, &t, Con, Lrc, ytmp);    /* ytmp = value of y at t */
-   if (isDll == 1)
-     root_func (&n_eq, &t, ytmp, &nroot, root);    /* root at t, ytmp */
+  deSolve_context *ctx = desolve_ctx;
+  radau_data *rad = (radau_data *) ctx->solver;
+   F77_CALL(contr5) (&ctx->n_eq, &t, Con, Lrc, rad->ytmp);    /* ytmp = value of y at t */
+   if (rad->isDll == 1)
+     rad->root_func (&ctx->n_eq, &t, rad->ytmp, &rad->nroot, rad->root);    /* root at t, ytmp */
    else
-     C_root_radau (&n_eq, &t, ytmp, &nroot, root);
-   return root[iroot] ;
+     C_root_radau (&ctx->n_eq, &t, rad->ytmp, &rad->nroot, rad->root);
+   return rad->root[rad->iroot] ;
 }
 
 /* function called by Fortran to check for output, lags, events, roots        */
@@ -198,6 +211,8 @@ static void C_soloutrad(int * nr, double * told, double * t, double * y,
   int * irtrn, double * xout)
 
 {
+  deSolve_context *ctx = desolve_ctx;
+  radau_data *rad = (radau_data *) ctx->solver;
   int i, j;
   int istate, iterm;
   double tr, tmin;
@@ -208,80 +223,80 @@ static void C_soloutrad(int * nr, double * told, double * t, double * y,
                       double, int);
 
   if (*told == *t) return;
-  timesteps[0] = *told-*t;
-  timesteps[1] = *told-*t;
+  ctx->timesteps[0] = *told-*t;
+  ctx->timesteps[1] = *told-*t;
 
-  if (islag == 1) C_saveLag(0, t, y, con, lrc, rpar, ipar);
+  if (rad->islag == 1) C_saveLag(0, t, y, con, lrc, rpar, ipar);
   *irtrn = 0;
 
-  if (isEvent && ! rootevent) {
-    if (*told <= tEvent && tEvent < *t) {
-      tin = tEvent;
-      F77_CALL(contr5) (&n_eq, &tEvent, con, lrc, y);
-      updateevent(&tin, y, &istate);
+  if (rad->isEvent && ! ctx->rootevent) {
+    if (*told <= ctx->tEvent && ctx->tEvent < *t) {
+      rad->tin = ctx->tEvent;
+      F77_CALL(contr5) (&ctx->n_eq, &ctx->tEvent, con, lrc, y);
+      updateevent(ctx, &rad->tin, y, &istate);
       *irtrn = -1;
     }
   }
   tmin = *t;
-  iroot = -1;
-  if (isroot & (fabs(*t - tprevroot) > tol)) {
-    if (isDll == 1)
-     root_func (&n_eq, t, y, &nroot, root);    /* root at t, ytmp */
+  rad->iroot = -1;
+  if (rad->isroot & (fabs(*t - rad->tprevroot) > tol)) {
+    if (rad->isDll == 1)
+     rad->root_func (&ctx->n_eq, t, y, &rad->nroot, rad->root);    /* root at t, ytmp */
     else
-     C_root_radau (&n_eq, t, y, &nroot, root);
+     C_root_radau (&ctx->n_eq, t, y, &rad->nroot, rad->root);
 
-    for (i = 0; i < nroot; i++)
-     if (fabs(root[i]) <  tol) {
-       iroot = i;
-       jroot[i] = 1;
+    for (i = 0; i < rad->nroot; i++)
+     if (fabs(rad->root[i]) <  tol) {
+       rad->iroot = i;
+       rad->jroot[i] = 1;
        *irtrn = -1;
-       endsim = 1;
-       tprevroot = *t;
-     } else if (fabs(oldroot[i]) >= tol && root[i] * oldroot[i] < 0) {
-       iroot = i;
-       jroot[i] = 1;
-       tr = brent(*told, *t, oldroot[i], root[i], f, con, lrc, tol, maxit);
-       if (fabs(tprevroot - tr) > tol) {
-       F77_CALL(contr5) (&n_eq, &tr, con, lrc, ytmp);
+       rad->endsim = 1;
+       rad->tprevroot = *t;
+     } else if (fabs(rad->oldroot[i]) >= tol && rad->root[i] * rad->oldroot[i] < 0) {
+       rad->iroot = i;
+       rad->jroot[i] = 1;
+       tr = brent(*told, *t, rad->oldroot[i], rad->root[i], f, con, lrc, tol, maxit);
+       if (fabs(rad->tprevroot - tr) > tol) {
+       F77_CALL(contr5) (&ctx->n_eq, &tr, con, lrc, rad->ytmp);
        *irtrn = -1;
-        endsim = 1;
+        rad->endsim = 1;
         if (tr < tmin) {
           tmin = tr;
-          tprevroot = tmin;
-          for (j = 0; j < n_eq; j++) y[j] = ytmp[j];
+          rad->tprevroot = tmin;
+          for (j = 0; j < ctx->n_eq; j++) y[j] = rad->ytmp[j];
         }
        }
-     } else jroot[i] = 0;
-    for (i = 0; i < nroot; i++) oldroot[i] = root[i];
+     } else rad->jroot[i] = 0;
+    for (i = 0; i < rad->nroot; i++) rad->oldroot[i] = rad->root[i];
   }
 
-  while (*told <= tt[it] && tt[it] < tmin) {
-    F77_CALL(contr5) (neq, &tt[it], con, lrc, ytmp);
-    saveOut(tt[it], ytmp);
-    it++;
-    if ( it >= maxt) break;
+  while (*told <= rad->tt[rad->it] && rad->tt[rad->it] < tmin) {
+    F77_CALL(contr5) (neq, &rad->tt[rad->it], con, lrc, rad->ytmp);
+    saveOut(rad->tt[rad->it], rad->ytmp);
+    rad->it++;
+    if ( rad->it >= rad->maxt) break;
   }
-   if ((*irtrn == -1) && rootevent) {
+   if ((*irtrn == -1) && ctx->rootevent) {
      *t = tmin;
-     tin = *t;
-     tEvent = tin;
-     if (nr_root < Rootsave) {
-       troot[nr_root] = tin;
-       for (j = 0; j < nroot; j++)
-         if (jroot[j] == 1) nrroot[nr_root] = j+1;
-       for (j = 0; j < n_eq; j++)
-         valroot[nr_root* n_eq + j] = y[j];
+     rad->tin = *t;
+     ctx->tEvent = rad->tin;
+     if (rad->nr_root < ctx->Rootsave) {
+       ctx->troot[rad->nr_root] = rad->tin;
+       for (j = 0; j < rad->nroot; j++)
+         if (rad->jroot[j] == 1) ctx->nrroot[rad->nr_root] = j+1;
+       for (j = 0; j < ctx->n_eq; j++)
+         ctx->valroot[rad->nr_root* ctx->n_eq + j] = y[j];
      }
      iterm = 0;      /* check if simulation should be terminated */
-     for (j = 0; j < nroot; j++)
-       if (jroot[j] == 1 && termroot[j] == 1) iterm = 1;
+     for (j = 0; j < rad->nroot; j++)
+       if (rad->jroot[j] == 1 && ctx->termroot[j] == 1) iterm = 1;
 
      if (iterm == 0) {
-       nr_root++;
-       updateevent(&tin, y, &istate);
-       endsim = 0;
+       rad->nr_root++;
+       updateevent(ctx, &rad->tin, y, &istate);
+       rad->endsim = 0;
      } else {
-       endsim = 1;
+       rad->endsim = 1;
      }
    }
 }
@@ -291,18 +306,20 @@ static void C_soloutrad(int * nr, double * told, double * t, double * y,
 static void C_jac_func_rad(int *neq, double *t, double *y, int *ml,
 		    int *mu, double *pd, int *nrowpd, double *yout, int *iout)
 {
+  deSolve_context *ctx = desolve_ctx;
   int i;
-  SEXP R_fcall, Time, ans;
+  SEXP R_fcall, ans, Y;
 
+  R_fcall = ctx_lang(ctx, CALL_JAC, ctx->R_jac_func, "dd", 1, *neq);
+  REAL(call_arg(R_fcall, 1))[0] = *t;
+  Y = call_arg(R_fcall, 2);
   for (i = 0; i < *neq; i++) REAL(Y)[i] = y[i];
 
-  PROTECT(Time = ScalarReal(*t));
-  PROTECT(R_fcall = lang3(R_jac_func,Time,Y));
-  PROTECT(ans = eval(R_fcall, R_envir));
+  PROTECT(ans = ctx_eval(ctx, R_fcall, ctx->R_envir));
 
   for (i = 0; i < *neq * *nrowpd; i++)  pd[i] = REAL(ans)[i];
 
-  UNPROTECT(3);
+  UNPROTECT(1);
 }
 
 /* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
@@ -341,6 +358,8 @@ SEXP call_radau(SEXP y, SEXP times, SEXP derivfunc, SEXP masfunc, SEXP jacfunc,
   int nprot = 0;
 
   SEXP TROOT, NROOT, VROOT, IROOT;
+  deSolve_context solver_ctx, *ctx = &solver_ctx;
+  radau_data rad_data, *rad = &rad_data;
 
   /* pointers to functions passed to FORTRAN */
   C_solout_type         *solout = NULL;
@@ -352,17 +371,20 @@ SEXP call_radau(SEXP y, SEXP times, SEXP derivfunc, SEXP masfunc, SEXP jacfunc,
 /******************************************************************************/
 /*                      #### initialisation ####                              */
 
-  lock_solver(); /* prevent nested call of solvers that have global variables */
+  init_context(ctx);
+  memset(rad, 0, sizeof(radau_data));
+  ctx->solver = rad;
+  enter_context(ctx);  /* nested calls of solvers are possible */
 
-  n_eq = LENGTH(y);             /* number of equations */
+  ctx->n_eq = LENGTH(y);             /* number of equations */
   nt   = LENGTH(times);         /* number of output times */
-  maxt = nt;
-  nroot  = INTEGER(nRoot)[0];   /* number of roots  */
-  isroot = 0; nr_root = 0;
-  if (nroot > 0) isroot = 1;
+  rad->maxt = nt;
+  rad->nroot  = INTEGER(nRoot)[0];   /* number of roots  */
+  rad->isroot = 0; rad->nr_root = 0;
+  if (rad->nroot > 0) rad->isroot = 1;
 
-  tt = (double *) R_alloc(nt, sizeof(double));
-  for (j = 0; j < nt; j++) tt[j] = REAL(times)[j];
+  rad->tt = (double *) R_alloc(nt, sizeof(double));
+  for (j = 0; j < nt; j++) rad->tt[j] = REAL(times)[j];
 
   ijac  = INTEGER(Nrjac)[0];
   mljac = INTEGER(Nrjac)[1];
@@ -371,16 +393,16 @@ SEXP call_radau(SEXP y, SEXP times, SEXP derivfunc, SEXP masfunc, SEXP jacfunc,
   mlmas = INTEGER(Nrmas)[1];
   mumas = INTEGER(Nrmas)[2];
   /* is function a dll ?*/
-  isDll = inherits(derivfunc, "NativeSymbol");
+  rad->isDll = inherits(derivfunc, "NativeSymbol");
 
   /* initialise output ... */
-  initOutC(isDll, &nout, &ntot, n_eq, nOut, Rpar, Ipar);
+  initOutC(ctx, rad->isDll, &rad->nout, &rad->ntot, ctx->n_eq, nOut, Rpar, Ipar);
 
   /* copies of variables that will be changed in the FORTRAN subroutine */
-  xytmp = (double *) R_alloc(n_eq, sizeof(double));
-  for (j = 0; j < n_eq; j++) xytmp[j] = REAL(y)[j];
+  xytmp = (double *) R_alloc(ctx->n_eq, sizeof(double));
+  for (j = 0; j < ctx->n_eq; j++) xytmp[j] = REAL(y)[j];
 
-  ytmp = (double *) R_alloc(n_eq, sizeof(double));
+  rad->ytmp = (double *) R_alloc(ctx->n_eq, sizeof(double));
 
   latol = LENGTH(atol);
   Atol = (double *) R_alloc((int) latol, sizeof(double));
@@ -398,74 +420,83 @@ SEXP call_radau(SEXP y, SEXP times, SEXP derivfunc, SEXP masfunc, SEXP jacfunc,
 
   /* work vectors */
   liw = INTEGER (lIw)[0];
-  iwork = (int *) R_alloc(liw, sizeof(int));
-  for (j=0; j<LENGTH(iWork); j++) iwork[j] = INTEGER(iWork)[j];
-  for (j=LENGTH(iWork); j<liw; j++) iwork[j] = 0;
+  rad->iwork = (int *) R_alloc(liw, sizeof(int));
+  for (j=0; j<LENGTH(iWork); j++) rad->iwork[j] = INTEGER(iWork)[j];
+  for (j=LENGTH(iWork); j<liw; j++) rad->iwork[j] = 0;
 
   lrw = INTEGER(lRw)[0];
-  rwork = (double *) R_alloc(lrw, sizeof(double));
-  for (j=0; j<length(rWork); j++) rwork[j] = REAL(rWork)[j];
-  for (j=length(rWork); j<lrw; j++) rwork[j] = 0.;
+  rad->rwork = (double *) R_alloc(lrw, sizeof(double));
+  for (j=0; j<length(rWork); j++) rad->rwork[j] = REAL(rWork)[j];
+  for (j=length(rWork); j<lrw; j++) rad->rwork[j] = 0.;
 
   /* initialise global R-variables...  */
   //initglobals (nt, ntot);
-  PROTECT(Y = allocVector(REALSXP, (n_eq))); nprot++;
-  PROTECT(YOUT = allocMatrix(REALSXP, ntot+1, nt)); nprot++;
+  PROTECT(ctx->Rcalls = allocVector(VECSXP, NRCALLS)); nprot++;
+  PROTECT(ctx->YOUT = allocMatrix(REALSXP, rad->ntot+1, nt)); nprot++;
 
   //timesteps = (double *) R_alloc(2, sizeof(double));
-  for (j=0; j<2; j++) timesteps[j] = 0.;
+  for (j=0; j<2; j++) ctx->timesteps[j] = 0.;
 
   /* Initialization of Parameters, Forcings (DLL), lags */
   //initParms(initfunc, parms);
   if (initfunc != NA_STRING) {
     if (inherits(initfunc, "NativeSymbol")) {
       init_func_type *initializer;
-      PROTECT(de_gparms = parms); nprot++;
+      PROTECT(ctx->de_gparms = parms); nprot++;
       initializer = (init_func_type *) R_ExternalPtrAddrFn_(initfunc);
       initializer(Initdeparms);
     }
   }
   // end inline initParms
 
-  isForcing = initForcings(flist);
-  isEvent = initEvents(elist, eventfunc, nroot);
-  islag = initLags(elag, 10, nroot);
+  isForcing = initForcings(ctx, flist);
+  rad->isEvent = initEvents(ctx, elist, eventfunc, rad->nroot);
+  rad->islag = initLags(ctx, elag, 10, rad->nroot);
 
-  if (nout > 0 || islag) {
-     xdytmp= (double *) R_alloc(n_eq, sizeof(double));
-     for (j = 0; j < n_eq; j++) xdytmp[j] = 0.;
+  if (rad->nout > 0 || rad->islag) {
+     rad->xdytmp= (double *) R_alloc(ctx->n_eq, sizeof(double));
+     for (j = 0; j < ctx->n_eq; j++) rad->xdytmp[j] = 0.;
   }
 
  /* pointers to functions deriv_func, jac_func, passed to FORTRAN */
-  if (isDll)  { /* DLL address passed to FORTRAN */
-      deriv_func = (C_deriv_func_type *) R_ExternalPtrAddrFn_(derivfunc);
+  if (rad->isDll)  { /* DLL address passed to FORTRAN */
+      rad->deriv_func = (C_deriv_func_type *) R_ExternalPtrAddrFn_(derivfunc);
 
  	   /* overruling deriv_func if forcing */
       if (isForcing) {
-        DLL_deriv_func = deriv_func;
-        deriv_func = (C_deriv_func_type *) C_deriv_func_forc_rad;
+        ctx->DLL_deriv_func = rad->deriv_func;
+        rad->deriv_func = (C_deriv_func_type *) C_deriv_func_forc_rad;
       }
   } else {
       /* interface function between FORTRAN and C/R passed to FORTRAN */
-      deriv_func = (C_deriv_func_type *) C_deriv_func_rad;
+      rad->deriv_func = (C_deriv_func_type *) C_deriv_func_rad;
       /* needed to communicate with R */
-      R_deriv_func = derivfunc;
+      ctx->R_deriv_func = derivfunc;
   }
-  R_envir = rho;           /* karline: this to allow merging compiled and R-code (e.g. events)*/
-
-  if (!isNull(jacfunc))   {
-      if (isDll)
+  ctx->R_envir = rho;           /* karline: this to allow merging compiled and R-code (e.g. events)*/
+
+  if (inherits(jacfunc, "deSolve.sparsity")) {
+      /* internal Jacobian, grouped columns of a known sparsity pattern */
+      initGroups(ctx, jacfunc, rad->deriv_func, mljac < ctx->n_eq);
+      if (rad->iwork[10] != 0) {
+        /* jactype "sparseint": sparse LU decomposition (sparselu.c) */
+        initSparseLU(ctx);
+        jac_func = cpr_spjac;
+      } else
+        jac_func = cpr_jac;
+  } else if (!isNull(jacfunc))   {
+      if (rad->isDll)
 	      jac_func = (C_jac_func_type_rad *) R_ExternalPtrAddrFn_(jacfunc);
 	    else  {
-	      R_jac_func = jacfunc;
+	      ctx->R_jac_func = jacfunc;
 	      jac_func= C_jac_func_rad;
 	    }
     }
   if (!isNull(masfunc))   {
-	   R_mas_func = masfunc;
+	   ctx->R_mas_func = masfunc;
 	   mas_func= C_mas_func_rad;
-     if (isDll)
-       R_envir = rho;
+     if (rad->isDll)
+       ctx->R_envir = rho;
 
   }
 
@@ -475,43 +506,43 @@ SEXP call_radau(SEXP y, SEXP times, SEXP derivfunc, SEXP masfunc, SEXP jacfunc,
   idid = 0;
 
 /*                   ####      integration     ####                           */
-  it   = 0;
-  tin  = REAL(times)[0];
+  rad->it   = 0;
+  rad->tin  = REAL(times)[0];
   tout = REAL(times)[nt-1];
-  saveOut (tin, xytmp);               /* save initial condition */
-  it++;
+  saveOut (rad->tin, xytmp);               /* save initial condition */
+  rad->it++;
 
-  if (nroot > 0)  {      /* also must find a root */
-    jroot = (int *) R_alloc(nroot, sizeof(int));
-    for (j = 0; j < nroot; j++) jroot[j] = 0;
+  if (rad->nroot > 0)  {      /* also must find a root */
+    rad->jroot = (int *) R_alloc(rad->nroot, sizeof(int));
+    for (j = 0; j < rad->nroot; j++) rad->jroot[j] = 0;
 
-    root = (double *) R_alloc(nroot, sizeof(double));
-    oldroot = (double *) R_alloc(nroot, sizeof(double));
+    rad->root = (double *) R_alloc(rad->nroot, sizeof(double));
+    rad->oldroot = (double *) R_alloc(rad->nroot, sizeof(double));
 
-    if (isDll) {
-      root_func = (C_root_func_type *) R_ExternalPtrAddrFn_(rootfunc);
+    if (rad->isDll) {
+      rad->root_func = (C_root_func_type *) R_ExternalPtrAddrFn_(rootfunc);
     } else {
-      root_func = (C_root_func_type *) C_root_radau;
-      R_root_func = rootfunc;
+      rad->root_func = (C_root_func_type *) C_root_radau;
+      ctx->R_root_func = rootfunc;
     }
 
     /* value of oldroot */
-    if (isDll == 1)
-      root_func (&n_eq, &tin, xytmp, &nroot, oldroot);    /* root at t, ytmp */
+    if (rad->isDll == 1)
+      rad->root_func (&ctx->n_eq, &rad->tin, xytmp, &rad->nroot, rad->oldroot);    /* root at t, ytmp */
     else
-      C_root_radau (&n_eq, &tin, xytmp, &nroot, oldroot);
+      C_root_radau (&ctx->n_eq, &rad->tin, xytmp, &rad->nroot, rad->oldroot);
 
-    tprevroot = tin; /* to make sure that roots are not too close */
+    rad->tprevroot = rad->tin; /* to make sure that roots are not too close */
   }
-  endsim = 0;
+  rad->endsim = 0;
   do {
-    if (islag == 1) C_saveLag(1, &tin, xytmp, out, ipar, out, ipar);
+    if (rad->islag == 1) C_saveLag(1, &rad->tin, xytmp, ctx->out, ctx->ipar, ctx->out, ctx->ipar);
 
-    F77_CALL(radau5) ( &n_eq, deriv_func, &tin, xytmp, &tout, &hini,
+    F77_CALL(radau5) ( &ctx->n_eq, rad->deriv_func, &rad->tin, xytmp, &tout, &hini,
 		     Rtol, Atol, &itol, jac_func, &ijac, &mljac, &mujac,
          mas_func, &imas, &mlmas, &mumas, solout, &iout,
-		     rwork, &lrw, iwork, &liw, out, ipar, &idid);
-	} while (tin < tout && idid >= 0 && endsim == 0);
+		     rad->rwork, &lrw, rad->iwork, &liw, ctx->out, ctx->ipar, &idid);
+	} while (rad->tin < tout && idid >= 0 && rad->endsim == 0);
 
   if (idid == -1)
      warning("input is not consistent");
@@ -523,68 +554,68 @@ SEXP call_radau(SEXP y, SEXP times, SEXP derivfunc, SEXP masfunc, SEXP jacfunc,
      warning("problem is probably stiff - interrupted");
 
 /*                   ####  an error occurred   ####                           */
-  if(it <= nt-1) saveOut (tin, xytmp);              /* save final condition */
+  if(rad->it <= nt-1) saveOut (rad->tin, xytmp);              /* save final condition */
   if (idid < 0) {
-    it = it-1;
-    PROTECT(YOUT2 = allocMatrix(REALSXP,ntot+1,(it+2))); nprot++;
-    returnearly (1, it, ntot);
+    rad->it = rad->it-1;
+    PROTECT(ctx->YOUT2 = allocMatrix(REALSXP,rad->ntot+1,(rad->it+2))); nprot++;
+    returnearly (ctx, 1, rad->it, rad->ntot);
   } else if (idid == 2) {
-    it = it-1;
-	PROTECT(YOUT2 = allocMatrix(REALSXP,ntot+1,(it+2))); nprot++;   
-    returnearly (0, it, ntot);
+    rad->it = rad->it-1;
+	PROTECT(ctx->YOUT2 = allocMatrix(REALSXP,rad->ntot+1,(rad->it+2))); nprot++;   
+    returnearly (ctx, 0, rad->it, rad->ntot);
     idid = -2;
   }
 /*                   ####   returning output   ####                           */
-  rwork[0] = hini;
-  rwork[1] = tin ;
+  rad->rwork[0] = hini;
+  rad->rwork[1] = rad->tin ;
 
-  PROTECT(ISTATE = allocVector(INTSXP, 7)); nprot++;
-  PROTECT(RWORK = allocVector(REALSXP, 5)); nprot++;
-  terminate(idid,iwork,7,13,rwork,5,0);
+  PROTECT(ctx->ISTATE = allocVector(INTSXP, 7)); nprot++;
+  PROTECT(ctx->RWORK = allocVector(REALSXP, 5)); nprot++;
+  terminate(ctx, idid,rad->iwork,7,13,rad->rwork,5,0);
 
-  if (iroot >= 0 || nr_root > 0)  {
-    PROTECT(IROOT = allocVector(INTSXP, nroot)); nprot++;
-    for (j = 0; j < nroot; j++) INTEGER(IROOT)[j] = jroot[j];
+  if (rad->iroot >= 0 || rad->nr_root > 0)  {
+    PROTECT(IROOT = allocVector(INTSXP, rad->nroot)); nprot++;
+    for (j = 0; j < rad->nroot; j++) INTEGER(IROOT)[j] = rad->jroot[j];
     PROTECT(NROOT = allocVector(INTSXP, 1)); nprot++;
-    INTEGER(NROOT)[0] = nr_root;
+    INTEGER(NROOT)[0] = rad->nr_root;
 
-    if (nr_root == 0) {
+    if (rad->nr_root == 0) {
       PROTECT(TROOT = allocVector(REALSXP, 1)); nprot++;
-      REAL(TROOT)[0] = tin;
+      REAL(TROOT)[0] = rad->tin;
     } else {
-      if (nr_root > Rootsave) nr_root = Rootsave;
+      if (rad->nr_root > ctx->Rootsave) rad->nr_root = ctx->Rootsave;
 
-      PROTECT(TROOT = allocVector(REALSXP, nr_root)); nprot++;
-      for (j = 0; j < nr_root; j++) REAL(TROOT)[j] = troot[j];
+      PROTECT(TROOT = allocVector(REALSXP, rad->nr_root)); nprot++;
+      for (j = 0; j < rad->nr_root; j++) REAL(TROOT)[j] = ctx->troot[j];
 
-      PROTECT(VROOT = allocVector(REALSXP, nr_root*n_eq)); nprot++;
-      for (j = 0; j < nr_root*n_eq; j++) REAL(VROOT)[j] = valroot[j];
+      PROTECT(VROOT = allocVector(REALSXP, rad->nr_root*ctx->n_eq)); nprot++;
+      for (j = 0; j < rad->nr_root*ctx->n_eq; j++) REAL(VROOT)[j] = ctx->valroot[j];
 
-      PROTECT(IROOT = allocVector(INTSXP, nr_root)); nprot++;
-      for (j = 0; j < nr_root; j++) INTEGER(IROOT)[j] = nrroot[j];
+      PROTECT(IROOT = allocVector(INTSXP, rad->nr_root)); nprot++;
+      for (j = 0; j < rad->nr_root; j++) INTEGER(IROOT)[j] = ctx->nrroot[j];
 
       if (idid == 1) {
-        setAttrib(YOUT, install("valroot"), VROOT);
-        setAttrib(YOUT, install("indroot"), IROOT);
+        setAttrib(ctx->YOUT, install("valroot"), VROOT);
+        setAttrib(ctx->YOUT, install("indroot"), IROOT);
       }
       else  {
-        setAttrib(YOUT2, install("valroot"), VROOT);
-        setAttrib(YOUT2, install("indroot"), IROOT);
+        setAttrib(ctx->YOUT2, install("valroot"), VROOT);
+        setAttrib(ctx->YOUT2, install("indroot"), IROOT);
       }
     }
 
     if (idid == 1 ) {
-      setAttrib(YOUT, install("troot"), TROOT);
-      setAttrib(YOUT, install("nroot"), NROOT);
+      setAttrib(ctx->YOUT, install("troot"), TROOT);
+      setAttrib(ctx->YOUT, install("nroot"), NROOT);
     } else  {
-      setAttrib(YOUT2, install("iroot"), IROOT);
-      setAttrib(YOUT2, install("troot"), TROOT);
-      setAttrib(YOUT2, install("nroot"), NROOT);
+      setAttrib(ctx->YOUT2, install("iroot"), IROOT);
+      setAttrib(ctx->YOUT2, install("troot"), TROOT);
+      setAttrib(ctx->YOUT2, install("nroot"), NROOT);
     }
   }
 
 /*                   ####     termination      ####                           */
-  unlock_solver();
+  leave_context(ctx);
   UNPROTECT(nprot);
   						
 // thpe: after reworking PROTECT/UNPROTECT, I checked how YOUT, YOUT2 is handled
@@ -600,8 +631,8 @@ SEXP call_radau(SEXP y, SEXP times, SEXP derivfunc, SEXP masfunc, SEXP jacfunc,
 
 // thpe: test version (currently disabled)
   if (idid > 0)
-    return(YOUT);
+    return(ctx->YOUT);
   else
-    return(YOUT2);	
+    return(ctx->YOUT2);	
 }
 
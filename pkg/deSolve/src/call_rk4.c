@@ -13,6 +13,7 @@ SEXP call_rk4(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
 
   /*  Initialization */
   int nprot = 0;
+  deSolve_context solver_ctx, *ctx = &solver_ctx;
 
   double *tt = NULL, *xs = NULL;
   double *tmp, *FF, *out;
@@ -44,10 +45,16 @@ SEXP call_rk4(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
   int nout    = INTEGER(Nout)[0]; /* n of global outputs if func is in a DLL */
   int verbose = INTEGER(Verbose)[0];
 
+  /*------------------------------------------------------------------------*/
+  /* solver context; timesteps, outputs, forcings and events are kept here  */
+  /*------------------------------------------------------------------------*/
+  init_context(ctx);
+  enter_context(ctx);  /* nested calls of solvers are possible */
+
   /*------------------------------------------------------------------------*/
   /* timesteps (for advection computation in ReacTran)                      */
   /*------------------------------------------------------------------------*/
-  for (i = 0; i < 2; i++) timesteps[i] = 0;
+  for (i = 0; i < 2; i++) ctx->timesteps[i] = 0;
 
   /*------------------------------------------------------------------------*/
   /* DLL, ipar, rpar (for compatibility with lsoda)                         */
@@ -58,13 +65,13 @@ SEXP call_rk4(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
 
   if (inherits(Func, "NativeSymbol")) { /* function is a dll */
     isDll = TRUE;
-    if (nout > 0) isOut = TRUE;
+    if (nout > 0) ctx->isOut = TRUE;
     lrpar = nout + LENGTH(Rpar);  /* length of rpar; LENGTH(Rpar) is always >0 */
     lipar = 3    + LENGTH(Ipar);  /* length of ipar */
 
   } else {                        /* function is not a dll */
     isDll = FALSE;
-    isOut = FALSE;
+    ctx->isOut = FALSE;
     lipar = 3;                    /* in lsoda = 1; */
     lrpar = nout;                 /* in lsoda = 1; */
   }
@@ -93,6 +100,7 @@ SEXP call_rk4(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
   PROTECT(R_f2 = allocVector(REALSXP, neq)); nprot++;
   PROTECT(R_f3 = allocVector(REALSXP, neq)); nprot++;
   PROTECT(R_f4 = allocVector(REALSXP, neq)); nprot++;
+  PROTECT(ctx->Rcalls = allocVector(VECSXP, NRCALLS)); nprot++;
   y0 = REAL(R_y0);
   f  = REAL(R_f);
   y  = REAL(R_y);
@@ -119,13 +127,13 @@ SEXP call_rk4(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
   if (Initfunc != NA_STRING) {
     if (inherits(Initfunc, "NativeSymbol")) {
       init_func_type *initializer;
-      PROTECT(de_gparms = Parms); nprot++;
+      PROTECT(ctx->de_gparms = Parms); nprot++;
       initializer = (init_func_type *) R_ExternalPtrAddrFn_(Initfunc);
       initializer(Initdeparms);
     }
   }
 
-  isForcing = initForcings(Flist);
+  isForcing = initForcings(ctx, Flist);
 
   /*------------------------------------------------------------------------*/
   /* Initialization of Integration Loop                                     */
@@ -141,27 +149,27 @@ SEXP call_rk4(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
   for (it = 0; it < nt - 1; it++) {
     t = tt[it];
     dt = tt[it + 1] - t;
-    timesteps[0] = timesteps[1];
-    timesteps[1] = dt;
+    ctx->timesteps[0] = ctx->timesteps[1];
+    ctx->timesteps[1] = dt;
 
     if (verbose)
       Rprintf("Time steps = %d / %d time = %e\n", it + 1, nt, t);
-    derivs(Func, t, y0, Parms, Rho, f1, out, 0, neq, ipar, isDll, isForcing);
+    derivs(ctx, Func, t, y0, Parms, Rho, f1, out, 0, neq, ipar, isDll, isForcing);
     for (i = 0; i < neq; i++) {
       f1[i] = dt * f1[i];
       f[i]  = y0[i] + 0.5 * f1[i];
     }
-    derivs(Func, t + 0.5*dt, f, Parms, Rho, f2, out, 0, neq, ipar, isDll, isForcing);
+    derivs(ctx, Func, t + 0.5*dt, f, Parms, Rho, f2, out, 0, neq, ipar, isDll, isForcing);
     for (i = 0; i < neq; i++) {
       f2[i] = dt * f2[i];
       f[i]  = y0[i] + 0.5 * f2[i];
     }
-    derivs(Func, t + 0.5*dt, f, Parms, Rho, f3, out, 0, neq, ipar, isDll, isForcing);
+    derivs(ctx, Func, t + 0.5*dt, f, Parms, Rho, f3, out, 0, neq, ipar, isDll, isForcing);
     for (i = 0; i < neq; i++) {
       f3[i] = dt * f3[i];
       f[i] = y0[i] + f3[i];
     }
-    derivs(Func, t + dt, f, Parms, Rho, f4, out, 0, neq, ipar, isDll, isForcing);
+    derivs(ctx, Func, t + dt, f, Parms, Rho, f4, out, 0, neq, ipar, isDll, isForcing);
     for (i = 0; i < neq; i++) {
       f4[i] = dt * f4[i];
     }
@@ -185,7 +193,7 @@ SEXP call_rk4(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
   for (int j = 0; j < nt; j++) {
     t = yout[j];
     for (i = 0; i < neq; i++) tmp[i] = yout[j + nt * (1 + i)];
-    derivs(Func, t, tmp, Parms, Rho, FF, out, -1, neq, ipar, isDll, isForcing);
+    derivs(ctx, Func, t, tmp, Parms, Rho, FF, out, -1, neq, ipar, isDll, isForcing);
     for (i = 0; i < nout; i++) {
       yout[j + nt * (1 + neq + i)] = out[i];
     }
@@ -194,8 +202,9 @@ SEXP call_rk4(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
   setIstate(R_yout, R_istate, istate, it, 4, 0, 4, 0);
 
   /* release R resources */
-  timesteps[0] = 0;
-  timesteps[1] = 0;
+  ctx->timesteps[0] = 0;
+  ctx->timesteps[1] = 0;
+  leave_context(ctx);
   UNPROTECT(nprot);
   return(R_yout);
 }
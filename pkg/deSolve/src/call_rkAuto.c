@@ -6,14 +6,53 @@
 #include "rk_util.h"
 #include "externalptr.h"
 
+/* outputs up to t with the knots collected since the last event, if they
+   are less than the nknots needed for the polynomial interpolation */
+static void flushknots(double *yknots, int iknots, int nknots, double t,
+                       double *tt, int nt, int *_it_ext, double *yout,
+                       double *tmp, int neq) {
+  int i, it_ext = *_it_ext;
+  double t_ext;
+
+  if (iknots >= nknots || iknots < 2) return;
+  t_ext = tt[it_ext];
+  while (t_ext <= t) {
+    lagrange(yknots, iknots, t_ext, tmp, neq);
+    yout[it_ext] = t_ext;
+    for (i = 0; i < neq; i++) yout[it_ext + nt * (1 + i)] = tmp[i];
+    if (it_ext < nt - 1) t_ext = tt[++it_ext]; else break;
+  }
+  *_it_ext = it_ext;
+}
+
+/* global outputs of nrow rows of yout (leading dimension ld) from an extra
+   call of derivs; rows with outputs captured during the steps are skipped;
+   j = -1 suppresses unnecessary internal copying */
+static void globalout(deSolve_context *ctx, SEXP Func, SEXP Parms, SEXP Rho,
+                      double *yout, int nrow, int ld, int neq, int nout,
+                      double *tmp, double *FF, double *out, int *ipar,
+                      int isDll, int isForcing, int skip) {
+  int i, j;
+
+  for (j = 0; j < nrow; j++) {
+    if (skip && !ISNA(yout[j + ld * (1 + neq)])) continue;
+    for (i = 0; i < neq; i++) tmp[i] = yout[j + ld * (1 + i)];
+    derivs(ctx, Func, yout[j], tmp, Parms, Rho, FF, out, -1, neq, ipar,
+           isDll, isForcing);
+    for (i = 0; i < nout; i++) yout[j + ld * (1 + neq + i)] = out[i];
+  }
+}
+
 SEXP call_rkAuto(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
   SEXP Parms, SEXP eventfunc, SEXP elist, SEXP Nout, SEXP Rho,
   SEXP Rtol, SEXP Atol, SEXP Tcrit, SEXP Verbose,
   SEXP Hmin, SEXP Hmax, SEXP Hini, SEXP Rpar, SEXP Ipar,
-  SEXP Method, SEXP Maxsteps, SEXP Flist) {
+  SEXP Method, SEXP Maxsteps, SEXP Flist, SEXP Rootfunc, SEXP nRoot,
+  SEXP Lags, SEXP Outinterp, SEXP Sink, SEXP Keep, SEXP Reduce) {
 
   /**  Initialization **/
   int nprot = 0;
+  deSolve_context solver_ctx, *ctx = &solver_ctx;
   double *tt = NULL, *xs = NULL;
 
   double *y,  *f,  *Fj, *tmp, *FF, *rr;
@@ -25,14 +64,16 @@ SEXP call_rkAuto(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
   SEXP R_FSAL, Alpha, Beta;
   int fsal = FALSE;       /* assume no FSAL */
 
-  /* Use polynomial interpolation if not disabled by the method
-     or when events come in to play (stop-and-go mode).
+  /* Use polynomial interpolation if not disabled by the method.
      Methods with dense output interpolate by default,
      all others do not. */
   int interpolate = TRUE;
 
   int i = 0, j = 0, it = 0, it_tot = 0, it_ext = 0, nt = 0, neq = 0, it_rej = 0;
-  int isForcing, isEvent;
+  int isForcing, isEvent, islag, nfev, nrow = 0;
+  rk_root *rt = NULL;
+  rk_outcap *oc = NULL;
+  out_sink *sk = NULL;
 
   /*------------------------------------------------------------------------*/
   /* Processing of Arguments                                                */
@@ -53,6 +94,7 @@ SEXP call_rkAuto(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
   int  maxsteps = INTEGER(Maxsteps)[0];
   int  nout     = INTEGER(Nout)[0]; /* number of global outputs is func is in a DLL */
   int  verbose  = INTEGER(Verbose)[0];
+  int  nroot    = INTEGER(nRoot)[0];  /* number of root functions */
 
   int stage     = (int)REAL(getListElement(Method, "stage"))[0];
 
@@ -99,10 +141,19 @@ SEXP call_rkAuto(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
   PROTECT(Xstart = AS_NUMERIC(Xstart)); nprot++;
   xs  = NUMERIC_POINTER(Xstart);
   neq = length(Xstart);
+  /*------------------------------------------------------------------------*/
+  /* solver context; timesteps, outputs, forcings and events are kept here  */
+  /*------------------------------------------------------------------------*/
+  init_context(ctx);
+  enter_context(ctx);  /* nested calls of solvers are possible */
+
+  /* specialized stage kernels if Method is one of the built-in tables */
+  ctx->solver = rk_findkernel(Method);
+
   /*------------------------------------------------------------------------*/
   /* timesteps (for advection computation in ReacTran)                      */
   /*------------------------------------------------------------------------*/
-  for (i = 0; i < 2; i++) timesteps[i] = 0;
+  for (i = 0; i < 2; i++) ctx->timesteps[i] = 0;
 
   /*------------------------------------------------------------------------*/
   /* DLL, ipar, rpar (for compatibility with lsoda)                         */
@@ -115,14 +166,14 @@ SEXP call_rkAuto(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
   if (inherits(Func, "NativeSymbol")) {
     /* function is a dll */
     isDll = TRUE;
-    if (nout > 0) isOut = TRUE;
+    if (nout > 0) ctx->isOut = TRUE;
     lrpar = nout + LENGTH(Rpar);  /* length of rpar; LENGTH(Rpar) is always >0 */
     lipar = 3    + LENGTH(Ipar);  /* length of ipar */
 
   } else {
     /* function is not a dll */
     isDll = FALSE;
-    isOut = FALSE;
+    ctx->isOut = FALSE;
     lipar = 3;    /* in lsoda = 1 */
     lrpar = nout; /* in lsoda = 1 */
   }
@@ -158,41 +209,50 @@ SEXP call_rkAuto(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
   FF  =  (double*) R_alloc(neq * stage, sizeof(double));
   rr  =  (double*) R_alloc(neq * 5, sizeof(double));
 
-  /* matrix for polynomial interpolation */
+  /* ring buffer of knots for polynomial interpolation */
   SEXP R_nknots;
   int nknots = 6;  /* 6 = 5th order polynomials by default*/
   int iknots = 0;  /* counter for knots buffer */
+  int ldknots = neq + 1;
   double *yknots;
 
   PROTECT(R_nknots = getListElement(Method, "nknots")); nprot++;
   if (length(R_nknots)) nknots = INTEGER(R_nknots)[0] + 1;
   if (nknots < 2) {nknots = 1; interpolate = FALSE;}
   if (densetype > 0) interpolate = TRUE;
-  yknots = (double*) R_alloc((neq + 1) * (nknots + 1), sizeof(double));
+  /* knots of the implicit method in stiff phases */
+  int nknotsi = (nknots < 2) ? 6 : nknots;
+  if (densetype == 3) {
+    /* Hermite dense output: degree 2 * nknots - 1 at least the order */
+    nknots  = (qerr + 2) / 2;
+    ldknots = 2 * neq + 1;
+  }
+  yknots = (double*) R_alloc(ldknots * (nknots + 1), sizeof(double));
 
-  /* matrix for holding states and global outputs */
-  PROTECT(R_yout = allocMatrix(REALSXP, nt, neq + nout + 1)); nprot++;
-  yout = REAL(R_yout);
-  /* initialize outputs with NA first */
-  for (i = 0; i < nt * (neq + nout + 1); i++) yout[i] = NA_REAL;
+  /* switching to an implicit method in stiff phases (rk_stiff.c) */
+  SEXP R_stiff;
+  PROTECT(R_stiff = getListElement(Method, "stiff")); nprot++;
+  if (length(R_stiff))
+    ctx->stiff = rk_stiffinit(R_stiff, neq, stage, A,
+                              (bb2 != NULL) ? bb2 : bb1, nknotsi);
 
   /* attribute that stores state information, similar to lsoda */
   SEXP R_istate;
   int *istate;
-  PROTECT(R_istate = allocVector(INTSXP, 22)); nprot++;
+  PROTECT(R_istate = allocVector(INTSXP, 23)); nprot++;
   istate = INTEGER(R_istate);
   istate[0] = 0; /* assume succesful return */
-  for (i = 0; i < 22; i++) istate[i] = 0;
+  for (i = 0; i < 23; i++) istate[i] = 0;
 
   /*------------------------------------------------------------------------*/
   /* Initialization of Parameters (for DLL functions)                       */
   /*------------------------------------------------------------------------*/
-  PROTECT(Y = allocVector(REALSXP,(neq))); nprot++;
+  PROTECT(ctx->Rcalls = allocVector(VECSXP, NRCALLS)); nprot++;
 
   if (Initfunc != NA_STRING) {
     if (inherits(Initfunc, "NativeSymbol")) {
       init_func_type *initializer;
-      PROTECT(de_gparms = Parms); nprot++;
+      PROTECT(ctx->de_gparms = Parms); nprot++;
       initializer = (init_func_type *) R_ExternalPtrAddrFn_(Initfunc);
       initializer(Initdeparms);
     }
@@ -200,24 +260,72 @@ SEXP call_rkAuto(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
 
 
   /* assign global variables of the event function */
-  n_eq = neq;
-  R_envir = Rho;
+  ctx->n_eq = neq;
+  ctx->R_envir = Rho;
+
+  isForcing = initForcings(ctx, Flist);
+  isEvent = initEvents(ctx, elist, eventfunc, nroot);
+
+  /* root finding (rk_root.c) */
+  if (nroot > 0) ctx->root = rt = rk_rootinit(ctx, Rootfunc, nroot, neq);
+
+  /* time lags: history of the accepted steps (lags.c) */
+  islag = initLags(ctx, Lags, 11, 0);
+
+  /* global outputs captured during the steps (rk_util.c) */
+  if (nout > 0 && LENGTH(Outinterp) > 0)
+    ctx->outcap = oc = rk_outinit(Outinterp, nout);
+
+  /* integrals, extremes and means over the accepted steps (rk_reduce.c);
+     reduced outputs are captured at the ends of the steps, but not
+     interpolated for the output times */
+  if (!isNull(Reduce)) {
+    ctx->reduce = rk_reduceinit(Reduce, neq);
+    if (nout > 0 && oc == NULL && ctx->reduce->needout) {
+      SEXP R_nointerp;
+      PROTECT(R_nointerp = ScalarInteger(FALSE)); nprot++;
+      ctx->outcap = oc = rk_outinit(R_nointerp, nout);
+    }
+  }
 
-  isForcing = initForcings(Flist);
-  isEvent = initEvents(elist, eventfunc, 0);
-  if (isEvent) interpolate = FALSE;
+  /* matrix for holding states and global outputs; with an output sink
+     (sink.c) only a buffer for one chunk of rows; with argument keep (and
+     without events and roots) the output matrix of the kept variables is
+     filled in chunks as well (matrixSink), by the same loop as a sink, in
+     which the last, shorter chunk is stored with its own number of rows */
+  initKeep(ctx, Keep, neq + nout);
+  if (!isNull(Sink) || (ctx->keep != NULL && !isEvent && rt == NULL)) {
+    if (!isNull(Sink)) {
+      sk = initSink(ctx, Sink, neq + nout + 1);
+    } else {
+      PROTECT(R_yout = allocMatrix(REALSXP, nt, ctx->nkeep + 1)); nprot++;
+      for (i = 0; i < nt * (ctx->nkeep + 1); i++) REAL(R_yout)[i] = NA_REAL;
+      sk = matrixSink(ctx, R_yout, (nt < 1000) ? nt : 1000, neq + nout + 1);
+    }
+    yout = (double *) R_alloc(sk->nrow * (neq + nout + 1), sizeof(double));
+  } else {
+    PROTECT(R_yout = allocMatrix(REALSXP, nt, neq + nout + 1)); nprot++;
+    yout = REAL(R_yout);
+    /* initialize outputs with NA first */
+    for (i = 0; i < nt * (neq + nout + 1); i++) yout[i] = NA_REAL;
+  }
 
   /*------------------------------------------------------------------------*/
   /* Initialization of Integration Loop                                     */
   /*------------------------------------------------------------------------*/
-  yout[0]   = tt[0];              /* initial time                 */
-  yknots[0] = tt[0];              /* for polynomial interpolation */
+  if (sk == NULL) yout[0] = tt[0];  /* initial time             */
   for (i = 0; i < neq; i++) {
     y0[i]        = xs[i];         /* initial values               */
-    yout[(i + 1) * nt] = y0[i];   /* output array                 */
-    yknots[iknots + nknots * (i + 1)] = xs[i]; /* for polynomials */
+    if (sk == NULL) yout[(i + 1) * nt] = y0[i];   /* output array */
+  }
+  /* first knot for polynomial interpolation */
+  putknot(yknots, nknots, ldknots, iknots++, tt[0], xs, NULL, neq);
+  if (rt != NULL) rk_rootstart(rt, tt[0], y0, neq);
+  if (islag) {
+    derivs(ctx, Func, tt[0], y0, Parms, Rho, dy1, out, 0, neq,
+           ipar, isDll, isForcing);
+    updatehistini(ctx, tt[0], y0, dy1, rr, NULL);
   }
-  iknots++;
 
   t = tt[0];
   tmax = fmax(tt[nt - 1], tcrit);
@@ -242,74 +350,345 @@ SEXP call_rkAuto(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
   it_tot = 0; /* total number of time steps                    */
   it_rej = 0;
 
-  if (interpolate) {
-  /* integrate over the whole time step and interpolate internally */
-    rk_auto(
-      fsal, neq, stage, isDll, isForcing, verbose, nknots, interpolate,
-      densetype, maxsteps, nt,
-      &iknots, &it, &it_ext, &it_tot, &it_rej,
-      istate, ipar,
-      t, tmax, hmin, hmax, alpha, beta,
-      &dt, &errold,
-      tt, y0, y1, y2, dy1, dy2, f, y, Fj, tmp, FF, rr, A,
-      out, bb1, bb2, cc, dd, atol, rtol, yknots, yout,
-      Func, Parms, Rho
-    );
-  } else {
-     /* integrate separately between external time steps; do not interpolate */
-     for (int j = 0; j < nt - 1; j++) {
-       t = tt[j];
-       tmax = fmin(tt[j + 1], tcrit);
-       dt = tmax - t;
-       if (isEvent) {
-         updateevent(&t, y0, istate);
-       }
-       if (verbose) Rprintf("\n %d th time interval = %g ... %g", j, t, tmax);
-       rk_auto(
+  if (sk != NULL) {
+    /* output sink: the output times in chunks of sk->nrow rows, the
+       steps end at the last time of each chunk, the step size estimate
+       is kept; each chunk is passed to the sink when it is complete.
+       The rows of a chunk are stored with leading dimension m (the stride
+       that rk_auto, rk_autoswitch and flushknots use), also for the last
+       chunk, which may be shorter than the buffer */
+    int base, m, ld, ncol = neq + nout + 1;
+    double tnext;
+    rk_switch *sw = ctx->stiff;
+    for (base = 0; base < nt; base += m) {
+      m = (nt - base < sk->nrow) ? nt - base : sk->nrow;
+      ld = m;
+      for (i = 0; i < m * ncol; i++) yout[i] = NA_REAL;
+      it_ext = 0;
+      if (base == 0) {  /* initial state */
+        yout[0] = t;
+        for (i = 0; i < neq; i++) yout[ld * (1 + i)] = y0[i];
+      }
+      if (interpolate) {
+        tnext = (base + m < nt) ? tt[base + m - 1] : tmax;
+        if (tnext > t) {
+          dt = fmin(dt, tnext - t);
+          if (sw != NULL)
+            rk_autoswitch(ctx,
+              fsal, neq, stage, isDll, isForcing, verbose, nknots, interpolate,
+              densetype, maxsteps, m,
+              &iknots, &it, &it_ext, &it_tot, &it_rej,
+              istate, ipar,
+              t, tnext, hmin, hmax, alpha, beta,
+              &dt, &errold,
+              tt + base, y0, y1, y2, dy1, dy2, f, y, Fj, tmp, FF, rr, A,
+              out, bb1, bb2, cc, dd, atol, rtol, yknots, yout,
+              Func, Parms, Rho
+            );
+          else
+            rk_auto(ctx,
+              fsal, neq, stage, isDll, isForcing, verbose, nknots, interpolate,
+              densetype, maxsteps, m,
+              &iknots, &it, &it_ext, &it_tot, &it_rej,
+              istate, ipar,
+              t, tnext, hmin, hmax, alpha, beta,
+              &dt, &errold,
+              tt + base, y0, y1, y2, dy1, dy2, f, y, Fj, tmp, FF, rr, A,
+              out, bb1, bb2, cc, dd, atol, rtol, yknots, yout,
+              Func, Parms, Rho
+            );
+          /* too few knots for the polynomial up to the end of the chunk */
+          if (sw != NULL && sw->stiff)
+            flushknots(sw->yknots, sw->iknots, sw->nknots, tnext, tt + base,
+                       m, &it_ext, yout, tmp, neq);
+          else if (densetype == 0)
+            flushknots(yknots, iknots, nknots, tnext, tt + base, m,
+                       &it_ext, yout, tmp, neq);
+          t = tnext;
+        }
+        /* last output of the chunk, if missed by rounding */
+        if (ISNA(yout[m - 1]) && t >= tt[base + m - 1]) {
+          yout[m - 1] = tt[base + m - 1];
+          for (i = 0; i < neq; i++) yout[m - 1 + ld * (1 + i)] = y0[i];
+          if (oc != NULL) rk_outstore(oc, t, yout, m - 1, ld, neq);
+        }
+      } else {
+        /* integrate separately between external time steps */
+        for (j = (base == 0) ? 1 : 0; j < m; j++) {
+          tnext = fmin(tt[base + j], tcrit);
+          dt = tnext - t;
+          if (sw != NULL)
+            rk_autoswitch(ctx,
+              fsal, neq, stage, isDll, isForcing, verbose, nknots, interpolate,
+              densetype, maxsteps, m,
+              &iknots, &it, &it_ext, &it_tot, &it_rej,
+              istate, ipar,
+              t, tnext, hmin, hmax, alpha, beta,
+              &dt, &errold,
+              tt + base, y0, y1, y2, dy1, dy2, f, y, Fj, tmp, FF, rr, A,
+              out, bb1, bb2, cc, dd, atol, rtol, yknots, yout,
+              Func, Parms, Rho
+            );
+          else
+            rk_auto(ctx,
+              fsal, neq, stage, isDll, isForcing, verbose, nknots, interpolate,
+              densetype, maxsteps, m,
+              &iknots, &it, &it_ext, &it_tot, &it_rej,
+              istate, ipar,
+              t, tnext, hmin, hmax, alpha, beta,
+              &dt, &errold,
+              tt + base, y0, y1, y2, dy1, dy2, f, y, Fj, tmp, FF, rr, A,
+              out, bb1, bb2, cc, dd, atol, rtol, yknots, yout,
+              Func, Parms, Rho
+            );
+          t = tnext;
+          yout[j] = t;
+          for (i = 0; i < neq; i++) yout[j + ld * (1 + i)] = y0[i];
+          if (oc != NULL) rk_outstore(oc, t, yout, j, ld, neq);
+          if (it_tot > maxsteps) break;
+        }
+      }
+      if (verbose) Rprintf("\n output rows %d ... %d passed to the sink", base + 1, base + m);
+      if (nout > 0)
+        globalout(ctx, Func, Parms, Rho, yout, m, ld, neq, nout, tmp, FF,
+                  out, ipar, isDll, isForcing, TRUE);
+      pushSink(ctx, sk, yout, m, ld);
+      if (it_tot > maxsteps) break;
+    }
+    PROTECT(R_yout = sinkResult(sk)); nprot++;
+
+  } else if (interpolate && (isEvent || rt != NULL)) {
+    /* integrate with interpolation from event to event: the steps end
+       exactly at the event times (and tcrit) and at roots, the interpolation
+       starts again after each event, the step size estimate is kept */
+    double tnext;
+    int newstate = FALSE;
+    rk_switch *sw = ctx->stiff;
+    if (nt > 1) it_ext = 1;  /* initial state kept, even if changed by an event */
+    do {
+      if (isEvent && ctx->tEvent == t) {
+        updateevent(ctx, &t, y0, istate);
+        newstate = TRUE;
+      }
+      if (newstate) {
+        if (densetype == 3) {
+          iknots = 1;   /* knot with the first stage of the next step */
+        } else if (densetype == 0) {
+          iknots = 0;
+          putknot(yknots, nknots, ldknots, iknots++, t, y0, NULL, neq);
+        }
+        if (sw != NULL) {
+          sw->irk->f0ok    = 0;        /* y0 may have changed */
+          sw->irk->restart = TRUE;
+          sw->iknots = 0;
+          putknot(sw->yknots, sw->nknots, neq + 1, sw->iknots++, t, y0,
+                  NULL, neq);
+        }
+        if (rt != NULL) rk_rootstart(rt, t, y0, neq);
+        newstate = FALSE;
+      }
+      tnext = (isEvent && ctx->tEvent > t && ctx->tEvent < tmax) ?
+        ctx->tEvent : tmax;
+      dt = fmin(dt, tnext - t);
+      if (verbose) Rprintf("\n time interval between events = %g ... %g", t, tnext);
+      if (sw != NULL)
+        rk_autoswitch(ctx,
           fsal, neq, stage, isDll, isForcing, verbose, nknots, interpolate,
           densetype, maxsteps, nt,
           &iknots, &it, &it_ext, &it_tot, &it_rej,
           istate, ipar,
-          t,  tmax, hmin, hmax, alpha, beta,
+          t, tnext, hmin, hmax, alpha, beta,
           &dt, &errold,
           tt, y0, y1, y2, dy1, dy2, f, y, Fj, tmp, FF, rr, A,
           out, bb1, bb2, cc, dd, atol, rtol, yknots, yout,
           Func, Parms, Rho
+        );
+      else
+        rk_auto(ctx,
+          fsal, neq, stage, isDll, isForcing, verbose, nknots, interpolate,
+          densetype, maxsteps, nt,
+          &iknots, &it, &it_ext, &it_tot, &it_rej,
+          istate, ipar,
+          t, tnext, hmin, hmax, alpha, beta,
+          &dt, &errold,
+          tt, y0, y1, y2, dy1, dy2, f, y, Fj, tmp, FF, rr, A,
+          out, bb1, bb2, cc, dd, atol, rtol, yknots, yout,
+          Func, Parms, Rho
+        );
+      /* the integration ended at a root */
+      if (rt != NULL && rt->found) tnext = rt->troot;
+      /* short intervals between events: too few knots for the polynomial */
+      if (sw != NULL && sw->stiff)
+        flushknots(sw->yknots, sw->iknots, sw->nknots, tnext, tt, nt,
+                   &it_ext, yout, tmp, neq);
+      else if (densetype == 0)
+        flushknots(yknots, iknots, nknots, tnext, tt, nt,
+                   &it_ext, yout, tmp, neq);
+      /* output at the event time itself, if missed by rounding */
+      if (tt[it_ext] <= tnext && ISNA(yout[it_ext])) {
+        yout[it_ext] = tt[it_ext];
+        for (i = 0; i < neq; i++) yout[it_ext + nt * (1 + i)] = y0[i];
+        if (oc != NULL) rk_outstore(oc, tt[it_ext], yout, it_ext, nt, neq);
+        if (it_ext < nt - 1) it_ext++;
+      }
+      t = tnext;
+      /* root: its event is applied, or the integration stops */
+      if (rt != NULL && rt->found) {
+        if (rk_rootevent(ctx, rt, t, y0)) break;
+        newstate = TRUE;
+      }
+    } while (t < tmax && it_tot <= maxsteps);
+    /* last row: the root that stopped the integration */
+    if (rt != NULL && rt->endsim) {
+      nrow = it_ext + 1;
+      if (it_ext > 0 && yout[it_ext - 1] == t) {
+        nrow = it_ext;
+      } else if (ISNA(yout[it_ext])) {
+        yout[it_ext] = t;
+        for (i = 0; i < neq; i++) yout[it_ext + nt * (1 + i)] = y0[i];
+        if (oc != NULL) rk_outstore(oc, t, yout, it_ext, nt, neq);
+      }
+    }
+
+  } else if (interpolate) {
+  /* integrate over the whole time step and interpolate internally */
+    if (ctx->stiff != NULL)
+      rk_autoswitch(ctx,
+        fsal, neq, stage, isDll, isForcing, verbose, nknots, interpolate,
+        densetype, maxsteps, nt,
+        &iknots, &it, &it_ext, &it_tot, &it_rej,
+        istate, ipar,
+        t, tmax, hmin, hmax, alpha, beta,
+        &dt, &errold,
+        tt, y0, y1, y2, dy1, dy2, f, y, Fj, tmp, FF, rr, A,
+        out, bb1, bb2, cc, dd, atol, rtol, yknots, yout,
+        Func, Parms, Rho
+      );
+    else
+      rk_auto(ctx,
+        fsal, neq, stage, isDll, isForcing, verbose, nknots, interpolate,
+        densetype, maxsteps, nt,
+        &iknots, &it, &it_ext, &it_tot, &it_rej,
+        istate, ipar,
+        t, tmax, hmin, hmax, alpha, beta,
+        &dt, &errold,
+        tt, y0, y1, y2, dy1, dy2, f, y, Fj, tmp, FF, rr, A,
+        out, bb1, bb2, cc, dd, atol, rtol, yknots, yout,
+        Func, Parms, Rho
       );
+  } else {
+     /* integrate separately between external time steps; do not interpolate */
+     for (int j = 0; j < nt - 1; j++) {
+       t = tt[j];
+       tmax = fmin(tt[j + 1], tcrit);
+       dt = tmax - t;
+       if (isEvent && ctx->tEvent == t) {
+         updateevent(ctx, &t, y0, istate);
+         if (ctx->stiff != NULL) {
+           ctx->stiff->irk->f0ok = 0;        /* y0 may have changed */
+           ctx->stiff->irk->restart = TRUE;
+         }
+         if (rt != NULL) rk_rootstart(rt, t, y0, neq);
+       }
+       if (verbose) Rprintf("\n %d th time interval = %g ... %g", j, t, tmax);
+       do {
+         if (ctx->stiff != NULL)
+           rk_autoswitch(ctx,
+              fsal, neq, stage, isDll, isForcing, verbose, nknots, interpolate,
+              densetype, maxsteps, nt,
+              &iknots, &it, &it_ext, &it_tot, &it_rej,
+              istate, ipar,
+              t,  tmax, hmin, hmax, alpha, beta,
+              &dt, &errold,
+              tt, y0, y1, y2, dy1, dy2, f, y, Fj, tmp, FF, rr, A,
+              out, bb1, bb2, cc, dd, atol, rtol, yknots, yout,
+              Func, Parms, Rho
+          );
+         else
+           rk_auto(ctx,
+              fsal, neq, stage, isDll, isForcing, verbose, nknots, interpolate,
+              densetype, maxsteps, nt,
+              &iknots, &it, &it_ext, &it_tot, &it_rej,
+              istate, ipar,
+              t,  tmax, hmin, hmax, alpha, beta,
+              &dt, &errold,
+              tt, y0, y1, y2, dy1, dy2, f, y, Fj, tmp, FF, rr, A,
+              out, bb1, bb2, cc, dd, atol, rtol, yknots, yout,
+              Func, Parms, Rho
+          );
+         /* the interval is continued after the event of a root,
+            or the integration stops */
+         if (rt != NULL && rt->found) {
+           t = rt->troot;
+           if (rk_rootevent(ctx, rt, t, y0)) break;
+           rk_rootstart(rt, t, y0, neq);
+           dt = fmin(dt, tmax - t);
+         } else {
+           t = tmax;
+         }
+       } while (t < tmax && it_tot <= maxsteps);
       /* in this mode, internal interpolation is skipped,
-         so we can simply store the results at the end of each call */
-      yout[j + 1] = tmax;
-      for (i = 0; i < neq; i++) yout[j + 1 + nt * (1 + i)] = y2[i];
+         so we can simply store the results at the end of each call;
+         y0 is the state reached by either method */
+      yout[j + 1] = (rt != NULL && rt->endsim) ? t : tmax;
+      for (i = 0; i < neq; i++) yout[j + 1 + nt * (1 + i)] = y0[i];
+      if (oc != NULL) rk_outstore(oc, yout[j + 1], yout, j + 1, nt, neq);
+      if (rt != NULL && rt->endsim) {
+        nrow = j + 2;
+        break;
+      }
     }
   }
 
+  /* outputs up to a root that stopped the integration, attributes of
+     the roots (rk_root.c) */
+  if (rt != NULL) {
+    if (!rt->endsim) nrow = nt;
+    PROTECT(R_yout = rk_rootout(ctx, rt, R_yout, nt, nrow, neq + nout + 1));
+    nprot++;
+    yout = REAL(R_yout);
+    nt = nrow;
+    if (rt->endsim) istate[0] = 3;
+  }
+
   /*====================================================================*/
-  /* call derivs again to get global outputs                            */
-  /* j = -1 suppresses unnecessary internal copying                     */
+  /* call derivs again to get global outputs (the rows of a sink have   */
+  /* them already)                                                      */
   /*====================================================================*/
-  if (nout > 0) {
-    for (int j = 0; j < nt; j++) {
-      t = yout[j];
-      for (i = 0; i < neq; i++) tmp[i] = yout[j + nt * (1 + i)];
-      derivs(Func, t, tmp, Parms, Rho, FF, out, -1, neq, ipar, isDll, isForcing);
-      for (i = 0; i < nout; i++) {
-        yout[j + nt * (1 + neq + i)] = out[i];
-      }
-    }
-  }
+  if (nout > 0 && sk == NULL)
+    globalout(ctx, Func, Parms, Rho, yout, nt, nt, neq, nout, tmp, FF,
+              out, ipar, isDll, isForcing, oc != NULL);
 
   /* attach diagnostic information (codes are compatible to lsoda) */
+  nfev = istate[12];  /* function evaluations of the implicit method */
   setIstate(R_yout, R_istate, istate, it_tot, stage, fsal, qerr, it_rej);
+  if (ctx->reduce != NULL) {
+    SEXP R_reduce;
+    PROTECT(R_reduce = rk_reduceout(ctx->reduce)); nprot++;
+    setAttrib(R_yout, install("reduce"), R_reduce);
+  }
   if (densetype == 2)   istate[12] = it_tot * stage + 2; /* number of function evaluations */
 
+  /* stiffness switching: function evaluations of both methods, method of
+     the last step (1 = explicit, 2 = implicit), number of switches and
+     steps taken with either method */
+  if (ctx->stiff != NULL) {
+    istate[12] = ctx->stiff->nsteps[0] * (stage - fsal) + 1 + nfev;
+    istate[19] = ctx->stiff->stiff + 1;
+    istate[20] = ctx->stiff->nswitch;
+    istate[21] = ctx->stiff->nsteps[0];
+    istate[22] = ctx->stiff->nsteps[1];
+  }
+
   /* verbose printing in debugging mode*/
   if (verbose)
     Rprintf("\nNumber of time steps it = %d, it_ext = %d, it_tot = %d it_rej %d\n",
       it, it_ext, it_tot, it_rej);
 
   /* release R resources */
-  timesteps[0] = 0;
-  timesteps[1] = 0;
+  ctx->timesteps[0] = 0;
+  ctx->timesteps[1] = 0;
+  leave_context(ctx);
   UNPROTECT(nprot);
   return(R_yout);
 }
@@ -9,10 +9,11 @@
 SEXP call_rkFixed(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
   SEXP Parms, SEXP eventfunc, SEXP elist, SEXP Nout, SEXP Rho,
   SEXP Tcrit, SEXP Verbose, SEXP Hini, SEXP Rpar, SEXP Ipar,
-      SEXP Method, SEXP Maxsteps, SEXP Flist) {
+      SEXP Method, SEXP Maxsteps, SEXP Flist, SEXP Rootfunc, SEXP nRoot) {
 
   /**  Initialization **/
   int nprot = 0;
+  deSolve_context solver_ctx, *ctx = &solver_ctx;
 
   double *tt = NULL, *xs = NULL;
 
@@ -20,13 +21,14 @@ SEXP call_rkFixed(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
   SEXP  R_yout;
   double *y0,  *y1, *dy1, *out, *yout;
 
-  double t, dt, tmax;
+  double t, dt, tmax, h;
 
   int fsal = FALSE;       /* fixed step methods have no FSAL */
   int interpolate = TRUE; /* polynomial interpolation is done by default */
 
-  int i = 0, j=0, it=0, it_tot=0, it_ext=0, nt = 0, neq=0;
+  int i = 0, j=0, it=0, it_tot=0, it_ext=0, nt = 0, neq=0, nrow = 0;
   int isForcing, isEvent;
+  rk_root *rt = NULL;
 
   /**************************************************************************/
   /****** Processing of Arguments                                      ******/
@@ -36,6 +38,7 @@ SEXP call_rkFixed(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
   int  maxsteps = INTEGER(Maxsteps)[0];
   int  nout     = INTEGER(Nout)[0]; /* number of global outputs if func is in a DLL */
   int  verbose  = INTEGER(Verbose)[0];
+  int  nroot    = INTEGER(nRoot)[0];  /* number of root functions */
 
   int stage     = (int)REAL(getListElement(Method, "stage"))[0];
 
@@ -61,13 +64,19 @@ SEXP call_rkFixed(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
   xs  = NUMERIC_POINTER(Xstart);
   neq = length(Xstart);
 
+  /*------------------------------------------------------------------------*/
+  /* solver context; timesteps, outputs, forcings and events are kept here  */
+  /*------------------------------------------------------------------------*/
+  init_context(ctx);
+  enter_context(ctx);  /* nested calls of solvers are possible */
+
   /*------------------------------------------------------------------------*/
   /* timesteps (for advection computation in ReacTran)                      */
   /*------------------------------------------------------------------------*/
   if (hini > 0)
-    for (i = 0; i < 2; i++) timesteps[i] = fmin(hini, tt[1] - tt[0]);
+    for (i = 0; i < 2; i++) ctx->timesteps[i] = fmin(hini, tt[1] - tt[0]);
   else
-    for (i = 0; i < 2; i++) timesteps[i] = tt[1] - tt[0];
+    for (i = 0; i < 2; i++) ctx->timesteps[i] = tt[1] - tt[0];
 
   /**************************************************************************/
   /****** DLL, ipar, rpar (to be compatible with lsoda)                ******/
@@ -78,13 +87,13 @@ SEXP call_rkFixed(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
 
   if (inherits(Func, "NativeSymbol")) { /* function is a dll */
     isDll = TRUE;
-    if (nout > 0) isOut = TRUE;
+    if (nout > 0) ctx->isOut = TRUE;
     lrpar = nout + LENGTH(Rpar);  /* length of rpar; LENGTH(Rpar) is always >0 */
     lipar = 3    + LENGTH(Ipar);  /* length of ipar */
 
   } else {                              /* function is not a dll */
     isDll = FALSE;
-    isOut = FALSE;
+    ctx->isOut = FALSE;
     lipar = 3;    /* in lsoda = 1 */
     lrpar = nout; /* in lsoda = 1 */
   }
@@ -116,7 +125,7 @@ SEXP call_rkFixed(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
   FF  =  (double *) R_alloc(neq * stage, sizeof(double));
   rr  =  (double *) R_alloc(neq * 5, sizeof(double));
 
-  /* matrix for polynomial interpolation */
+  /* ring buffer of knots for polynomial interpolation */
   SEXP R_nknots;
   int nknots = 6;  /* 6 = 5th order polynomials by default*/
   int iknots = 0;  /* counter for knots buffer */
@@ -144,36 +153,42 @@ SEXP call_rkFixed(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
   /*------------------------------------------------------------------------*/
   /* Initialization of Parameters (for DLL functions)                       */
   /*------------------------------------------------------------------------*/
-  PROTECT(Y = allocVector(REALSXP,(neq))); nprot++;
+  PROTECT(ctx->Rcalls = allocVector(VECSXP, NRCALLS)); nprot++;
 
   if (Initfunc != NA_STRING) {
     if (inherits(Initfunc, "NativeSymbol")) {
       init_func_type *initializer;
-      PROTECT(de_gparms = Parms); nprot++;
+      PROTECT(ctx->de_gparms = Parms); nprot++;
       initializer = (init_func_type *) R_ExternalPtrAddrFn_(Initfunc);
       initializer(Initdeparms);
     }
   }
 
   /* assign global variables of the event function */
-  n_eq = neq;
-  R_envir = Rho;
+  ctx->n_eq = neq;
+  ctx->R_envir = Rho;
 
-  isForcing = initForcings(Flist);
-  isEvent = initEvents(elist, eventfunc, 0);
+  isForcing = initForcings(ctx, Flist);
+  isEvent = initEvents(ctx, elist, eventfunc, nroot);
   if (isEvent) interpolate = FALSE;
 
+  /* root finding (rk_root.c), step by step between the output times */
+  if (nroot > 0) {
+    ctx->root = rt = rk_rootinit(ctx, Rootfunc, nroot, neq);
+    interpolate = FALSE;
+  }
+
   /*------------------------------------------------------------------------*/
   /* Initialization of Integration Loop                                     */
   /*------------------------------------------------------------------------*/
   yout[0]   = tt[0];              /* initial time                 */
-  yknots[0] = tt[0];              /* for polynomial interpolation */
   for (i = 0; i < neq; i++) {
     y0[i]        = xs[i];         /* initial values               */
     yout[(i + 1) * nt] = y0[i];   /* output array                 */
-    yknots[iknots + nknots * (i + 1)] = xs[i]; /* for polynomials */
   }
-  iknots++;
+  /* first knot for polynomial interpolation */
+  putknot(yknots, nknots, neq + 1, iknots++, tt[0], xs, NULL, neq);
+  if (rt != NULL) rk_rootstart(rt, tt[0], y0, neq);
 
   t = tt[0];
   tmax = fmax(tt[nt - 1], tcrit);
@@ -196,7 +211,7 @@ SEXP call_rkFixed(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
 
   if (interpolate) {
   /* integrate over the whole time step and interpolate internally */
-    rk_fixed(
+    rk_fixed(ctx,
          fsal, neq, stage, isDll, isForcing, verbose, nknots, interpolate,
          maxsteps, nt,
          &iknots, &it, &it_ext, &it_tot,
@@ -213,27 +228,58 @@ SEXP call_rkFixed(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
        t = tt[j];
        tmax = fmin(tt[j + 1], tcrit);
        dt = tmax - t;
-       if (isEvent) {
-         updateevent(&t, y0, istate);
+       if (isEvent && ctx->tEvent == t) {
+         updateevent(ctx, &t, y0, istate);
+         if (rt != NULL) rk_rootstart(rt, t, y0, neq);
        }
-       rk_fixed(
-         fsal, neq, stage, isDll, isForcing, verbose, nknots, interpolate,
-         maxsteps, nt,
-         &iknots, &it, &it_ext, &it_tot,
-         istate, ipar,
-         t, tmax, fmin(hini, fabs(dt)) * sign(dt),      // <----- hini for backward steps (still experimental)
-         &dt,
-         tt, y0, y1, dy1, f, y, Fj, tmp, FF, rr, A,
-         out, bb1, cc, yknots,  yout,
-         Func, Parms, Rho
-      );
+       /* hini = 0: one step per interval, also after a root */
+       h = (hini > 0) ? fmin(hini, fabs(dt)) * sign(dt) : dt;  // <----- hini for backward steps (still experimental)
+       do {
+         rk_fixed(ctx,
+           fsal, neq, stage, isDll, isForcing, verbose, nknots, interpolate,
+           maxsteps, nt,
+           &iknots, &it, &it_ext, &it_tot,
+           istate, ipar,
+           t, tmax, h,
+           &dt,
+           tt, y0, y1, dy1, f, y, Fj, tmp, FF, rr, A,
+           out, bb1, cc, yknots,  yout,
+           Func, Parms, Rho
+         );
+         /* the interval is continued after the event of a root,
+            or the integration stops */
+         if (rt != NULL && rt->found) {
+           t = rt->troot;
+           if (rk_rootevent(ctx, rt, t, y0)) break;
+           rk_rootstart(rt, t, y0, neq);
+           dt = tmax - t;
+           h  = (hini > 0) ? fmin(hini, fabs(dt)) * sign(dt) : dt;
+         } else {
+           t = tmax;
+         }
+       } while (fabs(t - tmax) > 100.0 * DBL_EPSILON);
       /* in this mode, internal interpolation is skipped,
          so we can simply store the results at the end of each call */
-      yout[j + 1] = tmax;
+      yout[j + 1] = (rt != NULL && rt->endsim) ? t : tmax;
       for (i = 0; i < neq; i++) yout[j + 1 + nt * (1 + i)] = y1[i];
+      if (rt != NULL && rt->endsim) {
+        nrow = j + 2;
+        break;
+      }
     }
   }
 
+  /* outputs up to a root that stopped the integration, attributes of
+     the roots (rk_root.c) */
+  if (rt != NULL) {
+    if (!rt->endsim) nrow = nt;
+    PROTECT(R_yout = rk_rootout(ctx, rt, R_yout, nt, nrow, neq + nout + 1));
+    nprot++;
+    yout = REAL(R_yout);
+    nt = nrow;
+    if (rt->endsim) istate[0] = 3;
+  }
+
   /*====================================================================*/
   /* call derivs again to get global outputs                            */
   /* j = -1 suppresses unnecessary internal copying                     */
@@ -242,7 +288,7 @@ SEXP call_rkFixed(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
     for (int j = 0; j < nt; j++) {
       t = yout[j];
       for (i = 0; i < neq; i++) tmp[i] = yout[j + nt * (1 + i)];
-      derivs(Func, t, tmp, Parms, Rho, FF, out, -1, neq, ipar, isDll, isForcing);
+      derivs(ctx, Func, t, tmp, Parms, Rho, FF, out, -1, neq, ipar, isDll, isForcing);
       for (i = 0; i < nout; i++) {
         yout[j + nt * (1 + neq + i)] = out[i];
       }
@@ -258,8 +304,9 @@ SEXP call_rkFixed(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
     Rprintf("Maxsteps %d\n", maxsteps);
   }
   /* release R resources */
-  timesteps[0] = 0;
-  timesteps[1] = 0;
+  ctx->timesteps[0] = 0;
+  ctx->timesteps[1] = 0;
+  leave_context(ctx);
   UNPROTECT(nprot);
   return(R_yout);
 }
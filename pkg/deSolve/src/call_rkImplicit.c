@@ -1,6 +1,6 @@
 /*==========================================================================*/
 /* Runge-Kutta Solvers, (C) Th. Petzoldt, License: GPL >=2                  */
-/* RK Solver for implicit methods with fixed step size                      */
+/* RK Solver for implicit methods with fixed or variable step size          */
 /* (experimental code derived by K.S.)                                      */
 /*==========================================================================*/
 
@@ -9,11 +9,13 @@
 
 SEXP call_rkImplicit(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
   SEXP Parms, SEXP eventfunc, SEXP elist, SEXP Nout, SEXP Rho,
-  SEXP Tcrit, SEXP Verbose, SEXP Hini, SEXP Rpar, SEXP Ipar,
-		  SEXP Method, SEXP Maxsteps, SEXP Flist) {
+  SEXP Atol, SEXP Rtol, SEXP Tcrit, SEXP Verbose,
+  SEXP Hmin, SEXP Hmax, SEXP Hini, SEXP Rpar, SEXP Ipar,
+		  SEXP Method, SEXP Maxsteps, SEXP Flist, SEXP Sparsity) {
 
   /**  Initialization **/
   int nprot = 0;
+  deSolve_context solver_ctx, *ctx = &solver_ctx;
 
   double *tt = NULL, *xs = NULL;
 
@@ -21,21 +23,31 @@ SEXP call_rkImplicit(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
   SEXP  R_yout;
   double *y0,  *y1, *dy1, *out, *yout;
 
-  double t, dt, tmax;
+  double t, dt = 0, tmax;
 
-  int fsal = FALSE;       /* fixed step methods have no FSAL */
+  int fsal = FALSE;       /* implicit methods have no FSAL */
   int interpolate = TRUE; /* polynomial interpolation is done by default */
 
-  int i = 0, j=0, it=0, it_tot=0, it_ext=0, nt = 0, neq=0;
-  int isForcing, isEvent;
+  int i = 0, j=0, it=0, it_tot=0, it_ext=0, nt = 0, neq=0, it_rej = 0;
+  int isForcing, isEvent, nfev;
 
-  double *alpha;
-  int *index;
+  irk_data *irk;
 
   /**************************************************************************/
   /****** Processing of Arguments                                      ******/
   /**************************************************************************/
+  int lAtol = LENGTH(Atol);
+  double *atol = (double*) R_alloc((int) lAtol, sizeof(double));
+
+  int lRtol = LENGTH(Rtol);
+  double *rtol = (double*) R_alloc((int) lRtol, sizeof(double));
+
+  for (j = 0; j < lRtol; j++) rtol[j] = REAL(Rtol)[j];
+  for (j = 0; j < lAtol; j++) atol[j] = REAL(Atol)[j];
+
   double  tcrit = REAL(Tcrit)[0];
+  double  hmin  = REAL(Hmin)[0];
+  double  hmax  = REAL(Hmax)[0];
   double  hini  = REAL(Hini)[0];
   int  maxsteps = INTEGER(Maxsteps)[0];
   int  nout     = INTEGER(Nout)[0]; /* number of global outputs if func is in a DLL */
@@ -43,6 +55,12 @@ SEXP call_rkImplicit(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
 
   int stage     = (int)REAL(getListElement(Method, "stage"))[0];
 
+  /* variable step size with an embedded error estimate */
+  SEXP R_varstep;
+  int varstep = FALSE;
+  PROTECT(R_varstep = AS_NUMERIC(getListElement(Method, "varstep"))); nprot++;
+  if (length(R_varstep)) varstep = (int) REAL(R_varstep)[0];
+
   SEXP R_A, R_B1, R_C;
   double  *A, *bb1, *cc=NULL;
 
@@ -65,10 +83,16 @@ SEXP call_rkImplicit(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
   xs  = NUMERIC_POINTER(Xstart);
   neq = length(Xstart);
 
+  /*------------------------------------------------------------------------*/
+  /* solver context; timesteps, outputs, forcings and events are kept here  */
+  /*------------------------------------------------------------------------*/
+  init_context(ctx);
+  enter_context(ctx);  /* nested calls of solvers are possible */
+
   /*------------------------------------------------------------------------*/
   /* timesteps (for advection computation in ReacTran)                      */
   /*------------------------------------------------------------------------*/
-  for (i = 0; i < 2; i++) timesteps[i] = 0;
+  for (i = 0; i < 2; i++) ctx->timesteps[i] = 0;
 
   /**************************************************************************/
   /****** DLL, ipar, rpar (to be compatible with lsoda)                ******/
@@ -79,13 +103,13 @@ SEXP call_rkImplicit(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
 
   if (inherits(Func, "NativeSymbol")) { /* function is a dll */
     isDll = TRUE;
-    if (nout > 0) isOut = TRUE;
+    if (nout > 0) ctx->isOut = TRUE;
     lrpar = nout + LENGTH(Rpar);  /* length of rpar; LENGTH(Rpar) is always >0 */
     lipar = 3    + LENGTH(Ipar);  /* length of ipar */
 
   } else {                              /* function is not a dll */
     isDll = FALSE;
-    isOut = FALSE;
+    ctx->isOut = FALSE;
     lipar = 3;    /* in lsoda = 1 */
     lrpar = nout; /* in lsoda = 1 */
   }
@@ -116,15 +140,12 @@ SEXP call_rkImplicit(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
   FF  =  (double *) R_alloc(neq * stage, sizeof(double));
   rr  =  (double *) R_alloc(neq * 5, sizeof(double));
 
-  /* ks */
-  alpha =  (double *) R_alloc(neq * stage * neq * stage, sizeof(double));
-  index =  (int *)    R_alloc(neq * stage, sizeof(int));
   tmp   =  (double *) R_alloc(neq * stage, sizeof(double));
   tmp2  =  (double *) R_alloc(neq * stage, sizeof(double));
   tmp3  =  (double *) R_alloc(neq * stage, sizeof(double));
 
 
-  /* matrix for polynomial interpolation */
+  /* ring buffer of knots for polynomial interpolation */
   SEXP R_nknots;
   int nknots = 6;  /* 6 = 5th order polynomials by default*/
   int iknots = 0;  /* counter for knots buffer */
@@ -155,39 +176,47 @@ SEXP call_rkImplicit(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
   /*------------------------------------------------------------------------*/
   /* Initialization of Parameters (for DLL functions)                       */
   /*------------------------------------------------------------------------*/
-  PROTECT(Y = allocVector(REALSXP,(neq))); nprot++;
+  PROTECT(ctx->Rcalls = allocVector(VECSXP, NRCALLS)); nprot++;
 
   if (Initfunc != NA_STRING) {
     if (inherits(Initfunc, "NativeSymbol")) {
       init_func_type *initializer;
-      PROTECT(de_gparms = Parms); nprot++;
+      PROTECT(ctx->de_gparms = Parms); nprot++;
       initializer = (init_func_type *) R_ExternalPtrAddrFn_(Initfunc);
       initializer(Initdeparms);
     }
   }
 
   /* assign global variables of the event function */
-  n_eq = neq;
-  R_envir = Rho;
+  ctx->n_eq = neq;
+  ctx->R_envir = Rho;
 
-  isForcing = initForcings(Flist);
-  isEvent = initEvents(elist, eventfunc,0);
+  isForcing = initForcings(ctx, Flist);
+  isEvent = initEvents(ctx, elist, eventfunc,0);
   if (isEvent) interpolate = FALSE;
 
+  /* known sparsity of the Jacobian: estimated with groups of columns */
+  if (inherits(Sparsity, "deSolve.sparsity"))
+    initGroups(ctx, Sparsity, NULL, FALSE);
+
+  /* Newton iteration and error estimate (rk_implicit.c) */
+  irk = irk_init(neq, stage, varstep, A, bb1, cc);
+  ctx->solver = irk;
+
   /*------------------------------------------------------------------------*/
   /* Initialization of Integration Loop                                     */
   /*------------------------------------------------------------------------*/
   yout[0]   = tt[0];              /* initial time                 */
-  yknots[0] = tt[0];              /* for polynomial interpolation */
   for (i = 0; i < neq; i++) {
     y0[i]        = xs[i];         /* initial values               */
     yout[(i + 1) * nt] = y0[i];   /* output array                 */
-    yknots[iknots + nknots * (i + 1)] = xs[i]; /* for polynomials */
   }
-  iknots++;
+  /* first knot for polynomial interpolation */
+  putknot(yknots, nknots, neq + 1, iknots++, tt[0], xs, NULL, neq);
 
   t = tt[0];
   tmax = fmax(tt[nt - 1], tcrit);
+  if (varstep) dt = fmin(hmax, hini);  /* 0: estimated from f(t, y0) */
 
   /* Initialization of work arrays (to be on the safe side, remove this later) */
   for (i = 0; i < neq; i++)  {
@@ -207,40 +236,42 @@ SEXP call_rkImplicit(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
 
   if (interpolate) {
   /* integrate over the whole time step and interpolate internally */
-    rk_implicit( alpha, index,
+    rk_implicit(ctx,
          fsal, neq, stage, isDll, isForcing, verbose, nknots, interpolate,
-         maxsteps, nt,
-  	     &iknots, &it, &it_ext, &it_tot,
+         varstep, maxsteps, nt,
+  	     &iknots, &it, &it_ext, &it_tot, &it_rej,
          istate, ipar,
-  	     t, tmax, hini,
+  	     t, tmax, hini, hmin, hmax,
   	     &dt,
   	     tt, y0, y1, dy1, f, y, Fj, tmp, tmp2, tmp3, FF, rr, A,
-  	     out, bb1, cc, yknots,  yout,
+  	     out, bb1, cc, atol, rtol, yknots,  yout,
   	     Func, Parms, Rho
     );
   } else {
    for (int j = 0; j < nt - 1; j++) {
        t = tt[j];
        tmax = fmin(tt[j + 1], tcrit);
-       dt = tmax - t;
+       if (!varstep) dt = tmax - t;
        if (isEvent) {
-         updateevent(&t, y0, istate);
+         updateevent(ctx, &t, y0, istate);
+         irk->f0ok = 0;        /* y0 may have changed */
+         irk->restart = TRUE;
        }
-      rk_implicit(alpha, index,
+      rk_implicit(ctx,
          fsal, neq, stage, isDll, isForcing, verbose, nknots, interpolate,
-         maxsteps, nt,
-  	     &iknots, &it, &it_ext, &it_tot,
+         varstep, maxsteps, nt,
+  	     &iknots, &it, &it_ext, &it_tot, &it_rej,
          istate, ipar,
-  	     t, tmax, hini,
+  	     t, tmax, hini, hmin, hmax,
   	     &dt,
   	     tt, y0, y1, dy1, f, y, Fj, tmp, tmp2, tmp3, FF, rr, A,
-  	     out, bb1, cc, yknots,  yout,
+  	     out, bb1, cc, atol, rtol, yknots,  yout,
   	     Func, Parms, Rho
       );
       /* in this mode, internal interpolation is skipped,
          so we can simply store the results at the end of each call */
       yout[j + 1] = tmax;
-      for (i = 0; i < neq; i++) yout[j + 1 + nt * (1 + i)] = y1[i];
+      for (i = 0; i < neq; i++) yout[j + 1 + nt * (1 + i)] = y0[i];
     }
   }
 
@@ -253,15 +284,19 @@ SEXP call_rkImplicit(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
     for (int j = 0; j < nt; j++) {
       t = yout[j];
       for (i = 0; i < neq; i++) tmp[i] = yout[j + nt * (1 + i)];
-      derivs(Func, t, tmp, Parms, Rho, FF, out, -1, neq, ipar, isDll, isForcing);
+      derivs(ctx, Func, t, tmp, Parms, Rho, FF, out, -1, neq, ipar, isDll, isForcing);
       for (i = 0; i < nout; i++) {
         yout[j + nt * (1 + neq + i)] = out[i];
       }
     }
   }
 
-  /* attach diagnostic information (codes are compatible to lsoda) */
-  setIstate(R_yout, R_istate, istate, it_tot, stage, fsal, qerr, 0);
+  /* attach diagnostic information (codes are compatible to lsoda);
+     function evaluations, Jacobians, LU decompositions, Newton iterations
+     and convergence failures are counted by rk_implicit */
+  nfev = istate[12];
+  setIstate(R_yout, R_istate, istate, it_tot, stage, fsal, qerr, it_rej);
+  istate[12] = nfev;
 
   /* release R resources */
   if (verbose) {
@@ -269,8 +304,9 @@ SEXP call_rkImplicit(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
     Rprintf("Maxsteps %d\n", maxsteps);
   }
   /* release R resources */
-  timesteps[0] = 0;
-  timesteps[1] = 0;
+  ctx->timesteps[0] = 0;
+  ctx->timesteps[1] = 0;
+  leave_context(ctx);
   UNPROTECT(nprot);
   return(R_yout);
 }
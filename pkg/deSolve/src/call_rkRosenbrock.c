@@ -0,0 +1,338 @@
+/*==========================================================================*/
+/* Runge-Kutta Solvers, (C) Th. Petzoldt, License: GPL >=2                  */
+/* RK Solver for Rosenbrock methods with variable step size                 */
+/*==========================================================================*/
+
+#include "rk_util.h"
+#include "externalptr.h"
+
+/* interface between the Jacobian of the Rosenbrock methods and R function */
+static void C_ros_jac(int *neq, double *t, double *y, int *ml,
+                      int *mu, double *pd, int *nrowpd, double *yout, int *iout)
+{
+  deSolve_context *ctx = desolve_ctx;
+  int i;
+  SEXP R_fcall, ans, Y;
+
+  R_fcall = ctx_lang(ctx, CALL_JAC, ctx->R_jac_func, "dd", 1, *neq);
+  REAL(call_arg(R_fcall, 1))[0] = *t;
+  Y = call_arg(R_fcall, 2);
+  for (i = 0; i < *neq; i++) REAL(Y)[i] = y[i];
+
+  PROTECT(ans = ctx_eval(ctx, R_fcall, ctx->R_envir));
+
+  for (i = 0; i < *neq * *nrowpd; i++)  pd[i] = REAL(ans)[i];
+
+  UNPROTECT(1);
+}
+
+SEXP call_rkRosenbrock(SEXP Xstart, SEXP Times, SEXP Func, SEXP Initfunc,
+  SEXP Parms, SEXP eventfunc, SEXP elist, SEXP Nout, SEXP Rho,
+  SEXP Atol, SEXP Rtol, SEXP Tcrit, SEXP Verbose,
+  SEXP Hmin, SEXP Hmax, SEXP Hini, SEXP Rpar, SEXP Ipar,
+  SEXP Method, SEXP Maxsteps, SEXP Flist,
+  SEXP Jacfunc, SEXP JacType, SEXP Sparsity) {
+
+  /**  Initialization **/
+  int nprot = 0;
+  deSolve_context solver_ctx, *ctx = &solver_ctx;
+
+  double *tt = NULL, *xs = NULL;
+
+  double *f, *tmp, *FF;
+  SEXP  R_yout;
+  double *y0,  *y1, *y2, *dy1, *dy2, *out, *yout;
+
+  double t, dt = 0, tmax;
+
+  int fsal = FALSE;       /* Rosenbrock methods have no FSAL */
+  int interpolate = TRUE; /* Hermite interpolation, also with events */
+
+  int i = 0, j=0, it=0, it_tot=0, it_ext=0, nt = 0, neq=0, it_rej = 0;
+  int isForcing, isEvent, nfev;
+
+  ros_data *ros;
+  ros_jac_func_type *jac = NULL;
+
+  /**************************************************************************/
+  /****** Processing of Arguments                                      ******/
+  /**************************************************************************/
+  int lAtol = LENGTH(Atol);
+  double *atol = (double*) R_alloc((int) lAtol, sizeof(double));
+
+  int lRtol = LENGTH(Rtol);
+  double *rtol = (double*) R_alloc((int) lRtol, sizeof(double));
+
+  for (j = 0; j < lRtol; j++) rtol[j] = REAL(Rtol)[j];
+  for (j = 0; j < lAtol; j++) atol[j] = REAL(Atol)[j];
+
+  double  tcrit = REAL(Tcrit)[0];
+  double  hmin  = REAL(Hmin)[0];
+  double  hmax  = REAL(Hmax)[0];
+  double  hini  = REAL(Hini)[0];
+  int  maxsteps = INTEGER(Maxsteps)[0];
+  int  nout     = INTEGER(Nout)[0]; /* number of global outputs if func is in a DLL */
+  int  verbose  = INTEGER(Verbose)[0];
+
+  /* type of the Jacobian (codes of lsoda) and bandwidths */
+  int  jt       = INTEGER(JacType)[0];
+  int  ml       = INTEGER(JacType)[1];
+  int  mu       = INTEGER(JacType)[2];
+
+  int stage     = (int)REAL(getListElement(Method, "stage"))[0];
+
+  SEXP R_A, R_B1, R_B2, R_C, R_G, R_Gi;
+  double  *A, *bb1, *bb2, *cc, *G, *gi;
+
+  PROTECT(R_A = getListElement(Method, "A")); nprot++;
+  A = REAL(R_A);
+
+  PROTECT(R_B1 = getListElement(Method, "b1")); nprot++;
+  bb1 = REAL(R_B1);
+
+  PROTECT(R_B2 = getListElement(Method, "b2")); nprot++;
+  bb2 = REAL(R_B2);
+
+  PROTECT(R_C = getListElement(Method, "c")); nprot++;
+  cc = REAL(R_C);
+
+  PROTECT(R_G = getListElement(Method, "G")); nprot++;
+  G = REAL(R_G);
+
+  PROTECT(R_Gi = getListElement(Method, "gammai")); nprot++;
+  gi = REAL(R_Gi);
+
+  double gamma = REAL(getListElement(Method, "gamma"))[0];
+  int  qerr  = (int)REAL(getListElement(Method, "Qerr"))[0];
+
+  PROTECT(Times = AS_NUMERIC(Times)); nprot++;
+  tt = NUMERIC_POINTER(Times);
+  nt = length(Times);
+
+  PROTECT(Xstart = AS_NUMERIC(Xstart)); nprot++;
+  xs  = NUMERIC_POINTER(Xstart);
+  neq = length(Xstart);
+
+  /*------------------------------------------------------------------------*/
+  /* solver context; timesteps, outputs, forcings and events are kept here  */
+  /*------------------------------------------------------------------------*/
+  init_context(ctx);
+  enter_context(ctx);  /* nested calls of solvers are possible */
+
+  /*------------------------------------------------------------------------*/
+  /* timesteps (for advection computation in ReacTran)                      */
+  /*------------------------------------------------------------------------*/
+  for (i = 0; i < 2; i++) ctx->timesteps[i] = 0;
+
+  /**************************************************************************/
+  /****** DLL, ipar, rpar (to be compatible with lsoda)                ******/
+  /**************************************************************************/
+  int isDll = FALSE;
+  int lrpar= 0, lipar = 0;
+  int *ipar = NULL;
+
+  if (inherits(Func, "NativeSymbol")) { /* function is a dll */
+    isDll = TRUE;
+    if (nout > 0) ctx->isOut = TRUE;
+    lrpar = nout + LENGTH(Rpar);  /* length of rpar; LENGTH(Rpar) is always >0 */
+    lipar = 3    + LENGTH(Ipar);  /* length of ipar */
+
+  } else {                              /* function is not a dll */
+    isDll = FALSE;
+    ctx->isOut = FALSE;
+    lipar = 3;    /* in lsoda = 1 */
+    lrpar = nout; /* in lsoda = 1 */
+  }
+  out   = (double *) R_alloc(lrpar, sizeof(double));
+  ipar  = (int *) R_alloc(lipar, sizeof(int));
+
+  ipar[0] = nout;              /* first 3 elements of ipar are special */
+  ipar[1] = lrpar;
+  ipar[2] = lipar;
+  if (isDll == 1) {
+    /* other elements of ipar are set in R-function lsodx via argument *ipar* */
+    for (j = 0; j < LENGTH(Ipar); j++) ipar[j+3] = INTEGER(Ipar)[j];
+    /* out:  first nout elements of out are reserved for output variables
+       other elements are set via argument *rpar*  */
+    for (j = 0; j < nout; j++)         out[j] = 0.0;
+    for (j = 0; j < LENGTH(Rpar); j++) out[nout+j] = REAL(Rpar)[j];
+  }
+
+  /*------------------------------------------------------------------------*/
+  /* Allocation of Workspace                                                */
+  /*------------------------------------------------------------------------*/
+  y0  =  (double *) R_alloc(neq, sizeof(double));
+  y1  =  (double *) R_alloc(neq, sizeof(double));
+  y2  =  (double *) R_alloc(neq, sizeof(double));
+  dy1 =  (double *) R_alloc(neq, sizeof(double));
+  dy2 =  (double *) R_alloc(neq, sizeof(double));
+  f   =  (double *) R_alloc(neq, sizeof(double));
+  tmp =  (double *) R_alloc(neq, sizeof(double));
+  FF  =  (double *) R_alloc(neq * stage, sizeof(double));
+
+  /* ring buffer of knots for Hermite interpolation, values and derivatives
+     of the last steps; degree 2 * nknots - 1 matches the order */
+  int nknots = (qerr + 2) / 2;
+  int iknots = 0;  /* counter for knots buffer */
+  double *yknots;
+
+  yknots = (double *) R_alloc((2 * neq + 1) * (nknots + 1), sizeof(double));
+
+  /* matrix for holding states and global outputs */
+  PROTECT(R_yout = allocMatrix(REALSXP, nt, neq + nout + 1)); nprot++;
+  yout = REAL(R_yout);
+  /* initialize outputs with NA first */
+  for (i = 0; i < nt * (neq + nout + 1); i++) yout[i] = NA_REAL;
+
+  /* attribute that stores state information, similar to lsoda */
+  SEXP R_istate;
+  int *istate;
+  PROTECT(R_istate = allocVector(INTSXP, 22)); nprot++;
+  istate = INTEGER(R_istate);
+  istate[0] = 0; /* assume succesful return */
+  for (i = 0; i < 22; i++) istate[i] = 0;
+
+  /*------------------------------------------------------------------------*/
+  /* Initialization of Parameters (for DLL functions)                       */
+  /*------------------------------------------------------------------------*/
+  PROTECT(ctx->Rcalls = allocVector(VECSXP, NRCALLS)); nprot++;
+
+  if (Initfunc != NA_STRING) {
+    if (inherits(Initfunc, "NativeSymbol")) {
+      init_func_type *initializer;
+      PROTECT(ctx->de_gparms = Parms); nprot++;
+      initializer = (init_func_type *) R_ExternalPtrAddrFn_(Initfunc);
+      initializer(Initdeparms);
+    }
+  }
+
+  /* assign global variables of the event function */
+  ctx->n_eq = neq;
+  ctx->R_envir = Rho;
+
+  isForcing = initForcings(ctx, Flist);
+  isEvent = initEvents(ctx, elist, eventfunc,0);
+
+  /* user-supplied Jacobian, compiled or an R function */
+  if (!isNull(Jacfunc) && (jt == 1 || jt == 4)) {
+    if (isDll)
+      jac = (ros_jac_func_type *) R_ExternalPtrAddrFn_(Jacfunc);
+    else {
+      ctx->R_jac_func = Jacfunc;
+      jac = C_ros_jac;
+    }
+  }
+
+  /* known sparsity of the full Jacobian: estimated with groups of columns */
+  if (jt == 2 && inherits(Sparsity, "deSolve.sparsity"))
+    initGroups(ctx, Sparsity, NULL, FALSE);
+
+  /* Jacobian, LU decomposition and coefficients (rk_rosenbrock.c) */
+  ros = ros_init(neq, stage, A, cc, gamma, G, gi, jt, ml, mu, jac);
+  ctx->solver = ros;
+
+  /*------------------------------------------------------------------------*/
+  /* Initialization of Integration Loop                                     */
+  /*------------------------------------------------------------------------*/
+  yout[0]   = tt[0];              /* initial time                 */
+  for (i = 0; i < neq; i++) {
+    y0[i]        = xs[i];         /* initial values               */
+    yout[(i + 1) * nt] = y0[i];   /* output array                 */
+  }
+  /* first knot for Hermite interpolation, derivative from the first step */
+  putknot(yknots, nknots, 2 * neq + 1, iknots++, tt[0], xs, NULL, neq);
+
+  t = tt[0];
+  tmax = fmax(tt[nt - 1], tcrit);
+  dt = fmin(hmax, hini);  /* 0: estimated from f(t, y0) */
+
+  /*------------------------------------------------------------------------*/
+  /* Main Loop                                                              */
+  /*------------------------------------------------------------------------*/
+  it     = 1; /* step counter; zero element is initial state   */
+  it_ext = 0; /* counter for external time step (dense output) */
+  it_tot = 0; /* total number of time steps                    */
+
+  if (isEvent) {
+    /* integrate with interpolation from event to event: the steps end
+       exactly at the event times, the step size estimate is kept */
+    double tnext;
+    if (nt > 1) it_ext = 1;  /* initial state kept, even if changed by an event */
+    do {
+      if (ctx->tEvent == t) {
+        updateevent(ctx, &t, y0, istate);
+        ros->f0ok   = FALSE;  /* y0 may have changed */
+        ros->newjac = TRUE;
+        iknots = 1;           /* knot with f(t, y0) of the next step */
+      }
+      tnext = (ctx->tEvent > t && ctx->tEvent < tmax) ? ctx->tEvent : tmax;
+      if (dt > 0) dt = fmin(dt, tnext - t);
+      rk_rosenbrock(ctx,
+         neq, stage, isDll, isForcing, verbose, nknots, interpolate,
+         maxsteps, nt,
+  	     &iknots, &it, &it_ext, &it_tot, &it_rej,
+         istate, ipar,
+  	     t, tnext, hmin, hmax, 1.0/qerr,
+  	     &dt,
+  	     tt, y0, y1, y2, dy1, dy2, f, tmp, FF,
+  	     A, out, bb1, bb2, cc, atol, rtol, yknots, yout,
+  	     Func, Parms, Rho
+      );
+      /* output at the event time itself, if missed by rounding */
+      if (tt[it_ext] <= tnext && ISNA(yout[it_ext])) {
+        yout[it_ext] = tt[it_ext];
+        for (i = 0; i < neq; i++) yout[it_ext + nt * (1 + i)] = y0[i];
+        if (it_ext < nt - 1) it_ext++;
+      }
+      t = tnext;
+    } while (t < tmax && it_tot <= maxsteps);
+  } else {
+  /* integrate over the whole time step and interpolate internally */
+    rk_rosenbrock(ctx,
+         neq, stage, isDll, isForcing, verbose, nknots, interpolate,
+         maxsteps, nt,
+  	     &iknots, &it, &it_ext, &it_tot, &it_rej,
+         istate, ipar,
+  	     t, tmax, hmin, hmax, 1.0/qerr,
+  	     &dt,
+  	     tt, y0, y1, y2, dy1, dy2, f, tmp, FF,
+  	     A, out, bb1, bb2, cc, atol, rtol, yknots, yout,
+  	     Func, Parms, Rho
+    );
+  }
+
+  /*====================================================================*/
+  /* call derivs again to get global outputs                            */
+  /* j = -1 suppresses unnecessary internal copying                     */
+  /*====================================================================*/
+
+  if(nout > 0) {
+    for (int j = 0; j < nt; j++) {
+      t = yout[j];
+      for (i = 0; i < neq; i++) tmp[i] = yout[j + nt * (1 + i)];
+      derivs(ctx, Func, t, tmp, Parms, Rho, FF, out, -1, neq, ipar, isDll, isForcing);
+      for (i = 0; i < nout; i++) {
+        yout[j + nt * (1 + neq + i)] = out[i];
+      }
+    }
+  }
+
+  /* attach diagnostic information (codes are compatible to lsoda);
+     function evaluations, Jacobians and LU decompositions are counted
+     by rk_rosenbrock */
+  nfev = istate[12];
+  setIstate(R_yout, R_istate, istate, it_tot, stage, fsal, qerr, it_rej);
+  istate[12] = nfev;
+
+  /* release R resources */
+  if (verbose) {
+    Rprintf("Number of time steps it = %d, it_ext = %d, it_tot = %d\n", it, it_ext, it_tot);
+    Rprintf("Maxsteps %d\n", maxsteps);
+  }
+  /* release R resources */
+  ctx->timesteps[0] = 0;
+  ctx->timesteps[1] = 0;
+  leave_context(ctx);
+  UNPROTECT(nprot);
+  return(R_yout);
+}
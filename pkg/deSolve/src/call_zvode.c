@@ -22,10 +22,6 @@
             improving names
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
-SEXP R_zderiv_func;
-SEXP R_zjac_func;
-SEXP R_vode_envir;
-
 /* definition of the call to the FORTRAN function dvode - in file zvode.f*/
 void F77_NAME(zvode)(void (*)(int *, double *, Rcomplex *, Rcomplex *,
                               Rcomplex *, int *),
@@ -44,15 +40,18 @@ void F77_NAME(zvode)(void (*)(int *, double *, Rcomplex *, Rcomplex *,
 static void C_zderiv_func (int *neq, double *t, Rcomplex *y,
                          Rcomplex *ydot, Rcomplex *yout, int *iout)
 {
+  deSolve_context *ctx = desolve_ctx;
+  zvode_data *zv = (zvode_data *) ctx->solver;
   int i;
-  SEXP R_fcall, Time, ans;
+  SEXP R_fcall, ans, cY;
   int nprot = 0;
 
+  R_fcall = ctx_lang(ctx, CALL_DERIV, zv->R_zderiv_func, "dz", 1, *neq);
+  REAL(call_arg(R_fcall, 1))[0] = *t;
+  cY = call_arg(R_fcall, 2);
   for (i = 0; i < *neq; i++)  COMPLEX(cY)[i] = y[i];
 
-  PROTECT(Time = ScalarReal(*t)); nprot++;
-  PROTECT(R_fcall = lang3(R_zderiv_func,Time,cY)); nprot++;
-  PROTECT(ans = eval(R_fcall, R_vode_envir)); nprot++;
+  PROTECT(ans = ctx_eval(ctx, R_fcall, zv->R_vode_envir)); nprot++;
 
   for (i = 0; i < *neq; i++)	ydot[i] = COMPLEX(VECTOR_ELT(ans,0))[i];
 
@@ -64,15 +63,18 @@ static void C_zderiv_func (int *neq, double *t, Rcomplex *y,
 static void C_zjac_func (int *neq, double *t, Rcomplex *y, int *ml,
 		    int *mu, Rcomplex *pd, int *nrowpd, Rcomplex *yout, int *iout)
 {
+  deSolve_context *ctx = desolve_ctx;
+  zvode_data *zv = (zvode_data *) ctx->solver;
   int i;
-  SEXP R_fcall, Time, ans;
+  SEXP R_fcall, ans, cY;
   int nprot = 0;
 
+  R_fcall = ctx_lang(ctx, CALL_JAC, zv->R_zjac_func, "dz", 1, *neq);
+  REAL(call_arg(R_fcall, 1))[0] = *t;
+  cY = call_arg(R_fcall, 2);
   for (i = 0; i < *neq; i++)  COMPLEX(cY)[i] = y[i];
 
-  PROTECT(Time = ScalarReal(*t)); nprot++;
-  PROTECT(R_fcall = lang3(R_zjac_func,Time,cY)); nprot++;
-  PROTECT(ans = eval(R_fcall, R_vode_envir)); nprot++;
+  PROTECT(ans = ctx_eval(ctx, R_fcall, zv->R_vode_envir)); nprot++;
 
   for (i = 0; i < *neq * *nrowpd; i++)  pd[i ] = COMPLEX(ans)[i ];
 
@@ -85,8 +87,10 @@ values of the forcing functions */
 static void C_zderiv_func_forc (int *neq, double *t, Rcomplex *y,
                          Rcomplex *ydot, Rcomplex *yout, int *iout)
 {
-  updatedeforc(t);
-  DLL_cderiv_func(neq, t, y, ydot, yout, iout);
+  deSolve_context *ctx = desolve_ctx;
+  zvode_data *zv = (zvode_data *) ctx->solver;
+  updatedeforc(ctx, t);
+  zv->DLL_cderiv_func(neq, t, y, ydot, yout, iout);
 }
 
 
@@ -115,12 +119,19 @@ SEXP call_zvode(SEXP y, SEXP times, SEXP derivfunc, SEXP parms, SEXP rtol,
   double *rwork;
   C_zderiv_func_type *zderiv_func;
   C_zjac_func_type   *zjac_func = NULL;
+  deSolve_context solver_ctx, *ctx = &solver_ctx;
+  zvode_data zv_data, *zv = &zv_data;
 
 /******************************************************************************/
 /******                         STATEMENTS                               ******/
 /******************************************************************************/
 
-  lock_solver(); /* prevent nested call of solvers that have global variables */
+  init_context(ctx);
+  memset(zv, 0, sizeof(zvode_data));
+  zv->R_zderiv_func = zv->R_zjac_func = R_NilValue;
+  zv->R_vode_envir = rho;
+  ctx->solver = zv;
+  enter_context(ctx);  /* nested calls of solvers are possible */
 
 /*                      #### initialisation ####                              */
 
@@ -147,7 +158,7 @@ SEXP call_zvode(SEXP y, SEXP times, SEXP derivfunc, SEXP parms, SEXP rtol,
   }
 
 /* initialise output for Complex variables ... */
-  initOutComplex(isDll, &nout, &ntot, neq, nOut, Rpar, Ipar);
+  initOutComplex(ctx, isDll, &nout, &ntot, neq, nOut, Rpar, Ipar);
 
 /* copies of all variables that will be changed in the FORTRAN subroutine */
 
@@ -170,17 +181,16 @@ SEXP call_zvode(SEXP y, SEXP times, SEXP derivfunc, SEXP parms, SEXP rtol,
   rwork = (double *) R_alloc(lrw, sizeof(double));
   for (j = 0; j < 20; j++) rwork[j] = REAL(rWork)[j];
 
-  /* global variable */
   //timesteps = (double *) R_alloc(2, sizeof(double));
-  for (j=0; j<2; j++) timesteps[j] = 0.;
+  for (j=0; j<2; j++) ctx->timesteps[j] = 0.;
 
   lzw = INTEGER(lZw)[0];
   zwork = (Rcomplex *) R_alloc(lzw, sizeof(Rcomplex));
 
-  /* initialise global R-variables... */
+  /* initialise R-variables of the solver context... */
 
-  PROTECT(cY = allocVector(CPLXSXP , neq) ); nprot++;
-  PROTECT(YOUT = allocMatrix(CPLXSXP,ntot+1,nt)); nprot++;
+  PROTECT(ctx->Rcalls = allocVector(VECSXP, NRCALLS)); nprot++;
+  PROTECT(ctx->YOUT = allocMatrix(CPLXSXP,ntot+1,nt)); nprot++;
 
   /**************************************************************************/
   /****** Initialization of Parameters and Forcings (DLL functions)    ******/
@@ -189,42 +199,42 @@ SEXP call_zvode(SEXP y, SEXP times, SEXP derivfunc, SEXP parms, SEXP rtol,
   if (initfunc != NA_STRING) {
     if (inherits(initfunc, "NativeSymbol")) {
       init_func_type *initializer;
-      PROTECT(de_gparms = parms); nprot++;
+      PROTECT(ctx->de_gparms = parms); nprot++;
       initializer = (init_func_type *) R_ExternalPtrAddrFn_(initfunc);
       initializer(Initdeparms);
     }
   }
   // end inline initParms
 
-  isForcing = initForcings(flist);
+  isForcing = initForcings(ctx, flist);
 
 /* pointers to functions zderiv_func and zjac_func, passed to the FORTRAN subroutine */
 
   if (isDll == 1) { /* DLL address passed to FORTRAN */
     zderiv_func = (C_zderiv_func_type *) R_ExternalPtrAddrFn_(derivfunc);
     /* no need to communicate with R - but output variables set here */
-    if (isOut) {
+    if (ctx->isOut) {
       dy = (Rcomplex *) R_alloc(neq, sizeof(Rcomplex));
       /* for (j = 0; j < neq; j++) dy[j] =  i0; */
     }
 	  /* here overruling zderiv_func if forcing */
     if (isForcing) {
-      DLL_cderiv_func = (C_zderiv_func_type *) R_ExternalPtrAddrFn_(derivfunc);
+      zv->DLL_cderiv_func = (C_zderiv_func_type *) R_ExternalPtrAddrFn_(derivfunc);
       zderiv_func = (C_zderiv_func_type *) C_zderiv_func_forc;
     }
   } else {
     /* interface function between FORTRAN and R passed to FORTRAN*/
     zderiv_func = (C_zderiv_func_type *) C_zderiv_func;
     /* needed to communicate with R */
-    R_zderiv_func = derivfunc;
-    R_vode_envir = rho;
+    zv->R_zderiv_func = derivfunc;
+    zv->R_vode_envir = rho;
   }
 
   if (!isNull(jacfunc)) {
     if (isDll == 1) {
 	    zjac_func = (C_zjac_func_type *) R_ExternalPtrAddrFn_(jacfunc);
     } else {
-	    R_zjac_func = jacfunc;
+	    zv->R_zjac_func = jacfunc;
 	    zjac_func = C_zjac_func;
     }
   }
@@ -249,14 +259,14 @@ SEXP call_zvode(SEXP y, SEXP times, SEXP derivfunc, SEXP parms, SEXP rtol,
 
 /*  COMPLEX(YOUT)[0] = COMPLEX(times)[0];*/
   for (j = 0; j < neq; j++) {
-    COMPLEX(YOUT)[j+1] = COMPLEX(y)[j];
+    COMPLEX(ctx->YOUT)[j+1] = COMPLEX(y)[j];
   }      /* function in DLL and output */
 
-  if (isOut == 1) {
+  if (ctx->isOut == 1) {
     tin = REAL(times)[0];
-    zderiv_func (&neq, &tin, xytmp, dy, zout, ipar) ;
+    zderiv_func (&neq, &tin, xytmp, dy, zv->zout, ctx->ipar) ;
     for (j = 0; j < nout; j++)
-      COMPLEX(YOUT)[j + neq + 1] = zout[j];
+      COMPLEX(ctx->YOUT)[j + neq + 1] = zv->zout[j];
   }
 
 /*                     ####   main time loop   ####                           */
@@ -266,11 +276,11 @@ SEXP call_zvode(SEXP y, SEXP times, SEXP derivfunc, SEXP parms, SEXP rtol,
 
  	  F77_CALL(zvode) (zderiv_func, &neq, xytmp, &tin, &tout,
 			   &itol, Rtol, Atol, &itask, &istate, &iopt, zwork, &lzw, rwork,
-			   &lrw, iwork, &liw, zjac_func, &jt, zout, ipar);
+			   &lrw, iwork, &liw, zjac_func, &jt, zv->zout, ctx->ipar);
 
     /* in case size of timesteps is called for */
-    timesteps [0] = rwork[10];
-    timesteps [1] = rwork[11];
+    ctx->timesteps [0] = rwork[10];
+    ctx->timesteps [1] = rwork[11];
 
     if (istate == -1) {
       warning("an excessive amount of work (> mxstep ) was done, but integration was not successful - increase maxsteps ?");
@@ -289,12 +299,12 @@ SEXP call_zvode(SEXP y, SEXP times, SEXP derivfunc, SEXP parms, SEXP rtol,
   	} else {
     	/*   REAL(YOUT)[(it+1)*(ntot+1)] = tin;*/
       for (j = 0; j < neq; j++)
-	      COMPLEX(YOUT)[(it+1)*(ntot + 1) + j + 1] = xytmp[j];
+	      COMPLEX(ctx->YOUT)[(it+1)*(ntot + 1) + j + 1] = xytmp[j];
 
-	    if (isOut == 1) {
-        zderiv_func (&neq, &tin, xytmp, dy, zout, ipar) ;
+	    if (ctx->isOut == 1) {
+        zderiv_func (&neq, &tin, xytmp, dy, zv->zout, ctx->ipar) ;
 	      for (j = 0; j < nout; j++)
-          COMPLEX(YOUT)[(it+1)*(ntot + 1) + j + neq + 1] = zout[j];
+          COMPLEX(ctx->YOUT)[(it+1)*(ntot + 1) + j + neq + 1] = zv->zout[j];
       }
     }
 
@@ -303,27 +313,27 @@ SEXP call_zvode(SEXP y, SEXP times, SEXP derivfunc, SEXP parms, SEXP rtol,
 	    warning("Returning early from dvode  Results are accurate, as far as they go\n");
 
     	/* redimension YOUT */
-	    PROTECT(YOUT2 = allocMatrix(CPLXSXP,ntot+1,(it+2))); nprot++;
+	    PROTECT(ctx->YOUT2 = allocMatrix(CPLXSXP,ntot+1,(it+2))); nprot++;
 
   	  for (k = 0; k < it+2; k++)
   	    for (j = 0; j < ntot+1; j++)
-  	      COMPLEX(YOUT2)[k*(ntot+1) + j] = COMPLEX(YOUT)[k*(ntot+1) + j];
+  	      COMPLEX(ctx->YOUT2)[k*(ntot+1) + j] = COMPLEX(ctx->YOUT)[k*(ntot+1) + j];
       break;
     }
   }  /* end main time loop */
 
 /*                   ####   returning output   ####                           */
-  PROTECT(ISTATE = allocVector(INTSXP, 23)); nprot++;
-  PROTECT(RWORK = allocVector(REALSXP, 4)); nprot++;
-  terminate(istate, iwork, 23, 0, rwork, 4, 10);
+  PROTECT(ctx->ISTATE = allocVector(INTSXP, 23)); nprot++;
+  PROTECT(ctx->RWORK = allocVector(REALSXP, 4)); nprot++;
+  terminate(ctx, istate, iwork, 23, 0, rwork, 4, 10);
 
-  unlock_solver();
+  leave_context(ctx);
   UNPROTECT(nprot);
 
   if (istate > 0)
-    return(YOUT);
+    return(ctx->YOUT);
   else
-    return(YOUT2);
+    return(ctx->YOUT2);
 }
 
 
@@ -1637,6 +1637,16 @@ C
       RETURN
 110   CONTINUE
 C
+C     deSolve: recompute the SAVEd pointers on continuation calls, so
+C     that a nested call of DDASPK (from RES) cannot overwrite them.
+C
+      NONNEG = 0
+      LID = LICNS
+      IF (INFO(10) .EQ. 1 .OR. INFO(10) .EQ. 3) LID = LICNS + NEQ
+      IF (INFO(10) .EQ. 2 .OR. INFO(10) .EQ. 3) NONNEG = 1
+      LENID = 0
+      IF (INFO(11) .EQ. 1 .OR. INFO(16) .EQ. 1) LENID = NEQ
+C
 C-----------------------------------------------------------------------
 C     This block is executed on all calls.
 C
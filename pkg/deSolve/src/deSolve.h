@@ -12,84 +12,187 @@
 
 
 /*============================================================================
-  global R variables 
+ type definitions for C functions
 ============================================================================*/
+typedef void C_deriv_func_type(int*, double*, double*, double*, double*, int*);
 
-#ifndef EXTERN
-# define EXTERN extern
-#endif
-
-EXTERN double *timesteps; /* see also: R_init_deSolve.c */
+typedef void C_res_func_type(double*, double*, double*, double*, double*,
+                             int*, double*, int*);
 
-EXTERN SEXP YOUT, YOUT2, ISTATE, RWORK, IROOT;    /* returned to R */
-EXTERN SEXP Y, YPRIME , Rin;
+typedef void event_func_type(int*, double*, double*);
 
-EXTERN int     n_eq; 
+/* this is for use in compiled code */
+typedef void init_func_type (void (*)(int*, double*));
 
+/*============================================================================
+  grouped finite difference Jacobians (jacgroups.c): sparsity pattern in
+  column format (ian, jan) and column groups (igp, jgp), 1-based
+============================================================================*/
+typedef struct cpr_data {
+  int     n, ngp, band;
+  int    *ian, *jan, *igp, *jgp;
+  C_deriv_func_type *deriv_func;
+  C_res_func_type   *res_func;     /* daspk */
+  double *f0, *f1, *ytmp, *yptmp, *del;
+  double *jx;                      /* values in column format (radau) */
+} cpr_data;
 
-/* use in daspk */
-EXTERN long int nrowpd;
+/* sparse LU decomposition of radau (sparselu.c) */
+typedef struct splu_data splu_data;
 
-/* output in DLL globals */
-EXTERN int  isOut, *ipar;
-EXTERN double *out;
+/* stiffness detection and method switching of rk (rk_stiff.c) */
+typedef struct rk_switch rk_switch;
 
-/* forcings  */
-EXTERN long int nforc;  /* the number of forcings */
-EXTERN double *tvec;
-EXTERN double *fvec;
-EXTERN int    *ivec;
-EXTERN int    fmethod;
+/* root finding of the explicit methods of rk (rk_root.c) */
+typedef struct rk_root rk_root;
 
-EXTERN int    *findex;
-EXTERN double *intpol;
-EXTERN int    *maxindex;
+/* global outputs of rk captured during the steps (rk_util.c) */
+typedef struct rk_outcap rk_outcap;
 
-EXTERN double *forcings;
+/* integrals, extremes and means of rk over the accepted steps (rk_reduce.c) */
+typedef struct rk_reduce rk_reduce;
 
-/* events */
-EXTERN double tEvent;
-EXTERN int iEvent, nEvent, typeevent, rootevent, Rootsave;
-EXTERN double *troot, *valroot;
-EXTERN int *nrroot, *termroot;
+/*============================================================================
+  solver context
+
+  All state of one running integration lives in a deSolve_context that is
+  owned by the calling C function (call_lsoda, call_radau, call_rkAuto, ...).
+  It is passed explicitly where possible; callbacks with fixed signatures
+  (FORTRAN codes, initfunc, lagvalue, timestep) find it via desolve_ctx,
+  the context of the innermost running solver in the current thread.
+
+  Solvers can be nested: enter_context() saves the FORTRAN common blocks
+  of the enclosing solver, ctx_eval() restores them after an R call. The
+  chain of running solvers is a thread-local stack (deSolve_utils.c), so
+  that unlock_solver() can drop the contexts of solvers aborted by an
+  error without reading them.
+============================================================================*/
 
-EXTERN double *timeevent, *valueevent;
-EXTERN int *svarevent, *methodevent;
+/* length of the FORTRAN common blocks saved by DSVCOM (dsvcom.f) */
+#define LRCOMMON  359
+#define LICOMMON  195
+
+typedef struct deSolve_context {
+  double timesteps[2];                 /* for getTimestep */
+
+  SEXP YOUT, YOUT2, ISTATE, RWORK, IROOT;  /* returned to R */
+  SEXP Rcalls;                 /* preallocated calls of the R functions */
+
+  int     n_eq;
+
+  /* use in daspk */
+  long int nrowpd;
+
+  /* output in DLL */
+  int     isOut, *ipar;
+  double *out;
+
+  /* forcings  */
+  int     finit;
+  long int nforc;  /* the number of forcings */
+  double *tvec;
+  double *fvec;
+  int    *ivec;
+  int     fmethod;
+  int    *findex;
+  double *intpol;
+  int    *maxindex;
+  double *forcings;
+
+  /* events */
+  double  tEvent;
+  int     iEvent, nEvent, typeevent, rootevent, Rootsave;
+  double *troot, *valroot;
+  int    *nrroot, *termroot;
+  double *timeevent, *valueevent;
+  int    *svarevent, *methodevent;
+  event_func_type *event_func;
+
+  /* compiled functions, if wrapped by forcings */
+  C_deriv_func_type *DLL_deriv_func;
+  C_res_func_type   *DLL_res_func;
+
+  /* solver R- functions */
+  SEXP R_deriv_func, R_jac_func, R_jac_vec, R_root_func, R_event_func;
+  SEXP R_envir;
+  /* DAE */
+  SEXP R_res_func, R_daejac_func, R_psol_func, R_mas_func;
+  SEXP de_gparms;
+
+  /* time delays */
+  int     interpolMethod;  /* for time-delays : 1 = hermite; 2=dense; 4=rk */
+  int     indexhist, indexlag, endreached, starthist;
+  double *histvar, *histdvar, *histtime, *histhh, *histsave;
+  int    *histord;
+  int     histsize, offset;
+  int     initialisehist, lyh, lhh, lo;
+
+  /* private data of a particular solver (radau, daspk, zvode) */
+  void   *solver;
+
+  /* column groups for the internal Jacobian, NULL if not used */
+  cpr_data *cpr;
+
+  /* sparse LU decomposition (radau, jactype "sparseint"), NULL if not used */
+  splu_data *splu;
+
+  /* switching of rk to an implicit method in stiff phases, NULL if not used */
+  rk_switch *stiff;
+
+  /* root finding of rk, NULL if not used */
+  rk_root *root;
+
+  /* outputs of rk captured during the steps, NULL if not used */
+  rk_outcap *outcap;
+
+  /* reductions of rk over the accepted steps, NULL if not used */
+  rk_reduce *reduce;
+
+  /* variables kept in the output: positions in (states, global outputs),
+     NULL = all (argument keep, see keepRow) */
+  int    *keep, nkeep;
+
+  /* worker thread of a parallel ensemble: no calls of the R API */
+  int     worker;
+
+  /* nesting */
+  int     nested;              /* common blocks saved in rcommon, icommon */
+  double  rcommon[LRCOMMON];
+  int     icommon[LICOMMON];
+} deSolve_context;
+
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+# define DESOLVE_TLS _Thread_local
+#elif defined(__GNUC__)
+# define DESOLVE_TLS __thread
+#else
+# define DESOLVE_TLS
+#endif
 
-/* time delays */
-EXTERN int interpolMethod;  /* for time-delays : 1 = hermite; 2=dense */
+#ifndef EXTERN
+# define EXTERN extern
+#endif
 
-/*============================================================================
- type definitions for C functions
-============================================================================*/
-typedef void C_deriv_func_type(int*, double*, double*, double*, double*, int*);
-EXTERN C_deriv_func_type* DLL_deriv_func;
+EXTERN DESOLVE_TLS deSolve_context *desolve_ctx; /* see R_init_deSolve.c */
 
-typedef void C_res_func_type(double*, double*, double*, double*, double*,
-                             int*, double*, int*);
-EXTERN C_res_func_type* DLL_res_func;
+void init_context(deSolve_context *ctx);
+void enter_context(deSolve_context *ctx);
+void leave_context(deSolve_context *ctx);
+SEXP ctx_eval(deSolve_context *ctx, SEXP call, SEXP rho);
 
+/* preallocated calls of R functions (ctx_lang, call_arg): slots in Rcalls */
+#define CALL_DERIV   0         /* func, res */
+#define CALL_JAC     1         /* jacfunc (also of daspk) */
+#define CALL_JACVEC  2
+#define CALL_ROOT    3
+#define CALL_EVENT   4
+#define CALL_MAS     5
+#define CALL_PSOL    6         /* psolfunc of daspk */
+#define NRCALLS      7
 
-/* this is for use in compiled code */
-typedef void init_func_type (void (*)(int*, double*));
+SEXP ctx_lang(deSolve_context *ctx, int slot, SEXP func, const char *args, ...);
+SEXP call_arg(SEXP call, int i);
 
-/*============================================================================
-  solver R- global functions 
-============================================================================*/
-EXTERN SEXP R_deriv_func;
-EXTERN SEXP R_jac_func;
-EXTERN SEXP R_jac_vec;
-EXTERN SEXP R_root_func;
-EXTERN SEXP R_event_func;
-EXTERN SEXP R_envir;
-
-/* DAE globals */
-EXTERN SEXP R_res_func;
-EXTERN SEXP R_daejac_func;
-EXTERN SEXP R_psol_func;
-EXTERN SEXP R_mas_func;
-
-EXTERN SEXP de_gparms;
 SEXP getListElement(SEXP list, const char* str);
 
 SEXP getTimestep(void);
@@ -98,18 +201,23 @@ SEXP getTimestep(void);
   C- utilities, functions 
 ============================================================================*/
 
-void lock_solver(void);
-void unlock_solver(void);
+SEXP solver_level(void);
+void unlock_solver(int *level);
 
-void returnearly (int, int, int);
-void terminate(int, int*, int, int, double *, int, int);
+void returnearly (deSolve_context *, int, int, int);
+int  initKeep(deSolve_context *ctx, SEXP Keep, int ntot);
+void keepRow(deSolve_context *ctx, double *dst, int ld, double t, double *y,
+             int neq, double *out);
+void terminate(deSolve_context *, int, int*, int, int, double *, int, int);
 
 /* declarations for initialisations */
 // void initParms(SEXP Initfunc, SEXP Parms);
 void Initdeparms(int*, double*);
 void Initdeforc(int*, double*);
-void initOutR(int isDll, int *nout, int *ntot, int neq, SEXP nOut, SEXP Rpar, SEXP Ipar);
-void initOutC(int isDll, int *nout, int *ntot, int neq, SEXP nOut, SEXP Rpar, SEXP Ipar);
+void initOutR(deSolve_context *ctx, int isDll, int *nout, int *ntot, int neq,
+              SEXP nOut, SEXP Rpar, SEXP Ipar);
+void initOutC(deSolve_context *ctx, int isDll, int *nout, int *ntot, int neq,
+              SEXP nOut, SEXP Rpar, SEXP Ipar);
 
 /* sparsity of Jacobian */
 void sparsity1D(SEXP Type, int* iwork, int neq, int liw);
@@ -118,14 +226,71 @@ void sparsity3D(SEXP Type, int* iwork, int neq, int liw);
 void sparsity2Dmap(SEXP Type, int* iwork, int neq, int liw);  /* testing, since version 1.10.4*/
 void sparsity3Dmap(SEXP Type, int* iwork, int neq, int liw);  /* testing, since version 1.10.4*/
 void interactmap (int *ij, int nnz, int *iwork, int *ipres, int ival);
+
+/* Jacobians by grouped finite differences */
+void initGroups(deSolve_context *ctx, SEXP Sparsity,
+                C_deriv_func_type *deriv_func, int band);
+void cpr_jac(int *neq, double *t, double *y, int *ml, int *mu,
+             double *pd, int *nrowpd, double *yout, int *iout);
+void cpr_daejac(double *t, double *y, double *yprime, double *pd, double *cj,
+                double *yout, int *iout);
+void cpr_spjac(int *neq, double *t, double *y, int *ml, int *mu,
+               double *pd, int *nrowpd, double *yout, int *iout);
+
+/* sparse LU decomposition for radau */
+void initSparseLU(deSolve_context *ctx);
+
+/* output sinks: chunks of rows passed to a compiled function, an R function,
+   a ring buffer of the last rows or a columnar output file (sink.c) */
+typedef void sink_func_type(int *, int *, double *);
+
+typedef struct out_sink {
+  int    type;            /* 1 = compiled, 2 = R function, 3 = ring buffer,
+                             4 = file, 5 = output matrix                    */
+  int    nrow, ncol;      /* rows per chunk (of the ring), columns          */
+  int    ncolin;          /* columns of the chunks, before ctx->keep        */
+  int    *keep, nkeep;    /* kept columns (ctx->keep), NULL = all           */
+  double *kbuf;           /* chunk with the kept columns                    */
+  SEXP   Rmat;            /* output matrix (type 5)                         */
+  int    ntot, iring;     /* rows passed so far, next row of the ring       */
+  sink_func_type *cfun;
+  SEXP   Rfun;
+  double *ring, *last;
+  char   *file;           /* output file: name, rows of a column, offset   */
+  int    nmax;            /* of the first column in bytes                   */
+  double offset;
+} out_sink;
+
+out_sink *initSink(deSolve_context *ctx, SEXP Sink, int ncol);
+out_sink *matrixSink(deSolve_context *ctx, SEXP Yout, int nrow, int ncol);
+void pushSink(deSolve_context *ctx, out_sink *sk, double *x, int nrow,
+              int ld);
+SEXP sinkResult(out_sink *sk);
+
+/* built-in preconditioners of the Krylov methods of daspk and lsodpk
+   (precond.c) */
+void prec_jac(C_res_func_type *res, int *ires, int *neq, double *t,
+              double *y, double *yprime, double *rewt, double *savr,
+              double *wk, double *h, double *cj, double *wp, int *iwp,
+              int *ier, double *rpar, int *ipar);
+void prec_psol(int *neq, double *t, double *y, double *yprime, double *savr,
+               double *wk, double *cj, double *wght, double *wp, int *iwp,
+               double *b, double *eplin, int *ier, double *rpar, int *ipar);
+void prec_blockjac(C_deriv_func_type *f, int *neq, double *t, double *y,
+                   double *ysv, double *rewt, double *fty, double *v,
+                   double *hl0, double *wp, int *iwp, int *ier,
+                   double *rpar, int *ipar);
+void prec_blocksol(int *neq, double *t, double *y, double *fty, double *wk,
+                   double *hl0, double *wp, int *iwp, double *b, int *lr,
+                   int *ier);
 //void initglobals(int, int);
 //void initdaeglobals(int, int);
 
 /* the forcings and event functions */
-void updatedeforc(double*);
-int initForcings(SEXP list);
-int initEvents(SEXP list, SEXP, int);
-void updateevent(double*, double*, int*);
+void updatedeforc(deSolve_context *, double*);
+int initForcings(deSolve_context *, SEXP list);
+int initEvents(deSolve_context *, SEXP list, SEXP, int);
+void updateevent(deSolve_context *, double*, double*, int*);
 
 
 /* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
@@ -149,27 +314,19 @@ double Hermite (double t0, double t1, double y0, double y1, double dy0,
 double dHermite(double t0, double t1, double y0, double y1, double dy0,
                 double dy1, double t);
 
-int initLags(SEXP elag, int solver, int nroot);
+int initLags(deSolve_context *ctx, SEXP elag, int solver, int nroot);
 
 /* history vectors  */
-void inithist(int max, int maxlags, int solver, int nroot);
+void inithist(deSolve_context *ctx, int max, int maxlags, int solver, int nroot);
 
-void updatehistini(double t, double *y, double *dY, double *rwork, int *iwork);
-void updatehist(double t, double *y, double *dy, double *rwork, int *iwork);
+void updatehistini(deSolve_context *ctx, double t, double *y, double *dY,
+                   double *rwork, int *iwork);
+void updatehist(deSolve_context *ctx, double t, double *y, double *dy,
+                double *rwork, int *iwork);
 
-int nexthist(int i);
-double interpolate(int i, int k, double t0, double t1, double t, 
-  double *Yh, int nq); 
-
-
-/*==========================================
-  Global variables for history arrays
-==========================================*/
+int nexthist(deSolve_context *ctx, int i);
+double interpolate(deSolve_context *ctx, int i, int k, double t0, double t1,
+  double t, double *Yh, int nq);
 
-EXTERN int indexhist, indexlag, endreached, starthist;
-EXTERN double *histvar, *histdvar, *histtime, *histhh, *histsave;
-EXTERN int    *histord;
-EXTERN int    histsize, offset;
-EXTERN int    initialisehist, lyh, lhh, lo;
 
 #undef EXTERN
@@ -10,44 +10,129 @@
 #include <R_ext/Applic.h>
 #include <R_ext/BLAS.h>
 #include <R_ext/Rdynload.h>
+#include <string.h>
+#include <stdarg.h>
 #include "deSolve.h"
 #include "externalptr.h"
 
-int solver_locked = 0;   /* prevent nested calls of odepack solvers */
+/* FORTRAN routine that saves and restores the common blocks (dsvcom.f) */
+void F77_NAME(dsvcom)(double *, int *, int *);
 
-void lock_solver(void) {
-  if (solver_locked) {
-    /* important: unlock for the next call *after* error */
-    solver_locked = 0;
-    error("The used combination of solvers cannot be nested.\n");
+/*==================================================
+ Solver context
+===================================================*/
+
+/* the contexts of the running solvers of this thread, innermost last
+   (ctx_stack[0] = NULL); kept here and not in the contexts themselves,
+   which are gone with the C stack frames of their solvers after an error */
+#define MAXNEST 100
+static DESOLVE_TLS deSolve_context *ctx_stack[MAXNEST + 1];
+static DESOLVE_TLS int ctx_depth = 0;
+
+void init_context(deSolve_context *ctx) {
+  memset(ctx, 0, sizeof(deSolve_context));
+  ctx->YOUT = ctx->YOUT2 = ctx->ISTATE = ctx->RWORK = ctx->IROOT = R_NilValue;
+  ctx->R_deriv_func = ctx->R_jac_func = ctx->R_jac_vec = R_NilValue;
+  ctx->R_root_func = ctx->R_event_func = ctx->R_envir = R_NilValue;
+  ctx->R_res_func = ctx->R_daejac_func = ctx->R_psol_func = R_NilValue;
+  ctx->R_mas_func = ctx->de_gparms = ctx->Rcalls = R_NilValue;
+  ctx->interpolMethod = 1;
+}
+
+/* make ctx the current context; if a solver is called from the model
+   function of another one, rescue the FORTRAN common blocks of the
+   enclosing solver first (only once per R call, see ctx_eval) */
+void enter_context(deSolve_context *ctx) {
+  int job = 1;
+  deSolve_context *outer = desolve_ctx;
+
+  if (ctx_depth >= MAXNEST) error("too many nested calls of solvers");
+  if (outer != NULL && !outer->nested) {
+    F77_CALL(dsvcom)(outer->rcommon, outer->icommon, &job);
+    outer->nested = 1;
   }
-  solver_locked = 1;
+  ctx_stack[++ctx_depth] = ctx;
+  desolve_ctx = ctx;
 }
 
-void unlock_solver(void) {
-  solver_locked = 0;
-  timesteps[0] = 0;
-  timesteps[1] = 0;
+void leave_context(deSolve_context *ctx) {
+  if (ctx_depth > 0 && ctx_stack[ctx_depth] == ctx) ctx_depth--;
+  desolve_ctx = ctx_stack[ctx_depth];
 }
 
+/* evaluate an R function on behalf of the solver that owns ctx;
+   R code may have called (and maybe aborted) other solvers in between */
+SEXP ctx_eval(deSolve_context *ctx, SEXP call, SEXP rho) {
+  int job = 2;
+  SEXP ans = eval(call, rho);
 
-/* Globals :*/
-// SEXP R_deriv_func;
-// SEXP R_jac_func;
-// SEXP R_jac_vec;
-// SEXP R_root_func;
-// SEXP R_event_func;
+  desolve_ctx = ctx;
+  if (ctx->nested) {
+    F77_CALL(dsvcom)(ctx->rcommon, ctx->icommon, &job);
+    ctx->nested = 0;
+  }
+  return ans;
+}
 
-// SEXP R_envir;
-// SEXP odesolve_gparms;
+/* the call of an R function of the solver, e.g. func(t, y, parms); it is
+   created at the first evaluation and kept in ctx->Rcalls (allocated and
+   protected by the solver, NRCALLS slots), so that the stages of a solver
+   only overwrite the values of the arguments, see call_arg.
+   args gives the types of the arguments: 'd' double, 'i' integer and
+   'z' complex vectors, followed by their length (int), or 's' for an
+   existing object (SEXP), e.g. the parameters */
+SEXP ctx_lang(deSolve_context *ctx, int slot, SEXP func, const char *args, ...) {
+  SEXP call = VECTOR_ELT(ctx->Rcalls, slot), s;
+  int i, n = strlen(args);
+  va_list ap;
+
+  if (isNull(call)) {
+    PROTECT(s = allocList(n));
+    PROTECT(call = LCONS(func, s));
+    va_start(ap, args);
+    for (i = 0, s = CDR(call); i < n; i++, s = CDR(s)) {
+      switch (args[i]) {
+        case 'd': SETCAR(s, allocVector(REALSXP, va_arg(ap, int))); break;
+        case 'i': SETCAR(s, allocVector(INTSXP,  va_arg(ap, int))); break;
+        case 'z': SETCAR(s, allocVector(CPLXSXP, va_arg(ap, int))); break;
+        default : SETCAR(s, va_arg(ap, SEXP));
+      }
+    }
+    va_end(ap);
+    SET_VECTOR_ELT(ctx->Rcalls, slot, call);
+    UNPROTECT(2);
+  }
+  return call;
+}
 
-// SEXP R_res_func;
-// SEXP R_daejac_func;
-// SEXP R_psol_func;
+/* argument i (1, 2, ...) of a call created by ctx_lang, to be overwritten
+   in place; if R code kept a reference to it in the previous evaluation
+   (e.g. assigned the state vector to a global variable), a fresh vector
+   is put into the call instead, so that this copy is not modified */
+SEXP call_arg(SEXP call, int i) {
+  SEXP s = call, x;
+
+  while (i-- > 0) s = CDR(s);
+  x = CAR(s);
+  if (MAYBE_SHARED(x)) {
+    x = allocVector(TYPEOF(x), XLENGTH(x));
+    SETCAR(s, x);
+  }
+  return x;
+}
 
-// SEXP R_mas_func;
+/* number of running solvers, taken by the R functions before a solver is
+   called (solver_level) and restored via on.exit() (unlock_solver): after
+   an error, the contexts of the aborted solvers are removed without
+   reading them, the enclosing solver (if any) is still running */
+SEXP solver_level(void) {
+  return ScalarInteger(ctx_depth);
+}
 
-// SEXP de_gparms;
+void unlock_solver(int *level) {
+  if (*level >= 0 && *level < ctx_depth) ctx_depth = *level;
+  desolve_ctx = ctx_stack[ctx_depth];
+}
 
 
 /*======================================================
@@ -57,6 +142,7 @@ note: forcing initialisation function is in forcings.c
 
 void Initdeparms(int *N, double *parms) {
   int i, Nparms;
+  SEXP de_gparms = desolve_ctx->de_gparms;
   Nparms = LENGTH(de_gparms);
   if ((*N) != Nparms) {
     warning("Number of parameters passed to solver, %i; number in DLL, %i\n",
@@ -68,7 +154,8 @@ void Initdeparms(int *N, double *parms) {
 }
 
 SEXP get_deSolve_gparms(void) {
-  return de_gparms;
+  if (desolve_ctx == NULL) return R_NilValue;
+  return desolve_ctx->de_gparms;
 }
 
 /*===========================================================================
@@ -77,12 +164,12 @@ SEXP get_deSolve_gparms(void) {
 SEXP getTimestep(void) {
   SEXP value;
   PROTECT(value = NEW_NUMERIC(2));
-  if (timesteps == NULL) {         /* integration not yet started... */
+  if (desolve_ctx == NULL) {       /* integration not yet started... */
     for (int i = 0; i < 2; i++)
       NUMERIC_POINTER(value)[i] = 0.0;
   } else
     for (int i = 0; i < 2; i++)
-      NUMERIC_POINTER(value)[i] = timesteps[i];
+      NUMERIC_POINTER(value)[i] = desolve_ctx->timesteps[i];
   UNPROTECT(1);
   return(value);
 }
@@ -92,7 +179,7 @@ SEXP getTimestep(void) {
 ===================================================*/
 
 /* an error occurred - save output in YOUT2 */
-void returnearly (int Print, int it, int ntot) {
+void returnearly (deSolve_context *ctx, int Print, int it, int ntot) {
   int j, k;
   if (Print)
     warning("Returning early. Results are accurate, as far as they go\n");
@@ -100,33 +187,61 @@ void returnearly (int Print, int it, int ntot) {
   //PROTECT(YOUT2 = allocMatrix(REALSXP,ntot+1,(it+2))); //incr_N_Protect();
   for (k = 0; k < it+2; k++)
     for (j = 0; j < ntot+1; j++)
-      REAL(YOUT2)[k*(ntot+1) + j] = REAL(YOUT)[k*(ntot+1) + j];
+      REAL(ctx->YOUT2)[k*(ntot+1) + j] = REAL(ctx->YOUT)[k*(ntot+1) + j];
   //UNPROTECT(1); // thpe
 }
 
+/* variables kept in the output (argument keep): Keep has their 0-based
+   positions in (states, global outputs), or is NULL for all of them;
+   returns the number of output columns without time */
+int initKeep(deSolve_context *ctx, SEXP Keep, int ntot) {
+  if (isNull(Keep)) {
+    ctx->keep  = NULL;
+    ctx->nkeep = ntot;
+  } else {
+    ctx->keep  = INTEGER(Keep);
+    ctx->nkeep = LENGTH(Keep);
+  }
+  return ctx->nkeep;
+}
+
+/* one output row: time, then the kept values of the states y and of the
+   global outputs out, stored with a stride of ld (ld = 1: a column of the
+   transposed output of lsoda, ld = nt: a row of an nt x ... matrix) */
+void keepRow(deSolve_context *ctx, double *dst, int ld, double t, double *y,
+             int neq, double *out) {
+  int i, k;
+
+  dst[0] = t;
+  for (i = 0; i < ctx->nkeep; i++) {
+    k = (ctx->keep == NULL) ? i : ctx->keep[i];
+    dst[(i + 1) * ld] = (k < neq) ? y[k] : out[k - neq];
+  }
+}
+
 /* add ISTATE and RSTATE */
-void terminate(int istate, int * iwork, int ilen, int ioffset,
+void terminate(deSolve_context *ctx, int istate, int * iwork, int ilen, int ioffset,
   double * rwork, int rlen, int roffset) {
 
   int k;
 
   //PROTECT(ISTATE = allocVector(INTSXP, ilen)); //incr_N_Protect();
-  for (k = 0; k < ilen-1; k++) INTEGER(ISTATE)[k+1] = iwork[k +ioffset];
-  INTEGER(ISTATE)[0] = istate;
+  for (k = 0; k < ilen-1; k++) INTEGER(ctx->ISTATE)[k+1] = iwork[k +ioffset];
+  INTEGER(ctx->ISTATE)[0] = istate;
 
   //PROTECT(RWORK = allocVector(REALSXP, rlen)); //incr_N_Protect();
-  for (k = 0; k < rlen; k++) REAL(RWORK)[k] = rwork[k+roffset];
+  for (k = 0; k < rlen; k++) REAL(ctx->RWORK)[k] = rwork[k+roffset];
   if (istate > 0) {
-    setAttrib(YOUT, install("istate"), ISTATE);
-    setAttrib(YOUT, install("rstate"), RWORK);
+    setAttrib(ctx->YOUT, install("istate"), ctx->ISTATE);
+    setAttrib(ctx->YOUT, install("rstate"), ctx->RWORK);
   }
   else  {
-    setAttrib(YOUT2, install("istate"), ISTATE);
-    setAttrib(YOUT2, install("rstate"), RWORK);
+    setAttrib(ctx->YOUT2, install("istate"), ctx->ISTATE);
+    setAttrib(ctx->YOUT2, install("rstate"), ctx->RWORK);
   }
   /* timestep = 0 - for use in getTimestep */
-  timesteps[0] = 0;
-  timesteps[1] = 0;
+  ctx->timesteps[0] = 0;
+  ctx->timesteps[1] = 0;
   //UNPROTECT(2); //thpe
 }
 
@@ -158,23 +273,25 @@ SEXP getListElement(SEXP list, const char *str) {
 
 /* Initialise output - output variables calculated in R-code ... */
 
-void initOutR(int isDll, int *nout, int *ntot, int neq, SEXP nOut, SEXP Rpar, SEXP Ipar) {
+void initOutR(deSolve_context *ctx, int isDll, int *nout, int *ntot, int neq,
+              SEXP nOut, SEXP Rpar, SEXP Ipar) {
 
-  int j, lrpar, lipar;
+  int j, lrpar, lipar, *ipar;
+  double *out;
   *nout = INTEGER(nOut)[0];       /* number of output variables */
   if (isDll) {                   /* function is a dll */
-    if (*nout > 0) isOut = 1;
+    if (*nout > 0) ctx->isOut = 1;
     *ntot  = neq + *nout;          /* length of yout */
     lrpar = *nout + LENGTH(Rpar); /* length of rpar; LENGTH(Rpar) is always >0 */
     lipar = 3 + LENGTH(Ipar);    /* length of ipar */
   } else {                       /* function is not a dll */
-    isOut = 0;
+    ctx->isOut = 0;
     *ntot = neq;
     lipar = 1;
     lrpar = 1;
   }
-  out  = (double*) R_alloc(lrpar, sizeof(double));
-  ipar = (int*)    R_alloc(lipar, sizeof(int));
+  ctx->out  = out  = (double*) R_alloc(lrpar, sizeof(double));
+  ctx->ipar = ipar = (int*)    R_alloc(lipar, sizeof(int));
   if (isDll ==1) {
     ipar[0] = *nout;              /* first 3 elements of ipar are special */
     ipar[1] = lrpar;
@@ -192,13 +309,15 @@ void initOutR(int isDll, int *nout, int *ntot, int neq, SEXP nOut, SEXP Rpar, SE
 
 /* Initialise output - output variables calculated in C-code ... */
 
-void initOutC(int isDll, int *nout, int *ntot, int neq, SEXP nOut, SEXP Rpar, SEXP Ipar) {
-  int j, lrpar, lipar;
+void initOutC(deSolve_context *ctx, int isDll, int *nout, int *ntot, int neq,
+              SEXP nOut, SEXP Rpar, SEXP Ipar) {
+  int j, lrpar, lipar, *ipar;
+  double *out;
   /* initialise output when a dae ... */
   /*  output always done here in C-code (<-> lsode, vode)... */
 
   *nout  = INTEGER(nOut)[0];
-  *ntot  = n_eq+*nout;
+  *ntot  = ctx->n_eq+*nout;
 
   if (isDll == 1) {                /* function is a dll */
     lrpar = *nout + LENGTH(Rpar);   /* length of rpar */
@@ -207,8 +326,8 @@ void initOutC(int isDll, int *nout, int *ntot, int neq, SEXP nOut, SEXP Rpar, SE
     lipar = 3;
     lrpar = *nout;
   }
-  out   = (double*) R_alloc(lrpar, sizeof(double));
-  ipar  = (int*)    R_alloc(lipar, sizeof(int));
+  ctx->out  = out  = (double*) R_alloc(lrpar, sizeof(double));
+  ctx->ipar = ipar = (int*)    R_alloc(lipar, sizeof(int));
 
   if (isDll == 1) {
     ipar[0] = *nout;                /* first 3 elements of ipar are special */
@@ -0,0 +1,615 @@
+C  The code in this file is based on ODEPACK from netlib
+C    https://www.netlib.org/odepack/
+C
+C  Original author: Alan C. Hindmarsh, Peter N. Brown
+C
+C  Driver DLSODPK, the Livermore solver with preconditioned Krylov
+C    iteration; built on DSTODPK, DPKSET and DSOLPK (opkda1.f), for use
+C    in R package deSolve.
+C
+
+*DECK DLSODPK
+      SUBROUTINE DLSODPK (F, NEQ, Y, T, TOUT, ITOL, RTOL, ATOL, ITASK,
+     1                  ISTATE, IOPT, RWORK, LRW, IWORK, LIW, JAC, PSOL,
+     2                  MF, rpar, ipar)
+      EXTERNAL F, JAC, PSOL
+CKS: added rpar, ipar
+      integer ipar(*)
+      double precision rpar(*)
+
+      INTEGER NEQ, ITOL, ITASK, ISTATE, IOPT, LRW, IWORK, LIW, MF
+      DOUBLE PRECISION Y, T, TOUT, RTOL, ATOL, RWORK
+      DIMENSION NEQ(*), Y(*), RTOL(*), ATOL(*), RWORK(LRW), IWORK(LIW)
+C-----------------------------------------------------------------------
+C DLSODPK solves the initial value problem dy/dt = f(t,y) as DLSODE,
+C but the linear systems of the Newton iteration, with matrix
+C P = I - h*el(1)*J, are solved by a preconditioned Krylov method,
+C so that the Jacobian J is never formed.  The arguments are those of
+C DLSODE, except for:
+C
+C PSOL   = subroutine that solves the preconditioner system P1 x = b,
+C          with P1 an approximation of (a factor of) P:
+C               SUBROUTINE PSOL (NEQ, T, Y, FTY, WK, HL0, WP, IWP,
+C                                B, LR, IER)
+C          B holds b on input and x on output; LR = 1 (left) or 2
+C          (right preconditioning), or 0 (MITER = 9).  IER = 0 if
+C          successful, .gt. 0 for a recoverable, .lt. 0 for an
+C          unrecoverable error.
+C JAC    = subroutine that computes and processes the preconditioner
+C          data in WP and IWP, called if JACFLG = 1:
+C               SUBROUTINE JAC (F, NEQ, T, Y, YSV, REWT, FTY, V, HL0,
+C                               WP, IWP, IER, RPAR, IPAR)
+C          FTY = f(T,Y), REWT the reciprocal error weights, V a work
+C          array of length NEQ and HL0 = h*el(1).
+C MF     = 10*METH + MITER.  METH = 1 (Adams) or 2 (BDF); MITER:
+C            0  functional iteration (no linear systems),
+C            1  SPIOM, incomplete orthogonalization,
+C            2  SPIGMR, GMRES,
+C            3  PCG, preconditioned conjugate gradient,
+C            4  PCGS, PCG for symmetric P,
+C            9  PSOL only, no Krylov iteration.
+C
+C Inputs in IWORK and RWORK for MITER .ge. 1:
+C   IWORK(1) = LWP, the length of WP;  IWORK(2) = LIWP, length of IWP;
+C   IWORK(3) = JPRE, 0 = no preconditioning, 1 = left, 2 = right,
+C              3 = both sides;
+C   IWORK(4) = JACFLG, 1 if JAC is to be called, else 0.
+C Optional inputs (IOPT = 1), in addition to those of DLSODE:
+C   IWORK(8) = MAXL, maximum Krylov dimension (default 5);
+C   IWORK(9) = KMP, vectors used in orthogonalization (default MAXL);
+C   RWORK(8) = DELT, convergence test constant (default 0.05).
+C
+C Work array lengths:
+C   LRW .ge. 20 + NYH*(MAXORD+1) + 3*NEQ + LENWK + LWP (+ NEQ if
+C            MITER .ge. 1), with LENWK = NEQ*(MAXL+2) + MAXL**2
+C            (MITER = 1), NEQ*(MAXL+2+MIN(1,MAXL-KMP)) + (MAXL+3)*MAXL
+C            + 1 (MITER = 2), 5*NEQ (MITER = 3 or 4), 2*NEQ (MITER = 9);
+C   LIW .ge. 30 + LIWP (+ MAXL if MITER = 1).
+C   WP starts at RWORK(20 + NYH*(MAXORD+1) + LENWK + 1),
+C   IWP at IWORK(31 + MAXL) if MITER = 1, at IWORK(31) otherwise.
+C
+C Optional outputs, in addition to those of DLSODE:
+C   IWORK(19) = NNI, number of nonlinear iterations,
+C   IWORK(20) = NLI, number of linear (Krylov) iterations,
+C   IWORK(21) = NPS, number of PSOL calls,
+C   IWORK(22) = NCFN, number of nonlinear convergence failures,
+C   IWORK(23) = NCFL, number of linear convergence failures.
+C ISTATE = -7 on return means that JAC or PSOL failed unrecoverably.
+C-----------------------------------------------------------------------
+      DOUBLE PRECISION DUMACH, DVNORM
+      INTEGER INIT, MXSTEP, MXHNIL, NHNIL, NSLAST, NYH, IOWNS,
+     1   ICF, IERPJ, IERSL, JCUR, JSTART, KFLAG, L,
+     2   LYH, LEWT, LACOR, LSAVF, LWM, LIWM, METH, MITER,
+     3   MAXORD, MAXCOR, MSBP, MXNCF, N, NQ, NST, NFE, NJE, NQU
+      INTEGER JPRE, JACFLG, LOCWP, LOCIWP, LSAVX, KMP, MAXL, MNEWT,
+     1   NNI, NLI, NPS, NCFN, NCFL
+      INTEGER I, I1, I2, IFLAG, IMXER, KGO, LF0, LENIW, LENIWK,
+     1   LENRW, LENWK, LENWM, LIWP, LWP, MORD, MXHNL0, MXSTP0
+      DOUBLE PRECISION ROWNS,
+     1   CCMAX, EL0, H, HMIN, HMXI, HU, RC, TN, UROUND
+      DOUBLE PRECISION DELT, EPCON, SQRTN, RSQRTN
+      DOUBLE PRECISION ATOLI, AYI, BIG, EWTI, H0, HMAX, HMX, RH, RTOLI,
+     1   TCRIT, TDIST, TNEXT, TOL, TOLSF, TP, SIZE, SUM, W0
+      DIMENSION MORD(2)
+      LOGICAL IHIT
+      CHARACTER(LEN=80) MSG
+      SAVE MORD, MXSTP0, MXHNL0
+      COMMON /DLS001/ ROWNS(209),
+     1   CCMAX, EL0, H, HMIN, HMXI, HU, RC, TN, UROUND,
+     2   INIT, MXSTEP, MXHNIL, NHNIL, NSLAST, NYH, IOWNS(6),
+     3   ICF, IERPJ, IERSL, JCUR, JSTART, KFLAG, L,
+     4   LYH, LEWT, LACOR, LSAVF, LWM, LIWM, METH, MITER,
+     5   MAXORD, MAXCOR, MSBP, MXNCF, N, NQ, NST, NFE, NJE, NQU
+      COMMON /DLPK01/ DELT, EPCON, SQRTN, RSQRTN,
+     1   JPRE, JACFLG, LOCWP, LOCIWP, LSAVX, KMP, MAXL, MNEWT,
+     2   NNI, NLI, NPS, NCFN, NCFL
+      DATA  MORD(1),MORD(2)/12,5/, MXSTP0/500/, MXHNL0/10/
+C-----------------------------------------------------------------------
+C Block A: legality of ISTATE and ITASK, as in DLSODE.
+C-----------------------------------------------------------------------
+      IHIT = .TRUE.
+      IF (ISTATE .LT. 1 .OR. ISTATE .GT. 3) GO TO 601
+      IF (ITASK .LT. 1 .OR. ITASK .GT. 5) GO TO 602
+      IF (ISTATE .EQ. 1) GO TO 10
+      IF (INIT .EQ. 0) GO TO 603
+      IF (ISTATE .EQ. 2) GO TO 200
+      GO TO 20
+ 10   INIT = 0
+      IF (TOUT .EQ. T) RETURN
+C-----------------------------------------------------------------------
+C Block B: inputs, optional inputs, pointers and lengths of the work
+C arrays.  RWORK holds YH, WM (Krylov work space, then WP), EWT, SAVF,
+C SAVX and ACOR; IWORK holds the Krylov work space, then IWP, from 31.
+C-----------------------------------------------------------------------
+ 20   IF (NEQ(1) .LE. 0) GO TO 604
+      IF (ISTATE .EQ. 1) GO TO 25
+      IF (NEQ(1) .GT. N) GO TO 605
+ 25   N = NEQ(1)
+      IF (ITOL .LT. 1 .OR. ITOL .GT. 4) GO TO 606
+      IF (IOPT .LT. 0 .OR. IOPT .GT. 1) GO TO 607
+      METH = MF/10
+      MITER = MF - 10*METH
+      IF (METH .LT. 1 .OR. METH .GT. 2) GO TO 608
+      IF (MITER .LT. 0) GO TO 608
+      IF (MITER .GT. 4 .AND. MITER .LT. 9) GO TO 608
+      IF (MITER .GT. 9) GO TO 608
+      JPRE = 0
+      JACFLG = 0
+      IF (MITER .GE. 1) JPRE = IWORK(3)
+      IF (MITER .GE. 1) JACFLG = IWORK(4)
+      IF (JPRE .LT. 0 .OR. JPRE .GT. 3) GO TO 609
+      IF (JACFLG .LT. 0 .OR. JACFLG .GT. 1) GO TO 610
+      IF (IOPT .EQ. 1) GO TO 40
+      MAXORD = MORD(METH)
+      MXSTEP = MXSTP0
+      MXHNIL = MXHNL0
+      IF (ISTATE .EQ. 1) H0 = 0.0D0
+      HMXI = 0.0D0
+      HMIN = 0.0D0
+      MAXL = MIN(5,N)
+      KMP = MAXL
+      DELT = 0.05D0
+      GO TO 60
+ 40   MAXORD = IWORK(5)
+      IF (MAXORD .LT. 0) GO TO 611
+      IF (MAXORD .EQ. 0) MAXORD = 100
+      MAXORD = MIN(MAXORD,MORD(METH))
+      MXSTEP = IWORK(6)
+      IF (MXSTEP .LT. 0) GO TO 612
+      IF (MXSTEP .EQ. 0) MXSTEP = MXSTP0
+      MXHNIL = IWORK(7)
+      IF (MXHNIL .LT. 0) GO TO 613
+      IF (MXHNIL .EQ. 0) MXHNIL = MXHNL0
+      IF (ISTATE .NE. 1) GO TO 50
+      H0 = RWORK(5)
+      IF ((TOUT - T)*H0 .LT. 0.0D0) GO TO 614
+ 50   HMAX = RWORK(6)
+      IF (HMAX .LT. 0.0D0) GO TO 615
+      HMXI = 0.0D0
+      IF (HMAX .GT. 0.0D0) HMXI = 1.0D0/HMAX
+      HMIN = RWORK(7)
+      IF (HMIN .LT. 0.0D0) GO TO 616
+      MAXL = IWORK(8)
+      IF (MAXL .EQ. 0) MAXL = 5
+      MAXL = MIN(MAXL,N)
+      KMP = IWORK(9)
+      IF (KMP .EQ. 0 .OR. KMP .GT. MAXL) KMP = MAXL
+      DELT = RWORK(8)
+      IF (DELT .EQ. 0.0D0) DELT = 0.05D0
+ 60   LYH = 21
+      IF (ISTATE .EQ. 1) NYH = N
+      LWM = LYH + (MAXORD + 1)*NYH
+      LENWK = 0
+      IF (MITER .EQ. 1) LENWK = N*(MAXL+2) + MAXL*MAXL
+      IF (MITER .EQ. 2)
+     1   LENWK = N*(MAXL+2+MIN(1,MAXL-KMP)) + (MAXL+3)*MAXL + 1
+      IF (MITER .EQ. 3 .OR. MITER .EQ. 4) LENWK = 5*N
+      IF (MITER .EQ. 9) LENWK = 2*N
+      LWP = 0
+      IF (MITER .GE. 1) LWP = IWORK(1)
+      LENWM = LENWK + LWP
+      LOCWP = LENWK + 1
+      LEWT = LWM + LENWM
+      LSAVF = LEWT + N
+      LSAVX = LSAVF + N
+      LACOR = LSAVX + N
+      IF (MITER .EQ. 0) LACOR = LSAVF + N
+      LENRW = LACOR + N - 1
+      IWORK(17) = LENRW
+      LIWM = 31
+      LENIWK = 0
+      IF (MITER .EQ. 1) LENIWK = MAXL
+      LIWP = 0
+      IF (MITER .GE. 1) LIWP = IWORK(2)
+      LENIW = 30 + LENIWK + LIWP
+      LOCIWP = LENIWK + 1
+      IWORK(18) = LENIW
+      IF (LENRW .GT. LRW) GO TO 617
+      IF (LENIW .GT. LIW) GO TO 618
+      RTOLI = RTOL(1)
+      ATOLI = ATOL(1)
+      DO 70 I = 1,N
+        IF (ITOL .GE. 3) RTOLI = RTOL(I)
+        IF (ITOL .EQ. 2 .OR. ITOL .EQ. 4) ATOLI = ATOL(I)
+        IF (RTOLI .LT. 0.0D0) GO TO 619
+        IF (ATOLI .LT. 0.0D0) GO TO 620
+ 70     CONTINUE
+      SQRTN = SQRT(REAL(N))
+      RSQRTN = 1.0D0/SQRTN
+      IF (ISTATE .EQ. 1) GO TO 100
+C ISTATE = 3: flag parameter changes to DSTODPK ------------------------
+      JSTART = -1
+      IF (NQ .LE. MAXORD) GO TO 90
+      DO 80 I = 1,N
+        RWORK(I+LSAVF-1) = RWORK(I+LWM-1)
+ 80   CONTINUE
+ 90   IF (N .EQ. NYH) GO TO 200
+      I1 = LYH + L*NYH
+      I2 = LYH + (MAXORD + 1)*NYH - 1
+      IF (I1 .GT. I2) GO TO 200
+      DO 95 I = I1,I2
+        RWORK(I) = 0.0D0
+ 95   CONTINUE
+      GO TO 200
+C-----------------------------------------------------------------------
+C Block C: first call (ISTATE = 1), as in DLSODE; the counters of the
+C Krylov iteration are set to zero.
+C-----------------------------------------------------------------------
+ 100  UROUND = DUMACH()
+      TN = T
+      IF (ITASK .NE. 4 .AND. ITASK .NE. 5) GO TO 110
+      TCRIT = RWORK(1)
+      IF ((TCRIT - TOUT)*(TOUT - T) .LT. 0.0D0) GO TO 625
+      IF (H0 .NE. 0.0D0 .AND. (T + H0 - TCRIT)*H0 .GT. 0.0D0)
+     1   H0 = TCRIT - T
+ 110  JSTART = 0
+      NHNIL = 0
+      NST = 0
+      NJE = 0
+      NSLAST = 0
+      HU = 0.0D0
+      NQU = 0
+      CCMAX = 0.3D0
+      MAXCOR = 3
+      MSBP = 20
+      MXNCF = 10
+      NNI = 0
+      NLI = 0
+      NPS = 0
+      NCFN = 0
+      NCFL = 0
+      LF0 = LYH + NYH
+      CALL F (NEQ, T, Y, RWORK(LF0), rpar, ipar)
+      NFE = 1
+      DO 115 I = 1,N
+        RWORK(I+LYH-1) = Y(I)
+ 115  CONTINUE
+      NQ = 1
+      H = 1.0D0
+      CALL DEWSET (N, ITOL, RTOL, ATOL, RWORK(LYH), RWORK(LEWT))
+      DO 120 I = 1,N
+        IF (RWORK(I+LEWT-1) .LE. 0.0D0) GO TO 621
+        RWORK(I+LEWT-1) = 1.0D0/RWORK(I+LEWT-1)
+ 120  CONTINUE
+      IF (H0 .NE. 0.0D0) GO TO 180
+      TDIST = ABS(TOUT - T)
+      W0 = MAX(ABS(T),ABS(TOUT))
+      IF (TDIST .LT. 2.0D0*UROUND*W0) GO TO 622
+      TOL = RTOL(1)
+      IF (ITOL .LE. 2) GO TO 140
+      DO 130 I = 1,N
+        TOL = MAX(TOL,RTOL(I))
+ 130  CONTINUE
+ 140  IF (TOL .GT. 0.0D0) GO TO 160
+      ATOLI = ATOL(1)
+      DO 150 I = 1,N
+        IF (ITOL .EQ. 2 .OR. ITOL .EQ. 4) ATOLI = ATOL(I)
+        AYI = ABS(Y(I))
+        IF (AYI .NE. 0.0D0) TOL = MAX(TOL,ATOLI/AYI)
+ 150    CONTINUE
+ 160  TOL = MAX(TOL,100.0D0*UROUND)
+      TOL = MIN(TOL,0.001D0)
+      SUM = DVNORM (N, RWORK(LF0), RWORK(LEWT))
+      SUM = 1.0D0/(TOL*W0*W0) + TOL*SUM**2
+      H0 = 1.0D0/SQRT(SUM)
+      H0 = MIN(H0,TDIST)
+      H0 = SIGN(H0,TOUT-T)
+ 180  RH = ABS(H0)*HMXI
+      IF (RH .GT. 1.0D0) H0 = H0/RH
+      H = H0
+      DO 190 I = 1,N
+        RWORK(I+LF0-1) = H0*RWORK(I+LF0-1)
+ 190  CONTINUE
+      GO TO 270
+C-----------------------------------------------------------------------
+C Block D: continuation calls (ISTATE = 2 or 3), as in DLSODE.
+C-----------------------------------------------------------------------
+ 200  NSLAST = NST
+      IF (ITASK .EQ. 1) THEN
+        GOTO 210
+      ELSE IF (ITASK .EQ. 2) THEN
+        GOTO 250
+      ELSE IF (ITASK .EQ. 3) THEN
+        GOTO 220
+      ELSE IF (ITASK .EQ. 4) THEN
+        GOTO 230
+      ELSE IF (ITASK .EQ. 5) THEN
+        GOTO 240
+      ENDIF
+ 210  IF ((TN - TOUT)*H .LT. 0.0D0) GO TO 250
+      CALL DINTDY (TOUT, 0, RWORK(LYH), NYH, Y, IFLAG)
+      IF (IFLAG .NE. 0) GO TO 627
+      T = TOUT
+      GO TO 420
+ 220  TP = TN - HU*(1.0D0 + 100.0D0*UROUND)
+      IF ((TP - TOUT)*H .GT. 0.0D0) GO TO 623
+      IF ((TN - TOUT)*H .LT. 0.0D0) GO TO 250
+      GO TO 400
+ 230  TCRIT = RWORK(1)
+      IF ((TN - TCRIT)*H .GT. 0.0D0) GO TO 624
+      IF ((TCRIT - TOUT)*H .LT. 0.0D0) GO TO 625
+      IF ((TN - TOUT)*H .LT. 0.0D0) GO TO 245
+      CALL DINTDY (TOUT, 0, RWORK(LYH), NYH, Y, IFLAG)
+      IF (IFLAG .NE. 0) GO TO 627
+      T = TOUT
+      GO TO 420
+ 240  TCRIT = RWORK(1)
+      IF ((TN - TCRIT)*H .GT. 0.0D0) GO TO 624
+ 245  HMX = ABS(TN) + ABS(H)
+      IHIT = ABS(TN - TCRIT) .LE. 100.0D0*UROUND*HMX
+      IF (IHIT) GO TO 400
+      TNEXT = TN + H*(1.0D0 + 4.0D0*UROUND)
+      IF ((TNEXT - TCRIT)*H .LE. 0.0D0) GO TO 250
+      H = (TCRIT - TN)*(1.0D0 - 4.0D0*UROUND)
+      IF (ISTATE .EQ. 2) JSTART = -2
+C-----------------------------------------------------------------------
+C Block E: the loop over steps, with calls of DSTODPK.
+C-----------------------------------------------------------------------
+ 250  CONTINUE
+      IF ((NST-NSLAST) .GE. MXSTEP) GO TO 500
+      CALL DEWSET (N, ITOL, RTOL, ATOL, RWORK(LYH), RWORK(LEWT))
+      DO 260 I = 1,N
+        IF (RWORK(I+LEWT-1) .LE. 0.0D0) GO TO 510
+        RWORK(I+LEWT-1) = 1.0D0/RWORK(I+LEWT-1)
+ 260  CONTINUE
+ 270  TOLSF = UROUND*DVNORM (N, RWORK(LYH), RWORK(LEWT))
+      IF (TOLSF .LE. 1.0D0) GO TO 280
+      TOLSF = TOLSF*2.0D0
+      IF (NST .EQ. 0) GO TO 626
+      GO TO 520
+ 280  IF ((TN + H) .NE. TN) GO TO 290
+      NHNIL = NHNIL + 1
+      IF (NHNIL .GT. MXHNIL) GO TO 290
+      MSG = 'DLSODPK- Warning..internal T (=R1) and H (=R2) are'
+      CALL XERRWD (MSG, 50, 101, 0, 0, 0, 0, 0, 0.0D0, 0.0D0)
+      MSG='      such that in the machine, T + H = T on the next step  '
+      CALL XERRWD (MSG, 60, 101, 0, 0, 0, 0, 0, 0.0D0, 0.0D0)
+      MSG = '      (H = step size). Solver will continue anyway'
+      CALL XERRWD (MSG, 50, 101, 0, 0, 0, 0, 2, TN, H)
+      IF (NHNIL .LT. MXHNIL) GO TO 290
+      MSG = 'DLSODPK- Above warning has been issued I1 times.  '
+      CALL XERRWD (MSG, 50, 102, 0, 0, 0, 0, 0, 0.0D0, 0.0D0)
+      MSG = '      It will not be issued again for this problem'
+      CALL XERRWD (MSG, 50, 102, 0, 1, MXHNIL, 0, 0, 0.0D0, 0.0D0)
+ 290  CONTINUE
+      CALL DSTODPK (NEQ, Y, RWORK(LYH), NYH, RWORK(LYH), RWORK(LEWT),
+     1   RWORK(LSAVF), RWORK(LSAVX), RWORK(LACOR), RWORK(LWM),
+     2   IWORK(LIWM), F, JAC, PSOL, rpar, ipar)
+      KGO = 1 - KFLAG
+      IF (KGO .EQ. 1) THEN
+         GOTO 300
+      ELSE IF (KGO .EQ. 2) THEN
+         GOTO 530
+      ELSE IF (KGO .EQ. 3) THEN
+         GOTO 540
+      ELSE IF (KGO .EQ. 4) THEN
+         GOTO 550
+      ENDIF
+C-----------------------------------------------------------------------
+C Block F: successful step, as in DLSODE.
+C-----------------------------------------------------------------------
+ 300  INIT = 1
+      IF (ITASK .EQ. 1) THEN
+         GOTO 310
+      ELSE IF (ITASK .EQ. 2) THEN
+         GOTO 400
+      ELSE IF (ITASK .EQ. 3) THEN
+         GOTO 330
+      ELSE IF (ITASK .EQ. 4) THEN
+         GOTO 340
+      ELSE IF (ITASK .EQ. 5) THEN
+         GOTO 350
+      ENDIF
+ 310  IF ((TN - TOUT)*H .LT. 0.0D0) GO TO 250
+      CALL DINTDY (TOUT, 0, RWORK(LYH), NYH, Y, IFLAG)
+      T = TOUT
+      GO TO 420
+ 330  IF ((TN - TOUT)*H .GE. 0.0D0) GO TO 400
+      GO TO 250
+ 340  IF ((TN - TOUT)*H .LT. 0.0D0) GO TO 345
+      CALL DINTDY (TOUT, 0, RWORK(LYH), NYH, Y, IFLAG)
+      T = TOUT
+      GO TO 420
+ 345  HMX = ABS(TN) + ABS(H)
+      IHIT = ABS(TN - TCRIT) .LE. 100.0D0*UROUND*HMX
+      IF (IHIT) GO TO 400
+      TNEXT = TN + H*(1.0D0 + 4.0D0*UROUND)
+      IF ((TNEXT - TCRIT)*H .LE. 0.0D0) GO TO 250
+      H = (TCRIT - TN)*(1.0D0 - 4.0D0*UROUND)
+      JSTART = -2
+      GO TO 250
+ 350  HMX = ABS(TN) + ABS(H)
+      IHIT = ABS(TN - TCRIT) .LE. 100.0D0*UROUND*HMX
+ 400  DO 410 I = 1,N
+        Y(I) = RWORK(I+LYH-1)
+ 410  CONTINUE
+      T = TN
+      IF (ITASK .NE. 4 .AND. ITASK .NE. 5) GO TO 420
+      IF (IHIT) T = TCRIT
+ 420  ISTATE = 2
+      RWORK(11) = HU
+      RWORK(12) = H
+      RWORK(13) = TN
+      IWORK(11) = NST
+      IWORK(12) = NFE
+      IWORK(13) = NJE
+      IWORK(14) = NQU
+      IWORK(15) = NQ
+      IWORK(19) = NNI
+      IWORK(20) = NLI
+      IWORK(21) = NPS
+      IWORK(22) = NCFN
+      IWORK(23) = NCFL
+      RETURN
+C-----------------------------------------------------------------------
+C Block H: unsuccessful returns, as in DLSODE, and ISTATE = -7 when
+C JAC or PSOL failed unrecoverably (KFLAG = -3).
+C-----------------------------------------------------------------------
+ 500  MSG = 'DLSODPK- At current T (=R1), MXSTEP (=I1) steps   '
+      CALL XERRWD (MSG, 50, 201, 0, 0, 0, 0, 0, 0.0D0, 0.0D0)
+      MSG = '      taken on this call before reaching TOUT     '
+      CALL XERRWD (MSG, 50, 201, 0, 1, MXSTEP, 0, 1, TN, 0.0D0)
+      ISTATE = -1
+      GO TO 580
+ 510  EWTI = RWORK(LEWT+I-1)
+      MSG = 'DLSODPK- At T (=R1), EWT(I1) has become R2 .LE. 0.'
+      CALL XERRWD (MSG, 50, 202, 0, 1, I, 0, 2, TN, EWTI)
+      ISTATE = -6
+      GO TO 580
+ 520  MSG = 'DLSODPK- At T (=R1), too much accuracy requested  '
+      CALL XERRWD (MSG, 50, 203, 0, 0, 0, 0, 0, 0.0D0, 0.0D0)
+      MSG = '      for precision of machine..  see TOLSF (=R2) '
+      CALL XERRWD (MSG, 50, 203, 0, 0, 0, 0, 2, TN, TOLSF)
+      RWORK(14) = TOLSF
+      ISTATE = -2
+      GO TO 580
+ 530  MSG = 'DLSODPK- At T(=R1) and step size H(=R2), the error'
+      CALL XERRWD (MSG, 50, 204, 0, 0, 0, 0, 0, 0.0D0, 0.0D0)
+      MSG = '      test failed repeatedly or with ABS(H) = HMIN'
+      CALL XERRWD (MSG, 50, 204, 0, 0, 0, 0, 2, TN, H)
+      ISTATE = -4
+      GO TO 560
+ 540  MSG = 'DLSODPK- At T (=R1) and step size H (=R2), the    '
+      CALL XERRWD (MSG, 50, 205, 0, 0, 0, 0, 0, 0.0D0, 0.0D0)
+      MSG = '      corrector convergence failed repeatedly     '
+      CALL XERRWD (MSG, 50, 205, 0, 0, 0, 0, 0, 0.0D0, 0.0D0)
+      MSG = '      or with ABS(H) = HMIN   '
+      CALL XERRWD (MSG, 30, 205, 0, 0, 0, 0, 2, TN, H)
+      ISTATE = -5
+      GO TO 560
+ 550  MSG = 'DLSODPK- At T (=R1), the preconditioner setup (JAC)'
+      CALL XERRWD (MSG, 50, 206, 0, 0, 0, 0, 0, 0.0D0, 0.0D0)
+      MSG = '      or solve (PSOL) failed unrecoverably        '
+      CALL XERRWD (MSG, 50, 206, 0, 0, 0, 0, 1, TN, 0.0D0)
+      ISTATE = -7
+      GO TO 580
+ 560  BIG = 0.0D0
+      IMXER = 1
+      DO 570 I = 1,N
+        SIZE = ABS(RWORK(I+LACOR-1)*RWORK(I+LEWT-1))
+        IF (BIG .GE. SIZE) GO TO 570
+        BIG = SIZE
+        IMXER = I
+ 570    CONTINUE
+      IWORK(16) = IMXER
+ 580  DO 590 I = 1,N
+        Y(I) = RWORK(I+LYH-1)
+ 590  CONTINUE
+      T = TN
+      RWORK(11) = HU
+      RWORK(12) = H
+      RWORK(13) = TN
+      IWORK(11) = NST
+      IWORK(12) = NFE
+      IWORK(13) = NJE
+      IWORK(14) = NQU
+      IWORK(15) = NQ
+      IWORK(19) = NNI
+      IWORK(20) = NLI
+      IWORK(21) = NPS
+      IWORK(22) = NCFN
+      IWORK(23) = NCFL
+      RETURN
+C-----------------------------------------------------------------------
+C Block I: illegal input.
+C-----------------------------------------------------------------------
+ 601  MSG = 'DLSODPK- ISTATE (=I1) illegal '
+      CALL XERRWD (MSG, 30, 1, 0, 1, ISTATE, 0, 0, 0.0D0, 0.0D0)
+      IF (ISTATE .LT. 0) GO TO 800
+      GO TO 700
+ 602  MSG = 'DLSODPK- ITASK (=I1) illegal  '
+      CALL XERRWD (MSG, 30, 2, 0, 1, ITASK, 0, 0, 0.0D0, 0.0D0)
+      GO TO 700
+ 603  MSG = 'DLSODPK- ISTATE .GT. 1 but DLSODPK not initialized'
+      CALL XERRWD (MSG, 50, 3, 0, 0, 0, 0, 0, 0.0D0, 0.0D0)
+      GO TO 700
+ 604  MSG = 'DLSODPK- NEQ (=I1) .LT. 1     '
+      CALL XERRWD (MSG, 30, 4, 0, 1, NEQ(1), 0, 0, 0.0D0, 0.0D0)
+      GO TO 700
+ 605  MSG = 'DLSODPK- ISTATE = 3 and NEQ increased (I1 to I2)  '
+      CALL XERRWD (MSG, 50, 5, 0, 2, N, NEQ(1), 0, 0.0D0, 0.0D0)
+      GO TO 700
+ 606  MSG = 'DLSODPK- ITOL (=I1) illegal   '
+      CALL XERRWD (MSG, 30, 6, 0, 1, ITOL, 0, 0, 0.0D0, 0.0D0)
+      GO TO 700
+ 607  MSG = 'DLSODPK- IOPT (=I1) illegal   '
+      CALL XERRWD (MSG, 30, 7, 0, 1, IOPT, 0, 0, 0.0D0, 0.0D0)
+      GO TO 700
+ 608  MSG = 'DLSODPK- MF (=I1) illegal     '
+      CALL XERRWD (MSG, 30, 8, 0, 1, MF, 0, 0, 0.0D0, 0.0D0)
+      GO TO 700
+ 609  MSG = 'DLSODPK- JPRE (=I1) illegal   '
+      CALL XERRWD (MSG, 30, 9, 0, 1, JPRE, 0, 0, 0.0D0, 0.0D0)
+      GO TO 700
+ 610  MSG = 'DLSODPK- JACFLG (=I1) illegal '
+      CALL XERRWD (MSG, 30, 10, 0, 1, JACFLG, 0, 0, 0.0D0, 0.0D0)
+      GO TO 700
+ 611  MSG = 'DLSODPK- MAXORD (=I1) .LT. 0  '
+      CALL XERRWD (MSG, 30, 11, 0, 1, MAXORD, 0, 0, 0.0D0, 0.0D0)
+      GO TO 700
+ 612  MSG = 'DLSODPK- MXSTEP (=I1) .LT. 0  '
+      CALL XERRWD (MSG, 30, 12, 0, 1, MXSTEP, 0, 0, 0.0D0, 0.0D0)
+      GO TO 700
+ 613  MSG = 'DLSODPK- MXHNIL (=I1) .LT. 0  '
+      CALL XERRWD (MSG, 30, 13, 0, 1, MXHNIL, 0, 0, 0.0D0, 0.0D0)
+      GO TO 700
+ 614  MSG = 'DLSODPK- TOUT (=R1) behind T (=R2)      '
+      CALL XERRWD (MSG, 40, 14, 0, 0, 0, 0, 2, TOUT, T)
+      MSG = '      Integration direction is given by H0 (=R1)  '
+      CALL XERRWD (MSG, 50, 14, 0, 0, 0, 0, 1, H0, 0.0D0)
+      GO TO 700
+ 615  MSG = 'DLSODPK- HMAX (=R1) .LT. 0.0  '
+      CALL XERRWD (MSG, 30, 15, 0, 0, 0, 0, 1, HMAX, 0.0D0)
+      GO TO 700
+ 616  MSG = 'DLSODPK- HMIN (=R1) .LT. 0.0  '
+      CALL XERRWD (MSG, 30, 16, 0, 0, 0, 0, 1, HMIN, 0.0D0)
+      GO TO 700
+ 617  CONTINUE
+      MSG='DLSODPK- RWORK length needed, LENRW (=I1), exceeds LRW (=I2)'
+      CALL XERRWD (MSG, 60, 17, 0, 2, LENRW, LRW, 0, 0.0D0, 0.0D0)
+      GO TO 700
+ 618  CONTINUE
+      MSG='DLSODPK- IWORK length needed, LENIW (=I1), exceeds LIW (=I2)'
+      CALL XERRWD (MSG, 60, 18, 0, 2, LENIW, LIW, 0, 0.0D0, 0.0D0)
+      GO TO 700
+ 619  MSG = 'DLSODPK- RTOL(I1) is R1 .LT. 0.0        '
+      CALL XERRWD (MSG, 40, 19, 0, 1, I, 0, 1, RTOLI, 0.0D0)
+      GO TO 700
+ 620  MSG = 'DLSODPK- ATOL(I1) is R1 .LT. 0.0        '
+      CALL XERRWD (MSG, 40, 20, 0, 1, I, 0, 1, ATOLI, 0.0D0)
+      GO TO 700
+ 621  EWTI = RWORK(LEWT+I-1)
+      MSG = 'DLSODPK- EWT(I1) is R1 .LE. 0.0         '
+      CALL XERRWD (MSG, 40, 21, 0, 1, I, 0, 1, EWTI, 0.0D0)
+      GO TO 700
+ 622  CONTINUE
+      MSG='DLSODPK- TOUT (=R1) too close to T(=R2) to start integration'
+      CALL XERRWD (MSG, 60, 22, 0, 0, 0, 0, 2, TOUT, T)
+      GO TO 700
+ 623  CONTINUE
+      MSG='DLSODPK- ITASK = I1 and TOUT (=R1) behind TCUR - HU (= R2)  '
+      CALL XERRWD (MSG, 60, 23, 0, 1, ITASK, 0, 2, TOUT, TP)
+      GO TO 700
+ 624  CONTINUE
+      MSG='DLSODPK- ITASK = 4 OR 5 and TCRIT (=R1) behind TCUR (=R2)   '
+      CALL XERRWD (MSG, 60, 24, 0, 0, 0, 0, 2, TCRIT, TN)
+      GO TO 700
+ 625  CONTINUE
+      MSG='DLSODPK- ITASK = 4 or 5 and TCRIT (=R1) behind TOUT (=R2)   '
+      CALL XERRWD (MSG, 60, 25, 0, 0, 0, 0, 2, TCRIT, TOUT)
+      GO TO 700
+ 626  MSG = 'DLSODPK- At start of problem, too much accuracy   '
+      CALL XERRWD (MSG, 50, 26, 0, 0, 0, 0, 0, 0.0D0, 0.0D0)
+      MSG='      requested for precision of machine..  See TOLSF (=R1) '
+      CALL XERRWD (MSG, 60, 26, 0, 0, 0, 0, 1, TOLSF, 0.0D0)
+      RWORK(14) = TOLSF
+      GO TO 700
+ 627  MSG = 'DLSODPK- Trouble in DINTDY.  ITASK = I1, TOUT = R1'
+      CALL XERRWD (MSG, 50, 27, 0, 1, ITASK, 0, 1, TOUT, 0.0D0)
+ 700  ISTATE = -3
+      RETURN
+ 800  MSG = 'DLSODPK- Run aborted.. apparent infinite loop     '
+      CALL XERRWD (MSG, 50, 303, 2, 0, 0, 0, 0, 0.0D0, 0.0D0)
+      RETURN
+C----------------------- End of Subroutine DLSODPK ---------------------
+      END
@@ -0,0 +1,174 @@
+C  Save and restore the common blocks of the FORTRAN solvers.
+C
+C  Based on the routines DSRCOM, DSRCMA, DSRCAR, DSRCMS, DSRCPK of ODEPACK
+C  and DVSRCO of DVODE; merged into one routine by the deSolve authors.
+C
+C  This is needed when a solver is called from within the model function
+C  of another solver (nested integration); the C-function enter_context
+C  saves the common blocks of the enclosing solver, ctx_eval restores them
+C  (see deSolve_utils.c).
+
+      SUBROUTINE DSVCOM (RSAV, ISAV, JOB)
+C-----------------------------------------------------------------------
+C RSAV = real array of length at least LRCOM = 359 (LRCOMMON in deSolve.h)
+C ISAV = integer array of length at least LICOM = 195 (LICOMMON)
+C JOB  = flag indicating to save or restore the common blocks:
+C        JOB  = 1 if common is to be saved (written to RSAV/ISAV)
+C        JOB  = 2 if common is to be restored (read from RSAV/ISAV)
+C-----------------------------------------------------------------------
+      INTEGER ISAV, JOB
+      DOUBLE PRECISION RSAV
+      DIMENSION RSAV(*), ISAV(*)
+C
+      INTEGER ILS, ILSA, ILSR, ILSS, ILPK, IVD1, IVD2, IZV1, IZV2,
+     1   ICON, ILIN
+      DOUBLE PRECISION RLS, RLSA, RLSR, RLSS, RLPK, RVD1, RVD2,
+     1   RZV1, RZV2, RCON
+C
+C     lsoda, lsode, lsodes, lsodar, lsoder
+      COMMON /DLS001/ RLS(218), ILS(37)
+      COMMON /DLSA01/ RLSA(22), ILSA(9)
+      COMMON /DLSR01/ RLSR(5), ILSR(9)
+      COMMON /DLSS01/ RLSS(6), ILSS(34)
+      COMMON /DLPK01/ RLPK(4), ILPK(13)
+C     vode and zvode
+      COMMON /DVOD01/ RVD1(48), IVD1(33)
+      COMMON /DVOD02/ RVD2(1), IVD2(8)
+      COMMON /ZVOD01/ RZV1(50), IZV1(33)
+      COMMON /ZVOD02/ RZV2(1), IZV2(8)
+C     radau5
+      COMMON /CONRA5/ ICON(4), RCON(4)
+      COMMON /LINAL/ ILIN(7)
+C
+      INTEGER I, IR, II
+C
+      IR = 0
+      II = 0
+      IF (JOB .EQ. 2) GO TO 100
+C
+      DO 10 I = 1,218
+ 10     RSAV(IR+I) = RLS(I)
+      IR = IR + 218
+      DO 11 I = 1,22
+ 11     RSAV(IR+I) = RLSA(I)
+      IR = IR + 22
+      DO 12 I = 1,5
+ 12     RSAV(IR+I) = RLSR(I)
+      IR = IR + 5
+      DO 13 I = 1,6
+ 13     RSAV(IR+I) = RLSS(I)
+      IR = IR + 6
+      DO 14 I = 1,4
+ 14     RSAV(IR+I) = RLPK(I)
+      IR = IR + 4
+      DO 15 I = 1,48
+ 15     RSAV(IR+I) = RVD1(I)
+      IR = IR + 48
+      RSAV(IR+1) = RVD2(1)
+      IR = IR + 1
+      DO 16 I = 1,50
+ 16     RSAV(IR+I) = RZV1(I)
+      IR = IR + 50
+      RSAV(IR+1) = RZV2(1)
+      IR = IR + 1
+      DO 17 I = 1,4
+ 17     RSAV(IR+I) = RCON(I)
+C
+      DO 20 I = 1,37
+ 20     ISAV(II+I) = ILS(I)
+      II = II + 37
+      DO 21 I = 1,9
+ 21     ISAV(II+I) = ILSA(I)
+      II = II + 9
+      DO 22 I = 1,9
+ 22     ISAV(II+I) = ILSR(I)
+      II = II + 9
+      DO 23 I = 1,34
+ 23     ISAV(II+I) = ILSS(I)
+      II = II + 34
+      DO 24 I = 1,13
+ 24     ISAV(II+I) = ILPK(I)
+      II = II + 13
+      DO 25 I = 1,33
+ 25     ISAV(II+I) = IVD1(I)
+      II = II + 33
+      DO 26 I = 1,8
+ 26     ISAV(II+I) = IVD2(I)
+      II = II + 8
+      DO 27 I = 1,33
+ 27     ISAV(II+I) = IZV1(I)
+      II = II + 33
+      DO 28 I = 1,8
+ 28     ISAV(II+I) = IZV2(I)
+      II = II + 8
+      DO 29 I = 1,4
+ 29     ISAV(II+I) = ICON(I)
+      II = II + 4
+      DO 30 I = 1,7
+ 30     ISAV(II+I) = ILIN(I)
+      RETURN
+C
+ 100  CONTINUE
+      DO 110 I = 1,218
+ 110    RLS(I) = RSAV(IR+I)
+      IR = IR + 218
+      DO 111 I = 1,22
+ 111    RLSA(I) = RSAV(IR+I)
+      IR = IR + 22
+      DO 112 I = 1,5
+ 112    RLSR(I) = RSAV(IR+I)
+      IR = IR + 5
+      DO 113 I = 1,6
+ 113    RLSS(I) = RSAV(IR+I)
+      IR = IR + 6
+      DO 114 I = 1,4
+ 114    RLPK(I) = RSAV(IR+I)
+      IR = IR + 4
+      DO 115 I = 1,48
+ 115    RVD1(I) = RSAV(IR+I)
+      IR = IR + 48
+      RVD2(1) = RSAV(IR+1)
+      IR = IR + 1
+      DO 116 I = 1,50
+ 116    RZV1(I) = RSAV(IR+I)
+      IR = IR + 50
+      RZV2(1) = RSAV(IR+1)
+      IR = IR + 1
+      DO 117 I = 1,4
+ 117    RCON(I) = RSAV(IR+I)
+C
+      DO 120 I = 1,37
+ 120    ILS(I) = ISAV(II+I)
+      II = II + 37
+      DO 121 I = 1,9
+ 121    ILSA(I) = ISAV(II+I)
+      II = II + 9
+      DO 122 I = 1,9
+ 122    ILSR(I) = ISAV(II+I)
+      II = II + 9
+      DO 123 I = 1,34
+ 123    ILSS(I) = ISAV(II+I)
+      II = II + 34
+      DO 124 I = 1,13
+ 124    ILPK(I) = ISAV(II+I)
+      II = II + 13
+      DO 125 I = 1,33
+ 125    IVD1(I) = ISAV(II+I)
+      II = II + 33
+      DO 126 I = 1,8
+ 126    IVD2(I) = ISAV(II+I)
+      II = II + 8
+      DO 127 I = 1,33
+ 127    IZV1(I) = ISAV(II+I)
+      II = II + 33
+      DO 128 I = 1,8
+ 128    IZV2(I) = ISAV(II+I)
+      II = II + 8
+      DO 129 I = 1,4
+ 129    ICON(I) = ISAV(II+I)
+      II = II + 4
+      DO 130 I = 1,7
+ 130    ILIN(I) = ISAV(II+I)
+      RETURN
+C----------------------- End of Subroutine DSVCOM ----------------------
+      END
@@ -0,0 +1,70 @@
+C  Warm restart of the Livermore solvers after an event.
+C
+C  Written by the deSolve authors, for the solvers that keep their
+C  state in common block DLS001 (DLSODA, DLSODE, DLSODES, DLSODAR,
+C  DLSODER and the root-finding versions).
+C
+C  An event that changes only the values of the state variables does
+C  not make the Jacobian (and its LU decomposition in RWORK) invalid,
+C  nor the step size, but the Nordsieck history array YH is no longer
+C  consistent with the new state.  Instead of a restart with ISTATE = 1,
+C  which discards everything, the history is reset to order 1 here:
+C  YH(*,1) = Y and YH(*,2) = H*YDOT, where YDOT = f(T,Y) is computed by
+C  the caller for the new state.  H is scaled such that H*EL(1) is not
+C  changed, so that the iteration matrix P = I - H*EL(1)*J remains
+C  valid; the solver is then called with ISTATE = 2.
+C
+C  The restart is only possible if the solver stopped exactly at T
+C  (ITASK = 4 or 5 with TCRIT = T) after at least one successful step;
+C  otherwise IWARM = 0 is returned and a cold restart must be done.
+
+      SUBROUTINE DWARMS (NEQ, T, Y, YDOT, RWORK, IWARM)
+      INTEGER NEQ, IWARM
+      DOUBLE PRECISION T, Y, YDOT, RWORK
+      DIMENSION Y(*), YDOT(*), RWORK(*)
+C
+      INTEGER IOWND, IALTH, IPUP, LMAX, MEO, NQNYH, NSLP,
+     1   ICF, IERPJ, IERSL, JCUR, JSTART, KFLAG, L,
+     2   LYH, LEWT, LACOR, LSAVF, LWM, LIWM, METH, MITER,
+     3   MAXORD, MAXCOR, MSBP, MXNCF, N, NQ, NST, NFE, NJE, NQU
+      DOUBLE PRECISION CONIT, CRATE, EL, ELCO, HOLD, RMAX, TESCO,
+     2   CCMAX, EL0, H, HMIN, HMXI, HU, RC, TN, UROUND
+      COMMON /DLS001/ CONIT, CRATE, EL(13), ELCO(13,12),
+     1   HOLD, RMAX, TESCO(3,12),
+     2   CCMAX, EL0, H, HMIN, HMXI, HU, RC, TN, UROUND,
+     3   IOWND(6), IALTH, IPUP, LMAX, MEO, NQNYH, NSLP,
+     3   ICF, IERPJ, IERSL, JCUR, JSTART, KFLAG, L,
+     4   LYH, LEWT, LACOR, LSAVF, LWM, LIWM, METH, MITER,
+     5   MAXORD, MAXCOR, MSBP, MXNCF, N, NQ, NST, NFE, NJE, NQU
+C
+      INTEGER I, NYH
+C
+      IWARM = 0
+      IF (NST .EQ. 0 .OR. KFLAG .NE. 0 .OR. JSTART .LE. 0) RETURN
+      IF (N .NE. NEQ) RETURN
+      IF (ABS(TN - T) .GT. 100.0D0*UROUND*MAX(ABS(TN),ABS(T))) RETURN
+C
+C order 1, with H*EL(1) as before ---------------------------------------
+      H = H*EL(1)/ELCO(1,1)
+      HOLD = H
+      NQ = 1
+      L = 2
+      IALTH = L
+      DO 10 I = 1,L
+        EL(I) = ELCO(I,1)
+ 10   CONTINUE
+      EL0 = EL(1)
+      CONIT = 0.5D0/(NQ+2)
+      NYH = IOWND(6)
+      NQNYH = NYH
+      TN = T
+C
+C the history array: YH(*,1) = Y, YH(*,2) = H*f(T,Y) -------------------
+      DO 20 I = 1,N
+        RWORK(LYH+I-1) = Y(I)
+        RWORK(LYH+NYH+I-1) = H*YDOT(I)
+ 20   CONTINUE
+      NFE = NFE + 1
+      IWARM = 1
+      RETURN
+      END
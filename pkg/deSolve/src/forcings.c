@@ -14,7 +14,7 @@
    "initForcings" creates forcing function vectors passed from an R-list
    "initforcings" puts a pointer to the vector that contains the
      forcing functions in the DLL. This is done by calling "Initdeforc";
-   here the C-globals are initialised .
+   here the forcing data of the solver context are initialised.
 
    Each time-step, before entering the compiled code, the forcing function
    variables are interpolated to the current time (function ("updateforc").
@@ -38,8 +38,6 @@
    version 1.11: certain roots associated to eventa can terminate simulation
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
-int    finit = 0;
-
 /*===========================================================================
          -----     Check for presence of forcing functions     -----
    function "initForcings" checks if forcing functions are present and if so,
@@ -49,7 +47,7 @@ int    finit = 0;
   =========================================================================== */
 
 
-int initForcings(SEXP flist) {
+int initForcings(deSolve_context *ctx, SEXP flist) {
 
     SEXP Tvec, Fvec, Ivec, initforc;
     int i, j, isForcing = 0;
@@ -60,20 +58,20 @@ int initForcings(SEXP flist) {
       Tvec = getListElement(flist, "tmat");
       Fvec = getListElement(flist, "fmat");
       Ivec = getListElement(flist, "imat");
-      nforc = LENGTH(Ivec)-2; /* nforc, fvec, ivec = globals */
+      ctx->nforc = LENGTH(Ivec)-2; /* nforc, fvec, ivec in ctx */
 
       i = LENGTH(Fvec);
-      fvec = (double *) R_alloc((int) i, sizeof(double));
-      for (j = 0; j < i; j++) fvec[j] = REAL(Fvec)[j];
+      ctx->fvec = (double *) R_alloc((int) i, sizeof(double));
+      for (j = 0; j < i; j++) ctx->fvec[j] = REAL(Fvec)[j];
 
-      tvec = (double *) R_alloc((int) i, sizeof(double));
-      for (j = 0; j < i; j++) tvec[j] = REAL(Tvec)[j];
+      ctx->tvec = (double *) R_alloc((int) i, sizeof(double));
+      for (j = 0; j < i; j++) ctx->tvec[j] = REAL(Tvec)[j];
 
       i = LENGTH (Ivec)-1; /* last element: the interpolation method...*/
-      ivec = (int *) R_alloc(i, sizeof(int));
-      for (j = 0; j < i; j++) ivec[j] = INTEGER(Ivec)[j];
+      ctx->ivec = (int *) R_alloc(i, sizeof(int));
+      for (j = 0; j < i; j++) ctx->ivec[j] = INTEGER(Ivec)[j];
 
-      fmethod = INTEGER(Ivec)[i];
+      ctx->fmethod = INTEGER(Ivec)[i];
       initforcings = (init_func_type *) R_ExternalPtrAddrFn_(initforc);
       initforcings(Initdeforc);
       isForcing = 1;
@@ -90,8 +88,9 @@ int initForcings(SEXP flist) {
 
 void Initdeforc(int *N, double *forc) {
   int i, ii;
-  if ((*N) != nforc) {
-    warning("Number of forcings passed to solver, %ld; number in DLL, %i\n", nforc, *N);
+  deSolve_context *ctx = desolve_ctx;
+  if ((*N) != ctx->nforc) {
+    warning("Number of forcings passed to solver, %ld; number in DLL, %i\n", ctx->nforc, *N);
     Rf_error("Confusion over the length of forc.");
   }
 
@@ -99,56 +98,56 @@ void Initdeforc(int *N, double *forc) {
      current value, interpolation factor,
      current forcing time, next forcing time,..
   */
-  finit = 1;
-  findex   = (int    *) R_alloc(nforc, sizeof(int));
-  intpol   = (double *) R_alloc(nforc, sizeof(double));
-  maxindex = (int    *) R_alloc(nforc, sizeof(int));
+  ctx->finit = 1;
+  ctx->findex   = (int    *) R_alloc(ctx->nforc, sizeof(int));
+  ctx->intpol   = (double *) R_alloc(ctx->nforc, sizeof(double));
+  ctx->maxindex = (int    *) R_alloc(ctx->nforc, sizeof(int));
 
   /* Input is in three vectors:
      tvec, fvec: time and value;
      ivec : index to each forcing in tvec and fvec
   */
-  for (i = 0; i<nforc; i++) {
-    ii = ivec[i]-1;
-    findex[i] = ii;
-    maxindex[i] = ivec[i+1]-2;
-    if (fmethod == 1) {
-      intpol[i] = (fvec[ii+1]-fvec[ii])/(tvec[ii+1]-tvec[ii]);
-    } else  intpol[i] = 0;
-    forc[i] = fvec[ii];
+  for (i = 0; i<ctx->nforc; i++) {
+    ii = ctx->ivec[i]-1;
+    ctx->findex[i] = ii;
+    ctx->maxindex[i] = ctx->ivec[i+1]-2;
+    if (ctx->fmethod == 1) {
+      ctx->intpol[i] = (ctx->fvec[ii+1]-ctx->fvec[ii])/(ctx->tvec[ii+1]-ctx->tvec[ii]);
+    } else  ctx->intpol[i] = 0;
+    forc[i] = ctx->fvec[ii];
   }
-  forcings = forc;      /* set pointer to C globals or FORTRAN common block */
+  ctx->forcings = forc; /* set pointer to C globals or FORTRAN common block */
 }
 
-void updatedeforc(double *time) {
+void updatedeforc(deSolve_context *ctx, double *time) {
   int i, ii,  zerograd;
 
   /* check if initialised? */
-  if (finit == 0)
+  if (ctx->finit == 0)
     error ("error in forcing function: not initialised");
 
-  for (i=0; i<nforc; i++) {
-    ii = findex[i];
+  for (i=0; i<ctx->nforc; i++) {
+    ii = ctx->findex[i];
     zerograd=0;
-    while (*time > tvec[ii+1]){
-      if (ii+2 > maxindex[i]) {   /* this probably redundant...*/
+    while (*time > ctx->tvec[ii+1]){
+      if (ii+2 > ctx->maxindex[i]) {   /* this probably redundant...*/
         zerograd=1;
         break;
       }
       ii = ii+1;
     }
-    while (*time < tvec[ii]){       /* test here for ii < 1 ?...*/
+    while (*time < ctx->tvec[ii]){       /* test here for ii < 1 ?...*/
       ii = ii-1;
     }
-    if (ii != findex[i]) {
-      findex[i] = ii;
-      if ((zerograd == 0) & (fmethod == 1)) {  /* fmethod 1=linear */
-        intpol[i] = (fvec[ii+1]-fvec[ii])/(tvec[ii+1]-tvec[ii]);
+    if (ii != ctx->findex[i]) {
+      ctx->findex[i] = ii;
+      if ((zerograd == 0) & (ctx->fmethod == 1)) {  /* fmethod 1=linear */
+        ctx->intpol[i] = (ctx->fvec[ii+1]-ctx->fvec[ii])/(ctx->tvec[ii+1]-ctx->tvec[ii]);
       } else {
-        intpol[i] = 0;
+        ctx->intpol[i] = 0;
       }
     }
-    forcings[i]=fvec[ii]+intpol[i]*(*time-tvec[ii]);
+    ctx->forcings[i]=ctx->fvec[ii]+ctx->intpol[i]*(*time-ctx->tvec[ii]);
   }
 }
 
@@ -156,25 +155,25 @@ void updatedeforc(double *time) {
   events: time, svar number, value, and method; in a list
    ==========================================================================*/
 
-typedef void event_func_type(int*, double*, double*);
-event_func_type  *event_func;
-
 static void C_event_func (int *n, double *t, double *y) {
   int i;
-  SEXP R_fcall, Time, ans;
+  SEXP R_fcall, ans, Y;
+  deSolve_context *ctx = desolve_ctx;
+
+  R_fcall = ctx_lang(ctx, CALL_EVENT, ctx->R_event_func, "dd", 1, *n);
+  REAL(call_arg(R_fcall, 1))[0] = *t;
+  Y = call_arg(R_fcall, 2);
   for (i = 0; i < *n; i++) REAL(Y)[i] = y[i];
 
-  PROTECT(Time = ScalarReal(*t));
-  PROTECT(R_fcall = lang3(R_event_func,Time,Y));
-  PROTECT(ans = eval(R_fcall, R_envir));
+  PROTECT(ans = ctx_eval(ctx, R_fcall, ctx->R_envir));
 
   for (i = 0; i < *n; i++) y[i] = REAL(ans)[i];
 
-  UNPROTECT(3);
+  UNPROTECT(1);
 }
 
 
-int initEvents(SEXP elist, SEXP eventfunc, int nroot) {
+int initEvents(deSolve_context *ctx, SEXP elist, SEXP eventfunc, int nroot) {
     SEXP Time, SVar, Value, Method, Type, Root, maxRoot, Terminateroot;
     int i, j, isEvent = 0;
 
@@ -182,99 +181,99 @@ int initEvents(SEXP elist, SEXP eventfunc, int nroot) {
     Root = getListElement(elist, "Root");
 
     if (!isNull(Root)) {   /* event combined with root - allocate memory to save time of root*/
-      rootevent = INTEGER(Root)[0];
+      ctx->rootevent = INTEGER(Root)[0];
 
       maxRoot = getListElement(elist, "Rootsave");
       if (!isNull(maxRoot))
-        Rootsave = INTEGER(maxRoot)[0];
+        ctx->Rootsave = INTEGER(maxRoot)[0];
       else
-        Rootsave = 0;
-      if (Rootsave > 0)  {
-         nrroot = (int *)R_alloc( (int)Rootsave, sizeof(int) );
-         for (i = 0; i < Rootsave; i++) nrroot[i] = 0;
-         troot = (double *)R_alloc( (int)Rootsave, sizeof(double) );
-         for (i = 0; i < Rootsave; i++) troot[i] = 0.;
-         valroot = (double *)R_alloc( (int)Rootsave*n_eq, sizeof(double) );
-         for (i = 0; i < Rootsave*n_eq; i++) valroot[i] = 0.;
+        ctx->Rootsave = 0;
+      if (ctx->Rootsave > 0)  {
+         ctx->nrroot = (int *)R_alloc( (int)ctx->Rootsave, sizeof(int) );
+         for (i = 0; i < ctx->Rootsave; i++) ctx->nrroot[i] = 0;
+         ctx->troot = (double *)R_alloc( (int)ctx->Rootsave, sizeof(double) );
+         for (i = 0; i < ctx->Rootsave; i++) ctx->troot[i] = 0.;
+         ctx->valroot = (double *)R_alloc( (int)ctx->Rootsave*ctx->n_eq, sizeof(double) );
+         for (i = 0; i < ctx->Rootsave*ctx->n_eq; i++) ctx->valroot[i] = 0.;
        }
 
      /* to allow certain roots to stop simulation */
-     termroot = (int *)R_alloc( nroot, sizeof(int) );
-     for (i = 0; i < nroot; i++) termroot[i] = 0;
+     ctx->termroot = (int *)R_alloc( nroot, sizeof(int) );
+     for (i = 0; i < nroot; i++) ctx->termroot[i] = 0;
 
      Terminateroot = getListElement(elist, "Terminalroot");
      for (i = 0; i < LENGTH(Terminateroot); i++) {
         j = INTEGER(Terminateroot)[i]-1;
         if (j > -1 && j < nroot)
-          termroot[j] = 1;
+          ctx->termroot[j] = 1;
      }
     }
     else
-      rootevent = 0;
+      ctx->rootevent = 0;
 
     if (!isNull(Time)) {
 
      isEvent = 1;
      Type = getListElement(elist,"Type");
-     typeevent = INTEGER(Type)[0];
+     ctx->typeevent = INTEGER(Type)[0];
 
      i = LENGTH(Time);
-     timeevent = (double *) R_alloc((int) i+1, sizeof(double));
-     for (j = 0; j < i; j++) timeevent[j] = REAL(Time)[j];
+     ctx->timeevent = (double *) R_alloc((int) i+1, sizeof(double));
+     for (j = 0; j < i; j++) ctx->timeevent[j] = REAL(Time)[j];
      /* cap the event timer with an event that can't possibly be reached */
      //timeevent[i] = timeevent[0] - 1; // J. Stott
-     timeevent[i] = DBL_MIN;        // thpe
-     if (typeevent == 1) {
+     ctx->timeevent[i] = DBL_MIN;        // thpe
+     if (ctx->typeevent == 1) {
        /* specified in a data.frame */
        SVar = getListElement(elist,"SVar");
        Value = getListElement(elist,"Value");
        Method = getListElement(elist,"Method");
 
-       valueevent = (double *) R_alloc((int) i, sizeof(double));
-       for (j = 0; j < i; j++) valueevent[j] = REAL(Value)[j];
+       ctx->valueevent = (double *) R_alloc((int) i, sizeof(double));
+       for (j = 0; j < i; j++) ctx->valueevent[j] = REAL(Value)[j];
 
-       svarevent = (int *) R_alloc(i, sizeof(int));
-       for (j = 0; j < i; j++) svarevent[j] = INTEGER(SVar)[j]-1;
+       ctx->svarevent = (int *) R_alloc(i, sizeof(int));
+       for (j = 0; j < i; j++) ctx->svarevent[j] = INTEGER(SVar)[j]-1;
 
-       methodevent = (int *) R_alloc(i, sizeof(int));
-       for (j = 0; j < i; j++) methodevent[j] = INTEGER(Method)[j];
+       ctx->methodevent = (int *) R_alloc(i, sizeof(int));
+       for (j = 0; j < i; j++) ctx->methodevent[j] = INTEGER(Method)[j];
      } else {
         /* a function: either R (typeevent=2) or compiled code (3)... */
-        if (typeevent == 3)  {
-          event_func = (event_func_type *) R_ExternalPtrAddrFn_(eventfunc);
+        if (ctx->typeevent == 3)  {
+          ctx->event_func = (event_func_type *) R_ExternalPtrAddrFn_(eventfunc);
         } else {
-          event_func = C_event_func;
-          R_event_func = eventfunc;
+          ctx->event_func = C_event_func;
+          ctx->R_event_func = eventfunc;
         }
       }
-      tEvent = timeevent[0];
-      iEvent = 0;
-      nEvent = i;
+      ctx->tEvent = ctx->timeevent[0];
+      ctx->iEvent = 0;
+      ctx->nEvent = i;
     }
     return(isEvent);
 }
 
-void updateevent(double *t, double *y, int *istate) {
+void updateevent(deSolve_context *ctx, double *t, double *y, int *istate) {
     int svar, method;
     double value;
-    if (tEvent == *t) {
-      if (typeevent == 1) {      /* specified in a data.frame */
+    if (ctx->tEvent == *t) {
+      if (ctx->typeevent == 1) {      /* specified in a data.frame */
         do {
-          svar = svarevent[iEvent];
-          method = methodevent[iEvent];
-          value = valueevent[iEvent];
+          svar = ctx->svarevent[ctx->iEvent];
+          method = ctx->methodevent[ctx->iEvent];
+          value = ctx->valueevent[ctx->iEvent];
           if (method == 1)
             y[svar] = value;
           else if (method == 2)
             y[svar] = y[svar] + value;
           else if (method == 3)
             y[svar] = y[svar] * value;
-          tEvent = timeevent[++iEvent];
-        } while (tEvent == *t);
+          ctx->tEvent = ctx->timeevent[++ctx->iEvent];
+        } while (ctx->tEvent == *t);
       } else {                  /* a root event or specific times */
-        event_func(&n_eq, t, y);
-        if (!rootevent)
-          tEvent = timeevent[++iEvent];  /* karline: this was toggled off - why?*/
+        ctx->event_func(&ctx->n_eq, t, y);
+        if (!ctx->rootevent)
+          ctx->tEvent = ctx->timeevent[++ctx->iEvent];  /* karline: this was toggled off - why?*/
       }
       *istate = 1;
     }
@@ -0,0 +1,243 @@
+/*==========================================================================*/
+/* Jacobians by grouped finite differences (Curtis, Powell and Reid)        */
+/*                                                                          */
+/* Columns of the Jacobian that have no nonzero element in a common row     */
+/* can be perturbed together, so a Jacobian with a known sparsity pattern   */
+/* needs only one evaluation of the derivative function per group of        */
+/* columns instead of one per column. The groups are found by JGROUP of     */
+/* ODEPACK (opkda1.f), the same routine that is used internally by lsodes.  */
+/*                                                                          */
+/* The sparsity pattern is stored in column format (ian, jan, 1-based, as   */
+/* in lsodes); igp and jgp are the groups as returned by JGROUP.            */
+/*==========================================================================*/
+
+#include <float.h>
+#include "deSolve.h"
+
+void F77_NAME(jgroup)(int *n, int *ia, int *ja, int *maxg, int *ngrp,
+                      int *igp, int *jgp, int *incl, int *jdone, int *ier);
+
+/* column groups of a sparsity pattern, igp must have length n + 1 */
+static int jacgroups(int n, int *ian, int *jan, int *igp, int *jgp) {
+  int maxg = n + 1, ngp = 0, ier = 0;
+  int *incl, *jdone;
+
+  incl  = (int *) R_alloc(n, sizeof(int));
+  jdone = (int *) R_alloc(n, sizeof(int));
+
+  F77_CALL(jgroup)(&n, ian, jan, &maxg, &ngp, igp, jgp, incl, jdone, &ier);
+  if (ier != 0) error("error during grouping of the Jacobian columns (jgroup)");
+  return(ngp);
+}
+
+/*==========================================================================*/
+/* R interface: column groups of a sparsity pattern, called by jacSparsity  */
+/*==========================================================================*/
+
+SEXP call_jacgroups(SEXP Ian, SEXP Jan) {
+  int n, ngp, nprot = 0;
+  SEXP Igp, Jgp, ans;
+
+  PROTECT(Ian = AS_INTEGER(Ian)); nprot++;
+  PROTECT(Jan = AS_INTEGER(Jan)); nprot++;
+  n = LENGTH(Ian) - 1;
+
+  PROTECT(Igp = allocVector(INTSXP, n + 1)); nprot++;
+  PROTECT(Jgp = allocVector(INTSXP, n)); nprot++;
+  ngp = jacgroups(n, INTEGER(Ian), INTEGER(Jan), INTEGER(Igp), INTEGER(Jgp));
+
+  PROTECT(ans = allocVector(VECSXP, 2)); nprot++;
+  SET_VECTOR_ELT(ans, 0, lengthgets(Igp, ngp + 1));
+  SET_VECTOR_ELT(ans, 1, Jgp);
+  UNPROTECT(nprot);
+  return(ans);
+}
+
+/*==========================================================================*/
+/* R interface: sparsity pattern of 1-D, 2-D and 3-D problems, as used by   */
+/* lsodes (sparsetype "1D", "2D", "3D"); returns list(ian, jan)             */
+/*==========================================================================*/
+
+SEXP call_sparsity(SEXP Type, SEXP nEq) {
+  int i, n, nnz, liw, type, nspec, nprot = 0;
+  int *iwork;
+  SEXP Ian, Jan, ans;
+
+  PROTECT(Type = AS_INTEGER(Type)); nprot++;
+  n     = INTEGER(nEq)[0];
+  type  = INTEGER(Type)[0];
+  nspec = INTEGER(Type)[1];
+
+  /* neighbours in all directions, cyclic boundaries and nspec components */
+  liw   = 31 + n + n * (14 + nspec);
+  iwork = (int *) R_alloc(liw, sizeof(int));
+
+  if (type == 2)
+    sparsity1D(Type, iwork, n, liw);
+  else if (type == 3)
+    sparsity2D(Type, iwork, n, liw);
+  else if (type == 4)
+    sparsity3D(Type, iwork, n, liw);
+  else
+    error("unknown type of sparsity %i", type);
+
+  nnz = iwork[30 + n] - 1;
+  PROTECT(Ian = allocVector(INTSXP, n + 1)); nprot++;
+  PROTECT(Jan = allocVector(INTSXP, nnz)); nprot++;
+  for (i = 0; i <= n; i++)  INTEGER(Ian)[i] = iwork[30 + i];
+  for (i = 0; i < nnz; i++) INTEGER(Jan)[i] = iwork[31 + n + i];
+
+  PROTECT(ans = allocVector(VECSXP, 2)); nprot++;
+  SET_VECTOR_ELT(ans, 0, Ian);
+  SET_VECTOR_ELT(ans, 1, Jan);
+  UNPROTECT(nprot);
+  return(ans);
+}
+
+/*==========================================================================*/
+/* initialisation, called by the solvers with an object of class            */
+/* "deSolve.sparsity" (see jacSparsity.R) as argument jacfunc               */
+/*==========================================================================*/
+
+void initGroups(deSolve_context *ctx, SEXP Sparsity,
+                C_deriv_func_type *deriv_func, int band) {
+  cpr_data *cpr;
+  int n;
+
+  cpr = (cpr_data *) R_alloc(1, sizeof(cpr_data));
+  n   = INTEGER(getListElement(Sparsity, "n"))[0];
+
+  cpr->n    = n;
+  cpr->ngp  = INTEGER(getListElement(Sparsity, "ngp"))[0];
+  cpr->band = band;
+  cpr->ian  = INTEGER(getListElement(Sparsity, "ian"));
+  cpr->jan  = INTEGER(getListElement(Sparsity, "jan"));
+  cpr->igp  = INTEGER(getListElement(Sparsity, "igp"));
+  cpr->jgp  = INTEGER(getListElement(Sparsity, "jgp"));
+  cpr->deriv_func = deriv_func;
+  cpr->res_func   = NULL;
+  cpr->jx         = NULL;
+
+  cpr->f0    = (double *) R_alloc(n, sizeof(double));
+  cpr->f1    = (double *) R_alloc(n, sizeof(double));
+  cpr->ytmp  = (double *) R_alloc(n, sizeof(double));
+  cpr->yptmp = (double *) R_alloc(n, sizeof(double));
+  cpr->del   = (double *) R_alloc(n, sizeof(double));
+
+  ctx->cpr = cpr;
+}
+
+/*==========================================================================*/
+/* Jacobian function passed to the FORTRAN solvers (lsoda, lsode, lsodar,   */
+/* vode, radau); full or banded storage, pd[i - j + mu, j] in the latter    */
+/* case. The increments are those of radau5.                                */
+/*==========================================================================*/
+
+void cpr_jac(int *neq, double *t, double *y, int *ml, int *mu,
+             double *pd, int *nrowpd, double *yout, int *iout) {
+  deSolve_context *ctx = desolve_ctx;
+  cpr_data *cpr = ctx->cpr;
+  int i, j, g, k, m, n = *neq;
+
+  for (i = 0; i < n * *nrowpd; i++) pd[i] = 0.;
+  for (i = 0; i < n; i++) cpr->ytmp[i] = y[i];
+
+  cpr->deriv_func(neq, t, cpr->ytmp, cpr->f0, yout, iout);
+
+  for (g = 0; g < cpr->ngp; g++) {
+    /* perturb all columns of the group at once */
+    for (k = cpr->igp[g] - 1; k < cpr->igp[g + 1] - 1; k++) {
+      j = cpr->jgp[k] - 1;
+      cpr->del[j] = sqrt(DBL_EPSILON * fmax(1e-5, fabs(y[j])));
+      cpr->ytmp[j] = y[j] + cpr->del[j];
+    }
+    cpr->deriv_func(neq, t, cpr->ytmp, cpr->f1, yout, iout);
+
+    for (k = cpr->igp[g] - 1; k < cpr->igp[g + 1] - 1; k++) {
+      j = cpr->jgp[k] - 1;
+      for (m = cpr->ian[j] - 1; m < cpr->ian[j + 1] - 1; m++) {
+        i = cpr->jan[m] - 1;
+        if (cpr->band) {
+          if (i - j > *ml || j - i > *mu) continue;
+          pd[i - j + *mu + j * *nrowpd] = (cpr->f1[i] - cpr->f0[i])/cpr->del[j];
+        } else
+          pd[i + j * *nrowpd] = (cpr->f1[i] - cpr->f0[i])/cpr->del[j];
+      }
+      cpr->ytmp[j] = y[j];
+    }
+  }
+}
+
+/*==========================================================================*/
+/* Jacobian function passed to daspk (full storage): dG/dy + cj * dG/dy',   */
+/* y and yprime of a group are perturbed together, as in DDASPK             */
+/*==========================================================================*/
+
+void cpr_daejac(double *t, double *y, double *yprime, double *pd, double *cj,
+                double *yout, int *iout) {
+  deSolve_context *ctx = desolve_ctx;
+  cpr_data *cpr = ctx->cpr;
+  int i, j, g, k, m, n = cpr->n, ires = 0;
+
+  for (i = 0; i < n * n; i++) pd[i] = 0.;
+  for (i = 0; i < n; i++) {
+    cpr->ytmp[i]  = y[i];
+    cpr->yptmp[i] = yprime[i];
+  }
+  cpr->res_func(t, cpr->ytmp, cpr->yptmp, cj, cpr->f0, &ires, yout, iout);
+
+  for (g = 0; g < cpr->ngp; g++) {
+    for (k = cpr->igp[g] - 1; k < cpr->igp[g + 1] - 1; k++) {
+      j = cpr->jgp[k] - 1;
+      cpr->del[j] = sqrt(DBL_EPSILON * fmax(1e-5, fabs(y[j])));
+      cpr->ytmp[j]  = y[j] + cpr->del[j];
+      cpr->yptmp[j] = yprime[j] + *cj * cpr->del[j];
+    }
+    cpr->res_func(t, cpr->ytmp, cpr->yptmp, cj, cpr->f1, &ires, yout, iout);
+
+    for (k = cpr->igp[g] - 1; k < cpr->igp[g + 1] - 1; k++) {
+      j = cpr->jgp[k] - 1;
+      for (m = cpr->ian[j] - 1; m < cpr->ian[j + 1] - 1; m++) {
+        i = cpr->jan[m] - 1;
+        pd[i + j * n] = (cpr->f1[i] - cpr->f0[i])/cpr->del[j];
+      }
+      cpr->ytmp[j]  = y[j];
+      cpr->yptmp[j] = yprime[j];
+    }
+  }
+}
+
+/*==========================================================================*/
+/* Jacobian function passed to radau with jactype "sparseint": the nonzero  */
+/* elements are stored in cpr->jx, in the order of jan, for the sparse LU   */
+/* decomposition (sparselu.c); pd is not used                               */
+/*==========================================================================*/
+
+void cpr_spjac(int *neq, double *t, double *y, int *ml, int *mu,
+               double *pd, int *nrowpd, double *yout, int *iout) {
+  deSolve_context *ctx = desolve_ctx;
+  cpr_data *cpr = ctx->cpr;
+  int i, j, g, k, m, n = *neq;
+
+  for (i = 0; i < n; i++) cpr->ytmp[i] = y[i];
+
+  cpr->deriv_func(neq, t, cpr->ytmp, cpr->f0, yout, iout);
+
+  for (g = 0; g < cpr->ngp; g++) {
+    for (k = cpr->igp[g] - 1; k < cpr->igp[g + 1] - 1; k++) {
+      j = cpr->jgp[k] - 1;
+      cpr->del[j] = sqrt(DBL_EPSILON * fmax(1e-5, fabs(y[j])));
+      cpr->ytmp[j] = y[j] + cpr->del[j];
+    }
+    cpr->deriv_func(neq, t, cpr->ytmp, cpr->f1, yout, iout);
+
+    for (k = cpr->igp[g] - 1; k < cpr->igp[g + 1] - 1; k++) {
+      j = cpr->jgp[k] - 1;
+      for (m = cpr->ian[j] - 1; m < cpr->ian[j + 1] - 1; m++) {
+        i = cpr->jan[m] - 1;
+        cpr->jx[m] = (cpr->f1[i] - cpr->f0[i])/cpr->del[j];
+      }
+      cpr->ytmp[j] = y[j];
+    }
+  }
+}
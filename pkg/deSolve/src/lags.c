@@ -27,6 +27,10 @@
    
    Note: findHistInt finds interval by bisectioning; only marginally
    more/less efficient than straightforward findHistInt2...
+
+   The Runge-Kutta methods with dense output (rk45dp7, ode45) store the
+   coefficients of the continuous output of each accepted step instead
+   (interpolMethod 4), so that lagged values have the order of the method.
    
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
@@ -40,8 +44,8 @@
 void F77_NAME(interpoly)(double *, int *, int *, double *, int *, double *, 
    int *, double *, double *);
    
-double interpolate(int i, int k, double t0, double hh, double t, 
-  double *Yh, int nq) {
+double interpolate(deSolve_context *ctx, int i, int k, double t0, double hh,
+  double t, double *Yh, int nq) {
   
   double  res;
  
@@ -50,10 +54,10 @@ double interpolate(int i, int k, double t0, double hh, double t,
   if (k > nq)
     error("illegal k %i, nq in interpolate, %i, at time %g", k, nq, t);
                 
-  if (i > n_eq || i <1)
-    error("illegal i %i, n_eq %i, at time %g", i, n_eq, t);
+  if (i > ctx->n_eq || i <1)
+    error("illegal i %i, n_eq %i, at time %g", i, ctx->n_eq, t);
 
-  F77_CALL(interpoly) (&t, &k, &i, Yh, &n_eq, &res, &nq, &t0, &hh); 
+  F77_CALL(interpoly) (&t, &k, &i, Yh, &ctx->n_eq, &res, &nq, &t0, &hh); 
   return(res);
 }  
 
@@ -63,6 +67,28 @@ void F77_NAME (contr5alone) (int *, int *, double *, double *, int *, double *,
 void F77_NAME (getconra) (double *);
 
 /*=========================================================================== 
+  Dense output of the Runge-Kutta methods (interpolMethod==4): y and dy at
+  s = (t - t0)/dt, from the coefficients r of the step (see denspar)
+  =========================================================================== */
+
+static double densrk(double *r, int i, int neq, double s) {
+  double s1 = 1.0 - s;
+  return(r[i] + s * (r[i + neq] + s1 * (r[i + 2 * neq]
+              + s * (r[i + 3 * neq] + s1 * r[i + 4 * neq]))));
+}
+
+static double ddensrk(double *r, int i, int neq, double s, double dt) {
+  double s1 = 1.0 - s, u, v, w, du, dv, dw;
+  u  = r[i + 3 * neq] + s1 * r[i + 4 * neq];
+  du = -r[i + 4 * neq];
+  v  = r[i + 2 * neq] + s * u;
+  dv = u + s * du;
+  w  = r[i + neq] + s1 * v;
+  dw = -v + s1 * dv;
+  return((w + s * dw) / dt);
+}
+
+/*===========================================================================
   Hermitian interpolation of y to x (interpolMethod==1)
   =========================================================================== */
 
@@ -111,59 +137,64 @@ double dHermite (double t0, double t1, double y0, double y1, double dy0,
   initialise history arrays + indices at start integration 
   =========================================================================== */
 
-void inithist(int max, int maxlags, int solver, int nroot) {
+void inithist(deSolve_context *ctx, int max, int maxlags, int solver,
+  int nroot) {
   int maxord;  
   
-  histsize = max;
-  initialisehist = 1;
-  indexhist  = -1; /* indexhist+1 = next time in circular buffer.  */
-  starthist  = 0;  /* start time in circular buffer.               */
-  endreached = 0;  /* if end of buffer reached and new values added at start  */
+  ctx->histsize = max;
+  ctx->initialisehist = 1;
+  ctx->indexhist  = -1; /* indexhist+1 = next time in circular buffer.  */
+  ctx->starthist  = 0;  /* start time in circular buffer.               */
+  ctx->endreached = 0;  /* if end of buffer reached and new values added at start  */
   
   /* interpolMethod = Hermite */
-  if (interpolMethod == 1) {
-    offset   = n_eq; /* size needed for saving one time-step in histvar*/
+  if (ctx->interpolMethod == 1) {
+    ctx->offset   = ctx->n_eq; /* size needed for saving one time-step in histvar*/
 
   /* interpolMethod = HigherOrder, Livermore solvers */
-  } else if (interpolMethod == 2) {
+  } else if (ctx->interpolMethod == 2) {
     if (solver == 0) 
       error("illegal input in lags - cannot combine interpol=2 with chosen solver");
     maxord  = 12;   /* 5(bdf) or 12 (adams) */
-    lyh     = 20;   /* position of history array in rwork (C-index) */
-    lhh     = 11;   /* position of h in rwork (C-index)
+    ctx->lyh     = 20;   /* position of history array in rwork (C-index) */
+    ctx->lhh     = 11;   /* position of h in rwork (C-index)
                        Note: for lsodx this is NEXT time step! */
-    lo      = 13;   /* position of method order in iwork (C-index) */
+    ctx->lo      = 13;   /* position of method order in iwork (C-index) */
     if (solver == 5) {  /* different for vode!  uses current time step*/  
-      lhh = 10;        
-      lo = 13;             
+      ctx->lhh = 10;        
+      ctx->lo = 13;             
     }
     if (solver == 4 || solver == 6 || solver == 7)  /* lsodar or lsoder */
-      lyh = 20+3*nroot;
+      ctx->lyh = 20+3*nroot;
+
+    ctx->offset  = ctx->n_eq*(maxord+1);       
+    ctx->histord = (int *) R_alloc (ctx->histsize, sizeof(int));
+    ctx->histhh  = (double *) R_alloc (ctx->histsize, sizeof(double));
 
-    offset  = n_eq*(maxord+1);       
-    histord = (int *) R_alloc (histsize, sizeof(int));
-    histhh  = (double *) R_alloc (histsize, sizeof(double));
+  /* interpolMethod = 4; dense output of rk: y and 5 coefficients */
+  } else if (ctx->interpolMethod == 4) {
+    ctx->offset  = ctx->n_eq * 6;
 
   /* interpolMethod = 3; HigherOrder, radau */
   } else {
-    offset  = n_eq * 4 + 2;
-    histsave = (double *) R_alloc (2, sizeof(double));
+    ctx->offset  = ctx->n_eq * 4 + 2;
+    ctx->histsave = (double *) R_alloc (2, sizeof(double));
   }
 
-  histtime = (double *) R_alloc (histsize, sizeof(double));
-  histvar  = (double *) R_alloc (offset * histsize, sizeof(double));
-  histdvar = (double *) R_alloc (n_eq * histsize, sizeof(double));
+  ctx->histtime = (double *) R_alloc (ctx->histsize, sizeof(double));
+  ctx->histvar  = (double *) R_alloc (ctx->offset * ctx->histsize, sizeof(double));
+  ctx->histdvar = (double *) R_alloc (ctx->n_eq * ctx->histsize, sizeof(double));
 }
 
 /*=========================================================================== 
   given the maximum size of the history arrays; finds the next index
   =========================================================================== */
 
-int nexthist(int i) {
-  if (i < histsize-1)
+int nexthist(deSolve_context *ctx, int i) {
+  if (i < ctx->histsize-1)
     return(i+1);
   else {
-    endreached = 1;
+    ctx->endreached = 1;
     return(0);
   }  
 }
@@ -173,64 +204,74 @@ int nexthist(int i) {
   =========================================================================== */
 
 /* first time: just store y, (dy) and t */
-void updatehistini(double t, double *y, double *dY, double *rwork, int *iwork){
+void updatehistini(deSolve_context *ctx, double t, double *y, double *dY,
+  double *rwork, int *iwork){
   int intpol;
 
-  intpol = interpolMethod;
-  interpolMethod = 1; 
-  updatehist(t, y, dY, rwork, iwork);
-  interpolMethod = intpol; 
-  if (interpolMethod == 2){
-    histord[0] = 0;
-    histhh[0] = timesteps[0];    
+  intpol = ctx->interpolMethod;
+  ctx->interpolMethod = 1; 
+  updatehist(ctx, t, y, dY, rwork, iwork);
+  ctx->interpolMethod = intpol; 
+  if (ctx->interpolMethod == 2){
+    ctx->histord[0] = 0;
+    ctx->histhh[0] = ctx->timesteps[0];    
   }  
 }
 
-void updatehist(double t, double *y, double *dY, double *rwork, int *iwork) {
+void updatehist(deSolve_context *ctx, double t, double *y, double *dY,
+  double *rwork, int *iwork) {
   int j, ii;
   double ss[2];
   
-  indexhist = nexthist(indexhist);
-  ii = indexhist * offset;     
+  ctx->indexhist = nexthist(ctx, ctx->indexhist);
+  ii = ctx->indexhist * ctx->offset;     
 
   /* interpolMethod = Hermite */
-  if (interpolMethod == 1) {
-    for (j = 0; j < n_eq; j++)  
-      histvar [ii  + j ] = y[j];
+  if (ctx->interpolMethod == 1) {
+    for (j = 0; j < ctx->n_eq; j++)  
+      ctx->histvar [ii  + j ] = y[j];
 
   /* higherOrder, livermores */
-  } else if (interpolMethod == 2) {
-    histord[indexhist] = iwork[lo];    
+  } else if (ctx->interpolMethod == 2) {
+    ctx->histord[ctx->indexhist] = iwork[ctx->lo];    
 
-    for (j = 0; j < offset; j++)
-      histvar[ii + j] = rwork[lyh + j];
-    histhh [indexhist] = rwork[lhh];   
+    for (j = 0; j < ctx->offset; j++)
+      ctx->histvar[ii + j] = rwork[ctx->lyh + j];
+    ctx->histhh [ctx->indexhist] = rwork[ctx->lhh];   
 
   /* higherOrder, radau */
-  }  else if (interpolMethod == 3) {
-    for (j = 0; j < 4 * n_eq; j++)
-      histvar[ii + j] = rwork[j];
+  }  else if (ctx->interpolMethod == 3) {
+    for (j = 0; j < 4 * ctx->n_eq; j++)
+      ctx->histvar[ii + j] = rwork[j];
     F77_CALL(getconra) (ss);
     for (j = 0; j < 2; j++)
-      histvar[ii + 4*n_eq + j] = ss[j];
+      ctx->histvar[ii + 4*ctx->n_eq + j] = ss[j];
+
+  /* dense output of rk: coefficients of the step that ends at t */
+  }  else if (ctx->interpolMethod == 4) {
+    for (j = 0; j < ctx->n_eq; j++)
+      ctx->histvar[ii + j] = y[j];
+    for (j = 0; j < 5 * ctx->n_eq; j++)
+      ctx->histvar[ii + ctx->n_eq + j] = rwork[j];
   }
 
-  ii = indexhist * n_eq;     
+  ii = ctx->indexhist * ctx->n_eq;     
  
-  for (j = 0; j < n_eq; j++)
-      histdvar[ii + j] = dY[j];
+  for (j = 0; j < ctx->n_eq; j++)
+      ctx->histdvar[ii + j] = dY[j];
 
-  histtime [indexhist] = t;
+  ctx->histtime [ctx->indexhist] = t;
 
-  if (endreached == 1)       /* starthist stays 0 until end reached... */
-    starthist = nexthist(starthist);
+  if (ctx->endreached == 1)       /* starthist stays 0 until end reached... */
+    ctx->starthist = nexthist(ctx, ctx->starthist);
 }
 
 /*=========================================================================== 
   find a past value (val=1) or a past derivative (val = 2)
   =========================================================================== */
 
-double past(int i, int interval, double t, int val)
+double past(deSolve_context *ctx, int i, int interval, double t,
+  int val)
 
   /* finds past values (val=1) or past derivatives (val=2)*/
 
@@ -239,74 +280,88 @@ double past(int i, int interval, double t, int val)
   double *Yh;
 
   /* error checking */
-  if ( i >= n_eq)
+  if ( i >= ctx->n_eq)
     error("illegal input in lagvalue - var nr too high, %i", i+1);
   
   /* equal to current value... */   
-  if ( interval == indexhist && t == histtime[interval]) {   
+  if ( interval == ctx->indexhist && t == ctx->histtime[interval]) {   
     if (val == 1)
-      res = histvar [interval * offset  + i ];
+      res = ctx->histvar [interval * ctx->offset  + i ];
     else 
-      res = histdvar [interval * offset  + i ];   
+      res = ctx->histdvar [interval * ctx->offset  + i ];   
   
   /* within last interval - for now: just extrapolate last value */
-  } else if ( interval == indexhist && interpolMethod == 1) {
+  } else if ( interval == ctx->indexhist &&
+             (ctx->interpolMethod == 1 || ctx->interpolMethod == 4)) {
     if (val == 1) {
-      t0  = histtime[interval];
-      y0  = histvar [interval * offset  + i ];
-      dy0 = histdvar [interval * n_eq  + i ];
+      t0  = ctx->histtime[interval];
+      y0  = ctx->histvar [interval * ctx->offset  + i ];
+      dy0 = ctx->histdvar [interval * ctx->n_eq  + i ];
       res = y0 + dy0*(t-t0);
     }
     else 
-      res = histdvar [interval * n_eq  + i ];
+      res = ctx->histdvar [interval * ctx->n_eq  + i ];
 
   /* Hermite interpolation */
-  }  else if (interpolMethod == 1) {
+  }  else if (ctx->interpolMethod == 1) {
     j  = interval;
-    jn = nexthist(j);
-
-    t0  = histtime[j];
-    t1  = histtime[jn];
-    y0  = histvar [j * n_eq  + i ];
-    y1  = histvar [jn * n_eq  + i ];
-    dy0 = histdvar [j * n_eq  + i ];
-    dy1 = histdvar [jn * n_eq  + i ];
+    jn = nexthist(ctx, j);
+
+    t0  = ctx->histtime[j];
+    t1  = ctx->histtime[jn];
+    y0  = ctx->histvar [j * ctx->n_eq  + i ];
+    y1  = ctx->histvar [jn * ctx->n_eq  + i ];
+    dy0 = ctx->histdvar [j * ctx->n_eq  + i ];
+    dy1 = ctx->histdvar [jn * ctx->n_eq  + i ];
     if (val == 1)
       res = Hermite (t0, t1, y0, y1, dy0, dy1, t);
     else
       res = dHermite (t0, t1, y0, y1, dy0, dy1, t);
   
   /* dense interpolation - livermore solvers */
-  } else if (interpolMethod == 2) {
+  } else if (ctx->interpolMethod == 2) {
     j  = interval;
-    jn = nexthist(j);
+    jn = nexthist(ctx, j);
 
-    t0  = histtime[j];
-    t1  = histtime[jn];
-    nq  = histord [j];
+    t0  = ctx->histtime[j];
+    t1  = ctx->histtime[jn];
+    nq  = ctx->histord [j];
     if (nq == 0) {
-      y0  = histvar [j  * offset  + i ];
-      y1  = histvar [jn * offset  + i ];
-      dy0 = histdvar [j  * n_eq  + i ];
-      dy1 = histdvar [jn * n_eq  + i ];
+      y0  = ctx->histvar [j  * ctx->offset  + i ];
+      y1  = ctx->histvar [jn * ctx->offset  + i ];
+      dy0 = ctx->histdvar [j  * ctx->n_eq  + i ];
+      dy1 = ctx->histdvar [jn * ctx->n_eq  + i ];
       if (val == 1)
         res = Hermite (t0, t1, y0, y1, dy0, dy1, t);
       else
         res = dHermite (t0, t1, y0, y1, dy0, dy1, t);
     } else { 
-      Yh  = &histvar [j * offset];
-      hh = histhh[j];
-      res = interpolate(i+1, val-1, t0, hh, t, Yh, nq); 
+      Yh  = &ctx->histvar [j * ctx->offset];
+      hh = ctx->histhh[j];
+      res = interpolate(ctx, i+1, val-1, t0, hh, t, Yh, nq); 
     }  
+  /* dense output of rk, coefficients stored with the end of the step */
+  } else if (ctx->interpolMethod == 4) {
+    j  = interval;
+    jn = nexthist(ctx, j);
+
+    t0 = ctx->histtime[j];
+    hh = ctx->histtime[jn] - t0;
+    Yh = &ctx->histvar [jn * ctx->offset + ctx->n_eq];
+    if (val == 1)
+      res = densrk(Yh, i, ctx->n_eq, (t - t0) / hh);
+    else
+      res = ddensrk(Yh, i, ctx->n_eq, (t - t0) / hh, hh);
+
   /* dense interpolation - radau - gets all values (i not used) */
   } else {
  //   if (val == 2)
  //     error("radau interpol = 2 does not work for lagderiv");
     j  = interval;
-    Yh  = &histvar [j * offset];
-    histsave  = &histvar [j * offset + 4*n_eq];
+    Yh  = &ctx->histvar [j * ctx->offset];
+    ctx->histsave  = &ctx->histvar [j * ctx->offset + 4*ctx->n_eq];
     ip = i+1;
-    F77_CALL(contr5alone) (&ip, &n_eq, &t, Yh, &offset, histsave, &res, &val);
+    F77_CALL(contr5alone) (&ip, &ctx->n_eq, &t, Yh, &ctx->offset, ctx->histsave, &res, &val);
   }
   return(res);
 }
@@ -316,60 +371,60 @@ double past(int i, int interval, double t, int val)
   two alternatives; only findHistInt used
   =========================================================================== */
 
-int findHistInt2 (double t) {
+int findHistInt2 (deSolve_context *ctx, double t) {
   int j, jn;
   
-  if ( t >= histtime[indexhist]) 
-    return(indexhist);
-  if ( t < histtime[starthist])
+  if ( t >= ctx->histtime[ctx->indexhist]) 
+    return(ctx->indexhist);
+  if ( t < ctx->histtime[ctx->starthist])
     error("illegal input in lagvalue - lag, %g, too large, at time = %g\n",
-      t, histtime[indexhist]);
+      t, ctx->histtime[ctx->indexhist]);
  
    /* find embracing time starting from beginning  */
-    j  = starthist;
-    jn = nexthist(j);
+    j  = ctx->starthist;
+    jn = nexthist(ctx, j);
 
-    while (histtime[jn]<t) {
+    while (ctx->histtime[jn]<t) {
       j = jn;
-      jn = nexthist(j);
+      jn = nexthist(ctx, j);
     }
     return(j);  
 }
 /* alternative: bisectioning... */
 
-int findHistInt (double t) {
+int findHistInt (deSolve_context *ctx, double t) {
   int ilo, ihi, imid, ii, n;
   
-  if ( t >= histtime[indexhist]) 
-    return(indexhist);
-  if ( t < histtime[starthist])
+  if ( t >= ctx->histtime[ctx->indexhist]) 
+    return(ctx->indexhist);
+  if ( t < ctx->histtime[ctx->starthist])
     error("illegal input in lagvalue - lag, %g, too large, at time = %g\n",
-      t, histtime[indexhist]);
+      t, ctx->histtime[ctx->indexhist]);
 
-  if (endreached == 0) {  /* still filling buffer; not yet wrapped */
+  if (ctx->endreached == 0) {  /* still filling buffer; not yet wrapped */
     ilo = 0;
-    ihi = indexhist;
+    ihi = ctx->indexhist;
     for(;;) {
        imid = (ilo + ihi) / 2;
       if (imid == ilo) return ilo;
-      if (t >= histtime[imid])
+      if (t >= ctx->histtime[imid])
         ilo = imid;
       else
         ihi = imid;
      }
   }
-  n = histsize -1;
+  n = ctx->histsize -1;
   ilo = 0;
   ihi = n;
   for(;;) {
      imid = (ilo + ihi) / 2;
   
-    ii = imid + starthist;
+    ii = imid + ctx->starthist;
     if (ii > n) ii = ii - n - 1;
 
     if (imid == ilo) return ii;
 
-    if (t >= histtime[ii])
+    if (t >= ctx->histtime[ii])
       ilo = imid;
     else
       ihi = imid;
@@ -381,27 +436,28 @@ int findHistInt (double t) {
   =========================================================================== */
 SEXP getLagValue(SEXP T, SEXP nr)
 {
+  deSolve_context *ctx = desolve_ctx;
   SEXP value;
   int i, ilen, interval;
   double t;
 
   ilen = LENGTH(nr);
-  if (initialisehist == 0)
+  if (ctx == NULL || ctx->initialisehist == 0)
     error("pastvalue can only be called from 'func' or 'res' when triggered by appropriate integrator.");
   if (!isNumeric(T)) error("'t' should be numeric");
 
   t = *NUMERIC_POINTER(T);
-  interval = findHistInt (t);
+  interval = findHistInt(ctx, t);
 
   if ((ilen ==1) && (INTEGER(nr)[0] == 0)) {
-    PROTECT(value=NEW_NUMERIC(n_eq));
-    for(i=0; i<n_eq; i++) {
-      NUMERIC_POINTER(value)[i] = past(i, interval, t, 1);
+    PROTECT(value=NEW_NUMERIC(ctx->n_eq));
+    for(i=0; i<ctx->n_eq; i++) {
+      NUMERIC_POINTER(value)[i] = past(ctx, i, interval, t, 1);
     }
   } else {
     PROTECT(value=NEW_NUMERIC(ilen));
     for(i=0; i<ilen; i++) {
-    NUMERIC_POINTER(value)[i] = past(INTEGER(nr)[i]-1, interval, t, 1);
+    NUMERIC_POINTER(value)[i] = past(ctx, INTEGER(nr)[i]-1, interval, t, 1);
     }
   }
   
@@ -414,27 +470,28 @@ SEXP getLagValue(SEXP T, SEXP nr)
   =========================================================================== */
 SEXP getLagDeriv(SEXP T, SEXP nr)
 {
+  deSolve_context *ctx = desolve_ctx;
   SEXP value;
   int i, ilen, interval;
   double t;
 
   ilen = LENGTH(nr);
-  if (initialisehist == 0)
+  if (ctx == NULL || ctx->initialisehist == 0)
     error("pastgradient can only be called from 'func' or 'res' when triggered by appropriate integrator.");
   if (!isNumeric(T)) error("'t' should be numeric");
 
   t = *NUMERIC_POINTER(T);
-  interval = findHistInt (t);
+  interval = findHistInt(ctx, t);
 
   if ((ilen ==1) && (INTEGER(nr)[0] == 0)) {
-    PROTECT(value=NEW_NUMERIC(n_eq));
-    for(i=0; i<n_eq; i++) {
-      NUMERIC_POINTER(value)[i] = past(i, interval, t, 2);
+    PROTECT(value=NEW_NUMERIC(ctx->n_eq));
+    for(i=0; i<ctx->n_eq; i++) {
+      NUMERIC_POINTER(value)[i] = past(ctx, i, interval, t, 2);
     }
   } else {
     PROTECT(value=NEW_NUMERIC(ilen));
     for(i=0; i<ilen; i++) {                                              
-      NUMERIC_POINTER(value)[i] = past(INTEGER(nr)[i]-1, interval, t, 2);
+      NUMERIC_POINTER(value)[i] = past(ctx, INTEGER(nr)[i]-1, interval, t, 2);
     }
   }
   UNPROTECT(1);
@@ -446,7 +503,7 @@ SEXP getLagDeriv(SEXP T, SEXP nr)
   Interrogate the lag settings as in an R-list   
    ==========================================================================*/
 
-int initLags(SEXP elag, int solver, int nroot) {
+int initLags(deSolve_context *ctx, SEXP elag, int solver, int nroot) {
 
   SEXP Mxhist, Islag, Interpol ;       
   int mxhist, islag;
@@ -458,15 +515,16 @@ int initLags(SEXP elag, int solver, int nroot) {
    Mxhist = getListElement(elag, "mxhist");
    mxhist = INTEGER(Mxhist)[0];
    Interpol = getListElement(elag, "interpol");
-   interpolMethod = INTEGER(Interpol)[0];
-   if (interpolMethod < 1) interpolMethod = 1;
-   if ((interpolMethod == 2) && (solver == 10)) interpolMethod = 3; /* radau */
+   ctx->interpolMethod = INTEGER(Interpol)[0];
+   if (ctx->interpolMethod < 1) ctx->interpolMethod = 1;
+   if ((ctx->interpolMethod == 2) && (solver == 10)) ctx->interpolMethod = 3; /* radau */
+   if ((ctx->interpolMethod == 2) && (solver == 11)) ctx->interpolMethod = 4; /* rk */
 //   if((solver == 7 || solver == 3) && interpolMethod == 2)
 //     error("cannot combine lags in lsodes, with interpol=2");
-   inithist(mxhist, 1, solver, nroot);
+   inithist(ctx, mxhist, 1, solver, nroot);
   } else {
     mxhist = 0;
-    interpolMethod = 1;
+    ctx->interpolMethod = 1;
   }  
   return(islag);
 }
@@ -479,23 +537,25 @@ int initLags(SEXP elag, int solver, int nroot) {
   =========================================================================== */
 
 void lagvalue(double T, int *nr, int N, double *ytau) {
+  deSolve_context *ctx = desolve_ctx;
   int i, interval;
 
-  if (initialisehist == 0)
+  if (ctx == NULL || ctx->initialisehist == 0)
     error("pastvalue can only be called from 'func' or 'res' when triggered by appropriate integrator.");
 
-  interval = findHistInt(T);
-  for(i = 0; i < N; i++)  ytau[i] = past(nr[i], interval, T, 1);
+  interval = findHistInt(ctx, T);
+  for(i = 0; i < N; i++)  ytau[i] = past(ctx, nr[i], interval, T, 1);
 }
 
 void lagderiv(double T, int *nr, int N, double *ytau) {
+  deSolve_context *ctx = desolve_ctx;
   int i, interval;
 
-  if (initialisehist == 0)
+  if (ctx == NULL || ctx->initialisehist == 0)
     error("pastvalue can only be called from 'func' or 'res' when triggered by appropriate integrator.");
 
-  interval = findHistInt(T);
+  interval = findHistInt(ctx, T);
 
-  for(i = 0; i < N; i++)  ytau[i] = past(nr[i], interval, T, 2);
+  for(i = 0; i < N; i++)  ytau[i] = past(ctx, nr[i], interval, T, 2);
 }
 
@@ -0,0 +1,233 @@
+/*==========================================================================*/
+/* Built-in preconditioners for the Krylov methods of daspk and lsodpk      */
+/*                                                                          */
+/* prec_jac estimates P, an approximation of A = dG/dy + cj * dG/dy', by    */
+/* finite differences of res, perturbing columns that are ml + mu + 1 apart */
+/* together (as in the routine DBANJA that comes with DASPK), or, for the   */
+/* block-Jacobi form with a sparsity pattern (ctx->cpr), the column groups  */
+/* of the pattern (jacgroups.c); prec_psol solves P x = b.  Two forms of P: */
+/*   banded (iwp[2] = 0): the band of A, decomposed by an incomplete LU     */
+/*     (ILU(0)) that keeps the nonzero pattern of the band;                 */
+/*   block-Jacobi (iwp[2] = block size nb): the diagonal blocks of A,       */
+/*     decomposed with partial pivoting (LINPACK dgefa).                    */
+/*                                                                          */
+/* integer work array iwp: iwp[0] = ml, iwp[1] = mu, iwp[2] = nb, then the  */
+/* nonzero pattern of the band (ILU) or the pivots of the blocks;           */
+/* real work array wp: the band (column j in wp[j*(ml+mu+1)...]) or the     */
+/* blocks, then two arrays of n/(ml+mu+1)+1 to save y and y'.               */
+/* The lengths lwp and lip are set in daspk.R.                              */
+/*                                                                          */
+/* prec_blockjac and prec_blocksol are the JAC and PSOL routines of lsodpk: */
+/* P = I - hl0 * J restricted to the blocks of the nspec species of one     */
+/* grid cell (as ordered by ode.2D and ode.3D, y[cell + species * ncell]).  */
+/* J is estimated with the column groups of the sparsity pattern           */
+/* (jacgroups.c), so that the transport terms do not spoil the blocks.      */
+/* iwp[0] = nspec, then the pivots (lip = 1 + n); lwp = n * nspec.          */
+/* P is not split in two factors: lr is not used, and lsodpk.R rejects      */
+/* precside = "both".                                                       */
+/*==========================================================================*/
+
+#include <float.h>
+#include "deSolve.h"
+
+void F77_NAME(dgefa)(double*, int*, int*, int*, int*);
+void F77_NAME(dgesl)(double*, int*, int*, int*, double*, int*);
+
+/* increment for column j, as in DBANJA */
+static double prec_del(double y, double yprime, double h, double rewt) {
+  double del, squr = sqrt(DBL_EPSILON);
+
+  del = squr * fmax(fabs(y), fmax(fabs(h * yprime), 1./rewt));
+  if (h * yprime < 0) del = -del;
+  return (y + del) - y;
+}
+
+void prec_jac(C_res_func_type *res, int *ires, int *neq, double *t,
+              double *y, double *yprime, double *rewt, double *savr,
+              double *wk, double *h, double *cj, double *wp, int *iwp,
+              int *ier, double *rpar, int *ipar) {
+  cpr_data *cpr = desolve_ctx->cpr;
+  int n = *neq, ml = iwp[0], mu = iwp[1], nb = iwp[2], *mask = iwp + 3;
+  int mband = ml + mu + 1, i, i1, i2, j, j0, k, b, g, m, isave, ipsave;
+  double del;
+
+  isave  = (nb > 0) ? nb * n : mband * n;
+  ipsave = isave + n / mband + 1;
+  for (i = 0; i < isave; i++) wp[i] = 0.;
+
+  if (nb > 0 && cpr != NULL) {          /* column groups of the sparsity */
+    for (g = 0; g < cpr->ngp; g++) {
+      for (k = cpr->igp[g] - 1; k < cpr->igp[g + 1] - 1; k++) {
+        j = cpr->jgp[k] - 1;
+        cpr->ytmp[j]  = y[j];
+        cpr->yptmp[j] = yprime[j];
+        cpr->del[j] = prec_del(y[j], yprime[j], *h, rewt[j]);
+        y[j]      += cpr->del[j];
+        yprime[j] += *cj * cpr->del[j];
+      }
+      res(t, y, yprime, cj, wk, ires, rpar, ipar);
+      for (k = cpr->igp[g] - 1; k < cpr->igp[g + 1] - 1; k++) {
+        j = cpr->jgp[k] - 1;
+        y[j]      = cpr->ytmp[j];
+        yprime[j] = cpr->yptmp[j];
+      }
+      if (*ires < 0) return;
+      for (k = cpr->igp[g] - 1; k < cpr->igp[g + 1] - 1; k++) {
+        j = cpr->jgp[k] - 1;
+        b = j / nb;
+        for (m = cpr->ian[j] - 1; m < cpr->ian[j + 1] - 1; m++) {
+          i = cpr->jan[m] - 1;
+          if (i / nb != b) continue;    /* only the rows of the same block */
+          wp[b * nb * nb + (i - b * nb) + (j - b * nb) * nb] =
+            (wk[i] - savr[i]) / cpr->del[j];
+        }
+      }
+    }
+  } else {                              /* columns mband apart */
+    for (j0 = 0; j0 < mband && j0 < n; j0++) {
+      for (j = j0, k = 0; j < n; j += mband, k++) {
+        wp[isave + k]  = y[j];
+        wp[ipsave + k] = yprime[j];
+        del = prec_del(y[j], yprime[j], *h, rewt[j]);
+        y[j]      += del;
+        yprime[j] += *cj * del;
+      }
+      res(t, y, yprime, cj, wk, ires, rpar, ipar);
+      for (j = j0, k = 0; j < n; j += mband, k++) {
+        y[j]      = wp[isave + k];
+        yprime[j] = wp[ipsave + k];
+      }
+      if (*ires < 0) return;
+      for (j = j0; j < n; j += mband) {
+        del = prec_del(y[j], yprime[j], *h, rewt[j]);
+        i1 = (j - mu > 0) ? j - mu : 0;
+        i2 = (j + ml < n - 1) ? j + ml : n - 1;
+        if (nb > 0) {                   /* only the rows of the same block */
+          b = j / nb;
+          if (i1 < b * nb) i1 = b * nb;
+          if (i2 > b * nb + nb - 1) i2 = b * nb + nb - 1;
+          for (i = i1; i <= i2; i++)
+            wp[b * nb * nb + (i - b * nb) + (j - b * nb) * nb] =
+              (wk[i] - savr[i]) / del;
+        } else
+          for (i = i1; i <= i2; i++)
+            wp[(i - j + mu) + j * mband] = (wk[i] - savr[i]) / del;
+      }
+    }
+  }
+
+  if (nb > 0) {                         /* LU of the diagonal blocks */
+    for (b = 0; b < n / nb; b++) {
+      F77_CALL(dgefa)(wp + b * nb * nb, &nb, &nb, mask + b * nb, &k);
+      if (k != 0) {
+        *ier = 1;
+        return;
+      }
+    }
+  } else {                              /* ILU(0) of the band, row by row */
+    for (i = 0; i < mband * n; i++) mask[i] = (wp[i] != 0.);
+    for (j = 0; j < n; j++) mask[mu + j * mband] = 1;
+#define A(i, j) wp[(i) - (j) + mu + (j) * mband]
+#define M(i, j) mask[(i) - (j) + mu + (j) * mband]
+    for (i = 0; i < n; i++) {
+      for (k = (i - ml > 0) ? i - ml : 0; k < i; k++) {
+        if (!M(i, k)) continue;
+        A(i, k) /= A(k, k);
+        i2 = (k + mu < n - 1) ? k + mu : n - 1;
+        for (j = k + 1; j <= i2; j++)
+          if (M(i, j)) A(i, j) -= A(i, k) * A(k, j);
+      }
+      if (A(i, i) == 0.) {
+        *ier = 1;
+        return;
+      }
+    }
+  }
+}
+
+void prec_psol(int *neq, double *t, double *y, double *yprime, double *savr,
+               double *wk, double *cj, double *wght, double *wp, int *iwp,
+               double *b, double *eplin, int *ier, double *rpar, int *ipar) {
+  int n = *neq, ml = iwp[0], mu = iwp[1], nb = iwp[2], *mask = iwp + 3;
+  int mband = ml + mu + 1, i, j, k, job = 0;
+
+  if (nb > 0) {
+    for (k = 0; k < n / nb; k++)
+      F77_CALL(dgesl)(wp + k * nb * nb, &nb, &nb, mask + k * nb, b + k * nb,
+                      &job);
+  } else {
+    for (i = 0; i < n; i++)             /* L, unit diagonal */
+      for (j = (i - ml > 0) ? i - ml : 0; j < i; j++)
+        if (M(i, j)) b[i] -= A(i, j) * b[j];
+    for (i = n - 1; i >= 0; i--) {      /* U */
+      for (j = i + 1; j <= i + mu && j < n; j++)
+        if (M(i, j)) b[i] -= A(i, j) * b[j];
+      b[i] /= A(i, i);
+    }
+  }
+  *ier = 0;
+}
+#undef A
+#undef M
+
+/*==========================================================================*/
+/* block-diagonal preconditioner of lsodpk                                  */
+/*==========================================================================*/
+
+void prec_blockjac(C_deriv_func_type *f, int *neq, double *t, double *y,
+                   double *ysv, double *rewt, double *fty, double *v,
+                   double *hl0, double *wp, int *iwp, int *ier,
+                   double *rpar, int *ipar) {
+  cpr_data *cpr = desolve_ctx->cpr;
+  int n = *neq, nspec = iwp[0], ncell = n / nspec, nn = nspec * nspec;
+  int i, j, g, k, m, c, info;
+
+  for (i = 0; i < n * nspec; i++) wp[i] = 0.;
+  for (i = 0; i < n; i++) cpr->ytmp[i] = y[i];
+
+  for (g = 0; g < cpr->ngp; g++) {
+    for (k = cpr->igp[g] - 1; k < cpr->igp[g + 1] - 1; k++) {
+      j = cpr->jgp[k] - 1;
+      cpr->del[j] = sqrt(DBL_EPSILON * fmax(1e-5, fabs(y[j])));
+      cpr->ytmp[j] = y[j] + cpr->del[j];
+    }
+    f(neq, t, cpr->ytmp, v, rpar, ipar);
+
+    for (k = cpr->igp[g] - 1; k < cpr->igp[g + 1] - 1; k++) {
+      j = cpr->jgp[k] - 1;
+      c = j % ncell;
+      for (m = cpr->ian[j] - 1; m < cpr->ian[j + 1] - 1; m++) {
+        i = cpr->jan[m] - 1;
+        if (i % ncell != c) continue;   /* only the rows of the same cell */
+        wp[c * nn + i / ncell + (j / ncell) * nspec] =
+          - *hl0 * (v[i] - fty[i]) / cpr->del[j];
+      }
+      cpr->ytmp[j] = y[j];
+    }
+  }
+
+  for (c = 0; c < ncell; c++) {         /* I - hl0 * J, and its LU */
+    for (i = 0; i < nspec; i++) wp[c * nn + i * (nspec + 1)] += 1.;
+    F77_CALL(dgefa)(wp + c * nn, &nspec, &nspec, iwp + 1 + c * nspec, &info);
+    if (info != 0) {
+      *ier = 1;
+      return;
+    }
+  }
+  *ier = 0;
+}
+
+void prec_blocksol(int *neq, double *t, double *y, double *fty, double *wk,
+                   double *hl0, double *wp, int *iwp, double *b, int *lr,
+                   int *ier) {
+  int n = *neq, nspec = iwp[0], ncell = n / nspec, nn = nspec * nspec;
+  int i, c, job = 0;
+
+  for (c = 0; c < ncell; c++) {
+    for (i = 0; i < nspec; i++) wk[i] = b[c + i * ncell];
+    F77_CALL(dgesl)(wp + c * nn, &nspec, &nspec, iwp + 1 + c * nspec, wk,
+                    &job);
+    for (i = 0; i < nspec; i++) b[c + i * ncell] = wk[i];
+  }
+  *ier = 0;
+}
@@ -335,6 +335,12 @@ C    IWORK(9)  THE VALUE OF M1.  DEFAULT M1=0.
 C
 C    IWORK(10) THE VALUE OF M2.  DEFAULT M2=M1.
 C
+C    IWORK(11) IF IWORK(11).NE.0, THE JACOBIAN IS A SPARSE MATRIX; IT IS
+C              STORED AND DECOMPOSED BY THE C ROUTINES IN sparselu.c
+C              (deSolve). THE SUBROUTINE "JAC" (IJAC=1) THEN STORES THE
+C              NONZERO ELEMENTS THERE AND DOES NOT USE FJAC. NOT WITH
+C              M1>0 OR THE HESSENBERG OPTION.
+C
 C ----------
 C
 C    WORK(1)   UROUND, THE ROUNDING UNIT, DEFAULT 1.D-16.
@@ -406,7 +412,7 @@ C *** *** *** *** *** *** *** *** *** *** *** *** ***
       IMPLICIT DOUBLE PRECISION (A-H,O-Z)
       DIMENSION Y(N),ATOL(*),RTOL(*),WORK(LWORK),IWORK(LIWORK)
       DIMENSION RPAR(*),IPAR(*)
-      LOGICAL IMPLCT,JBAND,ARRET,STARTN,PRED
+      LOGICAL IMPLCT,JBAND,ARRET,STARTN,PRED,SPARSE
       EXTERNAL FCN,JAC,MAS,SOLOUT
 C *** *** *** *** *** *** ***
 C        SETTING THE PARAMETERS 
@@ -588,6 +594,7 @@ C *** *** *** *** *** *** *** *** *** *** *** *** ***
 C ---- IMPLICIT, BANDED OR NOT ?
       IMPLCT=IMAS.NE.0
       JBAND=MLJAC.LT.NM1
+      SPARSE=IWORK(11).NE.0
 C -------- COMPUTATION OF THE ROW-DIMENSIONS OF THE 2-ARRAYS ---
 C -- JACOBIAN  AND  MATRICES E1, E2
       IF (JBAND) THEN
@@ -599,6 +606,11 @@ C -- JACOBIAN  AND  MATRICES E1, E2
          LDJAC=NM1
          LDE1=NM1
       END IF
+C -- SPARSE JACOBIAN: FJAC, E1 AND E2 ARE NOT USED
+      IF (SPARSE) THEN
+         LDJAC=1
+         LDE1=1
+      END IF
 C -- MASS MATRIX
       IF (IMPLCT) THEN
           IF (MLMAS.NE.NM1) THEN
@@ -630,6 +642,20 @@ C ------ BANDWITH OF "MAS" NOT SMALLER THAN BANDWITH OF "JAC"
           END IF
       END IF
       LDMAS2=MAX(1,LDMAS)
+C ------ SPARSE JACOBIAN, DECOMPOSED IN C: IJOB=8 (B=IDENTITY), 9 (MASS)
+      IF (SPARSE) THEN
+         IF (IJAC.EQ.0.OR.JBAND.OR.M1.GT.0.OR.IWORK(1).NE.0) THEN
+            CALL rprintf(
+     &  'SPARSE OPTION ONLY WITH IJAC=1, FULL FORMAT AND M1=0'
+     &  // char(0))
+            ARRET=.TRUE.
+         END IF
+         IF (IMPLCT) THEN
+            IJOB=9
+         ELSE
+            IJOB=8
+         END IF
+      END IF
 C ------ HESSENBERG OPTION ONLY FOR EXPLICIT EQU. WITH FULL JACOBIAN
       IF ((IMPLCT.OR.JBAND).AND.IJOB.EQ.7) THEN
        CALL rprintf(
@@ -34,6 +34,8 @@ C
         GOTO 6
       ELSE IF (IJOB .EQ. 7) THEN
         GOTO 7
+      ELSE IF (IJOB .EQ. 8 .OR. IJOB .EQ. 9) THEN
+        GOTO 8
       ELSE IF (IJOB .LE. 10) THEN
         GOTO 55       
       ELSE IF (IJOB .EQ. 11) THEN
@@ -238,6 +240,14 @@ C ---  B=IDENTITY, JACOBIAN A FULL MATRIX, HESSENBERG-OPTION
       RETURN
 C
 C -----------------------------------------------------------
+C
+   8  CONTINUE
+C ---  B=IDENTITY OR MASS MATRIX, JACOBIAN A SPARSE MATRIX
+C ---  (SPARSE LU DECOMPOSITION IN sparselu.c)
+      CALL DECSPR(N,FMAS,LDMAS,MLMAS,MUMAS,FAC1,IJOB,IER)
+      RETURN
+C
+C -----------------------------------------------------------
 C
   55  CONTINUE
       RETURN
@@ -268,6 +278,8 @@ C
         GOTO 6
       ELSE IF (IJOB .EQ. 7) THEN
         GOTO 7
+      ELSE IF (IJOB .EQ. 8 .OR. IJOB .EQ. 9) THEN
+        GOTO 8
       ELSE IF (IJOB .LE. 10) THEN
         GOTO 55       
       ELSE IF (IJOB .EQ. 11) THEN
@@ -515,6 +527,14 @@ C ---  B=IDENTITY, JACOBIAN A FULL MATRIX, HESSENBERG-OPTION
       RETURN
 C
 C -----------------------------------------------------------
+C
+   8  CONTINUE
+C ---  B=IDENTITY OR MASS MATRIX, JACOBIAN A SPARSE MATRIX
+C ---  (SPARSE LU DECOMPOSITION IN sparselu.c)
+      CALL DECSPC(N,FMAS,LDMAS,MLMAS,MUMAS,ALPHN,BETAN,IJOB,IER)
+      RETURN
+C
+C -----------------------------------------------------------
 C
   55  CONTINUE
       RETURN
@@ -1090,6 +1110,10 @@ C
         GOTO 6
       ELSE IF (IJOB .EQ. 7) THEN
         GOTO 7
+      ELSE IF (IJOB .EQ. 8) THEN
+        GOTO 8
+      ELSE IF (IJOB .EQ. 9) THEN
+        GOTO 9
       ELSE IF (IJOB .LE. 10) THEN
         GOTO 55       
       ELSE IF (IJOB .EQ. 11) THEN
@@ -1412,6 +1436,34 @@ C ---  B=IDENTITY, JACOBIAN A FULL MATRIX, HESSENBERG-OPTION
       RETURN
 C
 C -----------------------------------------------------------
+C
+   8  CONTINUE
+C ---  B=IDENTITY, JACOBIAN A SPARSE MATRIX
+      DO I=1,N
+         S2=-F2(I)
+         S3=-F3(I)
+         Z1(I)=Z1(I)-F1(I)*FAC1
+         Z2(I)=Z2(I)+S2*ALPHN-S3*BETAN
+         Z3(I)=Z3(I)+S3*ALPHN+S2*BETAN
+      END DO
+      CALL SOLSPR(N,Z1)
+      CALL SOLSPC(N,Z2,Z3)
+      RETURN
+C
+C -----------------------------------------------------------
+C
+   9  CONTINUE
+C ---  B IS A BANDED OR FULL MATRIX, JACOBIAN A SPARSE MATRIX
+      CALL MULSPM(N,F1,-FAC1,Z1)
+      CALL MULSPM(N,F2,-ALPHN,Z2)
+      CALL MULSPM(N,F3,BETAN,Z2)
+      CALL MULSPM(N,F3,-ALPHN,Z3)
+      CALL MULSPM(N,F2,-BETAN,Z3)
+      CALL SOLSPR(N,Z1)
+      CALL SOLSPC(N,Z2,Z3)
+      RETURN
+C
+C -----------------------------------------------------------
 C
   55  CONTINUE
       RETURN
@@ -1448,6 +1500,10 @@ C
         GOTO 6
       ELSE IF (IJOB .EQ. 7) THEN
         GOTO 7
+      ELSE IF (IJOB .EQ. 8) THEN
+        GOTO 8
+      ELSE IF (IJOB .EQ. 9) THEN
+        GOTO 9
       ELSE IF (IJOB .LE. 10) THEN
         GOTO 55       
       ELSE IF (IJOB .EQ. 11) THEN
@@ -1636,6 +1692,28 @@ C ------  B IS A BANDED MATRIX, JACOBIAN A FULL MATRIX, SECOND ORDER
          CONT(IM1)=SUM+Y0(IM1)
       END DO
       GOTO 48
+C
+   8  CONTINUE
+C ------  B=IDENTITY, JACOBIAN A SPARSE MATRIX
+      DO I=1,N
+         F2(I)=HEE1*Z1(I)+HEE2*Z2(I)+HEE3*Z3(I)
+         CONT(I)=F2(I)+Y0(I)
+      END DO
+      CALL SOLSPR(N,CONT)
+      GOTO 77
+C
+   9  CONTINUE
+C ------  B IS A BANDED OR FULL MATRIX, JACOBIAN A SPARSE MATRIX
+      DO I=1,N
+         F1(I)=HEE1*Z1(I)+HEE2*Z2(I)+HEE3*Z3(I)
+         F2(I)=0.D0
+      END DO
+      CALL MULSPM(N,F1,1.D0,F2)
+      DO I=1,N
+         CONT(I)=F2(I)+Y0(I)
+      END DO
+      CALL SOLSPR(N,CONT)
+      GOTO 77
 C
    6  CONTINUE
 C ------  B IS A FULL MATRIX, JACOBIAN A BANDED MATRIX
@@ -1699,6 +1777,8 @@ C
            GOTO 32
           ELSE IF (IJOB .EQ. 7) THEN
            GOTO 33
+          ELSE IF (IJOB .EQ. 8 .OR. IJOB .EQ. 9) THEN
+           GOTO 34
           ELSE IF (IJOB .LE. 10) THEN
            GOTO 55
           ELSE IF (IJOB .EQ.11 .OR. IJOB .EQ.13 .OR. IJOB .EQ.15) THEN
@@ -1777,6 +1857,11 @@ C ------ HESSENBERG MATRIX OPTION
              CONT(I)=ZSAFE
  640         CONTINUE
           END DO
+          GOTO 88
+C ------ SPARSE MATRIX OPTION
+  34      CONTINUE
+          CALL SOLSPR(N,CONT)
+          GOTO 88
 C -----------------------------------
    88     CONTINUE
           ERR=0.D0
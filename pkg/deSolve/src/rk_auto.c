@@ -8,7 +8,25 @@
 
 #include "rk_util.h"
 
-void rk_auto(
+/* derivative at the end (t + dt, y2) of the step, with the outputs there
+   if they are captured */
+static void rk_outend(deSolve_context *ctx, rk_outcap *oc, SEXP Func,
+                      double t, double dt, double *y2, SEXP Parms, SEXP Rho,
+                      double *dy2, double *out, int neq, int *ipar,
+                      int isDll, int isForcing) {
+  int i;
+
+  if (oc != NULL) oc->want = TRUE;
+  derivs(ctx, Func, t + dt, y2, Parms, Rho, dy2, out, 0, neq,
+         ipar, isDll, isForcing);
+  if (oc != NULL) {
+    oc->want = FALSE;
+    for (i = 0; i < oc->nout; i++) oc->out1[i] = out[i];
+    oc->t1 = t + dt;
+  }
+}
+
+void rk_auto(deSolve_context *ctx,
        /* integers */
        int fsal, int neq, int stage,
        int isDll, int isForcing, int verbose,
@@ -32,11 +50,32 @@ void rk_auto(
   )
 {
 
-  int i = 0, j = 0, j1 = 0, k = 0, accept = FALSE, nreject = *_it_rej, one = 1;
+  int i = 0, j = 0, j1 = 0, accept = FALSE, nreject = *_it_rej, f0 = FALSE;
   int iknots = *_iknots, it = *_it, it_ext = *_it_ext, it_tot = *_it_tot;
-  double err, dtnew, t_ext;
+  int dy2ok = FALSE;
+  double err, dtnew, t_ext, *dy;
   double dt = *_dt, errold = *_errold;
 
+  /* specialized kernels of a built-in method (rk_tableau.c), or NULL */
+  rk_kernel *kern = (rk_kernel *) ctx->solver;
+
+  /* stiffness detection (rk_stiff.c), or NULL */
+  rk_switch *sw = ctx->stiff;
+  if (sw != NULL) sw->switched = FALSE;
+
+  /* root finding (rk_root.c), or NULL */
+  rk_root *rt = ctx->root;
+
+  /* history of a delay differential equation (lags.c) */
+  int islag = ctx->initialisehist;
+
+  /* outputs captured at the ends of the steps (rk_util.c), or NULL */
+  rk_outcap *oc = ctx->outcap;
+
+  /* reductions over the accepted steps (rk_reduce.c), or NULL */
+  rk_reduce *rd = ctx->reduce;
+  int rdense = (rd != NULL && rd->dense);
+
   /* todo: make this user adjustable */
   static const double minscale = 0.2, maxscale = 10.0, safe = 0.9;
 
@@ -44,8 +83,8 @@ void rk_auto(
   /* Main Loop                                                              */
   /*------------------------------------------------------------------------*/
   do {
-    if (accept) timesteps[0] = timesteps[1];
-    timesteps[1] = dt;
+    if (accept) ctx->timesteps[0] = ctx->timesteps[1];
+    ctx->timesteps[1] = dt;
 
     /*  save former results of last step if the method allows this
        (first same as last)                                             */
@@ -53,46 +92,54 @@ void rk_auto(
     if (fsal && accept){
       j1 = 1;
       for (i = 0; i < neq; i++) FF[i] = FF[i + neq * (stage - 1)];
+    } else if (f0 && accept) {
+      j1 = 1;  /* derivative at y0 from the Hermite dense output */
     } else {
       j1 = 0;
     }
     /******  Prepare Coefficients from Butcher table ******/
     for (j = j1; j < stage; j++) {
-      for(i = 0; i < neq; i++) Fj[i] = 0;
-        k = 0;
-        while(k < j) {
-          for(i = 0; i < neq; i++)
-            Fj[i] = Fj[i] + A[j + stage * k] * FF[i + neq * k] * dt;
-          k++;
-        }
-        for (int i = 0; i < neq; i++) {
-          tmp[i] = Fj[i] + y0[i];
+      /* stage input y0 + dt * sum(A[j, k] * FF[, k]), in one pass */
+      if (kern)
+        kern->stage_f(j, tmp, y0, FF, dt, neq);
+      else
+        rk_stage(tmp, y0, FF, A, dt, j, j, stage, neq);
+      /* inputs of the last two stages for the stiffness detection */
+      if (sw != NULL && j >= stage - 2)
+        for (i = 0; i < neq; i++) sw->ys[i + neq * (j - stage + 2)] = tmp[i];
+      /******  Compute Derivatives ******/
+      /* pass option to avoid unnecessary copying in derivs */
+      if (oc != NULL) oc->want = (j == 0 || (fsal && j == stage - 1));
+      derivs(ctx, Func, t + dt * cc[j], tmp, Parms, Rho, FF, out, j, neq,
+             ipar, isDll, isForcing);
+      /* outputs at the start and (FSAL) at the end of the step */
+      if (oc != NULL && oc->want) {
+        oc->want = FALSE;
+        if (j == 0) {
+          for (i = 0; i < oc->nout; i++) oc->out0[i] = out[i];
+          oc->t0 = t;
+        } else {
+          for (i = 0; i < oc->nout; i++) oc->out1[i] = out[i];
+          oc->t1 = t + dt;
         }
-        /******  Compute Derivatives ******/
-        /* pass option to avoid unnecessary copying in derivs */
-        derivs(Func, t + dt * cc[j], tmp, Parms, Rho, FF, out, j, neq,
-               ipar, isDll, isForcing);
+      }
     }
 
     /*====================================================================*/
-    /* Estimation of new values                                           */
+    /* Estimation of new values and of the error                          */
     /*====================================================================*/
 
-    /* use BLAS wrapper with reduced error checking */
-    blas_matprod1(FF, neq, stage, bb1, stage, one, dy1);
-    blas_matprod1(FF, neq, stage, bb2, stage, one, dy2);
-
+    /* both estimates and the error norm in one pass (rk_util.c) */
+    if (kern)
+      err = kern->update(y1, y2, y0, tmp, FF, atol, rtol, dt, neq);
+    else
+      err = rk_update(y1, y2, y0, FF, bb1, bb2, atol, rtol, dt, stage, neq);
     it_tot++; /* count total number of time steps */
-    for (i = 0; i < neq; i++) {
-      y1[i] = y0[i] + dt * dy1[i];
-      y2[i] = y0[i] + dt * dy2[i];
-    }
 
     /*====================================================================*/
     /*      stepsize adjustment                                           */
     /*====================================================================*/
 
-    err = maxerr(y0, y1, y2, atol, rtol, neq);
     dtnew = dt;
     if (err == 0) {  /* use max scale if all tolerances are zero */
       dtnew  = fmin(dt * 10, hmax);
@@ -118,9 +165,44 @@ void rk_auto(
       dtnew = hmin;
     }
     /*====================================================================*/
+    /*      Root finding: a step with a root is taken again, up to the    */
+    /*      root, and the loop ends there                                 */
+    /*====================================================================*/
+    dy2ok = FALSE;
+    if (rt != NULL && !accept) {
+      rt->found = FALSE;  /* rejected, the root is searched again */
+    } else if (rt != NULL && !rt->found) {
+      /* derivative at the new point, from the FSAL stage if possible */
+      if (fsal && densetype != 2) {
+        dy = FF + neq * (stage - 1);
+      } else {
+        rk_outend(ctx, oc, Func, t, dt, y2, Parms, Rho, dy2, out, neq,
+                  ipar, isDll, isForcing);
+        dy = dy2;
+        dy2ok = TRUE;
+      }
+      if (rk_rootfind(rt, t, dt, y0, FF, y2, dy, neq)) {
+        rt->dtnext = dtnew;
+        if (rt->troot < t + dt) {
+          accept = FALSE;
+          dtnew = rt->troot - t;
+        }
+      }
+    }
+    /*====================================================================*/
     /*      Interpolation and Data Storage                                */
     /*====================================================================*/
     if (accept) {
+      /* dominant eigenvalue from the last two stages */
+      if (sw != NULL) rk_stiffexpl(sw, dt, FF, stage, neq);
+      /* derivative at the new point for dense output types 2 and 3 and
+         for the history of lags, also the first stage of the next step;
+         Cash-Karp needs it for FSAL even without interpolation */
+      if (!dy2ok && (densetype == 2 || (!fsal && (islag || oc != NULL ||
+                     rdense)) || (densetype == 3 && !fsal && interpolate))) {
+        rk_outend(ctx, oc, Func, t, dt, y2, Parms, Rho, dy2, out, neq,
+                  ipar, isDll, isForcing);
+      }
       if (interpolate) {
       /*--------------------------------------------------------------------*/
       /* case A1) "dense output type 1": built-in polynomial interpolation  */
@@ -136,6 +218,7 @@ void rk_auto(
             yout[it_ext] = t_ext;
             for (i = 0; i < neq; i++)
               yout[it_ext + nt * (1 + i)] = tmp[i];
+            if (oc != NULL) rk_outinterp(oc, t_ext, yout, it_ext, nt, neq);
           }
           if(it_ext < nt-1) t_ext = tt[++it_ext]; else break;
         }
@@ -144,9 +227,6 @@ void rk_auto(
         /* case A2) dense output type 2: the Cash-Karp method                 */
         /*--------------------------------------------------------------------*/
       } else if (densetype == 2)  {   /* dense output method 2 = Cash-Karp */
-        derivs(Func, t + dt, y2, Parms, Rho, dy2, out, 0, neq,
-               ipar, isDll, isForcing);
-
         t_ext = tt[it_ext];
 
         while (t_ext <= t + dt) {
@@ -156,36 +236,55 @@ void rk_auto(
             yout[it_ext] = t_ext;
             for (i = 0; i < neq; i++)
               yout[it_ext + nt * (1 + i)] = tmp[i];
+            if (oc != NULL) rk_outinterp(oc, t_ext, yout, it_ext, nt, neq);
           }
           if(it_ext < nt-1) t_ext = tt[++it_ext]; else break;
        }
-       /* FSAL (first same as last) for Cash-Karp */
-       for (i = 0; i < neq; i++) FF[i + neq * (stage - 1)] = dy2[i] ;
 
         /*--------------------------------------------------------------------*/
-        /* case B) Neville-Aitken-Interpolation for integrators               */
+        /* case A3) dense output type 3: Hermite interpolation with values    */
+        /* and derivatives of the last nknots steps (ring buffer), e.g. for   */
+        /* rk23bs (derivative from the FSAL stage) and rk45f                  */
+        /*--------------------------------------------------------------------*/
+      } else if (densetype == 3) {
+        double *dy = (fsal) ? FF + neq * (stage - 1) : dy2;
+        /* derivative at the initial knot is the first stage of step 1 */
+        if (iknots == 1) putknot(yknots, nknots, 2 * neq + 1, 0, t, y0, FF, neq);
+        putknot(yknots, nknots, 2 * neq + 1, iknots++, t + dt, y2, dy, neq);
+        t_ext = tt[it_ext];
+        while (t_ext <= t + dt) {
+          hermite(yknots, nknots, iknots, t_ext, tmp, neq);
+          /* store outputs */
+          if (it_ext < nt) {
+            yout[it_ext] = t_ext;
+            for (i = 0; i < neq; i++)
+              yout[it_ext + nt * (1 + i)] = tmp[i];
+            if (oc != NULL) rk_outinterp(oc, t_ext, yout, it_ext, nt, neq);
+          }
+          if(it_ext < nt-1) t_ext = tt[++it_ext]; else break;
+        }
+
+        /*--------------------------------------------------------------------*/
+        /* case B) polynomial interpolation for integrators                   */
         /* without dense output                                               */
         /*--------------------------------------------------------------------*/
       } else {
           /* (1) collect number "nknots" of knots in advance */
-          yknots[iknots] = t + dt;   /* time is first column */
-          for (i = 0; i < neq; i++) yknots[iknots + nknots * (1 + i)] = y2[i];
-          if (iknots < (nknots - 1)) {
-            iknots++;
-          } else {
+          putknot(yknots, nknots, neq + 1, iknots++, t + dt, y2, NULL, neq);
+          if (iknots >= nknots) {
 	    /* (2) do polynomial interpolation */
             t_ext = tt[it_ext];
             while (t_ext <= t + dt) {
-              neville(yknots, &yknots[nknots], t_ext, tmp, nknots, neq);
+              lagrange(yknots, nknots, t_ext, tmp, neq);
               /* (3) store outputs */
               if (it_ext < nt) {
                 yout[it_ext] = t_ext;
                 for (i = 0; i < neq; i++)
                   yout[it_ext + nt * (1 + i)] = tmp[i];
+                if (oc != NULL) rk_outinterp(oc, t_ext, yout, it_ext, nt, neq);
               }
               if(it_ext < nt-1) t_ext = tt[++it_ext]; else break;
             }
-            shiftBuffer(yknots, nknots, neq + 1);
           }
         }
       } else {
@@ -194,27 +293,67 @@ void rk_auto(
         /*         results are stored after the call                          */
         /*--------------------------------------------------------------------*/
       }
+      /* history of the lags: the coefficients of the dense output of the
+         step (interpolMethod 4), or values and derivatives at its end */
+      if (islag) {
+        if (ctx->interpolMethod == 4 && !interpolate)
+          denspar(FF, y0, y2, dt, dd, neq, stage, rr);
+        updatehist(ctx, t + dt, y2, (fsal) ? FF + neq * (stage - 1) : dy2,
+                   rr, NULL);
+      }
+      /* integrals, extremes and means; FF holds f(t, y0) until the next
+         step */
+      if (rd != NULL)
+        rk_reducestep(rd, t, dt, y0, y2, FF,
+                      (fsal && densetype != 2) ? FF + neq * (stage - 1) : dy2,
+                      (oc != NULL) ? oc->out0 : NULL,
+                      (oc != NULL) ? oc->out1 : NULL);
+      /* FSAL (first same as last) for Cash-Karp; first stage of the
+         next step for Hermite dense output */
+      if (densetype == 2)
+        for (i = 0; i < neq; i++) FF[i + neq * (stage - 1)] = dy2[i];
+      f0 = !fsal && (dy2ok || islag || oc != NULL || rdense ||
+                     (densetype == 3 && interpolate));
+      if (f0)
+        for (i = 0; i < neq; i++) FF[i] = dy2[i];
       /*--------------------------------------------------------------------*/
       /* next time step                                                     */
       /*--------------------------------------------------------------------*/
       t = t + dt;
       it++;
       for (i=0; i < neq; i++) y0[i] = y2[i];
+      /* outputs at the end are those at the start of the next step */
+      if (oc != NULL) {
+        for (i = 0; i < oc->nout; i++) oc->out0[i] = oc->out1[i];
+        oc->t0 = oc->t1;
+      }
     } /* else rejected time step */
     dt = fmin(dtnew, tmax - t);
     if (it_ext > nt) {
-      Rprintf("error in RK solver rk_auto.c: output buffer overflow\n");
+      if (!ctx->worker)
+        Rprintf("error in RK solver rk_auto.c: output buffer overflow\n");
       break;
     }
     if (it_tot > maxsteps) {
       istate[0] = -1;
-      warning("Number of time steps %i exceeded maxsteps at t = %g\n", it, t);
+      if (!ctx->worker)
+        warning("Number of time steps %i exceeded maxsteps at t = %g\n", it, t);
       break;
     }
+    /* stiff phase: continue with the implicit method */
+    if (sw != NULL && sw->switched) break;
+    /* the step ended at a root */
+    if (rt != NULL && rt->found && accept) break;
     /* tolerance to avoid rounding errors */
   } while (t < (tmax - 100.0 * DBL_EPSILON * dt)); /* end of rk main loop */
 
   /* return reference values */
   *_iknots = iknots; *_it = it; *_it_ext = it_ext; *_it_rej = nreject;
   *_it_tot = it_tot; *_dt = dtnew; *_errold = errold;
+  /* after a root: the step size proposed before the step to the root;
+     a step to the root that was not yet taken is dropped */
+  if (rt != NULL && rt->found) {
+    if (accept) *_dt = rt->dtnext; else rt->found = FALSE;
+  }
+  if (sw != NULL) sw->t = t;
 }
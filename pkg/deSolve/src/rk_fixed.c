@@ -6,7 +6,7 @@
 
 #include "rk_util.h"
 
-void rk_fixed(
+void rk_fixed(deSolve_context *ctx,
        /* integers */
        int fsal, int neq, int stage,
        int isDll, int isForcing, int verbose,
@@ -28,11 +28,14 @@ void rk_fixed(
        SEXP Func, SEXP Parms, SEXP Rho
   ) {
 
-  int i = 0, j = 0, one = 1;
+  int i = 0, j = 0, f0 = FALSE;
   int iknots = *_iknots, it = *_it, it_ext = *_it_ext, it_tot = *_it_tot;
   double t_ext;
   double dt = *_dt;
 
+  /* root finding (rk_root.c), or NULL */
+  rk_root *rt = ctx->root;
+
   /*------------------------------------------------------------------------*/
   /* Main Loop                                                              */
   /*------------------------------------------------------------------------*/
@@ -43,23 +46,23 @@ void rk_fixed(
       dt = tt[it] - tt[it-1];
     else
       dt = fmin(fabs(hini), fabs(tmax - t)) * sign(hini);
+    /* step up to the root found in the last step */
+    if (rt != NULL && rt->found) dt = rt->troot - t;
     //Rprintf("dt, hini = %g , %g\n", dt, hini);
-    timesteps[0] = timesteps[1];
-    timesteps[1] = dt;
+    ctx->timesteps[0] = ctx->timesteps[1];
+    ctx->timesteps[1] = dt;
 
     /******  Prepare Coefficients from Butcher table ******/
     /* NOTE: the fixed-step solver needs coefficients as vector, not matrix! */
     for (j = 0; j < stage; j++) {
+      if (j == 0 && f0) continue;  /* f(t, y0) is known */
       if (j == 0)
-        for(i = 0; i < neq; i++) Fj[i] = 0;
+        for (i = 0; i < neq; i++) tmp[i] = y0[i];
       else
-        for(i = 0; i < neq; i++)
-          Fj[i] = A[j] * FF[i + neq * (j - 1)] * dt;
-      for (int i = 0; i < neq; i++) {
-        tmp[i] = Fj[i] + y0[i];
-      }
+        for (i = 0; i < neq; i++)
+          tmp[i] = y0[i] + A[j] * dt * FF[i + neq * (j - 1)];
       /******  Compute Derivatives ******/
-      derivs(Func, t + dt * cc[j], tmp, Parms, Rho, FF, out, j, neq,
+      derivs(ctx, Func, t + dt * cc[j], tmp, Parms, Rho, FF, out, j, neq,
         ipar, isDll, isForcing);
     }
 
@@ -67,12 +70,27 @@ void rk_fixed(
     /* Estimation of new values                                           */
     /*====================================================================*/
 
-    /* use BLAS with reduced error checking */
-    blas_matprod1(FF, neq, stage, bb1, stage, one, dy1);
+    /* new values in one pass (rk_util.c) */
+    rk_update(y1, NULL, y0, FF, bb1, NULL, NULL, NULL, dt, stage, neq);
 
     it_tot++; /* count total number of time steps */
-    for (i = 0; i < neq; i++) {
-      y1[i] = y0[i] +  dt * dy1[i];
+
+    /*====================================================================*/
+    /*      Root finding: a step with a root is taken again, up to the    */
+    /*      root, and the loop ends there                                 */
+    /*====================================================================*/
+    f0 = FALSE;
+    if (rt != NULL && !rt->found) {
+      derivs(ctx, Func, t + dt, y1, Parms, Rho, dy1, out, 0, neq,
+             ipar, isDll, isForcing);
+      if (rk_rootfind(rt, t, dt, y0, FF, y1, dy1, neq) &&
+          fabs(rt->troot - t) < fabs(dt)) {
+        f0 = TRUE;
+        continue;
+      }
+      /* derivative at the new point is the first stage of the next step */
+      for (i = 0; i < neq; i++) FF[i] = dy1[i];
+      f0 = TRUE;
     }
 
     /*====================================================================*/
@@ -80,19 +98,16 @@ void rk_fixed(
     /*====================================================================*/
     if (interpolate) {
       /*------------------------------------------------------------------*/
-      /* Neville-Aitken-Interpolation                                     */
+      /* polynomial interpolation (Lagrange form, ring buffer of knots)   */
       /* the fixed step integrators have no dense output                  */
       /*------------------------------------------------------------------*/
       /* (1) collect number "nknots" of knots in advance */
-      yknots[iknots] = t + dt;   /* time in first column */
-      for (i = 0; i < neq; i++) yknots[iknots + nknots * (1 + i)] = y1[i];
-      if (iknots < (nknots - 1)) {
-        iknots++;
-      } else {
+      putknot(yknots, nknots, neq + 1, iknots++, t + dt, y1, NULL, neq);
+      if (iknots >= nknots) {
        /* (2) do polynomial interpolation */
        t_ext = tt[it_ext];
        while (t_ext <= t + dt) {
-        neville(yknots, &yknots[nknots], t_ext, tmp, nknots, neq);
+        lagrange(yknots, nknots, t_ext, tmp, neq);
         /* (3) store outputs */
         if (it_ext < nt) {
           yout[it_ext] = t_ext;
@@ -101,7 +116,6 @@ void rk_fixed(
         }
         if(it_ext < nt-1) t_ext = tt[++it_ext]; else break;
        }
-       shiftBuffer(yknots, nknots, neq + 1);
       }
     } else {
       /*--------------------------------------------------------------------*/
@@ -115,6 +129,8 @@ void rk_fixed(
     t = t + dt;
     it++;
     for (i = 0; i < neq; i++) y0[i] = y1[i];
+    /* the step ended at a root */
+    if (rt != NULL && rt->found) break;
     if (it_ext > nt) {
       Rprintf("error in RK solver rk_fixed.c: output buffer overflow\n");
       break;
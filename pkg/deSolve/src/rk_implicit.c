@@ -1,98 +1,191 @@
 /*==========================================================================*/
-/* Implicit RK Solver with fixed step size                                  */
+/* Implicit RK Solver with fixed or variable step size                      */
+/* simplified Newton iteration: the stage system is formed from the         */
+/* Jacobian of the derivatives (Kronecker product with A) and kept          */
+/* factorized over iterations and steps while the iteration converges well */
 /*==========================================================================*/
 
 #include "rk_util.h"
 void F77_NAME(dgefa)(double*, int*, int*, int*, int*);
 void F77_NAME(dgesl)(double*, int*, int*, int*, double*, int*);
-/*
-void lu_solve(double, int, int, double);
-void kfunc(int, int, double, double, double, double, double, double,
-      double, SEXP, SEXP, SEXP, double, double, double, int, int, int);
-void dkfunc(int, int, double, double, double, double, double, double, double,
-      SEXP, SEXP, SEXP, double, double, double, double, int, int, int, double);
-*/
-
-/* lower upper decomposition - no error checking */
-void lu_solve(double *alfa, int n, int *index, double *bet) {
-  int info;
-
-  F77_CALL(dgefa)(alfa, &n, &n, index, &info);
-	if (info != 0)
-    error("error during factorisation of matrix (dgefa), singular matrix");
-  F77_CALL(dgesl)(alfa, &n, &n, index, bet, &info);
-	if (info != 0)
-    error("error during backsubstitution");
-}
 
 /* function that returns -k + dt*derivs(t+c[i]*dt, y+sum(a[i,)*k
    this is the function whose roots should be found in the implicit method */
 
-void kfunc(int stage, int neq, double t, double dt,
+void kfunc(deSolve_context *ctx, int stage, int neq, double t, double dt,
    double *FF, double *Fj, double *A, double *cc, double *y0 ,
    SEXP Func, SEXP Parms, SEXP Rho, double *tmp, double *tmp2,
    double *out, int *ipar, int isDll, int isForcing){
 
-   int i, j, k;
+   int i, j;
    /******  Prepare Coefficients from Butcher table ******/
    for (j = 0; j < stage; j++) {
-     for (i = 0; i < neq; i++) Fj[i] = 0.;
-     for (k =0; k < stage; k++) { /* implicit part */
-       for(i = 0; i < neq; i++)
-         Fj[i] = Fj[i] + A[j + stage * k] * FF[i + neq * k] * dt;
-     }
-     for (int i = 0; i < neq; i++) {
-       tmp[i] = Fj[i] + y0[i];
-     }
+     /* implicit part: all stages, in one pass (rk_util.c) */
+     rk_stage(tmp, y0, FF, A, dt, j, stage, stage, neq);
      /******  Compute Derivatives ******/
      /* pass option to avoid unnecessary copying in derivs note:tmp2 rather than FF */
-     derivs(Func, t + dt * cc[j], tmp, Parms, Rho, tmp2, out, j, neq,
+     derivs(ctx, Func, t + dt * cc[j], tmp, Parms, Rho, tmp2, out, j, neq,
               ipar, isDll, isForcing);
    }
    for (i = 0; i< neq*stage;i++)
      tmp[i] = FF[i] - tmp2[i];       /* tmp should be = 0 at root */
 }
 
-/* function that returns the Jacobian of kfunc; df[i,j] should contain:
-   dkfunc_i/dFFj CHECK */
-void dkfunc(int stage, int neq, double t, double dt,
-   double *FF, double *Fj, double *A, double *cc, double *y0,
-   SEXP Func, SEXP Parms, SEXP Rho, double *tmp, double *tmp2, double *tmp3,
-   double *out, int *ipar, int isDll, int isForcing, double *df){
-
-   int i, j, nroot;
-   double d1, d2;
-
-   nroot = neq*stage;
-
-   /* function reference value in tmp2 */
-   kfunc(stage, neq, t, dt, FF, Fj, A, cc, y0, Func, Parms, Rho,
-         tmp2, tmp3, out, ipar, isDll, isForcing);
-
-   for (i = 0; i < nroot; i++) {
-     d1 = FF[i];                      /* copy */
-     d2 = fmax(1e-8, FF[i] * 1e-8);     /* perturb */
-     FF[i] = FF[i] + d2;
-     kfunc(stage, neq, t, dt, FF, Fj, A, cc, y0, Func, Parms, Rho,
-        tmp, tmp3, out, ipar, isDll, isForcing);
-     for (j = 0; j < nroot; j++)
-       df[nroot * i + j] = (tmp[j] - tmp2[j])/d2;   //df[j,i] j,i=1:nroot
-     FF[i] = d1;                      /* restore */
-   }
+/* workspace of the Newton iteration and weights of the error estimate;
+   the estimate is y1 - yhat, filtered with (I - dt * gamma * J)^-1 as in
+   radau5, where yhat is a quadrature with nodes 0 and the nonzero c, with
+   weight gamma (mean eigenvalue of A) of f(t, y0) and exact for
+   polynomials of degree ns - 1 (ns = number of nonzero c) */
+irk_data *irk_init(int neq, int stage, int varstep, double *A, double *bb1,
+                   double *cc) {
+  int i, j, k, ns = 0, info, job = 0, nroot = neq * stage;
+  int *m, *index;
+  double *V, *r;
+  irk_data *irk;
+
+  irk = (irk_data *) R_alloc(1, sizeof(irk_data));
+  /* fixed step size: one Jacobian per stage for the full Newton iteration */
+  irk->J     = (double *) R_alloc(neq * neq * (varstep ? 1 : stage),
+                                  sizeof(double));
+  irk->E     = (double *) R_alloc(nroot * nroot, sizeof(double));
+  irk->index = (int *)    R_alloc(nroot, sizeof(int));
+  irk->e     = (double *) R_alloc(stage, sizeof(double));
+  irk->Eerr  = NULL;
+  irk->indexerr = NULL;
+
+  irk->gamma = 0;
+  for (j = 0; j < stage; j++) irk->gamma += A[j + stage * j] / stage;
+
+  m = (int *) R_alloc(stage, sizeof(int));
+  for (j = 0; j < stage; j++) {
+    irk->e[j] = 0;
+    if (cc[j] != 0) m[ns++] = j;
+  }
+  if (varstep) {
+    if (ns == 0) error("implicit method without nonzero c, no error estimate");
+    V     = (double *) R_alloc(ns * ns, sizeof(double));
+    r     = (double *) R_alloc(ns, sizeof(double));
+    index = (int *)    R_alloc(ns, sizeof(int));
+    for (i = 0; i < ns; i++) {
+      V[ns * i] = 1.0;
+      for (k = 1; k < ns; k++) V[k + ns * i] = V[k - 1 + ns * i] * cc[m[i]];
+      r[i] = 0;
+    }
+    r[0] = -irk->gamma;
+    F77_CALL(dgefa)(V, &ns, &ns, index, &info);
+    if (info != 0) error("implicit method with equal values of c, no error estimate");
+    F77_CALL(dgesl)(V, &ns, &ns, index, r, &job);
+    for (i = 0; i < ns; i++) irk->e[m[i]] = r[i];
+
+    irk->Eerr     = (double *) R_alloc(neq * neq, sizeof(double));
+    irk->indexerr = (int *)    R_alloc(neq, sizeof(int));
+  }
+  irk->qerr = ns;
+
+  /* last stage is f(t + dt, y1), e.g. Radau IIA */
+  irk->stiffacc = (cc[stage - 1] == 1.0);
+  for (k = 0; k < stage; k++)
+    if (A[stage - 1 + stage * k] != bb1[k]) irk->stiffacc = FALSE;
+
+  irk->dtlu    = 0;
+  irk->faccon  = 1.0;
+  irk->theta   = 1.0;
+  irk->newjac  = TRUE;
+  irk->jcur    = FALSE;
+  irk->f0ok    = 0;
+  irk->restart = TRUE;
+  return(irk);
 }
 
-/* ks: check if tmp3 necessary ... */
-void rk_implicit( double * alfa,  /* neq*stage * neq*stage */
-       int *index,                /* neq*stage */
+/* Jacobian J of the derivatives at (t, y0) by finite differences, with
+   groups of columns if the sparsity is known; f0 = f(t, y0);
+   returns the number of function evaluations */
+int irk_jac(deSolve_context *ctx, double *J, int neq, double t,
+   double *y0, double *f0, double *ytmp, double *f1,
+   SEXP Func, SEXP Parms, SEXP Rho,
+   double *out, int *ipar, int isDll, int isForcing) {
+
+  int i, j, g, k, m;
+  double del;
+  cpr_data *cpr = ctx->cpr;
+
+  for (i = 0; i < neq; i++) ytmp[i] = y0[i];
+
+  if (cpr != NULL) {
+    /* known sparsity: perturb groups of independent columns together */
+    for (i = 0; i < neq * neq; i++) J[i] = 0.;
+    for (g = 0; g < cpr->ngp; g++) {
+      for (k = cpr->igp[g] - 1; k < cpr->igp[g + 1] - 1; k++) {
+        j = cpr->jgp[k] - 1;
+        cpr->del[j] = sqrt(DBL_EPSILON * fmax(1e-5, fabs(y0[j])));
+        ytmp[j] = y0[j] + cpr->del[j];
+      }
+      derivs(ctx, Func, t, ytmp, Parms, Rho, f1, out, 0, neq,
+             ipar, isDll, isForcing);
+      for (k = cpr->igp[g] - 1; k < cpr->igp[g + 1] - 1; k++) {
+        j = cpr->jgp[k] - 1;
+        for (m = cpr->ian[j] - 1; m < cpr->ian[j + 1] - 1; m++) {
+          i = cpr->jan[m] - 1;
+          J[i + neq * j] = (f1[i] - f0[i])/cpr->del[j];
+        }
+        ytmp[j] = y0[j];                 /* restore */
+      }
+    }
+    return(cpr->ngp);
+  }
+
+  for (j = 0; j < neq; j++) {
+    del = sqrt(DBL_EPSILON * fmax(1e-5, fabs(y0[j])));
+    ytmp[j] = y0[j] + del;               /* perturb */
+    derivs(ctx, Func, t, ytmp, Parms, Rho, f1, out, 0, neq,
+           ipar, isDll, isForcing);
+    for (i = 0; i < neq; i++)
+      J[i + neq * j] = (f1[i] - f0[i])/del;
+    ytmp[j] = y0[j];                     /* restore */
+  }
+  return(neq);
+}
+
+/* LU decomposition of the stage system E = I - dt * (A %x% J), unknown
+   (l, k) is derivative l of stage k, and of I - dt * gamma * J for the
+   error estimate; with full = TRUE, row block j has its own Jacobian at
+   the input of stage j; returns nonzero if a matrix is singular */
+static int irk_lu(irk_data *irk, double *A, double dt, int stage, int neq,
+                  int varstep, int full) {
+  int i, j, k, l, info, nroot = neq * stage;
+  double a, *E = irk->E, *J = irk->J, *Jj;
+
+  for (k = 0; k < stage; k++)
+    for (j = 0; j < stage; j++) {
+      a  = dt * A[j + stage * k];
+      Jj = J + ((full) ? neq * neq * j : 0);
+      for (l = 0; l < neq; l++)
+        for (i = 0; i < neq; i++)
+          E[i + neq * j + nroot * (l + neq * k)] = -a * Jj[i + neq * l];
+    }
+  for (i = 0; i < nroot; i++) E[i + nroot * i] += 1.0;
+  F77_CALL(dgefa)(E, &nroot, &nroot, irk->index, &info);
+
+  if (info == 0 && varstep) {
+    for (i = 0; i < neq * neq; i++) irk->Eerr[i] = -dt * irk->gamma * J[i];
+    for (i = 0; i < neq; i++) irk->Eerr[i + neq * i] += 1.0;
+    F77_CALL(dgefa)(irk->Eerr, &neq, &neq, irk->indexerr, &info);
+  }
+  if (info != 0 && !varstep)
+    error("error during factorisation of matrix (dgefa), singular matrix");
+  return(info);
+}
+
+void rk_implicit(deSolve_context *ctx,
        /* integers */
        int fsal, int neq, int stage,
        int isDll, int isForcing, int verbose,
-       int nknots, int interpolate, int maxsteps, int nt,
+       int nknots, int interpolate, int varstep, int maxsteps, int nt,
        /* int pointers */
-       int* _iknots, int* _it, int* _it_ext, int* _it_tot,
+       int* _iknots, int* _it, int* _it_ext, int* _it_tot, int* _it_rej,
        int* istate,  int* ipar,
        /* double */
-        double t, double tmax, double hini,
+       double t, double tmax, double hini, double hmin, double hmax,
        /* double pointers */
        double* _dt,
        /* arrays */
@@ -100,106 +193,256 @@ void rk_implicit( double * alfa,  /* neq*stage * neq*stage */
        double* f, double* y, double* Fj,
        double* tmp, double* tmp2, double* tmp3,
        double* FF, double* rr, double* A, double* out,
-       double* bb1, double* cc,
+       double* bb1, double* cc, double* atol, double* rtol,
        double* yknots, double* yout,
        /* SEXPs */
        SEXP Func, SEXP Parms, SEXP Rho
   )
 {
-  int i = 0, one = 1;
+  int i = 0, j = 0, k = 0, job = 0;
   int iknots = *_iknots, it = *_it, it_ext = *_it_ext, it_tot = *_it_tot;
-  double t_ext;
+  int nreject = *_it_rej, accept = FALSE, lastrej = FALSE;
+  int nfev = 0, njac = 0, nlu = 0, nnewt = 0, nconv = 0;
+  double t_ext, err, dtnew, d0, d1, sc;
   double dt = *_dt;
-  int iter, maxit = 100;
-  double errf, errx;
+  int iter, maxit = (varstep) ? 7 : 100, conv, singular = FALSE, full = FALSE;
+  double dn, dnold, eta;
   int nroot = neq * stage;
 
+  irk_data *irk = (irk_data *) ctx->solver;
+
+  /* switching back to an explicit method (rk_stiff.c), or NULL */
+  rk_switch *sw = ctx->stiff;
+  if (sw != NULL) sw->switched = FALSE;
+
+  /* todo: make this user adjustable */
+  static const double minscale = 0.2, maxscale = 10.0, safe = 0.9;
+  /* the Jacobian is kept while the Newton iteration contracts faster,
+     the default of radau5 */
+  static const double thet = 0.001;
+  /* tolerance of the Newton iteration, as in radau5 */
+  double fnewt = fmax(10 * DBL_EPSILON / rtol[0], fmin(0.03, sqrt(rtol[0])));
+
+  if (varstep) dt = fmin(dt, tmax - t);
+
   /*------------------------------------------------------------------------*/
   /* Main Loop                                                              */
   /*------------------------------------------------------------------------*/
   do {
     /* select time step (possibly irregular) */
-    if (hini > 0.0)
-      dt = fmin(hini, tmax - t); /* adjust dt for step-by-step-mode */
-    else
-      dt = tt[it] - tt[it-1];
-
-    timesteps[0] = timesteps[1];
-    timesteps[1] = dt;
-
-    /* Newton-Raphson steps */
-    for (iter = 0; iter < maxit; iter++) {
-      /* function value and Jacobian*/
-      kfunc(stage, neq, t, dt, FF, Fj, A, cc, y0, Func, Parms, Rho,
-        tmp, tmp2, out, ipar, isDll, isForcing);
-      it_tot++; /* count total number of time steps */
-      errf = 0.;
-      for ( i = 0; i < nroot; i++) errf = errf + fabs(tmp[i]);
-      if (errf < 1e-8) break;
-      dkfunc(stage, neq, t, dt, FF, Fj, A, cc, y0, Func, Parms, Rho,
-        tmp, tmp2, tmp3, out, ipar, isDll, isForcing, alfa);
-      it_tot = it_tot + nroot + 1;
-      lu_solve (alfa, nroot, index, tmp);
-      errx = 0;
-      for (i = 0; i < nroot; i++) {
-        errx = errx + fabs(tmp[i]);
-        FF[i] = FF[i] - tmp[i];
+    if (!varstep) {
+      if (hini > 0.0)
+        dt = fmin(hini, tmax - t); /* adjust dt for step-by-step-mode */
+      else
+        dt = tt[it] - tt[it-1];
+    }
+    it_tot++; /* count total number of time steps */
+
+    /* derivative at the start of the step, needed for the error estimate
+       and the starting values of the iteration; the reference value of the
+       finite differences is always evaluated */
+    if ((irk->f0ok == 0 && (varstep || irk->restart)) ||
+        (irk->f0ok != 1 && irk->newjac)) {
+      derivs(ctx, Func, t, y0, Parms, Rho, f, out, 0, neq,
+             ipar, isDll, isForcing);
+      nfev++;
+      irk->f0ok = 1;
+    }
+
+    /* initial step size from the norms of y0 and f(t, y0) */
+    if (dt <= 0) {
+      d0 = 0; d1 = 0;
+      for (i = 0; i < neq; i++) {
+        sc = atol[i] + rtol[i] * fabs(y0[i]);
+        d0 += (y0[i]/sc) * (y0[i]/sc);
+        d1 += (f[i]/sc) * (f[i]/sc);
       }
-      //  Rprintf("iter %i errf %g errx %g\n",iter, errf, errx);
-      if (errx < 1e-8) break;
+      dt = (d0 < 1e-10 || d1 < 1e-10) ? 1e-6 : 0.01 * sqrt(d0/d1);
+      dt = fmin(fmin(dt, hmax), tmax - t);
+    }
+    ctx->timesteps[0] = ctx->timesteps[1];
+    ctx->timesteps[1] = dt;
+
+    if (irk->newjac) {
+      nfev += irk_jac(ctx, irk->J, neq, t, y0, f, y, Fj, Func, Parms, Rho,
+                      out, ipar, isDll, isForcing);
+      njac++;
+      if (sw != NULL) sw->rho = rk_specrad(irk->J, neq, sw->x);
+      irk->newjac = FALSE;
+      irk->jcur   = TRUE;
+      irk->dtlu   = 0;
+    }
+    if (dt != irk->dtlu) {
+      singular = irk_lu(irk, A, dt, stage, neq, varstep, FALSE);
+      nlu++;
+      irk->dtlu = (singular) ? 0 : dt;
+    }
+    /* starting values: f(t, y0) for all stages, else the last stages */
+    if (irk->restart) {
+      for (j = 0; j < stage; j++)
+        for (i = 0; i < neq; i++) FF[i + neq * j] = f[i];
+      irk->restart = FALSE;
     }
 
     /*====================================================================*/
-    /* Estimation of new values                                           */
+    /* simplified Newton iteration, converged if the estimated distance   */
+    /* to the solution, eta * dn, is below fnewt                          */
     /*====================================================================*/
+    conv  = FALSE;
+    dnold = 1.0;
+    eta   = pow(fmax(irk->faccon, DBL_EPSILON), 0.8);
+    for (iter = 0; iter < maxit && !singular; iter++) {
+      kfunc(ctx, stage, neq, t, dt, FF, Fj, A, cc, y0, Func, Parms, Rho,
+        tmp, tmp2, out, ipar, isDll, isForcing);
+      nfev += stage;
+      nnewt++;
+      if (full) {
+        /* full Newton: Jacobians at the current stage inputs */
+        for (j = 0; j < stage; j++) {
+          rk_stage(tmp3, y0, FF, A, dt, j, stage, stage, neq);
+          nfev += irk_jac(ctx, irk->J + neq * neq * j, neq, t + cc[j] * dt,
+                          tmp3, tmp2 + neq * j, Fj, dy1, Func, Parms, Rho,
+                          out, ipar, isDll, isForcing);
+          njac++;
+        }
+        singular = irk_lu(irk, A, dt, stage, neq, varstep, TRUE);
+        nlu++;
+        irk->dtlu = 0;
+        if (singular) break;
+      }
+      F77_CALL(dgesl)(irk->E, &nroot, &nroot, irk->index, tmp, &job);
+      dn = 0;
+      for (j = 0; j < stage; j++)
+        for (i = 0; i < neq; i++) {
+          k = i + neq * j;
+          FF[k] = FF[k] - tmp[k];
+          sc = dt * tmp[k] / (atol[i] + rtol[i] * fabs(y0[i]));
+          dn += sc * sc;
+        }
+      dn = sqrt(dn / nroot);
+      if (iter > 0) {
+        irk->theta = dn / dnold;
+        if (irk->theta >= 0.99 && !full) break; /* diverges */
+        eta = irk->theta / (1.0 - irk->theta);
+      } else {
+        irk->theta = 0;
+      }
+      dnold = dn;
+      if (eta * dn <= fnewt) {
+        conv = TRUE;
+        irk->faccon = eta;
+        break;
+      }
+    }
 
-    /* use BLAS with reduced error checking */
-    blas_matprod1(FF, neq, stage, bb1, stage, one, dy1);
+    /*====================================================================*/
+    /* Estimation of new values and of the error                          */
+    /*====================================================================*/
+    accept = FALSE;
+    dtnew  = dt;
+    err    = 0;
+    if (conv || full) {
+      /* fixed step size: the last iterate of the full Newton iteration
+         is taken also without convergence */
+      rk_update(y1, NULL, y0, FF, bb1, NULL, NULL, NULL, dt, stage, neq);
+      accept = TRUE;
+    }
+    if (!conv) {
+      nconv++;
+      if (!irk->jcur) {
+        accept = FALSE;                       /* again with a new Jacobian */
+        irk->newjac = TRUE;
+        irk->restart = TRUE;
+      } else if (varstep) {
+        dtnew = 0.5 * dt;
+        irk->restart = TRUE;
+      } else if (!full) {
+        /* fixed step size: the step is repeated with a full Newton
+           iteration, i.e. a Jacobian per stage, updated in each iteration */
+        accept = FALSE;
+        full = TRUE;
+        irk->restart = TRUE;
+      }
+    } else if (varstep) {
+      for (i = 0; i < neq; i++) dy1[i] = irk->gamma * f[i];
+      for (j = 0; j < stage; j++)
+        if (irk->e[j] != 0)
+          for (i = 0; i < neq; i++) dy1[i] += irk->e[j] * FF[i + neq * j];
+      for (i = 0; i < neq; i++) dy1[i] = dt * dy1[i];
+      F77_CALL(dgesl)(irk->Eerr, &neq, &neq, irk->indexerr, dy1, &job);
+      for (i = 0; i < neq; i++) y[i] = y1[i] - dy1[i];
+      err = maxerr(y0, y1, y, atol, rtol, neq);
 
-    for (i = 0; i < neq; i++) {
-      y1[i] = y0[i] +  dt * dy1[i];
+      dtnew = dt * fmin(maxscale, fmax(minscale,
+                safe * pow(fmax(err, 1e-10), -1.0 / (irk->qerr + 1))));
+      dtnew = fmin(dtnew, hmax);
+      if (err > 1.0) {
+        nreject++;    /* count total number of rejected steps */
+        accept = FALSE;
+        irk->restart = TRUE;
+        if (!irk->jcur) irk->newjac = TRUE;
+      } else if (lastrej) {
+        dtnew = fmin(dtnew, dt);
+      }
+    }
+    if (varstep && !accept && dtnew < hmin) {
+      if (verbose) Rprintf("warning, h < Hmin\n");
+      istate[0] = -2;
+      break;
     }
 
     /*====================================================================*/
     /*      Interpolation and Data Storage                                */
     /*====================================================================*/
-    if (interpolate) {
-      /*------------------------------------------------------------------*/
-      /* Neville-Aitken-Interpolation                                     */
-      /* the fixed step integrators have no dense output                  */
-      /*------------------------------------------------------------------*/
-      /* (1) collect number "nknots" of knots in advanve */
-      yknots[iknots] = t + dt;   /* time in first column */
-      for (i = 0; i < neq; i++) yknots[iknots + nknots * (1 + i)] = y1[i];
-      if (iknots < (nknots - 1)) {
-        iknots++;
-      } else {
-       /* (2) do polynomial interpolation */
-       t_ext = tt[it_ext];
-       while (t_ext <= t + dt) {
-        neville(yknots, &yknots[nknots], t_ext, tmp, nknots, neq);
-        /* (3) store outputs */
-        if (it_ext < nt) {
-          yout[it_ext] = t_ext;
-          for (i = 0; i < neq; i++)
-            yout[it_ext + nt * (1 + i)] = tmp[i];
+    if (accept) {
+      if (sw != NULL) rk_stiffimpl(sw, dt);
+      if (interpolate) {
+        /*------------------------------------------------------------------*/
+        /* polynomial interpolation (Lagrange form, ring buffer of knots)   */
+        /* the implicit integrators have no dense output                    */
+        /*------------------------------------------------------------------*/
+        /* (1) collect number "nknots" of knots in advance */
+        putknot(yknots, nknots, neq + 1, iknots++, t + dt, y1, NULL, neq);
+        if (iknots >= nknots) {
+         /* (2) do polynomial interpolation */
+         t_ext = tt[it_ext];
+         while (t_ext <= t + dt) {
+          lagrange(yknots, nknots, t_ext, tmp, neq);
+          /* (3) store outputs */
+          if (it_ext < nt) {
+            yout[it_ext] = t_ext;
+            for (i = 0; i < neq; i++)
+              yout[it_ext + nt * (1 + i)] = tmp[i];
+          }
+          if(it_ext < nt-1) t_ext = tt[++it_ext]; else break;
+         }
         }
-        if(it_ext < nt-1) t_ext = tt[++it_ext]; else break;
-       }
-       shiftBuffer(yknots, nknots, neq + 1);
+      } else {
+        /*------------------------------------------------------------------*/
+        /* No interpolation mode for step to step integration               */
+        /*         results are stored after the call                        */
+        /*------------------------------------------------------------------*/
       }
-    } else {
+      /* the Jacobian and, with unchanged step size, the factorization are
+         reused as long as the iteration converges fast */
+      irk->jcur   = FALSE;
+      irk->newjac = (irk->theta > thet || full);
+      full        = FALSE;
+      if (varstep && !irk->newjac && dtnew >= dt && dtnew <= 1.2 * dt)
+        dtnew = dt;
+      /* stiffly accurate methods: the last stage is f(t + dt, y1) */
+      irk->f0ok = (irk->stiffacc) ? 2 : 0;
+      if (irk->stiffacc)
+        for (i = 0; i < neq; i++) f[i] = FF[i + neq * (stage - 1)];
       /*--------------------------------------------------------------------*/
-      /* No interpolation mode for step to step integration                 */
-      /*         results are stored after the call                          */
+      /* next time step                                                     */
       /*--------------------------------------------------------------------*/
+      t = t + dt;
+      it++;
+      for (i = 0; i < neq; i++) y0[i] = y1[i];
     }
-    /*--------------------------------------------------------------------*/
-    /* next time step                                                     */
-    /*--------------------------------------------------------------------*/
-    t = t + dt;
-    it++;
-    for (i = 0; i < neq; i++) y0[i] = y1[i];
+    lastrej = !accept;
+    if (varstep) dt = fmin(dtnew, tmax - t);
     if (it_ext > nt) {
       Rprintf("error in RK solver rk_implicit.c: output buffer overflow\n");
       break;
@@ -209,10 +452,18 @@ void rk_implicit( double * alfa,  /* neq*stage * neq*stage */
       warning("Number of time steps %i exceeded maxsteps at t = %g\n", it, t);
       break;
     }
+    /* non-stiff phase: continue with the explicit method */
+    if (sw != NULL && sw->switched) break;
     /* tolerance to avoid rounding errors */
   } while (t < (tmax - 100.0 * DBL_EPSILON * dt)); /* end of rk main loop */
 
+  /* counters of the implicit solver (codes are compatible to lsoda) */
+  istate[12] += nfev;  istate[15] += njac;  istate[16] += nlu;
+  istate[17] += nnewt; istate[18] += nconv;
+
   /* return reference values */
   *_iknots = iknots; *_it = it; *_it_ext = it_ext; *_it_tot = it_tot;
+  *_it_rej = nreject;
+  if (varstep) *_dt = dtnew;
+  if (sw != NULL) sw->t = t;
 }
-
@@ -0,0 +1,188 @@
+/*==========================================================================*/
+/* Runge-Kutta Solvers, (C) Th. Petzoldt, License: GPL >= 2                 */
+/* Reductions over the accepted steps of the explicit methods               */
+/*                                                                          */
+/* Integrals, minima and maxima (with their times) and means in time        */
+/* windows of selected states and global outputs are updated after each     */
+/* accepted step, so that they do not depend on the output times and no     */
+/* time series has to be stored for them. Within a step, the variables are  */
+/* linear (trapezoidal rule) or, for the states with quadrature = "dense",  */
+/* the cubic Hermite interpolant of y and f at both ends of the step; both  */
+/* are integrated exactly with the 2-point Gauss-Legendre rule, also over   */
+/* the parts of a step in different windows. The extremes are those of the  */
+/* values at the ends of the steps.                                         */
+/*==========================================================================*/
+
+#include "rk_util.h"
+
+static int *reduceindex(SEXP Reduce, const char *name, int *n) {
+  SEXP I = getListElement(Reduce, name);
+  *n = LENGTH(I);
+  return (*n > 0) ? INTEGER(I) : NULL;
+}
+
+rk_reduce *rk_reduceinit(SEXP Reduce, int neq) {
+  rk_reduce *rd;
+  SEXP Win;
+  int i;
+
+  rd = (rk_reduce *) R_alloc(1, sizeof(rk_reduce));
+  rd->neq   = neq;
+  rd->dense = LOGICAL(getListElement(Reduce, "dense"))[0];
+  rd->iint  = reduceindex(Reduce, "integral", &rd->nint);
+  rd->imin  = reduceindex(Reduce, "min", &rd->nmin);
+  rd->imax  = reduceindex(Reduce, "max", &rd->nmax);
+  rd->imean = reduceindex(Reduce, "mean", &rd->nmean);
+
+  rd->needout = FALSE;
+  for (i = 0; i < rd->nint; i++)  if (rd->iint[i] >= neq)  rd->needout = TRUE;
+  for (i = 0; i < rd->nmin; i++)  if (rd->imin[i] >= neq)  rd->needout = TRUE;
+  for (i = 0; i < rd->nmax; i++)  if (rd->imax[i] >= neq)  rd->needout = TRUE;
+  for (i = 0; i < rd->nmean; i++) if (rd->imean[i] >= neq) rd->needout = TRUE;
+
+  Win = getListElement(Reduce, "window");
+  rd->nwin = LENGTH(Win) - 1;
+  rd->win  = REAL(Win);
+  rd->iwin = 0;
+
+  rd->integral = (double *) R_alloc(rd->nint, sizeof(double));
+  rd->vmin = (double *) R_alloc(2 * rd->nmin, sizeof(double));
+  rd->tmin = rd->vmin + rd->nmin;
+  rd->vmax = (double *) R_alloc(2 * rd->nmax, sizeof(double));
+  rd->tmax = rd->vmax + rd->nmax;
+  rd->sum  = (double *) R_alloc(rd->nwin * rd->nmean, sizeof(double));
+  rd->len  = (double *) R_alloc(rd->nwin, sizeof(double));
+
+  for (i = 0; i < rd->nint; i++) rd->integral[i] = 0.0;
+  for (i = 0; i < rd->nmin; i++) {
+    rd->vmin[i] = R_PosInf;
+    rd->tmin[i] = NA_REAL;
+  }
+  for (i = 0; i < rd->nmax; i++) {
+    rd->vmax[i] = R_NegInf;
+    rd->tmax[i] = NA_REAL;
+  }
+  for (i = 0; i < rd->nwin * rd->nmean; i++) rd->sum[i] = 0.0;
+  for (i = 0; i < rd->nwin; i++) rd->len[i] = 0.0;
+  return(rd);
+}
+
+/* variable k (state or global output) at t0 + s * dt within the step */
+static double reducevalue(rk_reduce *rd, int k, double s) {
+  double v0, v1;
+
+  if (k >= rd->neq) {
+    v0 = rd->out0[k - rd->neq];
+    v1 = rd->out1[k - rd->neq];
+    return v0 + s * (v1 - v0);
+  }
+  v0 = rd->y0[k];
+  v1 = rd->y1[k];
+  if (rd->f0 == NULL || rd->f1 == NULL)
+    return v0 + s * (v1 - v0);
+  return (1 - s) * v0 + s * v1 + s * (s - 1) * ((1 - 2 * s) * (v1 - v0) +
+    (s - 1) * rd->dt * rd->f0[k] + s * rd->dt * rd->f1[k]);
+}
+
+/* integral of variable k from a to b (within the step), 2-point Gauss */
+static double reduceint(rk_reduce *rd, int k, double a, double b) {
+  double h = 0.5 * (b - a), m = 0.5 * (a + b), d = h / sqrt(3.0);
+
+  return h * (reducevalue(rd, k, (m - d - rd->t0) / rd->dt) +
+              reducevalue(rd, k, (m + d - rd->t0) / rd->dt));
+}
+
+/* extremes of variable k at both ends of the step */
+static double reduceend(rk_reduce *rd, int k, int end) {
+  if (k >= rd->neq)
+    return (end) ? rd->out1[k - rd->neq] : rd->out0[k - rd->neq];
+  return (end) ? rd->y1[k] : rd->y0[k];
+}
+
+/* accepted step from t to t + dt; f0, f1 are NULL for linear interpolation,
+   out0, out1 NULL without global outputs */
+void rk_reducestep(rk_reduce *rd, double t, double dt, double *y0,
+                   double *y1, double *f0, double *f1, double *out0,
+                   double *out1) {
+  int i, j, w;
+  double v, a, b;
+
+  if (dt <= 0) return;
+  rd->t0 = t;   rd->dt = dt;
+  rd->y0 = y0;  rd->y1 = y1;
+  rd->f0 = (rd->dense) ? f0 : NULL;
+  rd->f1 = (rd->dense) ? f1 : NULL;
+  rd->out0 = out0;  rd->out1 = out1;
+
+  for (i = 0; i < rd->nint; i++)
+    rd->integral[i] += reduceint(rd, rd->iint[i], t, t + dt);
+
+  for (j = 0; j < 2; j++) {
+    for (i = 0; i < rd->nmin; i++) {
+      v = reduceend(rd, rd->imin[i], j);
+      if (v < rd->vmin[i]) {
+        rd->vmin[i] = v;
+        rd->tmin[i] = t + j * dt;
+      }
+    }
+    for (i = 0; i < rd->nmax; i++) {
+      v = reduceend(rd, rd->imax[i], j);
+      if (v > rd->vmax[i]) {
+        rd->vmax[i] = v;
+        rd->tmax[i] = t + j * dt;
+      }
+    }
+  }
+
+  /* the parts of the step in the windows of the means */
+  if (rd->nmean == 0) return;
+  while (rd->iwin < rd->nwin && rd->win[rd->iwin + 1] <= t) rd->iwin++;
+  for (w = rd->iwin; w < rd->nwin && rd->win[w] < t + dt; w++) {
+    a = fmax(t, rd->win[w]);
+    b = fmin(t + dt, rd->win[w + 1]);
+    if (b <= a) continue;
+    for (i = 0; i < rd->nmean; i++)
+      rd->sum[w + rd->nwin * i] += reduceint(rd, rd->imean[i], a, b);
+    rd->len[w] += b - a;
+  }
+}
+
+/* list(integral, minimum, time of minimum, maximum, time of maximum,
+   means: windows x variables); the names are added in R (reduceattr) */
+SEXP rk_reduceout(rk_reduce *rd) {
+  SEXP R_reduce, V;
+  int i, w;
+
+  PROTECT(R_reduce = allocVector(VECSXP, 6));
+
+  V = allocVector(REALSXP, rd->nint);
+  SET_VECTOR_ELT(R_reduce, 0, V);
+  for (i = 0; i < rd->nint; i++) REAL(V)[i] = rd->integral[i];
+
+  V = allocVector(REALSXP, rd->nmin);
+  SET_VECTOR_ELT(R_reduce, 1, V);
+  for (i = 0; i < rd->nmin; i++)
+    REAL(V)[i] = (ISNA(rd->tmin[i])) ? NA_REAL : rd->vmin[i];
+  V = allocVector(REALSXP, rd->nmin);
+  SET_VECTOR_ELT(R_reduce, 2, V);
+  for (i = 0; i < rd->nmin; i++) REAL(V)[i] = rd->tmin[i];
+
+  V = allocVector(REALSXP, rd->nmax);
+  SET_VECTOR_ELT(R_reduce, 3, V);
+  for (i = 0; i < rd->nmax; i++)
+    REAL(V)[i] = (ISNA(rd->tmax[i])) ? NA_REAL : rd->vmax[i];
+  V = allocVector(REALSXP, rd->nmax);
+  SET_VECTOR_ELT(R_reduce, 4, V);
+  for (i = 0; i < rd->nmax; i++) REAL(V)[i] = rd->tmax[i];
+
+  /* windows not covered by the integration are NA */
+  V = allocMatrix(REALSXP, rd->nwin, rd->nmean);
+  SET_VECTOR_ELT(R_reduce, 5, V);
+  for (i = 0; i < rd->nmean; i++)
+    for (w = 0; w < rd->nwin; w++)
+      REAL(V)[w + rd->nwin * i] = (rd->len[w] > 0) ?
+        rd->sum[w + rd->nwin * i] / rd->len[w] : NA_REAL;
+
+  UNPROTECT(1);
+  return(R_reduce);
+}
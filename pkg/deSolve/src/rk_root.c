@@ -0,0 +1,227 @@
+/*==========================================================================*/
+/* Runge-Kutta Solvers, (C) Th. Petzoldt, License: GPL >= 2                 */
+/* Root finding for the explicit methods with fixed or variable step size   */
+/*                                                                          */
+/* After each accepted step, the root functions are evaluated at its end;  */
+/* sign changes are located with brent() on the cubic Hermite interpolant   */
+/* of the step (y and f at both ends). The step is then taken again, up to  */
+/* the earliest root, so that the state at the root is a solution of the    */
+/* method. Roots stop the integration as in lsodar, unless they trigger an  */
+/* event (events$root) that is not terminal (events$terminalroot).          */
+/*==========================================================================*/
+
+#include "rk_util.h"
+#include "externalptr.h"
+
+/* tolerances of the root function and of brent, as in radau */
+static const double tol = 1e-9;
+static const int maxit = 100;
+
+/* interface to the root function in R */
+static void C_root_rk(int *neq, double *t, double *y, int *ng, double *gout)
+{
+  deSolve_context *ctx = desolve_ctx;
+  int i;
+  SEXP R_fcall, ans, Y;
+
+  R_fcall = ctx_lang(ctx, CALL_ROOT, ctx->R_root_func, "dd", 1, *neq);
+  REAL(call_arg(R_fcall, 1))[0] = *t;
+  Y = call_arg(R_fcall, 2);
+  for (i = 0; i < *neq; i++) REAL(Y)[i] = y[i];
+
+  PROTECT(ans = ctx_eval(ctx, R_fcall, ctx->R_envir));
+  for (i = 0; i < *ng; i++) gout[i] = REAL(ans)[i];
+  UNPROTECT(1);
+}
+
+rk_root *rk_rootinit(deSolve_context *ctx, SEXP Rootfunc, int nroot, int neq)
+{
+  rk_root *rt;
+  int i;
+
+  rt = (rk_root *) R_alloc(1, sizeof(rk_root));
+  rt->nroot = nroot;
+  if (inherits(Rootfunc, "NativeSymbol")) {
+    rt->func = (rk_root_func_type *) R_ExternalPtrAddrFn_(Rootfunc);
+  } else {
+    rt->func = (rk_root_func_type *) C_root_rk;
+    ctx->R_root_func = Rootfunc;
+  }
+  rt->gout  = (double *) R_alloc(4 * nroot, sizeof(double));
+  rt->gold  = rt->gout + nroot;
+  rt->gtmp  = rt->gout + 2 * nroot;
+  rt->tr    = rt->gout + 3 * nroot;
+  rt->jroot = (int *) R_alloc(nroot, sizeof(int));
+  rt->ytmp  = (double *) R_alloc(neq, sizeof(double));
+  rt->found = FALSE;
+  rt->endsim = FALSE;
+  rt->nr_root = 0;
+  rt->troot = 0;
+  rt->dtnext = 0;
+  for (i = 0; i < nroot; i++) rt->jroot[i] = 0;
+  return(rt);
+}
+
+/* root functions at the start (t, y0) of the integration or after an event;
+   a root function that was not changed by the event at its root is not
+   checked in the next step, the step to the root may have ended just
+   before its sign change */
+void rk_rootstart(rk_root *rt, double t, double *y0, int neq)
+{
+  int i;
+
+  rt->func(&neq, &t, y0, &rt->nroot, rt->gold);
+  for (i = 0; i < rt->nroot; i++)
+    if (rt->found && rt->jroot[i] && rt->gold[i] == rt->gout[i])
+      rt->gold[i] = 0;
+  rt->found = FALSE;
+}
+
+/* state at t from the cubic Hermite interpolant of the step */
+static void rk_hermite3(rk_root *rt, double t, int neq)
+{
+  int i;
+  double s = (t - rt->t0) / rt->dt, s1 = 1.0 - s;
+  double h00 = (1.0 + 2.0 * s) * s1 * s1, h10 = s * s1 * s1 * rt->dt,
+         h01 = s * s * (3.0 - 2.0 * s),   h11 = -s * s * s1 * rt->dt;
+
+  for (i = 0; i < neq; i++)
+    rt->ytmp[i] = h00 * rt->y0[i] + h10 * rt->f0[i]
+                + h01 * rt->y1[i] + h11 * rt->f1[i];
+}
+
+/* function for brent's root finding algorithm */
+static double rk_rootfunc(double t, double *rw, int *iw)
+{
+  rk_root *rt = desolve_ctx->root;
+  int neq = desolve_ctx->n_eq;
+
+  rk_hermite3(rt, t, neq);
+  rt->func(&neq, &t, rt->ytmp, &rt->nroot, rt->gtmp);
+  return(rt->gtmp[rt->iroot]);
+}
+
+/* after an accepted step from (t, y0) to (t + dt, y1), f0 and f1 are the
+   derivatives at both ends; returns TRUE if a root function has a root in
+   the step: troot is the earliest one, jroot marks the root functions */
+int rk_rootfind(rk_root *rt, double t, double dt, double *y0, double *f0,
+                double *y1, double *f1, int neq)
+{
+  extern double brent(double, double, double, double,
+                      double (double, double *, int *), double *, int *,
+                      double, int);
+  int i;
+  double tmin = t + dt, tend = t + dt;
+
+  rt->t0 = t; rt->dt = dt;
+  rt->y0 = y0; rt->f0 = f0; rt->y1 = y1; rt->f1 = f1;
+  rt->func(&neq, &tend, y1, &rt->nroot, rt->gout);
+
+  rt->found = FALSE;
+  for (i = 0; i < rt->nroot; i++) {
+    rt->jroot[i] = 0;
+    if (fabs(rt->gout[i]) < tol) {
+      rt->tr[i] = tend;
+    } else if (fabs(rt->gold[i]) >= tol && rt->gout[i] * rt->gold[i] < 0) {
+      rt->iroot = i;
+      rt->tr[i] = brent(t, tend, rt->gold[i], rt->gout[i], rk_rootfunc,
+                        NULL, NULL, tol, maxit);
+    } else continue;
+    rt->jroot[i] = 1;
+    rt->found = TRUE;
+    if (rt->tr[i] < tmin) tmin = rt->tr[i];
+  }
+  if (!rt->found) {
+    for (i = 0; i < rt->nroot; i++) rt->gold[i] = rt->gout[i];
+    return(FALSE);
+  }
+  /* only the earliest root(s) */
+  for (i = 0; i < rt->nroot; i++)
+    if (rt->jroot[i] && rt->tr[i] > tmin + tol) rt->jroot[i] = 0;
+  rt->troot = tmin;
+  return(TRUE);
+}
+
+/* the step ended at a root at (t, y0): the root is recorded and its event
+   applied (events$root); returns TRUE if the integration stops, i.e. for
+   roots without events and terminal roots, as in lsodar */
+int rk_rootevent(deSolve_context *ctx, rk_root *rt, double t, double *y0)
+{
+  int j, iterm = 0, istate;
+  double pt;
+
+  rt->troot = t;
+  rt->func(&ctx->n_eq, &t, y0, &rt->nroot, rt->gout);
+  if (!ctx->rootevent) {
+    rt->endsim = TRUE;
+    return(TRUE);
+  }
+  if (rt->nr_root < ctx->Rootsave) {
+    ctx->troot[rt->nr_root] = t;
+    for (j = 0; j < rt->nroot; j++)
+      if (rt->jroot[j] == 1) ctx->nrroot[rt->nr_root] = j + 1;
+    for (j = 0; j < ctx->n_eq; j++)
+      ctx->valroot[rt->nr_root * ctx->n_eq + j] = y0[j];
+  }
+  rt->nr_root++;
+
+  /* check if simulation should be terminated */
+  for (j = 0; j < rt->nroot; j++)
+    if (rt->jroot[j] == 1 && ctx->termroot[j] == 1) iterm = 1;
+  if (iterm) {
+    rt->endsim = TRUE;
+    return(TRUE);
+  }
+  pt = ctx->tEvent;
+  ctx->tEvent = t;
+  updateevent(ctx, &t, y0, &istate);
+  ctx->tEvent = pt;
+  return(FALSE);
+}
+
+/* outputs up to the row nrow of the terminating root, and the attributes
+   of the roots, compatible to lsodar: iroot and troot for a root that
+   stops the integration, nroot, troot, valroot and indroot with events */
+SEXP rk_rootout(deSolve_context *ctx, rk_root *rt, SEXP R_yout,
+                int nt, int nrow, int ncol)
+{
+  int i, j, nr, nprot = 0;
+  SEXP R_yout2, TROOT, NROOT, VROOT, IROOT;
+
+  if (rt->endsim && nrow < nt) {
+    PROTECT(R_yout2 = allocMatrix(REALSXP, nrow, ncol)); nprot++;
+    for (j = 0; j < ncol; j++)
+      for (i = 0; i < nrow; i++)
+        REAL(R_yout2)[i + nrow * j] = REAL(R_yout)[i + nt * j];
+    R_yout = R_yout2;
+  }
+  if (rt->endsim && !ctx->rootevent) {
+    PROTECT(IROOT = allocVector(INTSXP, rt->nroot)); nprot++;
+    for (j = 0; j < rt->nroot; j++) INTEGER(IROOT)[j] = rt->jroot[j];
+    PROTECT(TROOT = allocVector(REALSXP, 1)); nprot++;
+    REAL(TROOT)[0] = rt->troot;
+    setAttrib(R_yout, install("iroot"), IROOT);
+    setAttrib(R_yout, install("troot"), TROOT);
+  }
+  if (rt->nr_root > 0) {
+    PROTECT(NROOT = allocVector(INTSXP, 1)); nprot++;
+    INTEGER(NROOT)[0] = rt->nr_root;
+    nr = (rt->nr_root > ctx->Rootsave) ? ctx->Rootsave : rt->nr_root;
+
+    PROTECT(TROOT = allocVector(REALSXP, nr)); nprot++;
+    for (j = 0; j < nr; j++) REAL(TROOT)[j] = ctx->troot[j];
+
+    PROTECT(VROOT = allocVector(REALSXP, nr * ctx->n_eq)); nprot++;
+    for (j = 0; j < nr * ctx->n_eq; j++) REAL(VROOT)[j] = ctx->valroot[j];
+
+    PROTECT(IROOT = allocVector(INTSXP, nr)); nprot++;
+    for (j = 0; j < nr; j++) INTEGER(IROOT)[j] = ctx->nrroot[j];
+
+    setAttrib(R_yout, install("troot"), TROOT);
+    setAttrib(R_yout, install("nroot"), NROOT);
+    setAttrib(R_yout, install("valroot"), VROOT);
+    setAttrib(R_yout, install("indroot"), IROOT);
+  }
+  UNPROTECT(nprot);
+  return(R_yout);
+}
@@ -0,0 +1,322 @@
+/*==========================================================================*/
+/* Runge-Kutta Solvers, (C) Th. Petzoldt, License: GPL >= 2                 */
+/* Rosenbrock (linearly implicit) methods with adaptive step size           */
+/*                                                                          */
+/* Coefficients in the transformed form of Kaps, Poon and Rentrop, the      */
+/* stages U_i solve (Hairer and Wanner, 1996, IV.7)                         */
+/*   (I / (gamma dt) - J) U_i = f(t + c_i dt, y0 + sum(a_ij U_j))           */
+/*                     + sum(g_ij U_j) / dt + dt * gamma_i * df/dt,         */
+/* y1 = y0 + sum(b1_i U_i) and y2 = y0 + sum(b2_i U_i). The Jacobian J is   */
+/* kept for rejected steps, only the matrix is factorized again.            */
+/*==========================================================================*/
+
+#include "rk_util.h"
+
+void F77_NAME(dgefa)(double*, int*, int*, int*, int*);
+void F77_NAME(dgesl)(double*, int*, int*, int*, double*, int*);
+void F77_NAME(dgbfa)(double*, int*, int*, int*, int*, int*, int*);
+void F77_NAME(dgbsl)(double*, int*, int*, int*, int*, int*, double*, int*);
+
+/* jt: 1 full user, 2 full internal, 4 banded user, 5 banded internal
+   Jacobian (as in lsoda); jac is the user-supplied function or NULL */
+ros_data *ros_init(int neq, int stage, double *A, double *cc, double gamma,
+                   double *G, double *gi, int jt, int ml, int mu,
+                   ros_jac_func_type *jac) {
+  int j, k;
+  ros_data *ros = (ros_data *) R_alloc(1, sizeof(ros_data));
+
+  ros->jac    = jac;
+  ros->banded = (jt == 4 || jt == 5);
+  ros->ml     = (ros->banded) ? ml : 0;
+  ros->mu     = (ros->banded) ? mu : 0;
+  if (ros->banded) {
+    ros->ldj  = ml + mu + 1;
+    ros->lde  = 2 * ml + mu + 1;
+  } else {
+    ros->ldj  = neq;
+    ros->lde  = neq;
+  }
+  ros->J      = (double *) R_alloc(ros->ldj * neq, sizeof(double));
+  ros->E      = (double *) R_alloc(ros->lde * neq, sizeof(double));
+  ros->index  = (int *) R_alloc(neq, sizeof(int));
+  ros->ft     = (double *) R_alloc(neq, sizeof(double));
+  ros->gamma  = gamma;
+  ros->G      = G;
+  ros->gi     = gi;
+
+  /* stages with the input and time of the previous one reuse its
+     function value (e.g. stage 2 of rodas3) */
+  ros->newf   = (int *) R_alloc(stage, sizeof(int));
+  ros->newf[0] = TRUE;
+  for (j = 1; j < stage; j++) {
+    ros->newf[j] = (cc[j] != cc[j - 1] || A[j + stage * (j - 1)] != 0);
+    for (k = 0; k < j - 1; k++)
+      if (A[j + stage * k] != A[j - 1 + stage * k]) ros->newf[j] = TRUE;
+  }
+  ros->f0ok   = FALSE;
+  ros->newjac = TRUE;
+  return(ros);
+}
+
+/* Jacobian at (t, y0), from the user or by finite differences; the banded
+   one is stored as in LINPACK, J[mu + i - j, j]; f0 = f(t, y0);
+   returns the number of function evaluations */
+static int ros_jac(deSolve_context *ctx, ros_data *ros, int neq, double t,
+   double *y0, double *f0, double *ytmp, double *f1,
+   SEXP Func, SEXP Parms, SEXP Rho,
+   double *out, int *ipar, int isDll, int isForcing) {
+
+  int i, j, g, w, ml = ros->ml, mu = ros->mu, ldj = ros->ldj;
+  double *J = ros->J;
+
+  if (ros->jac != NULL) {
+    for (i = 0; i < ldj * neq; i++) J[i] = 0.;
+    for (i = 0; i < neq; i++) ytmp[i] = y0[i];
+    ros->jac(&neq, &t, ytmp, &ml, &mu, J, &ldj, out, ipar);
+    return(0);
+  }
+  if (!ros->banded)
+    return(irk_jac(ctx, J, neq, t, y0, f0, ytmp, f1, Func, Parms, Rho,
+                   out, ipar, isDll, isForcing));
+
+  /* banded: columns j, j + w, j + 2w, ... are perturbed together */
+  w = ml + mu + 1;
+  for (i = 0; i < neq; i++) ytmp[i] = y0[i];
+  for (g = 0; g < w && g < neq; g++) {
+    for (j = g; j < neq; j += w)
+      ytmp[j] = y0[j] + sqrt(DBL_EPSILON * fmax(1e-5, fabs(y0[j])));
+    derivs(ctx, Func, t, ytmp, Parms, Rho, f1, out, 0, neq,
+           ipar, isDll, isForcing);
+    for (j = g; j < neq; j += w) {
+      for (i = (j > mu) ? j - mu : 0; i < neq && i <= j + ml; i++)
+        J[mu + i - j + ldj * j] = (f1[i] - f0[i]) / (ytmp[j] - y0[j]);
+      ytmp[j] = y0[j];                   /* restore */
+    }
+  }
+  return((w < neq) ? w : neq);
+}
+
+/* LU decomposition of I / (gamma dt) - J; returns nonzero if singular */
+static int ros_lu(ros_data *ros, double dt, int neq) {
+  int i, j, info, ml = ros->ml, mu = ros->mu;
+  double *E = ros->E, *J = ros->J, d = 1.0 / (ros->gamma * dt);
+
+  if (ros->banded) {
+    /* dgbfa needs ml additional rows for the fill-in */
+    for (i = 0; i < ros->lde * neq; i++) E[i] = 0.;
+    for (j = 0; j < neq; j++) {
+      for (i = (j > mu) ? j - mu : 0; i < neq && i <= j + ml; i++)
+        E[ml + mu + i - j + ros->lde * j] = -J[mu + i - j + ros->ldj * j];
+      E[ml + mu + ros->lde * j] += d;
+    }
+    F77_CALL(dgbfa)(E, &ros->lde, &neq, &ros->ml, &ros->mu, ros->index, &info);
+  } else {
+    for (i = 0; i < neq * neq; i++) E[i] = -J[i];
+    for (i = 0; i < neq; i++) E[i + neq * i] += d;
+    F77_CALL(dgefa)(E, &neq, &neq, ros->index, &info);
+  }
+  return(info);
+}
+
+static void ros_solve(ros_data *ros, double *b, int neq) {
+  int job = 0;
+  if (ros->banded)
+    F77_CALL(dgbsl)(ros->E, &ros->lde, &neq, &ros->ml, &ros->mu, ros->index,
+                    b, &job);
+  else
+    F77_CALL(dgesl)(ros->E, &neq, &neq, ros->index, b, &job);
+}
+
+void rk_rosenbrock(deSolve_context *ctx,
+       /* integers */
+       int neq, int stage,
+       int isDll, int isForcing, int verbose,
+       int nknots, int interpolate, int maxsteps, int nt,
+       /* int pointers */
+       int* _iknots, int* _it, int* _it_ext, int* _it_tot, int* _it_rej,
+       int* istate,  int* ipar,
+       /* double */
+       double t, double tmax, double hmin, double hmax, double alpha,
+       /* double pointers */
+       double* _dt,
+       /* arrays */
+       double* tt, double* y0, double* y1, double* y2, double* dy1,
+       double* dy2, double* f, double* tmp, double* FF,
+       double* A, double* out, double* bb1, double* bb2, double* cc,
+       double* atol, double* rtol, double* yknots, double* yout,
+       /* SEXPs */
+       SEXP Func, SEXP Parms, SEXP Rho
+  )
+{
+  int i = 0, j = 0, k = 0, accept = TRUE, nreject = *_it_rej, nsing = 0;
+  int iknots = *_iknots, it = *_it, it_ext = *_it_ext, it_tot = *_it_tot;
+  int nfev = 0, njac = 0, nlu = 0;
+  double err, dtnew, t_ext, g, d0, d1, sc, del, dtlu = 0;
+  double dt = *_dt, *U;
+
+  ros_data *ros = (ros_data *) ctx->solver;
+
+  static const double minscale = 0.2, maxscale = 6.0, safe = 0.9;
+
+  /*------------------------------------------------------------------------*/
+  /* Main Loop                                                              */
+  /*------------------------------------------------------------------------*/
+  do {
+    /* derivative at the start of the step, taken over from the end of the
+       last accepted step if y0 was not changed (e.g. by an event) */
+    if (!ros->f0ok) {
+      derivs(ctx, Func, t, y0, Parms, Rho, f, out, 0, neq,
+             ipar, isDll, isForcing);
+      nfev++;
+      ros->f0ok = TRUE;
+    }
+
+    /* initial step size from the norms of y0 and f(t, y0) */
+    if (dt <= 0) {
+      d0 = 0; d1 = 0;
+      for (i = 0; i < neq; i++) {
+        sc = atol[i] + rtol[i] * fabs(y0[i]);
+        d0 += (y0[i]/sc) * (y0[i]/sc);
+        d1 += (f[i]/sc) * (f[i]/sc);
+      }
+      dt = (d0 < 1e-10 || d1 < 1e-10) ? 1e-6 : 0.01 * sqrt(d0/d1);
+      dt = fmin(fmin(dt, hmax), tmax - t);
+    }
+    ctx->timesteps[0] = ctx->timesteps[1];
+    ctx->timesteps[1] = dt;
+
+    /* Jacobian and time derivative at (t, y0), both are kept if the
+       step is rejected */
+    if (ros->newjac) {
+      nfev += ros_jac(ctx, ros, neq, t, y0, f, tmp, dy1, Func, Parms, Rho,
+                      out, ipar, isDll, isForcing);
+      del = sqrt(DBL_EPSILON) * fmax(1e-5, fabs(t));
+      derivs(ctx, Func, t + del, y0, Parms, Rho, dy1, out, 0, neq,
+             ipar, isDll, isForcing);
+      nfev++;
+      for (i = 0; i < neq; i++) ros->ft[i] = (dy1[i] - f[i]) / del;
+      njac++;
+      ros->newjac = FALSE;
+      dtlu = 0;
+    }
+    if (dt != dtlu) {
+      nlu++;
+      if (ros_lu(ros, dt, neq) != 0) {
+        /* singular matrix: try a smaller step */
+        if (++nsing > 5)
+          error("repeated singular matrix (dgefa/dgbfa) at t = %g", t);
+        dt = dt * 0.5;
+        nreject++;
+        accept = FALSE;
+        continue;
+      }
+      dtlu = dt;
+    }
+    nsing = 0;
+
+    /*====================================================================*/
+    /* stages: one solution with the factorized matrix each               */
+    /*====================================================================*/
+    for (j = 0; j < stage; j++) {
+      U = FF + neq * j;
+      if (j == 0) {
+        for (i = 0; i < neq; i++) dy1[i] = f[i];
+      } else if (ros->newf[j]) {
+        rk_stage(tmp, y0, FF, A, 1.0, j, j, stage, neq);
+        derivs(ctx, Func, t + dt * cc[j], tmp, Parms, Rho, dy1, out, 0, neq,
+               ipar, isDll, isForcing);
+        nfev++;
+      }
+      for (i = 0; i < neq; i++) U[i] = dy1[i] + dt * ros->gi[j] * ros->ft[i];
+      for (k = 0; k < j; k++) {
+        g = ros->G[j + stage * k] / dt;
+        if (g != 0)
+          for (i = 0; i < neq; i++) U[i] += g * FF[i + neq * k];
+      }
+      ros_solve(ros, U, neq);
+    }
+
+    /* both solutions and the error norm (rk_util.c); the stages are
+       already scaled with the step size */
+    err = rk_update(y1, y2, y0, FF, bb1, bb2, atol, rtol, 1.0, stage, neq);
+    it_tot++; /* count total number of time steps */
+
+    /*====================================================================*/
+    /*      stepsize adjustment                                           */
+    /*====================================================================*/
+    if (err == 0) {
+      dtnew = fmin(dt * maxscale, hmax);
+      accept = TRUE;
+    } else if (err <= 1.0) {
+      /* increase step size only if last one was accepted */
+      dtnew = (accept) ?
+        fmin(hmax, dt * fmin(safe * pow(err, -alpha), maxscale)) : dt;
+      accept = TRUE;
+    } else {
+      nreject++;    /* count total number of rejected steps */
+      accept = FALSE;
+      dtnew = dt * fmax(safe * pow(err, -alpha), minscale);
+    }
+
+    if (dtnew < hmin) {
+      accept = TRUE;
+      if (verbose) Rprintf("warning, h < Hmin\n");
+      istate[0] = -2;
+      dtnew = hmin;
+    }
+    /*====================================================================*/
+    /*      Interpolation and Data Storage                                */
+    /*====================================================================*/
+    if (accept) {
+      /* derivative at the new point: Hermite knot and f(t, y0) of the
+         next step */
+      derivs(ctx, Func, t + dt, y2, Parms, Rho, dy2, out, 0, neq,
+             ipar, isDll, isForcing);
+      nfev++;
+      if (interpolate) {
+        if (iknots == 1)
+          putknot(yknots, nknots, 2 * neq + 1, 0, t, y0, f, neq);
+        putknot(yknots, nknots, 2 * neq + 1, iknots++, t + dt, y2, dy2, neq);
+        t_ext = tt[it_ext];
+        while (t_ext <= t + dt) {
+          hermite(yknots, nknots, iknots, t_ext, tmp, neq);
+          /* store outputs */
+          if (it_ext < nt) {
+            yout[it_ext] = t_ext;
+            for (i = 0; i < neq; i++)
+              yout[it_ext + nt * (1 + i)] = tmp[i];
+          }
+          if(it_ext < nt-1) t_ext = tt[++it_ext]; else break;
+        }
+      }
+      /*--------------------------------------------------------------------*/
+      /* next time step                                                     */
+      /*--------------------------------------------------------------------*/
+      t = t + dt;
+      it++;
+      for (i = 0; i < neq; i++) {
+        y0[i] = y2[i];
+        f[i]  = dy2[i];
+      }
+      ros->newjac = TRUE;
+    } /* else rejected time step, same Jacobian */
+    dt = fmin(dtnew, tmax - t);
+    if (it_ext > nt) {
+      if (!ctx->worker)
+        Rprintf("error in RK solver rk_rosenbrock.c: output buffer overflow\n");
+      break;
+    }
+    if (it_tot > maxsteps) {
+      istate[0] = -1;
+      if (!ctx->worker)
+        warning("Number of time steps %i exceeded maxsteps at t = %g\n", it, t);
+      break;
+    }
+    /* tolerance to avoid rounding errors */
+  } while (t < (tmax - 100.0 * DBL_EPSILON * dt)); /* end of rk main loop */
+
+  /* return reference values */
+  *_iknots = iknots; *_it = it; *_it_ext = it_ext; *_it_rej = nreject;
+  *_it_tot = it_tot; *_dt = dtnew;
+  istate[12] += nfev;  istate[15] += njac;  istate[16] += nlu;
+}
@@ -0,0 +1,236 @@
+/*==========================================================================*/
+/* Runge-Kutta Solvers, (C) Th. Petzoldt, License: GPL >= 2                 */
+/* Stiffness detection and switching between an explicit method with        */
+/* adaptive step size and an implicit method                                */
+/*                                                                          */
+/* Explicit phase: the dominant eigenvalue is estimated from the last two   */
+/* stages, rho = |f(Y_s) - f(Y_s-1)| / |Y_s - Y_s-1| (Hairer and Wanner,    */
+/* 1996, IV.2, as in dopri5); the problem is taken as stiff if dt * rho     */
+/* is at the stability boundary of the method in 15 steps without 6        */
+/* non-stiff steps in between. Implicit phase: the spectral radius of the   */
+/* Jacobian is estimated by power iteration whenever it is evaluated; the   */
+/* explicit method takes over again when dt * rho is inside its stability   */
+/* region during 15 successive steps.                                       */
+/*==========================================================================*/
+
+#include "rk_util.h"
+
+/* successive steps needed for a switch, as in dopri5 */
+static const int nstiffmax = 15, nonstiffmax = 6;
+
+/* stability boundary of an explicit method on the negative real axis, from
+   R(z) = 1 + sum(g_k z^k) with g_k = b' A^(k-1) 1 (A strictly lower) */
+static double rk_stabbound(double *A, double *bb, int stage) {
+  int i, j, k;
+  double *g, *v, *w, r, z = 0;
+
+  g = (double *) R_alloc(stage, sizeof(double));
+  v = (double *) R_alloc(stage, sizeof(double));
+  w = (double *) R_alloc(stage, sizeof(double));
+  for (j = 0; j < stage; j++) v[j] = 1.0;
+  for (k = 0; k < stage; k++) {
+    g[k] = 0;
+    for (j = 0; j < stage; j++) g[k] += bb[j] * v[j];
+    for (j = 0; j < stage; j++) {
+      w[j] = 0;
+      for (i = 0; i < j; i++) w[j] += A[j + stage * i] * v[i];
+    }
+    for (j = 0; j < stage; j++) v[j] = w[j];
+  }
+  /* first z < 0 (steps of 0.01) with |R(z)| > 1 */
+  do {
+    z -= 0.01;
+    r = 0;
+    for (k = stage - 1; k >= 0; k--) r = (r + g[k]) * z;
+    r += 1.0;
+  } while (fabs(r) <= 1.0 && z > -100.0);
+  return(-z - 0.01);
+}
+
+/* Stiff is the implicit method (rkMethod object); the explicit method
+   has the Butcher table A, the weights bb of the solution and at least
+   3 stages; nknots as for the polynomial interpolation */
+rk_switch *rk_stiffinit(SEXP Stiff, int neq, int stage, double *A,
+                        double *bb, int nknots) {
+  rk_switch *sw;
+  int n;
+
+  if (stage < 3)
+    error("stiffness detection needs a method with at least 3 stages");
+
+  sw = (rk_switch *) R_alloc(1, sizeof(rk_switch));
+  /* slightly inside the boundary, e.g. 3.25 for rk45dp7 as in dopri5 */
+  sw->bound    = 0.98 * rk_stabbound(A, bb, stage);
+  sw->rho      = 0;
+  sw->ys       = (double *) R_alloc(2 * neq, sizeof(double));
+  sw->x        = (double *) R_alloc(2 * neq, sizeof(double));
+  sw->t        = 0;
+  sw->stiff    = FALSE;
+  sw->switched = FALSE;
+  sw->nstiff   = 0;
+  sw->nonstiff = 0;
+  sw->nswitch  = 0;
+  sw->nsteps[0] = 0;
+  sw->nsteps[1] = 0;
+
+  sw->stage = (int)REAL(getListElement(Stiff, "stage"))[0];
+  sw->A     = REAL(getListElement(Stiff, "A"));
+  sw->bb1   = REAL(getListElement(Stiff, "b1"));
+  sw->cc    = REAL(getListElement(Stiff, "c"));
+  sw->irk   = irk_init(neq, sw->stage, TRUE, sw->A, sw->bb1, sw->cc);
+
+  n = neq * sw->stage;
+  sw->FF     = (double *) R_alloc(n, sizeof(double));
+  sw->tmp    = (double *) R_alloc(n, sizeof(double));
+  sw->tmp2   = (double *) R_alloc(n, sizeof(double));
+  sw->tmp3   = (double *) R_alloc(n, sizeof(double));
+  sw->nknots = nknots;
+  sw->iknots = 0;
+  sw->yknots = (double *) R_alloc((neq + 1) * (nknots + 1), sizeof(double));
+  return(sw);
+}
+
+static int rk_switchto(rk_switch *sw, int stiff) {
+  sw->stiff    = stiff;
+  sw->switched = TRUE;
+  sw->nstiff   = 0;
+  sw->nonstiff = 0;
+  sw->nswitch++;
+  return(TRUE);
+}
+
+/* after an accepted step of the explicit method; FF are the stages,
+   sw->ys the inputs of the last two; returns TRUE for a switch */
+int rk_stiffexpl(rk_switch *sw, double dt, double *FF, int stage, int neq) {
+  int i;
+  double d, num = 0, den = 0, *fs = FF + neq * (stage - 2);
+
+  for (i = 0; i < neq; i++) {
+    d = fs[i + neq] - fs[i];
+    num += d * d;
+    d = sw->ys[i + neq] - sw->ys[i];
+    den += d * d;
+  }
+  if (den > 0 && dt * sqrt(num / den) > sw->bound) {
+    sw->nonstiff = 0;
+    if (++sw->nstiff >= nstiffmax) return(rk_switchto(sw, TRUE));
+  } else if (++sw->nonstiff >= nonstiffmax) {
+    sw->nstiff = 0;
+  }
+  return(FALSE);
+}
+
+/* after an accepted step of the implicit method; returns TRUE for a switch */
+int rk_stiffimpl(rk_switch *sw, double dt) {
+  if (dt * sw->rho < sw->bound) {
+    if (++sw->nonstiff >= nstiffmax) return(rk_switchto(sw, FALSE));
+  } else {
+    sw->nonstiff = 0;
+  }
+  return(FALSE);
+}
+
+/* spectral radius of J (neq x neq) by power iteration from a fixed start
+   vector: geometric mean of the growth in the last 10 of 20 iterations;
+   x is workspace of length 2 * neq */
+double rk_specrad(double *J, int neq, double *x) {
+  int i, j, k;
+  double s, lg = 0, *y = x + neq;
+
+  s = 0;
+  for (i = 0; i < neq; i++) {
+    x[i] = 1.0 + 0.1 * (i % 7);
+    s += x[i] * x[i];
+  }
+  s = sqrt(s);
+  for (i = 0; i < neq; i++) x[i] /= s;
+  for (k = 0; k < 20; k++) {
+    s = 0;
+    for (i = 0; i < neq; i++) {
+      y[i] = 0;
+      for (j = 0; j < neq; j++) y[i] += J[i + neq * j] * x[j];
+      s += y[i] * y[i];
+    }
+    s = sqrt(s);
+    if (s == 0) return(0);
+    if (k >= 10) lg += log(s);
+    for (i = 0; i < neq; i++) x[i] = y[i] / s;
+  }
+  return(exp(lg / 10));
+}
+
+/* rk_auto with switching to the implicit method in stiff phases and back;
+   the arguments are those of rk_auto, the implicit method takes its
+   workspace from ctx->stiff and shares y0 and the step size */
+void rk_autoswitch(deSolve_context *ctx,
+       /* integers */
+       int fsal, int neq, int stage,
+       int isDll, int isForcing, int verbose,
+       int nknots, int interpolate, int densetype, int maxsteps, int nt,
+       /* int pointers */
+       int* _iknots, int* _it, int* _it_ext, int* _it_tot, int* _it_rej,
+       int* istate,  int* ipar,
+       /* double */
+       double t, double tmax, double hmin, double hmax,
+       double alpha, double beta,
+       /* double pointers */
+       double* _dt, double* _errold,
+       /* arrays */
+       double* tt, double* y0, double* y1, double* y2, double* dy1, double* dy2,
+       double* f, double* y, double* Fj, double* tmp,
+       double* FF, double* rr, double* A, double* out,
+       double* bb1, double* bb2, double* cc, double* dd,
+       double* atol, double* rtol, double* yknots, double* yout,
+       /* SEXPs */
+       SEXP Func, SEXP Parms, SEXP Rho
+  )
+{
+  rk_switch *sw = ctx->stiff;
+  void *kern = ctx->solver;
+  int stiff, it_tot;
+
+  do {
+    stiff  = sw->stiff;
+    it_tot = *_it_tot;
+    if (stiff) {
+      ctx->solver = sw->irk;
+      rk_implicit(ctx, FALSE, neq, sw->stage, isDll, isForcing, verbose,
+        sw->nknots, interpolate, TRUE, maxsteps, nt,
+        &sw->iknots, _it, _it_ext, _it_tot, _it_rej, istate, ipar,
+        t, tmax, 0.0, hmin, hmax, _dt,
+        tt, y0, y1, dy1, f, y, Fj, sw->tmp, sw->tmp2, sw->tmp3, sw->FF,
+        rr, sw->A, out, sw->bb1, sw->cc, atol, rtol, sw->yknots, yout,
+        Func, Parms, Rho);
+      ctx->solver = kern;
+    } else {
+      rk_auto(ctx, fsal, neq, stage, isDll, isForcing, verbose,
+        nknots, interpolate, densetype, maxsteps, nt,
+        _iknots, _it, _it_ext, _it_tot, _it_rej, istate, ipar,
+        t, tmax, hmin, hmax, alpha, beta, _dt, _errold,
+        tt, y0, y1, y2, dy1, dy2, f, y, Fj, tmp, FF, rr, A, out,
+        bb1, bb2, cc, dd, atol, rtol, yknots, yout,
+        Func, Parms, Rho);
+    }
+    sw->nsteps[stiff] += *_it_tot - it_tot;
+    t = sw->t;
+    if (!sw->switched) break;
+
+    /* hand over at (t, y0): the implicit method starts with a new Jacobian,
+       the interpolation of both methods with a new first knot */
+    if (sw->stiff) {
+      sw->irk->newjac  = TRUE;
+      sw->irk->f0ok    = 0;
+      sw->irk->restart = TRUE;
+      if (interpolate) {
+        sw->iknots = 0;
+        putknot(sw->yknots, sw->nknots, neq + 1, sw->iknots++, t, y0,
+                NULL, neq);
+      }
+    } else if (interpolate && densetype == 3) {
+      *_iknots = 1;   /* knot with the first stage of the next step */
+    } else if (interpolate && densetype == 0) {
+      *_iknots = 0;
+      putknot(yknots, nknots, neq + 1, (*_iknots)++, t, y0, NULL, neq);
+    }
+  } while (t < (tmax - 100.0 * DBL_EPSILON * *_dt));
+}
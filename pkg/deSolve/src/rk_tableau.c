@@ -0,0 +1,1051 @@
+/*==========================================================================*/
+/* Runge-Kutta Solvers, (C) Th. Petzoldt, License: GPL >= 2                 */
+/* Specialized kernels for the built-in explicit methods with adaptive      */
+/* step size                                                                */
+/*                                                                          */
+/* For each method of rkMethod() a stage kernel and an update kernel with   */
+/* the coefficients as compile-time constants (the same expressions as in   */
+/* rkMethod.R): zero coefficients are left out, y2 of methods with the      */
+/* first-same-as-last property is taken from the input of the last stage,   */
+/* and the error is formed from the differences b1 - b2. The code below     */
+/* the macros was generated from the Butcher tables; if a table in          */
+/* rkMethod.R is changed, it must be regenerated.                           */
+/*                                                                          */
+/* rk_findkernel selects the kernels by the ID of the method, but only if   */
+/* the coefficients passed from R are those of the built-in table, so that  */
+/* modified or user-defined tables use the generic code of rk_util.c.       */
+/*==========================================================================*/
+
+#include <float.h>
+#include "rk_util.h"
+
+/* y1, y2 and the contribution to the error norm (as in rk_update) from
+   the new value s2 and the difference d = y1 - y2 */
+#define RK_ERRTERM(s2, d)                                         \
+    y1[i] = s2 + d;                                               \
+    y2[i] = s2;                                                   \
+    double ay0  = fabs(y0[i]), ay2 = fabs(s2);                    \
+    double scal = atol[i] + ((ay0 > ay2) ? ay0 : ay2) * rtol[i];  \
+    double ok   = (scal > 0);                                     \
+    double delta = fabs(d) / (ok ? scal : 1.0);                   \
+    serr += ok * delta * delta;
+
+/*--------------------------------------------------------------------------*/
+/* rk23                                                                     */
+/*--------------------------------------------------------------------------*/
+
+static const double A_rk23[] = {
+  1.0/2.0, -1.0, 2.0
+};
+static const double b1_rk23[] = {
+  0.0, 1.0, 0.0
+};
+static const double b2_rk23[] = {
+  1.0/6.0, 2.0/3.0, 1.0/6.0
+};
+static const double c_rk23[] = {
+  0.0, 1.0/2.0, 2.0
+};
+
+static void stage_rk23(int j, double *tmp, double *y0, double *FF,
+                       double dt, int neq) {
+  int i;
+  double *F0 = FF, *F1 = FF + neq * 1;
+
+  switch (j) {
+  case 0:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i];
+    break;
+  case 1:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk23[0] * F0[i]);
+    break;
+  case 2:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk23[1] * F0[i] + A_rk23[2] * F1[i]);
+    break;
+  }
+}
+
+static double update_rk23(double *y1, double *y2, double *y0, double *tmp,
+                          double *FF, double *atol, double *rtol,
+                          double dt, int neq) {
+  int i;
+  double serr = 0;
+  double *F0 = FF, *F1 = FF + neq * 1, *F2 = FF + neq * 2;
+
+  RK_SIMD_ERR
+  for (i = 0; i < neq; i++) {
+    double s2 = y0[i] + dt * (b2_rk23[0] * F0[i] + b2_rk23[1] * F1[i]
+                             + b2_rk23[2] * F2[i]);
+    double d  = dt * ((b1_rk23[0] - b2_rk23[0]) * F0[i]
+                     + (b1_rk23[1] - b2_rk23[1]) * F1[i]
+                     + (b1_rk23[2] - b2_rk23[2]) * F2[i]);
+    RK_ERRTERM(s2, d)
+  }
+  return(sqrt(serr/neq));
+}
+
+/*--------------------------------------------------------------------------*/
+/* rk23bs                                                                   */
+/*--------------------------------------------------------------------------*/
+
+static const double A_rk23bs[] = {
+  1.0/2.0, 0.0, 3.0/4.0, 2.0/9.0, 1.0/3.0, 4.0/9.0
+};
+static const double b1_rk23bs[] = {
+  7.0/24.0, 1.0/4.0, 1.0/3.0, 1.0/8.0
+};
+static const double b2_rk23bs[] = {
+  2.0/9.0, 1.0/3.0, 4.0/9.0, 0.0
+};
+static const double c_rk23bs[] = {
+  0.0, 1.0/2.0, 3.0/4.0, 1.0
+};
+
+static void stage_rk23bs(int j, double *tmp, double *y0, double *FF,
+                         double dt, int neq) {
+  int i;
+  double *F0 = FF, *F1 = FF + neq * 1, *F2 = FF + neq * 2;
+
+  switch (j) {
+  case 0:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i];
+    break;
+  case 1:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk23bs[0] * F0[i]);
+    break;
+  case 2:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk23bs[2] * F1[i]);
+    break;
+  case 3:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk23bs[3] * F0[i] + A_rk23bs[4] * F1[i]
+                            + A_rk23bs[5] * F2[i]);
+    break;
+  }
+}
+
+static double update_rk23bs(double *y1, double *y2, double *y0, double *tmp,
+                            double *FF, double *atol, double *rtol,
+                            double dt, int neq) {
+  int i;
+  double serr = 0;
+  double *F0 = FF, *F1 = FF + neq * 1, *F2 = FF + neq * 2, *F3 = FF + neq * 3;
+
+  /* y2 is the input of the last stage (first same as last) */
+  RK_SIMD_ERR
+  for (i = 0; i < neq; i++) {
+    double s2 = tmp[i];
+    double d  = dt * ((b1_rk23bs[0] - b2_rk23bs[0]) * F0[i]
+                     + (b1_rk23bs[1] - b2_rk23bs[1]) * F1[i]
+                     + (b1_rk23bs[2] - b2_rk23bs[2]) * F2[i]
+                     + (b1_rk23bs[3] - b2_rk23bs[3]) * F3[i]);
+    RK_ERRTERM(s2, d)
+  }
+  return(sqrt(serr/neq));
+}
+
+/*--------------------------------------------------------------------------*/
+/* rk34f                                                                    */
+/*--------------------------------------------------------------------------*/
+
+static const double A_rk34f[] = {
+  2.0/7.0, 77.0/900.0, 343.0/900.0, 805.0/1444.0, -77175.0/54872.0,
+  97125.0/54872.0, 79.0/490.0, 0.0, 2175.0/3626.0, 2166.0/9065.0
+};
+static const double b1_rk34f[] = {
+  79.0/490.0, 0.0, 2175.0/3626.0, 2166.0/9065.0, 0.0
+};
+static const double b2_rk34f[] = {
+  229.0/1470.0, 0.0, 1125.0/1813.0, 13718.0/81585.0, 1.0/18.0
+};
+static const double c_rk34f[] = {
+  0.0, 2.0/7.0, 7.0/15.0, 35.0/38.0, 1.0
+};
+
+static void stage_rk34f(int j, double *tmp, double *y0, double *FF,
+                        double dt, int neq) {
+  int i;
+  double *F0 = FF, *F1 = FF + neq * 1, *F2 = FF + neq * 2, *F3 = FF + neq * 3;
+
+  switch (j) {
+  case 0:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i];
+    break;
+  case 1:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk34f[0] * F0[i]);
+    break;
+  case 2:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk34f[1] * F0[i] + A_rk34f[2] * F1[i]);
+    break;
+  case 3:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk34f[3] * F0[i] + A_rk34f[4] * F1[i]
+                            + A_rk34f[5] * F2[i]);
+    break;
+  case 4:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk34f[6] * F0[i] + A_rk34f[8] * F2[i]
+                            + A_rk34f[9] * F3[i]);
+    break;
+  }
+}
+
+static double update_rk34f(double *y1, double *y2, double *y0, double *tmp,
+                           double *FF, double *atol, double *rtol,
+                           double dt, int neq) {
+  int i;
+  double serr = 0;
+  double *F0 = FF, *F2 = FF + neq * 2, *F3 = FF + neq * 3, *F4 = FF + neq * 4;
+
+  RK_SIMD_ERR
+  for (i = 0; i < neq; i++) {
+    double s2 = y0[i] + dt * (b2_rk34f[0] * F0[i] + b2_rk34f[2] * F2[i]
+                             + b2_rk34f[3] * F3[i] + b2_rk34f[4] * F4[i]);
+    double d  = dt * ((b1_rk34f[0] - b2_rk34f[0]) * F0[i]
+                     + (b1_rk34f[2] - b2_rk34f[2]) * F2[i]
+                     + (b1_rk34f[3] - b2_rk34f[3]) * F3[i]
+                     + (b1_rk34f[4] - b2_rk34f[4]) * F4[i]);
+    RK_ERRTERM(s2, d)
+  }
+  return(sqrt(serr/neq));
+}
+
+/*--------------------------------------------------------------------------*/
+/* rk45f                                                                    */
+/*--------------------------------------------------------------------------*/
+
+static const double A_rk45f[] = {
+  1.0/4.0, 3.0/32.0, 9.0/32.0, 1932.0/2197.0, -7200.0/2197.0, 7296.0/2197.0,
+  439.0/216.0, -8.0, 3680.0/513.0, -845.0/4104.0, -8.0/27.0, 2.0,
+  -3544.0/2565.0, 1859.0/4104.0, -11.0/40.0
+};
+static const double b1_rk45f[] = {
+  25.0/216.0, 0.0, 1408.0/2565.0, 2197.0/4104.0, -1.0/5.0, 0.0
+};
+static const double b2_rk45f[] = {
+  16.0/135.0, 0.0, 6656.0/12825.0, 28561.0/56430.0, -9.0/50.0, 2.0/55.0
+};
+static const double c_rk45f[] = {
+  0.0, 1.0/4.0, 3.0/8.0, 12.0/13.0, 1.0, 1.0/2.0
+};
+
+static void stage_rk45f(int j, double *tmp, double *y0, double *FF,
+                        double dt, int neq) {
+  int i;
+  double *F0 = FF, *F1 = FF + neq * 1, *F2 = FF + neq * 2, *F3 = FF + neq * 3,
+         *F4 = FF + neq * 4;
+
+  switch (j) {
+  case 0:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i];
+    break;
+  case 1:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk45f[0] * F0[i]);
+    break;
+  case 2:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk45f[1] * F0[i] + A_rk45f[2] * F1[i]);
+    break;
+  case 3:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk45f[3] * F0[i] + A_rk45f[4] * F1[i]
+                            + A_rk45f[5] * F2[i]);
+    break;
+  case 4:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk45f[6] * F0[i] + A_rk45f[7] * F1[i]
+                            + A_rk45f[8] * F2[i] + A_rk45f[9] * F3[i]);
+    break;
+  case 5:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk45f[10] * F0[i] + A_rk45f[11] * F1[i]
+                            + A_rk45f[12] * F2[i] + A_rk45f[13] * F3[i]
+                            + A_rk45f[14] * F4[i]);
+    break;
+  }
+}
+
+static double update_rk45f(double *y1, double *y2, double *y0, double *tmp,
+                           double *FF, double *atol, double *rtol,
+                           double dt, int neq) {
+  int i;
+  double serr = 0;
+  double *F0 = FF, *F2 = FF + neq * 2, *F3 = FF + neq * 3, *F4 = FF + neq * 4,
+         *F5 = FF + neq * 5;
+
+  RK_SIMD_ERR
+  for (i = 0; i < neq; i++) {
+    double s2 = y0[i] + dt * (b2_rk45f[0] * F0[i] + b2_rk45f[2] * F2[i]
+                             + b2_rk45f[3] * F3[i] + b2_rk45f[4] * F4[i]
+                             + b2_rk45f[5] * F5[i]);
+    double d  = dt * ((b1_rk45f[0] - b2_rk45f[0]) * F0[i]
+                     + (b1_rk45f[2] - b2_rk45f[2]) * F2[i]
+                     + (b1_rk45f[3] - b2_rk45f[3]) * F3[i]
+                     + (b1_rk45f[4] - b2_rk45f[4]) * F4[i]
+                     + (b1_rk45f[5] - b2_rk45f[5]) * F5[i]);
+    RK_ERRTERM(s2, d)
+  }
+  return(sqrt(serr/neq));
+}
+
+/*--------------------------------------------------------------------------*/
+/* rk45ck                                                                   */
+/*--------------------------------------------------------------------------*/
+
+static const double A_rk45ck[] = {
+  1.0/5.0, 3.0/40.0, 9.0/40.0, 3.0/10.0, -9.0/10.0, 6.0/5.0, -11.0/54.0,
+  5.0/2.0, -70.0/27.0, 35.0/27.0, 1631.0/55296.0, 175.0/512.0, 575.0/13824.0,
+  44275.0/110592.0, 253.0/4096.0
+};
+static const double b1_rk45ck[] = {
+  2825.0/27648.0, 0.0, 18575.0/48384.0, 13525.0/55296.0, 277.0/14336.0,
+  1.0/4.0
+};
+static const double b2_rk45ck[] = {
+  37.0/378.0, 0.0, 250.0/621.0, 125.0/594.0, 0.0, 512.0/1771.0
+};
+static const double c_rk45ck[] = {
+  0.0, 1.0/5.0, 3.0/10.0, 3.0/5.0, 1.0, 7.0/8.0
+};
+
+static void stage_rk45ck(int j, double *tmp, double *y0, double *FF,
+                         double dt, int neq) {
+  int i;
+  double *F0 = FF, *F1 = FF + neq * 1, *F2 = FF + neq * 2, *F3 = FF + neq * 3,
+         *F4 = FF + neq * 4;
+
+  switch (j) {
+  case 0:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i];
+    break;
+  case 1:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk45ck[0] * F0[i]);
+    break;
+  case 2:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk45ck[1] * F0[i] + A_rk45ck[2] * F1[i]);
+    break;
+  case 3:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk45ck[3] * F0[i] + A_rk45ck[4] * F1[i]
+                            + A_rk45ck[5] * F2[i]);
+    break;
+  case 4:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk45ck[6] * F0[i] + A_rk45ck[7] * F1[i]
+                            + A_rk45ck[8] * F2[i] + A_rk45ck[9] * F3[i]);
+    break;
+  case 5:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk45ck[10] * F0[i] + A_rk45ck[11] * F1[i]
+                            + A_rk45ck[12] * F2[i] + A_rk45ck[13] * F3[i]
+                            + A_rk45ck[14] * F4[i]);
+    break;
+  }
+}
+
+static double update_rk45ck(double *y1, double *y2, double *y0, double *tmp,
+                            double *FF, double *atol, double *rtol,
+                            double dt, int neq) {
+  int i;
+  double serr = 0;
+  double *F0 = FF, *F2 = FF + neq * 2, *F3 = FF + neq * 3, *F4 = FF + neq * 4,
+         *F5 = FF + neq * 5;
+
+  RK_SIMD_ERR
+  for (i = 0; i < neq; i++) {
+    double s2 = y0[i] + dt * (b2_rk45ck[0] * F0[i] + b2_rk45ck[2] * F2[i]
+                             + b2_rk45ck[3] * F3[i] + b2_rk45ck[5] * F5[i]);
+    double d  = dt * ((b1_rk45ck[0] - b2_rk45ck[0]) * F0[i]
+                     + (b1_rk45ck[2] - b2_rk45ck[2]) * F2[i]
+                     + (b1_rk45ck[3] - b2_rk45ck[3]) * F3[i]
+                     + (b1_rk45ck[4] - b2_rk45ck[4]) * F4[i]
+                     + (b1_rk45ck[5] - b2_rk45ck[5]) * F5[i]);
+    RK_ERRTERM(s2, d)
+  }
+  return(sqrt(serr/neq));
+}
+
+/*--------------------------------------------------------------------------*/
+/* rk45e                                                                    */
+/*--------------------------------------------------------------------------*/
+
+static const double A_rk45e[] = {
+  1.0/2.0, 1.0/4.0, 1.0/4.0, 0.0, -1.0, 2.0, 7.0/27.0, 10.0/27.0, 0.0,
+  1.0/27.0, 28.0/625.0, -125.0/625.0, 546.0/625.0, 54.0/625.0, -378.0/625.0
+};
+static const double b1_rk45e[] = {
+  1.0/6.0, 0.0, 4.0/6.0, 1.0/6.0, 0.0, 0.0
+};
+static const double b2_rk45e[] = {
+  14.0/336.0, 0.0, 0.0, 35.0/336.0, 162.0/336.0, 125.0/336.0
+};
+static const double c_rk45e[] = {
+  0.0, 1.0/2.0, 1.0/2.0, 1.0, 2.0/3.0, 1.0/5.0
+};
+
+static void stage_rk45e(int j, double *tmp, double *y0, double *FF,
+                        double dt, int neq) {
+  int i;
+  double *F0 = FF, *F1 = FF + neq * 1, *F2 = FF + neq * 2, *F3 = FF + neq * 3,
+         *F4 = FF + neq * 4;
+
+  switch (j) {
+  case 0:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i];
+    break;
+  case 1:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk45e[0] * F0[i]);
+    break;
+  case 2:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk45e[1] * F0[i] + A_rk45e[2] * F1[i]);
+    break;
+  case 3:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk45e[4] * F1[i] + A_rk45e[5] * F2[i]);
+    break;
+  case 4:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk45e[6] * F0[i] + A_rk45e[7] * F1[i]
+                            + A_rk45e[9] * F3[i]);
+    break;
+  case 5:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk45e[10] * F0[i] + A_rk45e[11] * F1[i]
+                            + A_rk45e[12] * F2[i] + A_rk45e[13] * F3[i]
+                            + A_rk45e[14] * F4[i]);
+    break;
+  }
+}
+
+static double update_rk45e(double *y1, double *y2, double *y0, double *tmp,
+                           double *FF, double *atol, double *rtol,
+                           double dt, int neq) {
+  int i;
+  double serr = 0;
+  double *F0 = FF, *F2 = FF + neq * 2, *F3 = FF + neq * 3, *F4 = FF + neq * 4,
+         *F5 = FF + neq * 5;
+
+  RK_SIMD_ERR
+  for (i = 0; i < neq; i++) {
+    double s2 = y0[i] + dt * (b2_rk45e[0] * F0[i] + b2_rk45e[3] * F3[i]
+                             + b2_rk45e[4] * F4[i] + b2_rk45e[5] * F5[i]);
+    double d  = dt * ((b1_rk45e[0] - b2_rk45e[0]) * F0[i]
+                     + (b1_rk45e[2] - b2_rk45e[2]) * F2[i]
+                     + (b1_rk45e[3] - b2_rk45e[3]) * F3[i]
+                     + (b1_rk45e[4] - b2_rk45e[4]) * F4[i]
+                     + (b1_rk45e[5] - b2_rk45e[5]) * F5[i]);
+    RK_ERRTERM(s2, d)
+  }
+  return(sqrt(serr/neq));
+}
+
+/*--------------------------------------------------------------------------*/
+/* rk45dp6                                                                  */
+/*--------------------------------------------------------------------------*/
+
+static const double A_rk45dp6[] = {
+  1.0/5.0, 3.0/40.0, 9.0/40.0, 3.0/10.0, -9.0/10.0, 6.0/5.0, 226.0/729.0,
+  -25.0/27.0, 880.0/729.0, 55.0/729.0, -181.0/270.0, 5.0/2.0, -266.0/297.0,
+  -91.0/27.0, 189.0/55.0
+};
+static const double b1_rk45dp6[] = {
+  31.0/540.0, 0.0, 190.0/297.0, -145.0/108.0, 351.0/220.0, 1.0/20.0
+};
+static const double b2_rk45dp6[] = {
+  19.0/216.0, 0.0, 1000.0/2079.0, -125.0/216.0, 81.0/88.0, 5.0/56.0
+};
+static const double c_rk45dp6[] = {
+  0.0, 1.0/5.0, 3.0/10.0, 3.0/5.0, 2.0/3.0, 1.0
+};
+
+static void stage_rk45dp6(int j, double *tmp, double *y0, double *FF,
+                          double dt, int neq) {
+  int i;
+  double *F0 = FF, *F1 = FF + neq * 1, *F2 = FF + neq * 2, *F3 = FF + neq * 3,
+         *F4 = FF + neq * 4;
+
+  switch (j) {
+  case 0:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i];
+    break;
+  case 1:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk45dp6[0] * F0[i]);
+    break;
+  case 2:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk45dp6[1] * F0[i] + A_rk45dp6[2] * F1[i]);
+    break;
+  case 3:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk45dp6[3] * F0[i] + A_rk45dp6[4] * F1[i]
+                            + A_rk45dp6[5] * F2[i]);
+    break;
+  case 4:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk45dp6[6] * F0[i] + A_rk45dp6[7] * F1[i]
+                            + A_rk45dp6[8] * F2[i] + A_rk45dp6[9] * F3[i]);
+    break;
+  case 5:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk45dp6[10] * F0[i] + A_rk45dp6[11] * F1[i]
+                            + A_rk45dp6[12] * F2[i] + A_rk45dp6[13] * F3[i]
+                            + A_rk45dp6[14] * F4[i]);
+    break;
+  }
+}
+
+static double update_rk45dp6(double *y1, double *y2, double *y0, double *tmp,
+                             double *FF, double *atol, double *rtol,
+                             double dt, int neq) {
+  int i;
+  double serr = 0;
+  double *F0 = FF, *F2 = FF + neq * 2, *F3 = FF + neq * 3, *F4 = FF + neq * 4,
+         *F5 = FF + neq * 5;
+
+  RK_SIMD_ERR
+  for (i = 0; i < neq; i++) {
+    double s2 = y0[i] + dt * (b2_rk45dp6[0] * F0[i] + b2_rk45dp6[2] * F2[i]
+                             + b2_rk45dp6[3] * F3[i] + b2_rk45dp6[4] * F4[i]
+                             + b2_rk45dp6[5] * F5[i]);
+    double d  = dt * ((b1_rk45dp6[0] - b2_rk45dp6[0]) * F0[i]
+                     + (b1_rk45dp6[2] - b2_rk45dp6[2]) * F2[i]
+                     + (b1_rk45dp6[3] - b2_rk45dp6[3]) * F3[i]
+                     + (b1_rk45dp6[4] - b2_rk45dp6[4]) * F4[i]
+                     + (b1_rk45dp6[5] - b2_rk45dp6[5]) * F5[i]);
+    RK_ERRTERM(s2, d)
+  }
+  return(sqrt(serr/neq));
+}
+
+/*--------------------------------------------------------------------------*/
+/* rk45dp7                                                                  */
+/*--------------------------------------------------------------------------*/
+
+static const double A_rk45dp7[] = {
+  1.0/5.0, 3.0/40.0, 9.0/40.0, 44.0/45.0, -56.0/15.0, 32.0/9.0,
+  19372.0/6561.0, -25360.0/2187.0, 64448.0/6561.0, -212.0/729.0,
+  9017.0/3168.0, -355.0/33.0, 46732.0/5247.0, 49.0/176.0, -5103.0/18656.0,
+  35.0/384.0, 0.0, 500.0/1113.0, 125.0/192.0, -2187.0/6784.0, 11.0/84.0
+};
+static const double b1_rk45dp7[] = {
+  5179.0/57600.0, 0.0, 7571.0/16695.0, 393.0/640.0, -92097.0/339200.0,
+  187.0/2100.0, 1.0/40.0
+};
+static const double b2_rk45dp7[] = {
+  35.0/384.0, 0.0, 500.0/1113.0, 125.0/192.0, -2187.0/6784.0, 11.0/84.0, 0.0
+};
+static const double c_rk45dp7[] = {
+  0.0, 1.0/5.0, 3.0/10.0, 4.0/5.0, 8.0/9.0, 1.0, 1.0
+};
+
+static void stage_rk45dp7(int j, double *tmp, double *y0, double *FF,
+                          double dt, int neq) {
+  int i;
+  double *F0 = FF, *F1 = FF + neq * 1, *F2 = FF + neq * 2, *F3 = FF + neq * 3,
+         *F4 = FF + neq * 4, *F5 = FF + neq * 5;
+
+  switch (j) {
+  case 0:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i];
+    break;
+  case 1:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk45dp7[0] * F0[i]);
+    break;
+  case 2:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk45dp7[1] * F0[i] + A_rk45dp7[2] * F1[i]);
+    break;
+  case 3:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk45dp7[3] * F0[i] + A_rk45dp7[4] * F1[i]
+                            + A_rk45dp7[5] * F2[i]);
+    break;
+  case 4:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk45dp7[6] * F0[i] + A_rk45dp7[7] * F1[i]
+                            + A_rk45dp7[8] * F2[i] + A_rk45dp7[9] * F3[i]);
+    break;
+  case 5:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk45dp7[10] * F0[i] + A_rk45dp7[11] * F1[i]
+                            + A_rk45dp7[12] * F2[i] + A_rk45dp7[13] * F3[i]
+                            + A_rk45dp7[14] * F4[i]);
+    break;
+  case 6:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk45dp7[15] * F0[i] + A_rk45dp7[17] * F2[i]
+                            + A_rk45dp7[18] * F3[i] + A_rk45dp7[19] * F4[i]
+                            + A_rk45dp7[20] * F5[i]);
+    break;
+  }
+}
+
+static double update_rk45dp7(double *y1, double *y2, double *y0, double *tmp,
+                             double *FF, double *atol, double *rtol,
+                             double dt, int neq) {
+  int i;
+  double serr = 0;
+  double *F0 = FF, *F2 = FF + neq * 2, *F3 = FF + neq * 3, *F4 = FF + neq * 4,
+         *F5 = FF + neq * 5, *F6 = FF + neq * 6;
+
+  /* y2 is the input of the last stage (first same as last) */
+  RK_SIMD_ERR
+  for (i = 0; i < neq; i++) {
+    double s2 = tmp[i];
+    double d  = dt * ((b1_rk45dp7[0] - b2_rk45dp7[0]) * F0[i]
+                     + (b1_rk45dp7[2] - b2_rk45dp7[2]) * F2[i]
+                     + (b1_rk45dp7[3] - b2_rk45dp7[3]) * F3[i]
+                     + (b1_rk45dp7[4] - b2_rk45dp7[4]) * F4[i]
+                     + (b1_rk45dp7[5] - b2_rk45dp7[5]) * F5[i]
+                     + (b1_rk45dp7[6] - b2_rk45dp7[6]) * F6[i]);
+    RK_ERRTERM(s2, d)
+  }
+  return(sqrt(serr/neq));
+}
+
+/*--------------------------------------------------------------------------*/
+/* rk78dp                                                                   */
+/*--------------------------------------------------------------------------*/
+
+static const double A_rk78dp[] = {
+  1.0/18.0, 1.0/48.0, 1.0/16.0, 1.0/32.0, 0.0, 3.0/32.0, 5.0/16.0, 0.0,
+  -75.0/64.0, 75.0/64.0, 3.0/80.0, 0.0, 0.0, 3.0/16.0, 3.0/20.0,
+  29443841.0/614563906.0, 0.0, 0.0, 77736538.0/692538347.0,
+  -28693883.0/1125000000.0, 23124283.0/1800000000.0, 16016141.0/946692911.0,
+  0.0, 0.0, 61564180.0/158732637.0, 22789713.0/633445777.0,
+  545815736.0/2771057229.0, -180193667.0/1043307555.0, 39632708.0/573591083.0,
+  0.0, 0.0, -433636366.0/683701615.0, -421739975.0/2616292301.0,
+  100302831.0/723423059.0, 790204164.0/839813087.0, 800635310.0/3783071287.0,
+  246121993.0/1340847787.0, 0.0, 0.0, -37695042795.0/15268766246.0,
+  -309121744.0/1061227803.0, -12992083.0/490766935.0,
+  6005943493.0/2108947869.0, 393006217.0/1396673457.0,
+  123872331.0/1001029789.0, -1028468189.0/846180014.0, 0.0, 0.0,
+  8478235783.0/508512852.0, 1311729495.0/1432422823.0,
+  -10304129995.0/1701304382.0, -48777925059.0/3047939560.0,
+  15336726248.0/1032824649.0, -45442868181.0/3398467696.0,
+  3065993473.0/597172653.0, 185892177.0/718116043.0, 0.0, 0.0,
+  -3185094517.0/667107341.0, -477755414.0/1098053517.0,
+  -703635378.0/230739211.0, 5731566787.0/1027545527.0,
+  5232866602.0/850066563.0, -4093664535.0/808688257.0,
+  3962137247.0/1805957418.0, 65686358.0/487910083.0, 403863854.0/491063109.0,
+  0.0, 0.0, -5068492393.0/434740067.0, -411421997.0/543043805.0,
+  652783627.0/914296604.0, 11173962825.0/925320556.0,
+  -13158990841.0/6184727034.0, 3936647629.0/1978049680.0,
+  -160528059.0/685178525.0, 248638103.0/1413531060.0, 0.0
+};
+static const double b1_rk78dp[] = {
+  13451932.0/455176623.0, 0.0, 0.0, 0.0, 0.0, -808719846.0/976000145.0,
+  1757004468.0/5645159321.0, 656045339.0/265891186.0,
+  -3867574721.0/1518517206.0, 465885868.0/322736535.0, 53011238.0/667516719.0,
+  2.0/45.0, 0.0
+};
+static const double b2_rk78dp[] = {
+  14005451.0/335480064.0, 0.0, 0.0, 0.0, 0.0, -59238493.0/1068277825.0,
+  181606767.0/758867731.0, 561292985.0/797845732.0,
+  -1041891430.0/1371343529.0, 760417239.0/1151165299.0,
+  118820643.0/751138087.0, -528747749.0/2220607170.0, 1.0/4.0
+};
+static const double c_rk78dp[] = {
+  0.0, 1.0/18.0, 1.0/12.0, 1.0/8.0, 5.0/16.0, 3.0/8.0, 59.0/400.0, 93.0/200.0,
+  5490023248.0/9719169821.0, 13.0/20.0, 1201146811.0/1299019798.0, 1.0, 1.0
+};
+
+static void stage_rk78dp(int j, double *tmp, double *y0, double *FF,
+                         double dt, int neq) {
+  int i;
+  double *F0 = FF, *F1 = FF + neq * 1, *F2 = FF + neq * 2, *F3 = FF + neq * 3,
+         *F4 = FF + neq * 4, *F5 = FF + neq * 5, *F6 = FF + neq * 6,
+         *F7 = FF + neq * 7, *F8 = FF + neq * 8, *F9 = FF + neq * 9,
+         *F10 = FF + neq * 10;
+
+  switch (j) {
+  case 0:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i];
+    break;
+  case 1:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk78dp[0] * F0[i]);
+    break;
+  case 2:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk78dp[1] * F0[i] + A_rk78dp[2] * F1[i]);
+    break;
+  case 3:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk78dp[3] * F0[i] + A_rk78dp[5] * F2[i]);
+    break;
+  case 4:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk78dp[6] * F0[i] + A_rk78dp[8] * F2[i]
+                            + A_rk78dp[9] * F3[i]);
+    break;
+  case 5:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk78dp[10] * F0[i] + A_rk78dp[13] * F3[i]
+                            + A_rk78dp[14] * F4[i]);
+    break;
+  case 6:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk78dp[15] * F0[i] + A_rk78dp[18] * F3[i]
+                            + A_rk78dp[19] * F4[i] + A_rk78dp[20] * F5[i]);
+    break;
+  case 7:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk78dp[21] * F0[i] + A_rk78dp[24] * F3[i]
+                            + A_rk78dp[25] * F4[i] + A_rk78dp[26] * F5[i]
+                            + A_rk78dp[27] * F6[i]);
+    break;
+  case 8:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk78dp[28] * F0[i] + A_rk78dp[31] * F3[i]
+                            + A_rk78dp[32] * F4[i] + A_rk78dp[33] * F5[i]
+                            + A_rk78dp[34] * F6[i] + A_rk78dp[35] * F7[i]);
+    break;
+  case 9:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk78dp[36] * F0[i] + A_rk78dp[39] * F3[i]
+                            + A_rk78dp[40] * F4[i] + A_rk78dp[41] * F5[i]
+                            + A_rk78dp[42] * F6[i] + A_rk78dp[43] * F7[i]
+                            + A_rk78dp[44] * F8[i]);
+    break;
+  case 10:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk78dp[45] * F0[i] + A_rk78dp[48] * F3[i]
+                            + A_rk78dp[49] * F4[i] + A_rk78dp[50] * F5[i]
+                            + A_rk78dp[51] * F6[i] + A_rk78dp[52] * F7[i]
+                            + A_rk78dp[53] * F8[i] + A_rk78dp[54] * F9[i]);
+    break;
+  case 11:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk78dp[55] * F0[i] + A_rk78dp[58] * F3[i]
+                            + A_rk78dp[59] * F4[i] + A_rk78dp[60] * F5[i]
+                            + A_rk78dp[61] * F6[i] + A_rk78dp[62] * F7[i]
+                            + A_rk78dp[63] * F8[i] + A_rk78dp[64] * F9[i]
+                            + A_rk78dp[65] * F10[i]);
+    break;
+  case 12:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk78dp[66] * F0[i] + A_rk78dp[69] * F3[i]
+                            + A_rk78dp[70] * F4[i] + A_rk78dp[71] * F5[i]
+                            + A_rk78dp[72] * F6[i] + A_rk78dp[73] * F7[i]
+                            + A_rk78dp[74] * F8[i] + A_rk78dp[75] * F9[i]
+                            + A_rk78dp[76] * F10[i]);
+    break;
+  }
+}
+
+static double update_rk78dp(double *y1, double *y2, double *y0, double *tmp,
+                            double *FF, double *atol, double *rtol,
+                            double dt, int neq) {
+  int i;
+  double serr = 0;
+  double *F0 = FF, *F5 = FF + neq * 5, *F6 = FF + neq * 6, *F7 = FF + neq * 7,
+         *F8 = FF + neq * 8, *F9 = FF + neq * 9, *F10 = FF + neq * 10,
+         *F11 = FF + neq * 11, *F12 = FF + neq * 12;
+
+  RK_SIMD_ERR
+  for (i = 0; i < neq; i++) {
+    double s2 = y0[i] + dt * (b2_rk78dp[0] * F0[i] + b2_rk78dp[5] * F5[i]
+                             + b2_rk78dp[6] * F6[i] + b2_rk78dp[7] * F7[i]
+                             + b2_rk78dp[8] * F8[i] + b2_rk78dp[9] * F9[i]
+                             + b2_rk78dp[10] * F10[i]
+                             + b2_rk78dp[11] * F11[i]
+                             + b2_rk78dp[12] * F12[i]);
+    double d  = dt * ((b1_rk78dp[0] - b2_rk78dp[0]) * F0[i]
+                     + (b1_rk78dp[5] - b2_rk78dp[5]) * F5[i]
+                     + (b1_rk78dp[6] - b2_rk78dp[6]) * F6[i]
+                     + (b1_rk78dp[7] - b2_rk78dp[7]) * F7[i]
+                     + (b1_rk78dp[8] - b2_rk78dp[8]) * F8[i]
+                     + (b1_rk78dp[9] - b2_rk78dp[9]) * F9[i]
+                     + (b1_rk78dp[10] - b2_rk78dp[10]) * F10[i]
+                     + (b1_rk78dp[11] - b2_rk78dp[11]) * F11[i]
+                     + (b1_rk78dp[12] - b2_rk78dp[12]) * F12[i]);
+    RK_ERRTERM(s2, d)
+  }
+  return(sqrt(serr/neq));
+}
+
+/*--------------------------------------------------------------------------*/
+/* rk78f                                                                    */
+/*--------------------------------------------------------------------------*/
+
+static const double A_rk78f[] = {
+  2.0/27.0, 1.0/36.0, 1.0/12.0, 1.0/24.0, 0.0, 1.0/8.0, 5.0/12.0, 0.0,
+  -25.0/16.0, 25.0/16.0, 0.05, 0.0, 0.0, 0.25, 0.2, -25.0/108.0, 0.0, 0.0,
+  125.0/108.0, -65.0/27.0, 125.0/54.0, 31.0/300.0, 0.0, 0.0, 0.0, 61.0/225.0,
+  -2.0/9.0, 13.0/900.0, 2.0, 0.0, 0.0, -53.0/6.0, 704.0/45.0, -107.0/9.0,
+  67.0/90.0, 3.0, -91.0/108.0, 0.0, 0.0, 23.0/108.0, -976.0/135.0, 311.0/54.0,
+  -19.0/60.0, 17.0/6.0, -1.0/12.0, 2383.0/4100.0, 0.0, 0.0, -341.0/164.0,
+  4496.0/1025.0, -301.0/82.0, 2133.0/4100.0, 45.0/82.0, 45.0/164.0, 18.0/41.0,
+  3.0/205.0, 0.0, 0.0, 0.0, 0.0, -6.0/41.0, -3.0/205.0, -3.0/41.0, 3.0/41.0,
+  6.0/41.0, 0.0, -1777.0/4100.0, 0.0, 0.0, -341.0/164.0, 4496.0/1025.0,
+  -289.0/82.0, 2193.0/4100.0, 51.0/82.0, 33.0/164.0, 12.0/41.0, 0.0, 1.0
+};
+static const double b1_rk78f[] = {
+  41.0/840.0, 0.0, 0.0, 0.0, 0.0, 34.0/105.0, 9.0/35.0, 9.0/35.0, 9.0/280.0,
+  9.0/280.0, 41.0/840.0, 0.0, 0.0
+};
+static const double b2_rk78f[] = {
+  0.0, 0.0, 0.0, 0.0, 0.0, 34.0/105.0, 9.0/35.0, 9.0/35.0, 9.0/280.0,
+  9.0/280.0, 0.0, 41.0/840.0, 41.0/840.0
+};
+static const double c_rk78f[] = {
+  0.0, 2.0/27.0, 1.0/9.0, 1.0/6.0, 5.0/12.0, 0.5, 5.0/6.0, 1.0/6.0, 2.0/3.0,
+  1.0/3.0, 1.0, 0.0, 1.0
+};
+
+static void stage_rk78f(int j, double *tmp, double *y0, double *FF,
+                        double dt, int neq) {
+  int i;
+  double *F0 = FF, *F1 = FF + neq * 1, *F2 = FF + neq * 2, *F3 = FF + neq * 3,
+         *F4 = FF + neq * 4, *F5 = FF + neq * 5, *F6 = FF + neq * 6,
+         *F7 = FF + neq * 7, *F8 = FF + neq * 8, *F9 = FF + neq * 9,
+         *F11 = FF + neq * 11;
+
+  switch (j) {
+  case 0:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i];
+    break;
+  case 1:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk78f[0] * F0[i]);
+    break;
+  case 2:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk78f[1] * F0[i] + A_rk78f[2] * F1[i]);
+    break;
+  case 3:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk78f[3] * F0[i] + A_rk78f[5] * F2[i]);
+    break;
+  case 4:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk78f[6] * F0[i] + A_rk78f[8] * F2[i]
+                            + A_rk78f[9] * F3[i]);
+    break;
+  case 5:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk78f[10] * F0[i] + A_rk78f[13] * F3[i]
+                            + A_rk78f[14] * F4[i]);
+    break;
+  case 6:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk78f[15] * F0[i] + A_rk78f[18] * F3[i]
+                            + A_rk78f[19] * F4[i] + A_rk78f[20] * F5[i]);
+    break;
+  case 7:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk78f[21] * F0[i] + A_rk78f[25] * F4[i]
+                            + A_rk78f[26] * F5[i] + A_rk78f[27] * F6[i]);
+    break;
+  case 8:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk78f[28] * F0[i] + A_rk78f[31] * F3[i]
+                            + A_rk78f[32] * F4[i] + A_rk78f[33] * F5[i]
+                            + A_rk78f[34] * F6[i] + A_rk78f[35] * F7[i]);
+    break;
+  case 9:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk78f[36] * F0[i] + A_rk78f[39] * F3[i]
+                            + A_rk78f[40] * F4[i] + A_rk78f[41] * F5[i]
+                            + A_rk78f[42] * F6[i] + A_rk78f[43] * F7[i]
+                            + A_rk78f[44] * F8[i]);
+    break;
+  case 10:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk78f[45] * F0[i] + A_rk78f[48] * F3[i]
+                            + A_rk78f[49] * F4[i] + A_rk78f[50] * F5[i]
+                            + A_rk78f[51] * F6[i] + A_rk78f[52] * F7[i]
+                            + A_rk78f[53] * F8[i] + A_rk78f[54] * F9[i]);
+    break;
+  case 11:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk78f[55] * F0[i] + A_rk78f[60] * F5[i]
+                            + A_rk78f[61] * F6[i] + A_rk78f[62] * F7[i]
+                            + A_rk78f[63] * F8[i] + A_rk78f[64] * F9[i]);
+    break;
+  case 12:
+    RK_SIMD
+    for (i = 0; i < neq; i++)
+      tmp[i] = y0[i] + dt * (A_rk78f[66] * F0[i] + A_rk78f[69] * F3[i]
+                            + A_rk78f[70] * F4[i] + A_rk78f[71] * F5[i]
+                            + A_rk78f[72] * F6[i] + A_rk78f[73] * F7[i]
+                            + A_rk78f[74] * F8[i] + A_rk78f[75] * F9[i]
+                            + A_rk78f[77] * F11[i]);
+    break;
+  }
+}
+
+static double update_rk78f(double *y1, double *y2, double *y0, double *tmp,
+                           double *FF, double *atol, double *rtol,
+                           double dt, int neq) {
+  int i;
+  double serr = 0;
+  double *F0 = FF, *F5 = FF + neq * 5, *F6 = FF + neq * 6, *F7 = FF + neq * 7,
+         *F8 = FF + neq * 8, *F9 = FF + neq * 9, *F10 = FF + neq * 10,
+         *F11 = FF + neq * 11, *F12 = FF + neq * 12;
+
+  RK_SIMD_ERR
+  for (i = 0; i < neq; i++) {
+    double s2 = y0[i] + dt * (b2_rk78f[5] * F5[i] + b2_rk78f[6] * F6[i]
+                             + b2_rk78f[7] * F7[i] + b2_rk78f[8] * F8[i]
+                             + b2_rk78f[9] * F9[i] + b2_rk78f[11] * F11[i]
+                             + b2_rk78f[12] * F12[i]);
+    double d  = dt * ((b1_rk78f[0] - b2_rk78f[0]) * F0[i]
+                     + (b1_rk78f[10] - b2_rk78f[10]) * F10[i]
+                     + (b1_rk78f[11] - b2_rk78f[11]) * F11[i]
+                     + (b1_rk78f[12] - b2_rk78f[12]) * F12[i]);
+    RK_ERRTERM(s2, d)
+  }
+  return(sqrt(serr/neq));
+}
+
+/*==========================================================================*/
+/* selection of the kernels                                                 */
+/*==========================================================================*/
+
+#define KERNEL(id, stage) \
+  {#id, stage, A_##id, b1_##id, b2_##id, c_##id, stage_##id, update_##id}
+
+static rk_kernel rk_kernels[] = {
+  KERNEL(rk23, 3),
+  KERNEL(rk23bs, 4),
+  KERNEL(rk34f, 5),
+  KERNEL(rk45f, 6),
+  KERNEL(rk45ck, 6),
+  KERNEL(rk45e, 6),
+  KERNEL(rk45dp6, 6),
+  KERNEL(rk45dp7, 7),
+  KERNEL(rk78dp, 13),
+  KERNEL(rk78f, 13)
+};
+
+static int rk_same(double *x, const double *ref, int n) {
+  for (int i = 0; i < n; i++)
+    if (fabs(x[i] - ref[i]) > 4 * DBL_EPSILON * fabs(ref[i])) return(FALSE);
+  return(TRUE);
+}
+
+/* kernels of method Method (a list of class rkMethod), NULL if none */
+rk_kernel *rk_findkernel(SEXP Method) {
+  SEXP ID = getListElement(Method, "ID"), R_A, R_B1, R_B2, R_C;
+  int i, j, k, m, stage, n = sizeof(rk_kernels) / sizeof(rk_kernel);
+  rk_kernel *kern = NULL;
+
+  if (!isString(ID) || LENGTH(ID) < 1) return(NULL);
+  for (i = 0; i < n; i++)
+    if (strcmp(CHAR(STRING_ELT(ID, 0)), rk_kernels[i].id) == 0)
+      kern = &rk_kernels[i];
+  if (kern == NULL) return(NULL);
+
+  if (!isReal(getListElement(Method, "stage"))) return(NULL);
+  stage = (int)REAL(getListElement(Method, "stage"))[0];
+  R_A  = getListElement(Method, "A");
+  R_B1 = getListElement(Method, "b1");
+  R_B2 = getListElement(Method, "b2");
+  R_C  = getListElement(Method, "c");
+  if (stage != kern->stage || !isReal(R_A) || !isReal(R_B1) ||
+      !isReal(R_B2) || !isReal(R_C) || LENGTH(R_A) < stage * (stage - 1) ||
+      LENGTH(R_B1) != stage || LENGTH(R_B2) != stage || LENGTH(R_C) != stage)
+    return(NULL);
+
+  /* strictly lower triangle of A (stage rows), row by row */
+  for (j = 0, m = 0; j < stage; j++)
+    for (k = 0; k < j; k++, m++)
+      if (!rk_same(REAL(R_A) + j + stage * k, kern->A + m, 1)) return(NULL);
+  if (!rk_same(REAL(R_B1), kern->b1, stage) ||
+      !rk_same(REAL(R_B2), kern->b2, stage) ||
+      !rk_same(REAL(R_C),  kern->c,  stage)) return(NULL);
+  return(kern);
+}
@@ -13,7 +13,7 @@
 #include <R_ext/Applic.h> /* for dgemm */
 #include <R_ext/BLAS.h>
 #include <R_ext/Boolean.h>
-#include "deSolve.h"
+#include "rk_util.h"
 
 /* For backwards compatibility with <= R 3.6.2 */
 /* where FCONE wasn't defined by R yet */
@@ -112,19 +112,130 @@ double maxerr(double *y0, double *y1, double *y2, double *Atol, double *Rtol, in
     /* y2 is used to estimate next y-value */
     scal  = Atol[i] + fmax(fabs(y0[i]), fabs(y2[i])) * Rtol[i];
     delta = fabs(y2[i] - y1[i]);
-    if (scal > 0) serr += pow(delta/scal, 2.0);
+    if (scal > 0) serr += (delta/scal) * (delta/scal);
   }
   return(sqrt(serr/n)); /* Euclidean norm */
 }
 
+/*----------------------------------------------------------------------------*/
+/* Fused stage kernels, shared by rk_auto, rk_fixed and rk_implicit:          */
+/* each stage input, both solution estimates and the error norm are formed    */
+/* in one pass over the states, instead of one pass per stage plus BLAS       */
+/* calls with a single column. Zero coefficients of the Butcher table are     */
+/* skipped. The loops are written for vectorization by the compiler, with     */
+/* "omp simd" if OpenMP is available, else as plain (scalar) loops.           */
+/*----------------------------------------------------------------------------*/
+
+/* nonzero coefficients a (times dt) and their columns f, padded with zero
+   coefficients to a multiple of four columns (one pass per four columns) */
+static int rk_coef(double *a, double **f, double *coef, int inc, int kmax,
+                   double *FF, double dt, int neq) {
+  int k, nk = 0;
+
+  for (k = 0; k < kmax; k++)
+    if (coef[k * inc] != 0) {
+      a[nk] = coef[k * inc] * dt;
+      f[nk++] = FF + neq * k;
+    }
+  while (nk % 4) {
+    a[nk] = 0;
+    f[nk++] = FF;
+  }
+  return(nk);
+}
+
+/* z = x + a[0] * f[0] + ... + a[3] * f[3]; z may be x */
+static void rk_axpy4(double *z, double *x, double *a, double **f, int neq) {
+  double *f0 = f[0], *f1 = f[1], *f2 = f[2], *f3 = f[3];
+  double a0 = a[0], a1 = a[1], a2 = a[2], a3 = a[3];
+
+  RK_SIMD
+  for (int i = 0; i < neq; i++)
+    z[i] = x[i] + a0 * f0[i] + a1 * f1[i] + a2 * f2[i] + a3 * f3[i];
+}
+
+/* stage input tmp = y0 + dt * sum(A[j, k] * FF[, k]), k < kmax */
+void rk_stage(double *tmp, double *y0, double *FF, double *A, double dt,
+              int j, int kmax, int stage, int neq) {
+  int i, m, nk;
+  double a[stage + 4], *f[stage + 4];
+
+  nk = rk_coef(a, f, A + j, stage, kmax, FF, dt, neq);
+  if (nk == 0)
+    for (i = 0; i < neq; i++) tmp[i] = y0[i];
+  for (m = 0; m < nk; m += 4)
+    rk_axpy4(tmp, (m == 0) ? y0 : tmp, a + m, f + m, neq);
+}
+
+/* new values y1 = y0 + dt * FF %*% bb1 and, if y2 != NULL, the embedded
+   estimate y2 = y0 + dt * FF %*% bb2; returns the error norm of maxerr,
+   formed in the last pass over the states */
+double rk_update(double *y1, double *y2, double *y0, double *FF,
+                 double *bb1, double *bb2, double *Atol, double *Rtol,
+                 double dt, int stage, int neq) {
+  int i, m, nk;
+  double a[stage + 4], b[stage + 4], *f[stage + 4];
+  double *x1, *x2, *f0, *f1, *f2, *f3, a0, a1, a2, a3, b0, b1, b2, b3;
+  double serr = 0;
+
+  if (!y2) {
+    nk = rk_coef(a, f, bb1, 1, stage, FF, dt, neq);
+    for (m = 0; m < nk; m += 4)
+      rk_axpy4(y1, (m == 0) ? y0 : y1, a + m, f + m, neq);
+    return(0);
+  }
+  /* the same columns for both estimates */
+  nk = 0;
+  for (m = 0; m < stage; m++)
+    if (bb1[m] != 0 || bb2[m] != 0) {
+      a[nk] = bb1[m] * dt;
+      b[nk] = bb2[m] * dt;
+      f[nk++] = FF + neq * m;
+    }
+  while (nk % 4 || nk == 0) {
+    a[nk] = b[nk] = 0;
+    f[nk++] = FF;
+  }
+
+  for (m = 0; m < nk; m += 4) {
+    x1 = (m == 0) ? y0 : y1;
+    x2 = (m == 0) ? y0 : y2;
+    f0 = f[m]; f1 = f[m + 1]; f2 = f[m + 2]; f3 = f[m + 3];
+    a0 = a[m]; a1 = a[m + 1]; a2 = a[m + 2]; a3 = a[m + 3];
+    b0 = b[m]; b1 = b[m + 1]; b2 = b[m + 2]; b3 = b[m + 3];
+    if (m + 4 < nk) {
+      RK_SIMD
+      for (i = 0; i < neq; i++) {
+        y1[i] = x1[i] + a0 * f0[i] + a1 * f1[i] + a2 * f2[i] + a3 * f3[i];
+        y2[i] = x2[i] + b0 * f0[i] + b1 * f1[i] + b2 * f2[i] + b3 * f3[i];
+      }
+    } else {                            /* last pass, with the error norm */
+      RK_SIMD_ERR
+      for (i = 0; i < neq; i++) {
+        double s1 = x1[i] + a0 * f0[i] + a1 * f1[i] + a2 * f2[i] + a3 * f3[i];
+        double s2 = x2[i] + b0 * f0[i] + b1 * f1[i] + b2 * f2[i] + b3 * f3[i];
+        y1[i] = s1;
+        y2[i] = s2;
+        /* y2 is used to estimate next y-value; selects instead of
+           branches (and fmax), which keeps the loop vectorizable */
+        double ay0  = fabs(y0[i]), ay2 = fabs(s2);
+        double scal = Atol[i] + ((ay0 > ay2) ? ay0 : ay2) * Rtol[i];
+        double ok   = (scal > 0);
+        double delta = fabs(s2 - s1) / (ok ? scal : 1.0);
+        serr += ok * delta * delta;
+      }
+    }
+  }
+  return(sqrt(serr/neq)); /* Euclidean norm */
+}
+
 /*==========================================================================*/
 /*   CALL TO THE MODEL FUNCTION                                             */
 /*==========================================================================*/
-void derivs(SEXP Func, double t, double* y, SEXP Parms, SEXP Rho,
+void derivs(deSolve_context *ctx, SEXP Func, double t, double* y, SEXP Parms, SEXP Rho,
       double *ydot, double *yout, int j, int neq, int *ipar, int isDll,
             int isForcing) {
   SEXP Val, rVal, R_fcall;
-  SEXP R_t;
   SEXP R_y;
   int i = 0;
   int nout = ipar[0];
@@ -136,8 +247,11 @@ void derivs(SEXP Func, double t, double* y, SEXP Parms, SEXP Rho,
     /*   Function is a DLL function                                           */
     /*------------------------------------------------------------------------*/
     C_deriv_func_type *cderivs;
-    if (isForcing) updatedeforc(&t);
-    cderivs = (C_deriv_func_type *) R_ExternalPtrAddrFn_(Func);
+    if (isForcing) updatedeforc(ctx, &t);
+    /* pointer resolved in advance, e.g. for the threads of an ensemble */
+    cderivs = ctx->DLL_deriv_func;
+    if (cderivs == NULL)
+      cderivs = (C_deriv_func_type *) R_ExternalPtrAddrFn_(Func);
     cderivs(&neq, &t, y, ytmp, yout, ipar);
     if (j >= 0)
       for (i = 0; i < neq; i++)  ydot[i + neq * j] = ytmp[i];
@@ -145,13 +259,15 @@ void derivs(SEXP Func, double t, double* y, SEXP Parms, SEXP Rho,
     /*------------------------------------------------------------------------*/
     /* Function is an R function                                              */
     /*------------------------------------------------------------------------*/
-    PROTECT(R_t = ScalarReal(t));
-    PROTECT(R_y = allocVector(REALSXP, neq));
+    /* call object, time and state are allocated once per solve (ctx->Rcalls)
+       and overwritten for each stage, see ctx_lang and call_arg */
+    R_fcall = ctx_lang(ctx, CALL_DERIV, Func, "dds", 1, neq, Parms);
+    REAL(call_arg(R_fcall, 1))[0] = t;
+    R_y = call_arg(R_fcall, 2);
     yy = REAL(R_y);
     for (i=0; i < neq; i++) yy[i] = y[i];
 
-    PROTECT(R_fcall = lang4(Func, R_t, R_y, Parms));
-    PROTECT(Val = eval(R_fcall, Rho));
+    PROTECT(Val = ctx_eval(ctx, R_fcall, Rho));
 
     /* extract the states from first list element of "Val" */
 
@@ -172,7 +288,7 @@ void derivs(SEXP Func, double t, double* y, SEXP Parms, SEXP Rho,
 
     /* extract outputs from second and following list elements */
     /* this is essentially an unlist for non-nested numeric lists */
-    if (j < 0) {
+    if (j < 0 || (ctx->outcap != NULL && ctx->outcap->want)) {
       int elt = 1, ii = 0, l;
       for (i = 0; i < nout; i++)  {
         l = LENGTH(VECTOR_ELT(Val, elt));
@@ -186,7 +302,7 @@ void derivs(SEXP Func, double t, double* y, SEXP Parms, SEXP Rho,
         ii++;
       }
     }
-    UNPROTECT(4);
+    UNPROTECT(1);
   }
 }
 
@@ -225,7 +341,8 @@ void densout(double *r, double t0, double t, double dt, double* res, int neq) {
 }
 
 /*----------------------------------------------------------------------------*/
-/* dense output for the Cash-Karp method  - does not work (yet)               */
+/* dense output for the Cash-Karp method, 4th order;                          */
+/* dy is the derivative at the end of the step                                */
 /*----------------------------------------------------------------------------*/
 
 void densoutck(double t0, double t, double dt, double* y0,
@@ -252,28 +369,63 @@ void densoutck(double t0, double t, double dt, double* y0,
 }
 
 /*----------------------------------------------------------------------------*/
-/* Polynomial interpolation                                                   */
-/*    ksig: number of signals                                                 */
-/*    n:    number of knots per signal                                        */
-/*    x[0 .. n-1]:            vector of x values                              */
-/*    y[0 .. n-1, 0 .. ksig]: array  of y values                              */
+/* Interpolation from the last steps (knots)                                  */
+/*                                                                            */
+/* The knots are kept in a ring buffer of nknots slots of ld values each:     */
+/* knot k (counted from the start) is stored in slot k % nknots, as time,     */
+/* states and (Hermite interpolation, ld = 2 * neq + 1) derivatives, so that  */
+/* nothing is shifted when a knot is added. The interpolation weights are     */
+/* computed once per output time, then applied to all states.                 */
 /*----------------------------------------------------------------------------*/
-void neville(double *xx, double *y, double tnew, double *ynew, int n, int ksig) {
-  int i, j, k;
-  double x[n];
-  double yy[n * ksig]; /* temporary workspace */
-  double tscal = xx[n-1] - xx[0];
-  double t = tnew / tscal;
-  for (i = 0; i < n; i++) x[i] = xx[i] / tscal;
-  for (i = 0; i < n * ksig; i++) yy[i] = y[i];
-
-  for (k = 0; k < ksig; k++) {
-    for (j = 1; j < n; j++)
-      for (i = n - 1; i >= j; i--) {
-        yy[i + k * n] = ((t - x[i - j]) * yy[i + k * n]
-          - (t - x[i]) * yy[i - 1 + k * n]) / (x[i] - x[i - j]);
+
+void putknot(double *yknots, int nknots, int ld, int k, double t,
+             double *y, double *dy, int neq) {
+  double *p = yknots + (k % nknots) * ld;
+
+  p[0] = t;
+  for (int i = 0; i < neq; i++) p[1 + i] = y[i];
+  if (dy)
+    for (int i = 0; i < neq; i++) p[1 + neq + i] = dy[i];
+}
+
+/* Lagrange polynomial through all nknots knots (same as Neville-Aitken) */
+void lagrange(double *yknots, int nknots, double tnew, double *ynew, int neq) {
+  int i, j, k, ld = neq + 1;
+  double w, *p;
+
+  for (i = 0; i < neq; i++) ynew[i] = 0;
+  for (k = 0; k < nknots; k++) {
+    p = yknots + k * ld;
+    w = 1;
+    for (j = 0; j < nknots; j++)
+      if (j != k) w *= (tnew - yknots[j * ld]) / (p[0] - yknots[j * ld]);
+    RK_SIMD
+    for (i = 0; i < neq; i++) ynew[i] += w * p[1 + i];
+  }
+}
+
+/* Hermite polynomial (degree 2 * nk - 1) through values and derivatives
+   of the nk <= nknots knots in the buffer */
+void hermite(double *yknots, int nknots, int nk, double tnew, double *ynew,
+             int neq) {
+  int i, j, k, ld = 2 * neq + 1;
+  double a, b, l, s, *p;
+
+  if (nk > nknots) nk = nknots;
+  for (i = 0; i < neq; i++) ynew[i] = 0;
+  for (k = 0; k < nk; k++) {
+    p = yknots + k * ld;
+    l = 1;
+    s = 0;
+    for (j = 0; j < nk; j++)
+      if (j != k) {
+        l *= (tnew - yknots[j * ld]) / (p[0] - yknots[j * ld]);
+        s += 1 / (p[0] - yknots[j * ld]);
       }
-    ynew[k] = yy[n - 1 + k * n];
+    a = (1 - 2 * s * (tnew - p[0])) * l * l;
+    b = (tnew - p[0]) * l * l;
+    RK_SIMD
+    for (i = 0; i < neq; i++) ynew[i] += a * p[1 + i] + b * p[1 + neq + i];
   }
 }
 
@@ -281,14 +433,6 @@ void neville(double *xx, double *y, double tnew, double *ynew, int n, int ksig)
 /*   Specific utility functions                                               */
 /*============================================================================*/
 
-void shiftBuffer (double *x, int n, int k) {
-  /* n = rows, k = columns */
-  for (int i = 0; i < (n - 1); i++)
-    for (int j = 0; j < k; j++)
-      x[i + j * n] = x[i + 1 + j * n];
-}
-
-
 void setIstate(SEXP R_yout, SEXP R_istate, int *istate,
   int it_tot, int stage, int fsal, int qerr, int nrej) {
   /* karline: nsteps + 1 for "initial condition evaluation" */
@@ -301,3 +445,64 @@ void setIstate(SEXP R_yout, SEXP R_istate, int *istate,
   istate[14] = qerr;                        /* order of the method */
   setAttrib(R_yout, install("istate"), R_istate);
 }
+
+/*============================================================================*/
+/*   Global outputs captured during the steps                                 */
+/*                                                                            */
+/* The outputs at both ends of an accepted step come from function            */
+/* evaluations that the method needs anyway (FSAL stage or first stage of the */
+/* next step). Rows that are not filled here are left NA and are evaluated    */
+/* with an extra call of func after the integration, as before.               */
+/*============================================================================*/
+
+rk_outcap *rk_outinit(SEXP Outinterp, int nout) {
+  rk_outcap *oc;
+  int i, n = LENGTH(Outinterp);
+
+  oc = (rk_outcap *) R_alloc(1, sizeof(rk_outcap));
+  oc->nout   = nout;
+  oc->interp = (int *) R_alloc(nout, sizeof(int));
+  oc->out0   = (double *) R_alloc(2 * nout, sizeof(double));
+  oc->out1   = oc->out0 + nout;
+  oc->allinterp = TRUE;
+  for (i = 0; i < nout; i++) {
+    oc->interp[i] = INTEGER(Outinterp)[i % n];
+    if (!oc->interp[i]) oc->allinterp = FALSE;
+  }
+  oc->want = FALSE;
+  oc->t0 = oc->t1 = NA_REAL;
+  return(oc);
+}
+
+/* outputs at t_ext within the step from t0 to t1: the values at the ends,
+   or linear interpolation if all outputs may be interpolated */
+void rk_outinterp(rk_outcap *oc, double t_ext, double *yout, int it_ext,
+  int nt, int neq) {
+  int i;
+  double s, eps = 100.0 * DBL_EPSILON * fabs(oc->t1 - oc->t0);
+
+  if (ISNA(oc->t0) || ISNA(oc->t1) || t_ext < oc->t0 - eps ||
+      t_ext > oc->t1 + eps) return;
+  if (fabs(t_ext - oc->t1) <= eps) {
+    for (i = 0; i < oc->nout; i++)
+      yout[it_ext + nt * (1 + neq + i)] = oc->out1[i];
+  } else if (fabs(t_ext - oc->t0) <= eps) {
+    for (i = 0; i < oc->nout; i++)
+      yout[it_ext + nt * (1 + neq + i)] = oc->out0[i];
+  } else if (oc->allinterp) {
+    s = (t_ext - oc->t0) / (oc->t1 - oc->t0);
+    for (i = 0; i < oc->nout; i++)
+      yout[it_ext + nt * (1 + neq + i)] =
+        oc->out0[i] + s * (oc->out1[i] - oc->out0[i]);
+  }
+}
+
+/* outputs of the state reached at t, stored after a call of rk_auto */
+void rk_outstore(rk_outcap *oc, double t, double *yout, int it_ext,
+  int nt, int neq) {
+  int i;
+
+  if (oc->t0 != t) return;
+  for (i = 0; i < oc->nout; i++)
+    yout[it_ext + nt * (1 + neq + i)] = oc->out0[i];
+}
@@ -49,7 +49,37 @@ double maxdiff(double *x, double *y, int n);
 
 double maxerr(double *y0, double *y1, double *y2, double* Atol, double* Rtol, int n);
 
-void derivs(SEXP Func, double t, double* y, SEXP Parms, SEXP Rho,
+/* loops over the states, vectorized with "omp simd" if OpenMP is available */
+#ifdef _OPENMP
+# define RK_SIMD     _Pragma("omp simd")
+# define RK_SIMD_ERR _Pragma("omp simd reduction(+:serr)")
+#else
+# define RK_SIMD
+# define RK_SIMD_ERR
+#endif
+
+void rk_stage(double *tmp, double *y0, double *FF, double *A, double dt,
+  int j, int kmax, int stage, int neq);
+
+double rk_update(double *y1, double *y2, double *y0, double *FF,
+  double *bb1, double *bb2, double *Atol, double *Rtol,
+  double dt, int stage, int neq);
+
+/* specialized kernels of the built-in methods (rk_tableau.c); A is the
+   strictly lower triangle of the Butcher table, row by row */
+typedef struct rk_kernel {
+  const char   *id;
+  int           stage;
+  const double *A, *b1, *b2, *c;
+  void   (*stage_f)(int j, double *tmp, double *y0, double *FF,
+                    double dt, int neq);
+  double (*update)(double *y1, double *y2, double *y0, double *tmp,
+                   double *FF, double *atol, double *rtol, double dt, int neq);
+} rk_kernel;
+
+rk_kernel *rk_findkernel(SEXP Method);
+
+void derivs(deSolve_context *ctx, SEXP Func, double t, double* y, SEXP Parms, SEXP Rho,
 	    double *ydot, double *yout, int j, int neq, int *ipar, 
             int isDll, int isForcing);
 	    
@@ -61,18 +91,41 @@ void densout(double *r, double t0, double t, double dt, double* res, int neq);
 void densoutck(double t0, double t, double dt, double * y0,   
   double* FF, double* dy, double* res, int neq);
 
-void neville(double *xx, double *y, double tnew, double *ynew, int n, int ksig);
+void putknot(double *yknots, int nknots, int ld, int k, double t,
+  double *y, double *dy, int neq);
+
+void lagrange(double *yknots, int nknots, double tnew, double *ynew, int neq);
 
-void shiftBuffer (double *x, int n, int k);
+void hermite(double *yknots, int nknots, int nk, double tnew, double *ynew,
+  int neq);
 
 void setIstate(SEXP R_yout, SEXP R_istate, int *istate,
   int it_tot, int stage, int fsal, int qerr, int nrej);
+
+/* global outputs captured from the function evaluations at the ends of
+   the steps, instead of an extra call of func per output time */
+struct rk_outcap {
+  int    nout;
+  int    *interp;       /* output may be interpolated within a step     */
+  int    allinterp;     /* all outputs may be interpolated              */
+  int    want;          /* the next call of derivs stores the outputs   */
+  double t0, t1;        /* times of the outputs at start and end of step */
+  double *out0, *out1;  /* outputs at start and end of the step         */
+};
+
+rk_outcap *rk_outinit(SEXP Outinterp, int nout);
+
+void rk_outinterp(rk_outcap *oc, double t_ext, double *yout, int it_ext,
+  int nt, int neq);
+
+void rk_outstore(rk_outcap *oc, double t, double *yout, int it_ext,
+  int nt, int neq);
   
 /*==========================================================================*/
 /* core functions (main loop) for solvers with variable / fixed step size   */
 /*==========================================================================*/
 
-void rk_auto(
+void rk_auto(deSolve_context *ctx,
   /* integers */
   int fsal, int neq, int stage,
   int isDll, int isForcing, int verbose,
@@ -96,7 +149,7 @@ void rk_auto(
  );
 
 
-void rk_fixed(
+void rk_fixed(deSolve_context *ctx,
   /* integers */
   int fsal, int neq, int stage,
   int isDll, int isForcing, int verbose,
@@ -119,25 +172,213 @@ void rk_fixed(
 );
 
  
-void rk_implicit(double * alfa, int *index, 
+/* data of the Newton iteration of the implicit methods, in ctx->solver;
+   the stage system I - dt * (A %x% J) is formed from the Jacobian J of
+   the derivatives and kept factorized as long as the iteration converges */
+typedef struct irk_data {
+  double *J;       /* Jacobian of the derivative function, neq x neq      */
+  double *E;       /* LU of the stage system, neq*stage x neq*stage       */
+  double *Eerr;    /* LU of I - dt * gamma * J (filter of the error)      */
+  int    *index, *indexerr;
+  double *e;       /* weights of the stages in the error estimate         */
+  double gamma;    /* weight of f(t, y0) in the error estimate            */
+  double dtlu;     /* step size of the factorization, 0 = none            */
+  double faccon, theta;  /* convergence rate of the Newton iteration      */
+  int    qerr;     /* order of the error estimate                         */
+  int    stiffacc; /* stiffly accurate: last stage is f(t + dt, y1)       */
+  int    f0ok;     /* f(t, y0): 0 unknown, 1 evaluated, 2 last stage     */
+  int    newjac, jcur, restart;
+} irk_data;
+
+irk_data *irk_init(int neq, int stage, int varstep, double *A, double *bb1,
+  double *cc);
+
+int irk_jac(deSolve_context *ctx, double *J, int neq, double t,
+  double *y0, double *f0, double *ytmp, double *f1,
+  SEXP Func, SEXP Parms, SEXP Rho,
+  double *out, int *ipar, int isDll, int isForcing);
+
+void rk_implicit(deSolve_context *ctx,
        /* integers */
        int fsal, int neq, int stage,
        int isDll, int isForcing, int verbose,
-       int nknots, int interpolate, int maxsteps, int nt,
+       int nknots, int interpolate, int varstep, int maxsteps, int nt,
        /* int pointers */
-       int* _iknots, int* _it, int* _it_ext, int* _it_tot, 
+       int* _iknots, int* _it, int* _it_ext, int* _it_tot, int* _it_rej,
        int* istate,  int* ipar,
        /* double */
-        double t, double tmax, double hini,
+       double t, double tmax, double hini, double hmin, double hmax,
        /* double pointers */
        double* _dt,
        /* arrays */
-       double* tt, double* y0, double* y1, double* dy1, 
-       double* f, double* y, double* Fj, 
+       double* tt, double* y0, double* y1, double* dy1,
+       double* f, double* y, double* Fj,
        double* tmp, double* tmp2, double *tmp3,
-       double* FF, double* rr, double* A, double* out, 
-       double* bb1, double* cc, 
+       double* FF, double* rr, double* A, double* out,
+       double* bb1, double* cc, double* atol, double* rtol,
        double* yknots, double* yout,
        /* SEXPs */
        SEXP Func, SEXP Parms, SEXP Rho
 ); 
+
+/*==========================================================================*/
+/* Rosenbrock methods with adaptive step size (rk_rosenbrock.c)             */
+/*==========================================================================*/
+
+/* user-supplied Jacobian, compiled or the interface to R, as in lsoda */
+typedef void ros_jac_func_type(int *, double *, double *, int *, int *,
+  double *, int *, double *, int *);
+
+/* data of the linearly implicit stages, in ctx->solver; J is kept for
+   rejected steps, E = I / (gamma * dt) - J is factorized for each dt */
+typedef struct ros_data {
+  ros_jac_func_type *jac;  /* user-supplied Jacobian or NULL             */
+  int    banded, ml, mu;
+  int    ldj, lde;   /* leading dimensions of J and E (LINPACK band form) */
+  double *J;         /* Jacobian of the derivatives at (t, y0)            */
+  double *E;         /* LU of I / (gamma * dt) - J                        */
+  int    *index;
+  double *ft;        /* derivative of f with respect to time              */
+  double gamma, *G, *gi;   /* coefficients of the method                  */
+  int    *newf;      /* stage needs a new function evaluation             */
+  int    f0ok, newjac;
+} ros_data;
+
+ros_data *ros_init(int neq, int stage, double *A, double *cc, double gamma,
+  double *G, double *gi, int jt, int ml, int mu, ros_jac_func_type *jac);
+
+void rk_rosenbrock(deSolve_context *ctx,
+  /* integers */
+  int neq, int stage,
+  int isDll, int isForcing, int verbose,
+  int nknots, int interpolate, int maxsteps, int nt,
+  /* int pointers */
+  int* _iknots, int* _it, int* _it_ext, int* _it_tot, int* _it_rej,
+  int* istate,  int* ipar,
+  /* double */
+  double t, double tmax, double hmin, double hmax, double alpha,
+  /* double pointers */
+  double* _dt,
+  /* arrays */
+  double* tt, double* y0, double* y1, double* y2, double* dy1,
+  double* dy2, double* f, double* tmp, double* FF,
+  double* A, double* out, double* bb1, double* bb2, double* cc,
+  double* atol, double* rtol, double* yknots, double* yout,
+  /* SEXPs */
+  SEXP Func, SEXP Parms, SEXP Rho
+);
+
+/*==========================================================================*/
+/* stiffness detection: rk switches from an explicit method with variable   */
+/* step size to an implicit method in stiff phases and back (rk_stiff.c)    */
+/*==========================================================================*/
+
+struct rk_switch {
+  double bound;    /* stability boundary of the explicit method (real axis) */
+  double rho;      /* spectral radius of the Jacobian (implicit method)     */
+  double *ys;      /* inputs of the last two stages (explicit method)       */
+  double *x;       /* workspace of the power iteration, 2 * neq             */
+  double t;        /* time reached by the last call of the integrator       */
+  int    stiff;    /* TRUE: the implicit method is active                   */
+  int    switched; /* the last call stopped for a switch of the method      */
+  int    nstiff, nonstiff;  /* successive steps (not) detected as stiff    */
+  int    nswitch, nsteps[2]; /* switches, steps with each method           */
+  /* the implicit method and its workspace */
+  irk_data *irk;
+  int    stage, nknots, iknots;
+  double *A, *bb1, *cc;
+  double *FF, *tmp, *tmp2, *tmp3, *yknots;
+};
+
+rk_switch *rk_stiffinit(SEXP Stiff, int neq, int stage, double *A,
+  double *bb, int nknots);
+
+int rk_stiffexpl(rk_switch *sw, double dt, double *FF, int stage, int neq);
+
+int rk_stiffimpl(rk_switch *sw, double dt);
+
+double rk_specrad(double *J, int neq, double *x);
+
+void rk_autoswitch(deSolve_context *ctx,
+  /* integers */
+  int fsal, int neq, int stage,
+  int isDll, int isForcing, int verbose,
+  int nknots, int interpolate, int densetype, int maxsteps, int nt,
+  /* int pointers */
+  int* _iknots, int* _it, int* _it_ext, int* _it_tot, int *_it_rej,
+  int* istate,  int* ipar,
+  /* double */
+  double t, double tmax, double hmin, double hmax,
+  double alpha, double beta,
+  /* double pointers */
+  double* _dt, double* _errold,
+  /* arrays */
+  double* tt, double* y0, double* y1, double* y2, double* dy1, double* dy2,
+  double* f, double* y, double* Fj, double* tmp,
+  double* FF, double* rr, double* A, double* out,
+  double* bb1, double* bb2, double* cc, double* dd,
+  double* atol, double* rtol, double* yknots, double* yout,
+  /* SEXPs */
+  SEXP Func, SEXP Parms, SEXP Rho
+ );
+
+/*==========================================================================*/
+/* root finding for the explicit methods (rk_root.c)                        */
+/*==========================================================================*/
+
+/* compiled root function or the interface to R, as in lsodar */
+typedef void rk_root_func_type(int *, double *, double *, int *, double *);
+
+struct rk_root {
+  rk_root_func_type *func;
+  int    nroot;      /* number of root functions                           */
+  double *gout, *gold;  /* root functions at the end and start of the step */
+  double *gtmp, *tr; /* workspace of brent, roots of the root functions    */
+  int    *jroot;     /* root functions with a root at troot                */
+  int    iroot;      /* root function searched by brent                    */
+  double t0, dt, *y0, *f0, *y1, *f1;  /* step of the Hermite interpolant   */
+  double *ytmp;
+  double troot;      /* earliest root in the last step                     */
+  double dtnext;     /* step size proposed before the step to the root     */
+  int    found;      /* a root was found, the step is taken up to troot    */
+  int    endsim;     /* the integration stops at troot                     */
+  int    nr_root;    /* number of roots with events                        */
+};
+
+rk_root *rk_rootinit(deSolve_context *ctx, SEXP Rootfunc, int nroot, int neq);
+
+void rk_rootstart(rk_root *rt, double t, double *y0, int neq);
+
+int rk_rootfind(rk_root *rt, double t, double dt, double *y0, double *f0,
+  double *y1, double *f1, int neq);
+
+int rk_rootevent(deSolve_context *ctx, rk_root *rt, double t, double *y0);
+
+SEXP rk_rootout(deSolve_context *ctx, rk_root *rt, SEXP R_yout,
+  int nt, int nrow, int ncol);
+
+/*==========================================================================*/
+/* reductions over the accepted steps of the explicit methods (rk_reduce.c) */
+/*==========================================================================*/
+
+struct rk_reduce {
+  int    neq;
+  int    dense;      /* quadrature with the Hermite interpolant of the states */
+  int    nint, nmin, nmax, nmean;  /* number of variables of each reduction */
+  int    *iint, *imin, *imax, *imean;  /* positions in (states, outputs)  */
+  int    needout;    /* global outputs are needed                           */
+  int    nwin, iwin; /* windows of the means, first window of the next step */
+  double *win;       /* nwin + 1 bounds of the windows                      */
+  double *integral;  /* integrals over all steps                            */
+  double *vmin, *tmin, *vmax, *tmax;  /* extremes and their times           */
+  double *sum, *len; /* integrals and covered lengths of the windows       */
+  /* the step: values and derivatives of the states, outputs at both ends  */
+  double t0, dt, *y0, *y1, *f0, *f1, *out0, *out1;
+};
+
+rk_reduce *rk_reduceinit(SEXP Reduce, int neq);
+
+void rk_reducestep(rk_reduce *rd, double t, double dt, double *y0,
+  double *y1, double *f0, double *f1, double *out0, double *out1);
+
+SEXP rk_reduceout(rk_reduce *rd);
@@ -0,0 +1,259 @@
+/* output sinks: results pushed in chunks instead of one output matrix */
+
+#include <stdio.h>
+#include <string.h>
+#ifndef _WIN32
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+#include "deSolve.h"
+#include "externalptr.h"
+
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+   Output sinks
+
+   Instead of allocating the full output matrix (rows = output times,
+   columns = time, states and global outputs) before the integration, a
+   solver fills a buffer of "nrow" rows and passes each full chunk to the
+   sink, so that long simulations run in bounded memory and the results can
+   be consumed while the solver is still running.
+
+   "initSink" creates the sink from an R-list (see checksink in R):
+     type 1: a compiled function void sink(int *nrow, int *ncol, double *x),
+             x is the chunk in column-major order;
+     type 2: an R function, called with the chunk as a matrix;
+     type 3: a ring buffer that keeps only the last "nrow" rows;
+     type 4: a binary file, written column by column (see outfile.R): a
+             header of "offset" bytes (with the output times), then the
+             columns of "nmax" rows each. The columns of the chunks are
+             written at their position in the file (pwrite, stdio on
+             Windows), so that only the rows of a chunk are touched and
+             the file is never mapped as a whole; the file is opened and
+             closed per chunk, so nothing is left open after an error;
+     type 5: the output matrix of the solver ("matrixSink"), used for
+             argument keep without a sink.
+   With argument keep (ctx->keep), only the time and the kept columns of
+   the chunks are passed on.
+   "pushSink" passes a chunk to the sink, "sinkResult" returns the matrix
+   that the solver returns to R: the last rows (type 3) or the last row.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+#ifdef _WIN32
+# define sink_fseek(f, pos) _fseeki64(f, (long long)(pos), SEEK_SET)
+#endif
+
+/* the columns of ctx->keep */
+static void initSinkKeep(deSolve_context *ctx, out_sink *sk, int ncol) {
+  sk->ncolin = ncol;
+  sk->keep   = ctx->keep;
+  sk->nkeep  = 0;
+  sk->kbuf   = NULL;
+  sk->Rmat   = R_NilValue;
+  if (sk->keep != NULL) {
+    sk->nkeep = ctx->nkeep;
+    sk->ncol  = sk->nkeep + 1;
+    sk->kbuf  = (double *) R_alloc(sk->nrow * sk->ncol, sizeof(double));
+  }
+}
+
+/* size of the output file: header and nmax rows of all columns */
+static double sinkFileSize(out_sink *sk) {
+  return sk->offset + sizeof(double) * (double)sk->nmax * sk->ncol;
+}
+
+static void initSinkFile(out_sink *sk, SEXP Sink) {
+  const char *fn = R_ExpandFileName(
+    translateChar(STRING_ELT(getListElement(Sink, "file"), 0)));
+  FILE *f;
+  int ok;
+
+  sk->file   = (char *) R_alloc(strlen(fn) + 1, sizeof(char));
+  strcpy(sk->file, fn);
+  sk->nmax   = INTEGER(getListElement(Sink, "nmax"))[0];
+  sk->offset = REAL(getListElement(Sink, "offset"))[0];
+
+  /* the header is written by R; the file is extended to its final size */
+  f = fopen(sk->file, "r+b");
+  if (f == NULL) error("cannot open output file %s", sk->file);
+#ifdef _WIN32
+  ok = (sink_fseek(f, sinkFileSize(sk) - 1) == 0 && fputc(0, f) != EOF);
+#else
+  ok = (ftruncate(fileno(f), (off_t) sinkFileSize(sk)) == 0);
+#endif
+  fclose(f);
+  if (!ok) error("cannot resize output file %s", sk->file);
+}
+
+/* rows ntot ... ntot + nrow - 1 of all columns, written column by column
+   at their position in the file (pwrite, or fseek and fwrite on Windows) */
+static void pushSinkFile(out_sink *sk, double *x, int nrow, int ld) {
+  int j;
+
+  if (sk->ntot + nrow > sk->nmax)
+    error("more rows than output times in output file %s", sk->file);
+#ifndef _WIN32
+  int fd = open(sk->file, O_WRONLY);
+  int ok = (fd >= 0);
+  size_t len, done;
+  ssize_t w;
+  char *buf;
+  off_t fpos;
+
+  for (j = 0; ok && j < sk->ncol; j++) {
+    fpos = (off_t) sk->offset +
+           (off_t) sizeof(double) * ((off_t) sk->nmax * j + sk->ntot);
+    buf = (char *) (x + (size_t) ld * j);
+    len = nrow * sizeof(double);
+    for (done = 0; ok && done < len; done += w) {
+      w = pwrite(fd, buf + done, len - done, fpos + (off_t) done);
+      ok = (w > 0);
+    }
+  }
+  if (fd >= 0) close(fd);
+  if (!ok) error("cannot write output file %s", sk->file);
+#else
+  FILE *f = fopen(sk->file, "r+b");
+  int ok = (f != NULL);
+  long long pos;
+
+  for (j = 0; ok && j < sk->ncol; j++) {
+    pos = (long long) sk->offset +
+          (long long) sizeof(double) * ((long long) sk->nmax * j + sk->ntot);
+    ok = (sink_fseek(f, pos) == 0 &&
+          fwrite(x + (size_t) ld * j, sizeof(double), nrow, f) == (size_t) nrow);
+  }
+  if (f != NULL) fclose(f);
+  if (!ok) error("cannot write output file %s", sk->file);
+#endif
+}
+
+out_sink *initSink(deSolve_context *ctx, SEXP Sink, int ncol) {
+  SEXP Func;
+  out_sink *sk;
+  int i;
+
+  sk = (out_sink *) R_alloc(1, sizeof(out_sink));
+  sk->type  = INTEGER(getListElement(Sink, "type"))[0];
+  sk->nrow  = INTEGER(getListElement(Sink, "nrow"))[0];
+  sk->ncol  = ncol;
+  initSinkKeep(ctx, sk, ncol);
+  ncol = sk->ncol;
+  sk->ntot  = 0;
+  sk->iring = 0;
+  sk->cfun  = NULL;
+  sk->Rfun  = R_NilValue;
+  sk->ring  = NULL;
+  sk->file  = NULL;
+
+  Func = getListElement(Sink, "func");
+  if (sk->type == 1) {
+    sk->cfun = (sink_func_type *) R_ExternalPtrAddrFn_(Func);
+  } else if (sk->type == 2) {
+    sk->Rfun = Func;
+  } else if (sk->type == 4) {
+    initSinkFile(sk, Sink);
+  } else {
+    sk->ring = (double *) R_alloc(sk->nrow * ncol, sizeof(double));
+    for (i = 0; i < sk->nrow * ncol; i++) sk->ring[i] = NA_REAL;
+  }
+  /* the last row, returned by the callbacks */
+  sk->last = (double *) R_alloc(ncol, sizeof(double));
+  for (i = 0; i < ncol; i++) sk->last[i] = NA_REAL;
+  return(sk);
+}
+
+/* the rows of the output matrix Yout (nmax x ncol, initialized by the
+   solver), filled in chunks of nrow rows with the kept columns */
+out_sink *matrixSink(deSolve_context *ctx, SEXP Yout, int nrow, int ncol) {
+  out_sink *sk = (out_sink *) R_alloc(1, sizeof(out_sink));
+
+  sk->type  = 5;
+  sk->nrow  = nrow;
+  sk->ncol  = ncol;
+  sk->ntot  = 0;
+  sk->iring = 0;
+  sk->cfun  = NULL;
+  sk->ring  = NULL;
+  sk->file  = NULL;
+  sk->Rfun  = R_NilValue;
+  initSinkKeep(ctx, sk, ncol);
+  sk->Rmat  = Yout;
+  sk->nmax  = nrows(Yout);
+  sk->last  = (double *) R_alloc(sk->ncol, sizeof(double));
+  return(sk);
+}
+
+/* a chunk of nrow rows (at most sk->nrow), stored with leading dimension
+   ld; the last chunk of a solver may be shorter than the others */
+void pushSink(deSolve_context *ctx, out_sink *sk, double *x, int nrow,
+              int ld) {
+  int i, j, ncol = sk->ncol;
+  SEXP X, R_fcall;
+
+  if (nrow < 1) return;
+  if (nrow > sk->nrow)
+    error("chunk of %d rows for a sink of %d rows", nrow, sk->nrow);
+  if (sk->keep != NULL) {    /* time and the kept columns */
+    for (i = 0; i < nrow; i++) sk->kbuf[i] = x[i];
+    for (j = 0; j < sk->nkeep; j++)
+      for (i = 0; i < nrow; i++)
+        sk->kbuf[i + nrow * (j + 1)] = x[i + ld * (sk->keep[j] + 1)];
+    x  = sk->kbuf;
+    ld = nrow;
+  }
+  for (j = 0; j < ncol; j++) sk->last[j] = x[nrow - 1 + ld * j];
+  if (sk->type == 4) pushSinkFile(sk, x, nrow, ld);
+  sk->ntot += nrow;
+
+  if (sk->type == 1) {
+    if (ld == nrow) {
+      sk->cfun(&nrow, &ncol, x);
+    } else {
+      double *xx = (double *) R_alloc(nrow * ncol, sizeof(double));
+      for (j = 0; j < ncol; j++)
+        for (i = 0; i < nrow; i++) xx[i + nrow * j] = x[i + ld * j];
+      sk->cfun(&nrow, &ncol, xx);
+    }
+  } else if (sk->type == 2) {
+    PROTECT(X = allocMatrix(REALSXP, nrow, ncol));
+    for (j = 0; j < ncol; j++)
+      for (i = 0; i < nrow; i++) REAL(X)[i + nrow * j] = x[i + ld * j];
+    PROTECT(R_fcall = lang2(sk->Rfun, X));
+    ctx_eval(ctx, R_fcall, R_GlobalEnv);
+    UNPROTECT(2);
+  } else if (sk->type == 5) {
+    if (sk->ntot > sk->nmax) error("more rows than output times");
+    for (j = 0; j < ncol; j++)
+      for (i = 0; i < nrow; i++)
+        REAL(sk->Rmat)[sk->ntot - nrow + i + sk->nmax * j] = x[i + ld * j];
+  } else if (sk->type == 3) {
+    for (i = 0; i < nrow; i++) {
+      for (j = 0; j < ncol; j++)
+        sk->ring[sk->iring + sk->nrow * j] = x[i + ld * j];
+      sk->iring = (sk->iring + 1) % sk->nrow;
+    }
+  }
+}
+
+/* the rows returned to R, in the order of time */
+SEXP sinkResult(out_sink *sk) {
+  int i, j, k, nr;
+  SEXP R_yout;
+
+  if (sk->type == 5) return(sk->Rmat);
+  if (sk->type == 3) {
+    nr = (sk->ntot < sk->nrow) ? sk->ntot : sk->nrow;
+    PROTECT(R_yout = allocMatrix(REALSXP, nr, sk->ncol));
+    for (i = 0; i < nr; i++) {
+      k = (sk->iring - nr + i + sk->nrow) % sk->nrow;
+      for (j = 0; j < sk->ncol; j++)
+        REAL(R_yout)[i + nr * j] = sk->ring[k + sk->nrow * j];
+    }
+  } else {
+    PROTECT(R_yout = allocMatrix(REALSXP, 1, sk->ncol));
+    for (j = 0; j < sk->ncol; j++) REAL(R_yout)[j] = sk->last[j];
+  }
+  setAttrib(R_yout, install("nsink"), ScalarInteger(sk->ntot));
+  UNPROTECT(1);
+  return(R_yout);
+}
@@ -0,0 +1,615 @@
+/*==========================================================================*/
+/* Sparse LU decomposition for radau5 (jactype "sparseint")                 */
+/*                                                                          */
+/* In each step with a new Jacobian or step size, radau5 decomposes the     */
+/* real matrix E1 = fac1 * M - J and the complex matrix                     */
+/* E2 = (alphn + i betan) * M - J, M is the mass matrix or the identity.    */
+/* With a sparse Jacobian, both are stored and decomposed here; the         */
+/* routines DECSPR, DECSPC, SOLSPR, SOLSPC and MULSPM are called from       */
+/* radau5a.f (IJOB = 8: no mass matrix, IJOB = 9: mass matrix).             */
+/*                                                                          */
+/* The symbolic analysis is done once per call of radau: the pattern of E   */
+/* (Jacobian, diagonal and mass matrix) and a fill-reducing order of the    */
+/* columns (reverse Cuthill-McKee). The first decomposition is a            */
+/* left-looking LU with partial pivoting (Gilbert and Peierls, 1988); the   */
+/* following ones reuse its pivot sequence and the patterns of L and U and  */
+/* only compute new values. If a pivot becomes too small, the decomposition */
+/* with pivoting is repeated.                                               */
+/*==========================================================================*/
+
+#include <string.h>
+#include "deSolve.h"
+
+/* relative size of a pivot that is accepted without row interchange */
+#define PIVTOL 0.001
+
+typedef struct splu_factor {
+  int     lmax, umax;             /* allocated length of L and U */
+  int     valid;                  /* pivots and patterns can be reused */
+  int    *Lp, *Li, *Up, *Ui, *pinv;
+  double *Lx, *Lz, *Ux, *Uz;      /* Lz, Uz: imaginary parts (complex E2) */
+} splu_factor;
+
+struct splu_data {
+  int     n, nz, nzj;
+  int    *Ep, *Ei, *jmap, *q;     /* pattern of E (0-based), J -> E, order */
+  double *Bx, *Ex, *Ez;           /* mass matrix, E (real, imaginary part) */
+  double *x, *z;                  /* dense work vectors */
+  int    *xi, *pstack, *mark;
+  splu_factor re, cx;
+};
+
+/*==========================================================================*/
+/* initialisation, called by call_radau; the Jacobian (cpr_spjac) is put in */
+/* cpr->jx, the symbolic analysis waits for the mass matrix (first DECSPR)  */
+/*==========================================================================*/
+
+void initSparseLU(deSolve_context *ctx) {
+  cpr_data *cpr = ctx->cpr;
+  splu_data *lu;
+
+  lu = (splu_data *) R_alloc(1, sizeof(splu_data));
+  memset(lu, 0, sizeof(splu_data));
+  lu->n   = cpr->n;
+  lu->nzj = cpr->ian[cpr->n] - 1;
+  cpr->jx = (double *) R_alloc(lu->nzj, sizeof(double));
+
+  ctx->splu = lu;
+}
+
+/*==========================================================================*/
+/* reverse Cuthill-McKee order of the columns, on the pattern of E + E'     */
+/*==========================================================================*/
+
+/* level structure rooted at 'root', returns the number of levels; *last is */
+/* a node of minimum degree in the last level                               */
+static int rcmLevels(int root, int *Sp, int *Si, int *mark, int stamp,
+                     int *ls, int *last) {
+  int head = 0, tail = 1, lstart = 0, lend, nlev = 0, i, j, p, deg, mindeg;
+
+  ls[0] = root;
+  mark[root] = stamp;
+  while (head < tail) {
+    lstart = head;
+    lend   = tail;
+    nlev++;
+    for (; head < lend; head++) {
+      i = ls[head];
+      for (p = Sp[i]; p < Sp[i + 1]; p++) {
+        j = Si[p];
+        if (mark[j] != stamp) {
+          mark[j] = stamp;
+          ls[tail++] = j;
+        }
+      }
+    }
+  }
+  *last  = ls[lstart];
+  mindeg = Sp[ls[lstart] + 1] - Sp[ls[lstart]];
+  for (i = lstart + 1; i < tail; i++) {
+    deg = Sp[ls[i] + 1] - Sp[ls[i]];
+    if (deg < mindeg) {
+      mindeg = deg;
+      *last = ls[i];
+    }
+  }
+  return(nlev);
+}
+
+static void rcmOrder(splu_data *lu, int *q) {
+  int i, j, k, p, m, n = lu->n, root, last, last2, nlev, nlev2, it, stamp = 0;
+  int head, start, deg, *Sp, *Si, *mark, *ls, *perm, *done;
+
+  /* symmetric pattern without diagonal, duplicates removed */
+  Sp   = (int *) R_alloc(n + 1, sizeof(int));
+  mark = (int *) R_alloc(n, sizeof(int));
+  for (i = 0; i <= n; i++) Sp[i] = 0;
+  for (j = 0; j < n; j++)
+    for (p = lu->Ep[j]; p < lu->Ep[j + 1]; p++)
+      if ((i = lu->Ei[p]) != j) {
+        Sp[i + 1]++;
+        Sp[j + 1]++;
+      }
+  for (i = 0; i < n; i++) Sp[i + 1] += Sp[i];
+  Si = (int *) R_alloc(Sp[n] + 1, sizeof(int));
+  for (i = 0; i < n; i++) mark[i] = Sp[i];
+  for (j = 0; j < n; j++)
+    for (p = lu->Ep[j]; p < lu->Ep[j + 1]; p++)
+      if ((i = lu->Ei[p]) != j) {
+        Si[mark[i]++] = j;
+        Si[mark[j]++] = i;
+      }
+  for (i = 0; i < n; i++) mark[i] = -1;
+  m = 0;
+  start = Sp[0];
+  for (i = 0; i < n; i++) {
+    k = Sp[i + 1];
+    Sp[i] = m;
+    for (p = start; p < k; p++) {
+      j = Si[p];
+      if (mark[j] != i) {
+        mark[j] = i;
+        Si[m++] = j;
+      }
+    }
+    start = k;
+  }
+  Sp[n] = m;
+
+  /* Cuthill-McKee, for each connected component from a pseudo-peripheral */
+  /* node (George and Liu), then reversed                                 */
+  ls   = (int *) R_alloc(n, sizeof(int));
+  perm = (int *) R_alloc(n, sizeof(int));
+  done = (int *) R_alloc(n, sizeof(int));
+  for (i = 0; i < n; i++) {
+    mark[i] = 0;
+    done[i] = 0;
+  }
+  k = 0;
+  for (i = 0; i < n; i++) {
+    if (done[i]) continue;
+    root = i;
+    nlev = rcmLevels(root, Sp, Si, mark, ++stamp, ls, &last);
+    for (it = 0; it < 10; it++) {
+      nlev2 = rcmLevels(last, Sp, Si, mark, ++stamp, ls, &last2);
+      if (nlev2 <= nlev) break;
+      root = last;
+      nlev = nlev2;
+      last = last2;
+    }
+    head = k;
+    perm[k++] = root;
+    done[root] = 1;
+    while (head < k) {
+      j = perm[head++];
+      start = k;
+      for (p = Sp[j]; p < Sp[j + 1]; p++)
+        if (! done[Si[p]]) {
+          done[Si[p]] = 1;
+          perm[k++] = Si[p];
+        }
+      /* neighbours by increasing degree (insertion sort) */
+      for (m = start + 1; m < k; m++) {
+        int node = perm[m];
+        deg = Sp[node + 1] - Sp[node];
+        for (p = m; p > start && Sp[perm[p - 1] + 1] - Sp[perm[p - 1]] > deg; p--)
+          perm[p] = perm[p - 1];
+        perm[p] = node;
+      }
+    }
+  }
+  for (i = 0; i < n; i++) q[i] = perm[n - 1 - i];
+}
+
+/*==========================================================================*/
+/* symbolic analysis: pattern of E = J + diagonal + mass matrix, position   */
+/* of the Jacobian elements in E, values of the mass matrix, column order   */
+/*==========================================================================*/
+
+/* element (i, j) of the mass matrix, full or banded storage as in radau5, */
+/* and the range of rows of column j                                       */
+#define MAS(i, j)  (banded ? fmas[(i) - (j) + mumas + (j) * ldmas] : fmas[(i) + (j) * ldmas])
+#define MASLO(j)   (banded && (j) > mumas ? (j) - mumas : 0)
+#define MASHI(j)   (banded && (j) + mlmas < n - 1 ? (j) + mlmas : n - 1)
+
+static void luSymbolic(deSolve_context *ctx, double *fmas, int ldmas,
+                       int mlmas, int mumas, int mass) {
+  splu_data *lu = ctx->splu;
+  cpr_data *cpr = ctx->cpr;
+  int i, j, m, p, n = lu->n, nzmax, banded, *mark;
+
+  banded = (mlmas < n);
+  nzmax  = lu->nzj + n;
+  if (mass)
+    for (j = 0; j < n; j++)
+      for (i = MASLO(j); i <= MASHI(j); i++)
+        if (MAS(i, j) != 0.) nzmax++;
+
+  lu->Ep   = (int *) R_alloc(n + 1, sizeof(int));
+  lu->Ei   = (int *) R_alloc(nzmax, sizeof(int));
+  lu->jmap = (int *) R_alloc(lu->nzj, sizeof(int));
+  mark     = (int *) R_alloc(n, sizeof(int));
+  for (i = 0; i < n; i++) mark[i] = -1;
+
+  p = 0;
+  for (j = 0; j < n; j++) {
+    lu->Ep[j] = p;
+    for (m = cpr->ian[j] - 1; m < cpr->ian[j + 1] - 1; m++) {
+      i = cpr->jan[m] - 1;
+      if (mark[i] < lu->Ep[j]) {
+        mark[i] = p;
+        lu->Ei[p++] = i;
+      }
+      lu->jmap[m] = mark[i];
+    }
+    if (mark[j] < lu->Ep[j]) {
+      mark[j] = p;
+      lu->Ei[p++] = j;
+    }
+    if (mass)
+      for (i = MASLO(j); i <= MASHI(j); i++)
+        if (MAS(i, j) != 0. && mark[i] < lu->Ep[j]) {
+          mark[i] = p;
+          lu->Ei[p++] = i;
+        }
+  }
+  lu->Ep[n] = p;
+  lu->nz    = p;
+
+  /* mass matrix (or identity) on the pattern of E */
+  lu->Bx = (double *) R_alloc(lu->nz, sizeof(double));
+  for (j = 0; j < n; j++)
+    for (p = lu->Ep[j]; p < lu->Ep[j + 1]; p++) {
+      i = lu->Ei[p];
+      if (! mass)
+        lu->Bx[p] = (i == j) ? 1. : 0.;
+      else
+        lu->Bx[p] = (i < MASLO(j) || i > MASHI(j)) ? 0. : MAS(i, j);
+    }
+
+  lu->Ex = (double *) R_alloc(lu->nz, sizeof(double));
+  lu->Ez = (double *) R_alloc(lu->nz, sizeof(double));
+  lu->x  = (double *) R_alloc(n, sizeof(double));
+  lu->z  = (double *) R_alloc(n, sizeof(double));
+  lu->xi     = (int *) R_alloc(n, sizeof(int));
+  lu->pstack = (int *) R_alloc(n, sizeof(int));
+  lu->mark   = (int *) R_alloc(n, sizeof(int));
+  lu->q      = (int *) R_alloc(n, sizeof(int));
+  rcmOrder(lu, lu->q);
+
+  lu->re.pinv = (int *) R_alloc(n, sizeof(int));
+  lu->cx.pinv = (int *) R_alloc(n, sizeof(int));
+  lu->re.Lp = (int *) R_alloc(n + 1, sizeof(int));
+  lu->re.Up = (int *) R_alloc(n + 1, sizeof(int));
+  lu->cx.Lp = (int *) R_alloc(n + 1, sizeof(int));
+  lu->cx.Up = (int *) R_alloc(n + 1, sizeof(int));
+}
+
+/* (re)allocation of L or U, the first nz elements are kept                 */
+static void luGrow(int **Xi, double **Xx, double **Xz, int nz, int *nzmax,
+                   int newmax, int cplx) {
+  int p, *Ti;
+  double *Tx, *Tz = NULL;
+
+  Ti = (int *) R_alloc(newmax, sizeof(int));
+  Tx = (double *) R_alloc(newmax, sizeof(double));
+  if (cplx) Tz = (double *) R_alloc(newmax, sizeof(double));
+  for (p = 0; p < nz; p++) {
+    Ti[p] = (*Xi)[p];
+    Tx[p] = (*Xx)[p];
+    if (cplx) Tz[p] = (*Xz)[p];
+  }
+  *Xi = Ti;
+  *Xx = Tx;
+  *Xz = Tz;
+  *nzmax = newmax;
+}
+
+/*==========================================================================*/
+/* decomposition with partial pivoting (left-looking): column k of L and U  */
+/* from the sparse triangular solve L x = E(:, q[k]), the nonzero pattern   */
+/* of x is the set of rows reachable in the graph of L (depth-first search) */
+/*==========================================================================*/
+
+static int luReach(splu_data *lu, splu_factor *F, int col, int stamp) {
+  int i, j, p, p2, jnew, head, done, top = lu->n;
+  int *xi = lu->xi, *pstack = lu->pstack, *mark = lu->mark, *pinv = F->pinv;
+
+  for (p = lu->Ep[col]; p < lu->Ep[col + 1]; p++) {
+    if (mark[lu->Ei[p]] == stamp) continue;
+    /* depth-first search from row Ei[p]; the stack grows from xi[0], */
+    /* finished rows are put at xi[--top] in topological order        */
+    head  = 0;
+    xi[0] = lu->Ei[p];
+    while (head >= 0) {
+      j    = xi[head];
+      jnew = pinv[j];
+      if (mark[j] != stamp) {
+        mark[j] = stamp;
+        pstack[head] = (jnew < 0) ? 0 : F->Lp[jnew];
+      }
+      done = 1;
+      p2 = (jnew < 0) ? 0 : F->Lp[jnew + 1];
+      for (; pstack[head] < p2; pstack[head]++) {
+        i = F->Li[pstack[head]];
+        if (mark[i] == stamp) continue;
+        xi[++head] = i;
+        done = 0;
+        break;
+      }
+      if (done) {
+        head--;
+        xi[--top] = j;
+      }
+    }
+  }
+  return(top);
+}
+
+static int luFactor(splu_data *lu, splu_factor *F, double *Ax, double *Az) {
+  int i, j, k, p, pp, J, top, col, ipiv, lnz = 0, unz = 0, n = lu->n;
+  int cplx = (Az != NULL), *pinv = F->pinv, *xi = lu->xi;
+  double *x = lu->x, *z = lu->z, a, t, pr, pz, d, xr, xz;
+
+  if (F->lmax == 0) {
+    luGrow(&F->Li, &F->Lx, &F->Lz, 0, &F->lmax, 4 * lu->nz + n, cplx);
+    luGrow(&F->Ui, &F->Ux, &F->Uz, 0, &F->umax, 4 * lu->nz + n, cplx);
+  }
+  for (i = 0; i < n; i++) {
+    x[i] = 0.;
+    z[i] = 0.;
+    pinv[i] = -1;
+    lu->mark[i] = -1;
+  }
+  F->valid = 0;
+
+  for (k = 0; k < n; k++) {
+    F->Lp[k] = lnz;
+    F->Up[k] = unz;
+    if (lnz + n > F->lmax)
+      luGrow(&F->Li, &F->Lx, &F->Lz, lnz, &F->lmax, 2 * F->lmax + n, cplx);
+    if (unz + n > F->umax)
+      luGrow(&F->Ui, &F->Ux, &F->Uz, unz, &F->umax, 2 * F->umax + n, cplx);
+
+    /* x = L \ E(:, col) */
+    col = lu->q[k];
+    top = luReach(lu, F, col, k);
+    for (p = lu->Ep[col]; p < lu->Ep[col + 1]; p++) {
+      x[lu->Ei[p]] = Ax[p];
+      if (cplx) z[lu->Ei[p]] = Az[p];
+    }
+    for (p = top; p < n; p++) {
+      j = xi[p];
+      if ((J = pinv[j]) < 0) continue;
+      xr = x[j];
+      if (cplx) {
+        xz = z[j];
+        for (pp = F->Lp[J] + 1; pp < F->Lp[J + 1]; pp++) {
+          i = F->Li[pp];
+          x[i] -= F->Lx[pp] * xr - F->Lz[pp] * xz;
+          z[i] -= F->Lx[pp] * xz + F->Lz[pp] * xr;
+        }
+      } else
+        for (pp = F->Lp[J] + 1; pp < F->Lp[J + 1]; pp++)
+          x[F->Li[pp]] -= F->Lx[pp] * xr;
+    }
+
+    /* pivot: the largest of the rows that are not yet pivotal, the */
+    /* diagonal element if it is not too small                      */
+    ipiv = -1;
+    a = -1.;
+    for (p = top; p < n; p++) {
+      i = xi[p];
+      if (pinv[i] < 0) {
+        t = fabs(x[i]) + fabs(z[i]);
+        if (t > a) {
+          a = t;
+          ipiv = i;
+        }
+      } else {
+        F->Ui[unz] = pinv[i];
+        F->Ux[unz] = x[i];
+        if (cplx) F->Uz[unz] = z[i];
+        unz++;
+      }
+    }
+    if (ipiv == -1 || a <= 0.) {
+      for (p = top; p < n; p++) x[xi[p]] = z[xi[p]] = 0.;
+      return(k + 1);
+    }
+    if (pinv[col] < 0 && fabs(x[col]) + fabs(z[col]) >= a * PIVTOL) ipiv = col;
+
+    /* diagonal of U last, then column k of L, the pivot row first */
+    pr = x[ipiv];
+    pz = z[ipiv];
+    F->Ui[unz] = k;
+    F->Ux[unz] = pr;
+    if (cplx) F->Uz[unz] = pz;
+    unz++;
+    pinv[ipiv] = k;
+    F->Li[lnz] = ipiv;
+    F->Lx[lnz] = 1.;
+    if (cplx) F->Lz[lnz] = 0.;
+    lnz++;
+    d = pr * pr + pz * pz;
+    for (p = top; p < n; p++) {
+      i = xi[p];
+      if (pinv[i] < 0) {
+        F->Li[lnz] = i;
+        if (cplx) {
+          F->Lx[lnz] = (x[i] * pr + z[i] * pz) / d;
+          F->Lz[lnz] = (z[i] * pr - x[i] * pz) / d;
+        } else
+          F->Lx[lnz] = x[i] / pr;
+        lnz++;
+      }
+      x[i] = 0.;
+      z[i] = 0.;
+    }
+  }
+  F->Lp[n] = lnz;
+  F->Up[n] = unz;
+  for (p = 0; p < lnz; p++) F->Li[p] = pinv[F->Li[p]];
+  F->valid = 1;
+  return(0);
+}
+
+/*==========================================================================*/
+/* decomposition with the pivots and patterns of the previous one; returns  */
+/* 1 if a pivot is too small                                                */
+/*==========================================================================*/
+
+static int luRefactor(splu_data *lu, splu_factor *F, double *Ax, double *Az) {
+  int i, k, p, pp, J, n = lu->n, cplx = (Az != NULL), *pinv = F->pinv;
+  double *x = lu->x, *z = lu->z, a, pr, pz, d, xr, xz;
+
+  for (i = 0; i < n; i++) {
+    x[i] = 0.;
+    z[i] = 0.;
+  }
+  for (k = 0; k < n; k++) {
+    for (p = lu->Ep[lu->q[k]]; p < lu->Ep[lu->q[k] + 1]; p++) {
+      x[pinv[lu->Ei[p]]] = Ax[p];
+      if (cplx) z[pinv[lu->Ei[p]]] = Az[p];
+    }
+    /* U(:, k) in the order of the first decomposition (topological) */
+    for (p = F->Up[k]; p < F->Up[k + 1] - 1; p++) {
+      J  = F->Ui[p];
+      xr = x[J];
+      xz = z[J];
+      F->Ux[p] = xr;
+      x[J] = 0.;
+      if (cplx) {
+        F->Uz[p] = xz;
+        z[J] = 0.;
+        for (pp = F->Lp[J] + 1; pp < F->Lp[J + 1]; pp++) {
+          i = F->Li[pp];
+          x[i] -= F->Lx[pp] * xr - F->Lz[pp] * xz;
+          z[i] -= F->Lx[pp] * xz + F->Lz[pp] * xr;
+        }
+      } else
+        for (pp = F->Lp[J] + 1; pp < F->Lp[J + 1]; pp++)
+          x[F->Li[pp]] -= F->Lx[pp] * xr;
+    }
+    pr = x[k];
+    pz = z[k];
+    x[k] = z[k] = 0.;
+    F->Ux[F->Up[k + 1] - 1] = pr;
+    if (cplx) F->Uz[F->Up[k + 1] - 1] = pz;
+
+    a = 0.;
+    for (pp = F->Lp[k] + 1; pp < F->Lp[k + 1]; pp++) {
+      i = F->Li[pp];
+      a = fmax(a, fabs(x[i]) + fabs(z[i]));
+    }
+    if (fabs(pr) + fabs(pz) <= a * PIVTOL || (pr == 0. && pz == 0.)) {
+      F->valid = 0;
+      return(1);
+    }
+    d = pr * pr + pz * pz;
+    for (pp = F->Lp[k] + 1; pp < F->Lp[k + 1]; pp++) {
+      i = F->Li[pp];
+      if (cplx) {
+        F->Lx[pp] = (x[i] * pr + z[i] * pz) / d;
+        F->Lz[pp] = (z[i] * pr - x[i] * pz) / d;
+      } else
+        F->Lx[pp] = x[i] / pr;
+      x[i] = z[i] = 0.;
+    }
+  }
+  return(0);
+}
+
+static int luDecomp(splu_data *lu, splu_factor *F, double *Ax, double *Az) {
+  if (F->valid && luRefactor(lu, F, Ax, Az) == 0) return(0);
+  return(luFactor(lu, F, Ax, Az));
+}
+
+/* solution of E x = b, b is overwritten by x (br, bi in the complex case)  */
+static void luSolve(splu_data *lu, splu_factor *F, double *br, double *bi) {
+  int i, j, p, n = lu->n, cplx = (bi != NULL);
+  double *x = lu->x, *z = lu->z, xr, xz, ur, uz, d;
+
+  for (i = 0; i < n; i++) {
+    x[F->pinv[i]] = br[i];
+    z[F->pinv[i]] = cplx ? bi[i] : 0.;
+  }
+  /* L is unit lower triangular, the diagonal is the first element */
+  for (j = 0; j < n; j++) {
+    xr = x[j];
+    xz = z[j];
+    if (cplx)
+      for (p = F->Lp[j] + 1; p < F->Lp[j + 1]; p++) {
+        x[F->Li[p]] -= F->Lx[p] * xr - F->Lz[p] * xz;
+        z[F->Li[p]] -= F->Lx[p] * xz + F->Lz[p] * xr;
+      }
+    else
+      for (p = F->Lp[j] + 1; p < F->Lp[j + 1]; p++)
+        x[F->Li[p]] -= F->Lx[p] * xr;
+  }
+  /* U is upper triangular, the diagonal is the last element */
+  for (j = n - 1; j >= 0; j--) {
+    p = F->Up[j + 1] - 1;
+    if (cplx) {
+      ur = F->Ux[p];
+      uz = F->Uz[p];
+      d  = ur * ur + uz * uz;
+      xr = (x[j] * ur + z[j] * uz) / d;
+      xz = (z[j] * ur - x[j] * uz) / d;
+      x[j] = xr;
+      z[j] = xz;
+      for (p = F->Up[j]; p < F->Up[j + 1] - 1; p++) {
+        x[F->Ui[p]] -= F->Ux[p] * xr - F->Uz[p] * xz;
+        z[F->Ui[p]] -= F->Ux[p] * xz + F->Uz[p] * xr;
+      }
+    } else {
+      xr = x[j] / F->Ux[p];
+      x[j] = xr;
+      for (p = F->Up[j]; p < F->Up[j + 1] - 1; p++)
+        x[F->Ui[p]] -= F->Ux[p] * xr;
+    }
+  }
+  for (j = 0; j < n; j++) {
+    br[lu->q[j]] = x[j];
+    if (cplx) bi[lu->q[j]] = z[j];
+  }
+}
+
+/*==========================================================================*/
+/* routines called from radau5a.f                                          */
+/*==========================================================================*/
+
+/* decomposition of E1 = fac1 * M - J                                       */
+void F77_SUB(decspr)(int *n, double *fmas, int *ldmas, int *mlmas, int *mumas,
+                     double *fac1, int *ijob, int *ier) {
+  deSolve_context *ctx = desolve_ctx;
+  splu_data *lu = ctx->splu;
+  double *jx = ctx->cpr->jx;
+  int p;
+
+  if (lu->Ep == NULL)
+    luSymbolic(ctx, fmas, *ldmas, *mlmas, *mumas, *ijob == 9);
+
+  for (p = 0; p < lu->nz; p++)  lu->Ex[p] = *fac1 * lu->Bx[p];
+  for (p = 0; p < lu->nzj; p++) lu->Ex[lu->jmap[p]] -= jx[p];
+  *ier = luDecomp(lu, &lu->re, lu->Ex, NULL);
+}
+
+/* decomposition of E2 = (alphn + i betan) * M - J                          */
+void F77_SUB(decspc)(int *n, double *fmas, int *ldmas, int *mlmas, int *mumas,
+                     double *alphn, double *betan, int *ijob, int *ier) {
+  deSolve_context *ctx = desolve_ctx;
+  splu_data *lu = ctx->splu;
+  double *jx = ctx->cpr->jx;
+  int p;
+
+  if (lu->Ep == NULL)
+    luSymbolic(ctx, fmas, *ldmas, *mlmas, *mumas, *ijob == 9);
+
+  for (p = 0; p < lu->nz; p++) {
+    lu->Ex[p] = *alphn * lu->Bx[p];
+    lu->Ez[p] = *betan * lu->Bx[p];
+  }
+  for (p = 0; p < lu->nzj; p++) lu->Ex[lu->jmap[p]] -= jx[p];
+  *ier = luDecomp(lu, &lu->cx, lu->Ex, lu->Ez);
+}
+
+void F77_SUB(solspr)(int *n, double *b) {
+  splu_data *lu = desolve_ctx->splu;
+  luSolve(lu, &lu->re, b, NULL);
+}
+
+void F77_SUB(solspc)(int *n, double *br, double *bi) {
+  splu_data *lu = desolve_ctx->splu;
+  luSolve(lu, &lu->cx, br, bi);
+}
+
+/* z = z + fac * M x                                                        */
+void F77_SUB(mulspm)(int *n, double *x, double *fac, double *z) {
+  splu_data *lu = desolve_ctx->splu;
+  int j, p;
+
+  for (j = 0; j < *n; j++)
+    for (p = lu->Ep[j]; p < lu->Ep[j + 1]; p++)
+      z[lu->Ei[p]] += *fac * lu->Bx[p] * x[j];
+}